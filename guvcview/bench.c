@@ -0,0 +1,1138 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  guvcview-bench - frame pipeline benchmark                                    #
+#                                                                               #
+#  feeds synthetic or recorded raw frames through the decoder, render fx,       #
+#  video encoder and muxer (no device needed) and reports per stage            #
+#  ns/frame, MB/s and heap allocations (text, csv or json)                      #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <libavcodec/avcodec.h>
+
+#include "gviewv4l2core.h"
+#include "gviewrender.h"
+#include "gviewencoder.h"
+#include "gview.h"
+#include "../config.h"
+
+int debug_level = 0;
+
+#define BENCH_REPORT_TEXT (0)
+#define BENCH_REPORT_CSV  (1)
+#define BENCH_REPORT_JSON (2)
+
+#define BENCH_STAGE_DECODE (0)
+#define BENCH_STAGE_FX     (1)
+#define BENCH_STAGE_ENCODE (2)
+#define BENCH_STAGE_MUX    (3)
+#define BENCH_STAGE_TOTAL  (4)
+#define BENCH_NUM_STAGES   (5)
+
+/*number of distinct synthetic frames (cycled through)*/
+#define BENCH_SYNTH_POOL   (8)
+
+static const char *stage_name[BENCH_NUM_STAGES] =
+{
+	"decode",
+	"fx",
+	"encode",
+	"mux",
+	"total"
+};
+
+typedef struct _bench_stage_t
+{
+	int run;              /*stage is enabled*/
+	uint64_t frames;      /*timed frames*/
+	uint64_t total_ns;    /*accumulated time*/
+	uint64_t min_ns;      /*fastest frame*/
+	uint64_t max_ns;      /*slowest frame*/
+	uint64_t bytes;       /*stage input bytes*/
+	uint64_t allocs;      /*heap allocations*/
+	uint64_t alloc_bytes; /*heap allocated bytes*/
+} bench_stage_t;
+
+typedef struct _bench_frame_t
+{
+	uint8_t *data;
+	size_t size;
+} bench_frame_t;
+
+typedef struct _bench_options_t
+{
+	char fourcc[5];
+	uint32_t pixelformat;
+	int width;
+	int height;
+	int frames;
+	int warmup;
+	int fps;
+	uint32_t fx_mask;
+	char *codec;
+	int muxer;
+	char *input;
+	char *output;
+	int report;
+} bench_options_t;
+
+static bench_stage_t stages[BENCH_NUM_STAGES];
+
+/*
+ * heap allocation counters
+ *   malloc and friends are interposed on glibc (covers all the
+ *   libraries loaded by the benchmark, libav included)
+ */
+static uint64_t alloc_count = 0;
+static uint64_t alloc_size = 0;
+
+#if defined(__GLIBC__)
+#define BENCH_COUNT_ALLOCS (1)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+static inline void count_alloc(size_t size)
+{
+	__atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&alloc_size, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+	count_alloc(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	count_alloc(nmemb * size);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	count_alloc(size);
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	count_alloc(size);
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	count_alloc(size);
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	if(alignment < sizeof(void *) || (alignment & (alignment - 1)))
+		return EINVAL;
+
+	count_alloc(size);
+	void *ptr = __libc_memalign(alignment, size);
+	if(ptr == NULL)
+		return ENOMEM;
+
+	*memptr = ptr;
+	return 0;
+}
+#else
+#define BENCH_COUNT_ALLOCS (0)
+#endif
+
+/*
+ * print benchmark usage
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void bench_usage()
+{
+	printf("Usage: guvcview-bench [OPTIONS]\n\n");
+	printf("  -f, --format=FOURCC       raw input format: YUYV, YU12, NV12, MJPG, H264,\n");
+	printf("                            BA81, GBRG, GRBG, RGGB (default YUYV)\n");
+	printf("  -x, --resolution=WxH      frame size (default 640x480)\n");
+	printf("  -n, --frames=N            timed frames (default 300)\n");
+	printf("  -w, --warmup=N            untimed warmup frames (default 10)\n");
+	printf("  -F, --fps=FPS             timestamp rate (default 30)\n");
+	printf("  -i, --input=FILE          recorded raw frames (concatenated frames for\n");
+	printf("                            fixed size formats, jpeg stream for MJPG,\n");
+	printf("                            annex-b elementary stream for H264)\n");
+	printf("  -p, --fx=MASK             render fx mask (default 0 - no fx stage)\n");
+	printf("  -e, --encoder=CODEC       video codec 4cc, \"raw\" or \"none\" (default MJPG)\n");
+	printf("  -m, --muxer=MUXER         mkv, webm or avi (default mkv)\n");
+	printf("  -o, --output=FILE         muxer output (default: temp file, removed)\n");
+	printf("  -r, --report=FORMAT       text, csv or json (default text)\n");
+	printf("  -v, --verbosity=LEVEL     library verbosity level\n");
+	printf("  -h, --help                print this help\n");
+}
+
+/*
+ * get raw frame size for fixed size formats
+ * args:
+ *    pixelformat - v4l2 pixel format
+ *    width - frame width
+ *    height - frame height
+ *
+ * asserts:
+ *    none
+ *
+ * returns: frame size in bytes (0 for variable size formats)
+ */
+static size_t bench_raw_frame_size(uint32_t pixelformat, int width, int height)
+{
+	switch(pixelformat)
+	{
+		case V4L2_PIX_FMT_YUYV:
+			return width * height * 2;
+		case V4L2_PIX_FMT_YUV420:
+		case V4L2_PIX_FMT_NV12:
+			return (width * height * 3) / 2;
+		case V4L2_PIX_FMT_SBGGR8:
+		case V4L2_PIX_FMT_SGBRG8:
+		case V4L2_PIX_FMT_SGRBG8:
+		case V4L2_PIX_FMT_SRGGB8:
+			return width * height;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * get the bayer pattern of a raw bayer format
+ * args:
+ *    pixelformat - v4l2 pixel format
+ *
+ * asserts:
+ *    none
+ *
+ * returns: 2x2 pattern string (NULL if not bayer)
+ */
+static const char *bench_bayer_pattern(uint32_t pixelformat)
+{
+	switch(pixelformat)
+	{
+		case V4L2_PIX_FMT_SBGGR8:
+			return "BGGR";
+		case V4L2_PIX_FMT_SGBRG8:
+			return "GBRG";
+		case V4L2_PIX_FMT_SGRBG8:
+			return "GRBG";
+		case V4L2_PIX_FMT_SRGGB8:
+			return "RGGB";
+		default:
+			return NULL;
+	}
+}
+
+/*
+ * fill a deterministic yu12 test pattern (moving gradients and box)
+ * args:
+ *    yuv - pointer to yu12 frame buffer
+ *    width - frame width
+ *    height - frame height
+ *    index - frame index
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void bench_synth_yu12(uint8_t *yuv, int width, int height, int index)
+{
+	uint8_t *py = yuv;
+	uint8_t *pu = yuv + (width * height);
+	uint8_t *pv = pu + ((width * height) / 4);
+
+	int bx = (index * 16) % (width > 64 ? width - 64 : 1);
+	int by = (index * 8) % (height > 64 ? height - 64 : 1);
+
+	int h = 0, w = 0;
+	for(h = 0; h < height; h++)
+	{
+		for(w = 0; w < width; w++)
+		{
+			uint8_t y = (uint8_t) (((w * 255) / width + (h * 64) / height + index * 4) & 0xFF);
+			/*some high frequency detail for the encoders*/
+			if(((w >> 3) + (h >> 3)) & 1)
+				y ^= 0x10;
+			if(w >= bx && w < bx + 64 && h >= by && h < by + 64)
+				y = 235;
+			*py++ = y;
+		}
+	}
+
+	for(h = 0; h < height / 2; h++)
+	{
+		for(w = 0; w < width / 2; w++)
+		{
+			*pu++ = (uint8_t) (64 + ((w * 128) / (width / 2)));
+			*pv++ = (uint8_t) (64 + ((h * 128) / (height / 2) + index) % 128);
+		}
+	}
+}
+
+/*
+ * convert a yu12 frame to the raw input format
+ * args:
+ *    raw - pointer to bench frame (data is allocated)
+ *    yuv - pointer to yu12 frame
+ *    opts - pointer to benchmark options
+ *
+ * asserts:
+ *    none
+ *
+ * returns: error code (0 - E_OK)
+ */
+static int bench_synth_raw(bench_frame_t *raw, uint8_t *yuv, bench_options_t *opts)
+{
+	int width = opts->width;
+	int height = opts->height;
+
+	uint8_t *py = yuv;
+	uint8_t *pu = yuv + (width * height);
+	uint8_t *pv = pu + ((width * height) / 4);
+
+	int h = 0, w = 0;
+
+	if(opts->pixelformat == V4L2_PIX_FMT_MJPEG ||
+		opts->pixelformat == V4L2_PIX_FMT_JPEG)
+	{
+		/*use the snapshot jpeg encoder and read it back*/
+		char filename[] = "/tmp/guvcview-bench-XXXXXX";
+		int fd = mkstemp(filename);
+		if(fd < 0)
+		{
+			fprintf(stderr, "GUVCVIEW-BENCH: couldn't create temp file: %s\n", strerror(errno));
+			return E_FILE_IO_ERR;
+		}
+		close(fd);
+
+		v4l2_frame_buff_t frame;
+		memset(&frame, 0, sizeof(v4l2_frame_buff_t));
+		frame.width = width;
+		frame.height = height;
+		frame.yuv_frame = yuv;
+
+		int ret = v4l2core_save_image(&frame, filename, IMG_FMT_JPG);
+
+		FILE *fp = fopen(filename, "rb");
+		if(ret == E_OK && fp != NULL)
+		{
+			struct stat st;
+			fstat(fileno(fp), &st);
+			raw->size = st.st_size;
+			raw->data = malloc(raw->size);
+			if(raw->data == NULL ||
+				fread(raw->data, 1, raw->size, fp) != raw->size)
+				ret = E_FILE_IO_ERR;
+		}
+		else
+			ret = E_FILE_IO_ERR;
+
+		if(fp)
+			fclose(fp);
+		unlink(filename);
+
+		return ret;
+	}
+
+	raw->size = bench_raw_frame_size(opts->pixelformat, width, height);
+	if(raw->size == 0)
+	{
+		fprintf(stderr, "GUVCVIEW-BENCH: no synthetic input for %s (use --input)\n",
+			opts->fourcc);
+		return E_FORMAT_ERR;
+	}
+
+	raw->data = malloc(raw->size);
+	if(raw->data == NULL)
+	{
+		fprintf(stderr, "GUVCVIEW-BENCH: FATAL memory allocation failure (bench_synth_raw): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	uint8_t *out = raw->data;
+	const char *pattern = bench_bayer_pattern(opts->pixelformat);
+
+	switch(opts->pixelformat)
+	{
+		case V4L2_PIX_FMT_YUYV:
+			for(h = 0; h < height; h++)
+			{
+				uint8_t *pul = pu + ((h / 2) * (width / 2));
+				uint8_t *pvl = pv + ((h / 2) * (width / 2));
+				for(w = 0; w < width; w += 2)
+				{
+					*out++ = *py++;
+					*out++ = *pul++;
+					*out++ = *py++;
+					*out++ = *pvl++;
+				}
+			}
+			break;
+
+		case V4L2_PIX_FMT_YUV420:
+			memcpy(out, yuv, raw->size);
+			break;
+
+		case V4L2_PIX_FMT_NV12:
+			memcpy(out, py, width * height);
+			out += width * height;
+			for(w = 0; w < (width * height) / 4; w++)
+			{
+				*out++ = *pu++;
+				*out++ = *pv++;
+			}
+			break;
+
+		default:
+			if(pattern)
+			{
+				uint8_t *rgb = malloc(width * height * 3);
+				if(rgb == NULL)
+				{
+					fprintf(stderr, "GUVCVIEW-BENCH: FATAL memory allocation failure (bench_synth_raw): %s\n", strerror(errno));
+					exit(-1);
+				}
+				v4l2core_yu12_to_rgb(rgb, width * 3, yuv, width, height, RGB_FMT_RGB24);
+
+				for(h = 0; h < height; h++)
+				{
+					for(w = 0; w < width; w++)
+					{
+						char c = pattern[((h & 1) << 1) + (w & 1)];
+						int ch = (c == 'R') ? 0 : ((c == 'G') ? 1 : 2);
+						*out++ = rgb[(h * width + w) * 3 + ch];
+					}
+				}
+				free(rgb);
+			}
+			break;
+	}
+
+	return E_OK;
+}
+
+/*
+ * check for an annex-b start code
+ * args:
+ *    p - pointer to data
+ *    end - pointer to data end
+ *
+ * asserts:
+ *    none
+ *
+ * returns: start code length (3 or 4) or 0 if none
+ */
+static int bench_start_code(uint8_t *p, uint8_t *end)
+{
+	if(end - p >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1)
+		return 4;
+	if(end - p >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1)
+		return 3;
+	return 0;
+}
+
+/*
+ * split a recorded file in raw frames
+ * args:
+ *    opts - pointer to benchmark options
+ *    data - file data
+ *    size - file size
+ *    pool - pointer to frame pool (allocated)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: number of frames in pool
+ */
+static int bench_split_input(bench_options_t *opts, uint8_t *data, size_t size, bench_frame_t **pool)
+{
+	int count = 0;
+	int max = 64;
+	bench_frame_t *frames = calloc(max, sizeof(bench_frame_t));
+	if(frames == NULL)
+	{
+		fprintf(stderr, "GUVCVIEW-BENCH: FATAL memory allocation failure (bench_split_input): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	uint8_t *end = data + size;
+	size_t frame_size = bench_raw_frame_size(opts->pixelformat, opts->width, opts->height);
+
+	uint8_t *start = NULL;
+	uint8_t *p = data;
+
+	while(p < end)
+	{
+		uint8_t *next = NULL;
+
+		if(frame_size > 0)
+		{
+			/*fixed size frames*/
+			if((size_t) (end - p) < frame_size)
+				break;
+			start = p;
+			next = p + frame_size;
+		}
+		else if(opts->pixelformat == V4L2_PIX_FMT_H264)
+		{
+			/*access unit boundaries: aud/sps/pps/sei or a new first slice*/
+			int has_slice = 0;
+			start = p;
+			while(p < end)
+			{
+				int sc = bench_start_code(p, end);
+				if(!sc)
+				{
+					p++;
+					continue;
+				}
+				if(p + sc >= end)
+				{
+					p = end;
+					break;
+				}
+				int type = p[sc] & 0x1F;
+				int first_mb = (p + sc + 1 < end) && (p[sc + 1] & 0x80);
+				if(has_slice &&
+					((type >= 6 && type <= 9) ||
+					 ((type == 1 || type == 5) && first_mb)))
+					break;
+				if(type == 1 || type == 5)
+					has_slice = 1;
+				p += sc;
+			}
+			next = p;
+		}
+		else
+		{
+			/*jpeg stream: frames start at SOI*/
+			while(p + 2 < end && !(p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF))
+				p++;
+			if(p + 2 >= end)
+				break;
+			start = p;
+			p += 3;
+			while(p + 2 < end && !(p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF))
+				p++;
+			next = (p + 2 < end) ? p : end;
+		}
+
+		if(next <= start)
+			break;
+
+		if(count >= max)
+		{
+			max *= 2;
+			frames = realloc(frames, max * sizeof(bench_frame_t));
+			if(frames == NULL)
+			{
+				fprintf(stderr, "GUVCVIEW-BENCH: FATAL memory allocation failure (bench_split_input): %s\n", strerror(errno));
+				exit(-1);
+			}
+		}
+
+		frames[count].size = next - start;
+		frames[count].data = malloc(frames[count].size);
+		if(frames[count].data == NULL)
+		{
+			fprintf(stderr, "GUVCVIEW-BENCH: FATAL memory allocation failure (bench_split_input): %s\n", strerror(errno));
+			exit(-1);
+		}
+		memcpy(frames[count].data, start, frames[count].size);
+		count++;
+
+		p = next;
+	}
+
+	*pool = frames;
+	return count;
+}
+
+/*
+ * load the raw frame pool (recorded or synthetic)
+ * args:
+ *    opts - pointer to benchmark options
+ *    pool - pointer to frame pool (allocated)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: number of frames in pool (<= 0 on error)
+ */
+static int bench_load_frames(bench_options_t *opts, bench_frame_t **pool)
+{
+	if(opts->input)
+	{
+		FILE *fp = fopen(opts->input, "rb");
+		if(fp == NULL)
+		{
+			fprintf(stderr, "GUVCVIEW-BENCH: couldn't open %s: %s\n", opts->input, strerror(errno));
+			return -1;
+		}
+
+		struct stat st;
+		fstat(fileno(fp), &st);
+		uint8_t *data = malloc(st.st_size > 0 ? st.st_size : 1);
+		if(data == NULL)
+		{
+			fprintf(stderr, "GUVCVIEW-BENCH: FATAL memory allocation failure (bench_load_frames): %s\n", strerror(errno));
+			exit(-1);
+		}
+		size_t size = fread(data, 1, st.st_size, fp);
+		fclose(fp);
+
+		int count = bench_split_input(opts, data, size, pool);
+		free(data);
+
+		if(count <= 0)
+			fprintf(stderr, "GUVCVIEW-BENCH: no %s frames found in %s\n", opts->fourcc, opts->input);
+		return count;
+	}
+
+	if(opts->pixelformat == V4L2_PIX_FMT_H264)
+	{
+		fprintf(stderr, "GUVCVIEW-BENCH: H264 needs a recorded stream (--input)\n");
+		return -1;
+	}
+
+	bench_frame_t *frames = calloc(BENCH_SYNTH_POOL, sizeof(bench_frame_t));
+	uint8_t *yuv = malloc((opts->width * opts->height * 3) / 2);
+	if(frames == NULL || yuv == NULL)
+	{
+		fprintf(stderr, "GUVCVIEW-BENCH: FATAL memory allocation failure (bench_load_frames): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	int i = 0;
+	for(i = 0; i < BENCH_SYNTH_POOL; i++)
+	{
+		bench_synth_yu12(yuv, opts->width, opts->height, i);
+		if(bench_synth_raw(&frames[i], yuv, opts) != E_OK)
+			break;
+	}
+	free(yuv);
+
+	*pool = frames;
+	return i;
+}
+
+/*
+ * account a stage run
+ * args:
+ *    stage - pointer to stage stats
+ *    ns - elapsed time
+ *    bytes - stage input bytes
+ *    allocs - allocations done by the stage
+ *    alloc_bytes - bytes allocated by the stage
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void bench_account(bench_stage_t *stage, uint64_t ns, uint64_t bytes,
+	uint64_t allocs, uint64_t alloc_bytes)
+{
+	if(stage->frames == 0 || ns < stage->min_ns)
+		stage->min_ns = ns;
+	if(ns > stage->max_ns)
+		stage->max_ns = ns;
+	stage->frames++;
+	stage->total_ns += ns;
+	stage->bytes += bytes;
+	stage->allocs += allocs;
+	stage->alloc_bytes += alloc_bytes;
+}
+
+/*
+ * print the benchmark report
+ * args:
+ *    opts - pointer to benchmark options
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void bench_report(bench_options_t *opts)
+{
+	const char *muxer_name[] = {"mkv", "webm", "avi"};
+	int i = 0;
+
+	switch(opts->report)
+	{
+		case BENCH_REPORT_CSV:
+			printf("version,format,width,height,fx,codec,muxer,stage,frames,"
+				"ns_per_frame,min_ns,max_ns,mb_per_s,allocs_per_frame,alloc_bytes_per_frame\n");
+			break;
+		case BENCH_REPORT_JSON:
+			printf("{\n  \"version\": \"%s\",\n  \"format\": \"%s\",\n"
+				"  \"width\": %i,\n  \"height\": %i,\n  \"fx\": %u,\n"
+				"  \"codec\": \"%s\",\n  \"muxer\": \"%s\",\n"
+				"  \"count_allocs\": %s,\n  \"stages\": [",
+				VERSION, opts->fourcc, opts->width, opts->height, opts->fx_mask,
+				opts->codec, muxer_name[opts->muxer],
+				BENCH_COUNT_ALLOCS ? "true" : "false");
+			break;
+		default:
+			printf("guvcview-bench %s: %s %ix%i fx=0x%x codec=%s muxer=%s\n",
+				VERSION, opts->fourcc, opts->width, opts->height, opts->fx_mask,
+				opts->codec, muxer_name[opts->muxer]);
+			printf("%-8s %8s %12s %12s %12s %10s %12s %14s\n",
+				"stage", "frames", "ns/frame", "min ns", "max ns", "MB/s",
+				"allocs/frame", "alloc B/frame");
+			break;
+	}
+
+	int first = 1;
+	for(i = 0; i < BENCH_NUM_STAGES; i++)
+	{
+		bench_stage_t *stage = &stages[i];
+		if(!stage->run || stage->frames == 0)
+			continue;
+
+		double ns_frame = (double) stage->total_ns / stage->frames;
+		double mbs = stage->total_ns > 0 ?
+			((double) stage->bytes / (1024.0 * 1024.0)) / ((double) stage->total_ns / NSEC_PER_SEC) : 0;
+		double allocs_frame = (double) stage->allocs / stage->frames;
+		double alloc_bytes_frame = (double) stage->alloc_bytes / stage->frames;
+
+		switch(opts->report)
+		{
+			case BENCH_REPORT_CSV:
+				printf("%s,%s,%i,%i,%u,%s,%s,%s,%" PRIu64 ",%.0f,%" PRIu64 ",%" PRIu64 ",%.2f,%.2f,%.0f\n",
+					VERSION, opts->fourcc, opts->width, opts->height, opts->fx_mask,
+					opts->codec, muxer_name[opts->muxer], stage_name[i],
+					stage->frames, ns_frame, stage->min_ns, stage->max_ns,
+					mbs, allocs_frame, alloc_bytes_frame);
+				break;
+			case BENCH_REPORT_JSON:
+				printf("%s\n    {\"stage\": \"%s\", \"frames\": %" PRIu64 ", \"ns_per_frame\": %.0f, "
+					"\"min_ns\": %" PRIu64 ", \"max_ns\": %" PRIu64 ", \"mb_per_s\": %.2f, "
+					"\"allocs_per_frame\": %.2f, \"alloc_bytes_per_frame\": %.0f}",
+					first ? "" : ",", stage_name[i], stage->frames, ns_frame,
+					stage->min_ns, stage->max_ns, mbs, allocs_frame, alloc_bytes_frame);
+				break;
+			default:
+				printf("%-8s %8" PRIu64 " %12.0f %12" PRIu64 " %12" PRIu64 " %10.2f %12.2f %14.0f\n",
+					stage_name[i], stage->frames, ns_frame, stage->min_ns,
+					stage->max_ns, mbs, allocs_frame, alloc_bytes_frame);
+				break;
+		}
+		first = 0;
+	}
+
+	if(opts->report == BENCH_REPORT_JSON)
+		printf("\n  ]\n}\n");
+}
+
+/*
+ * parse command line options
+ * args:
+ *    argc - number of arguments
+ *    argv - argument list
+ *    opts - pointer to benchmark options
+ *
+ * asserts:
+ *    none
+ *
+ * returns: 0 to run, 1 to exit (help), -1 on error
+ */
+static int bench_parse_options(int argc, char *argv[], bench_options_t *opts)
+{
+	static struct option long_options[] =
+	{
+		{"format",     required_argument, 0, 'f'},
+		{"resolution", required_argument, 0, 'x'},
+		{"frames",     required_argument, 0, 'n'},
+		{"warmup",     required_argument, 0, 'w'},
+		{"fps",        required_argument, 0, 'F'},
+		{"input",      required_argument, 0, 'i'},
+		{"fx",         required_argument, 0, 'p'},
+		{"encoder",    required_argument, 0, 'e'},
+		{"muxer",      required_argument, 0, 'm'},
+		{"output",     required_argument, 0, 'o'},
+		{"report",     required_argument, 0, 'r'},
+		{"verbosity",  required_argument, 0, 'v'},
+		{"help",       no_argument,       0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	int c = 0;
+	while((c = getopt_long(argc, argv, "f:x:n:w:F:i:p:e:m:o:r:v:h", long_options, NULL)) != -1)
+	{
+		switch(c)
+		{
+			case 'f':
+				strncpy(opts->fourcc, optarg, 4);
+				opts->fourcc[4] = '\0';
+				break;
+			case 'x':
+				if(sscanf(optarg, "%ix%i", &opts->width, &opts->height) != 2)
+				{
+					fprintf(stderr, "GUVCVIEW-BENCH: bad resolution %s\n", optarg);
+					return -1;
+				}
+				break;
+			case 'n':
+				opts->frames = atoi(optarg);
+				break;
+			case 'w':
+				opts->warmup = atoi(optarg);
+				break;
+			case 'F':
+				opts->fps = atoi(optarg);
+				break;
+			case 'i':
+				opts->input = optarg;
+				break;
+			case 'p':
+				opts->fx_mask = (uint32_t) strtoul(optarg, NULL, 0);
+				break;
+			case 'e':
+				opts->codec = optarg;
+				break;
+			case 'm':
+				if(strcasecmp(optarg, "webm") == 0)
+					opts->muxer = ENCODER_MUX_WEBM;
+				else if(strcasecmp(optarg, "avi") == 0)
+					opts->muxer = ENCODER_MUX_AVI;
+				else
+					opts->muxer = ENCODER_MUX_MKV;
+				break;
+			case 'o':
+				opts->output = optarg;
+				break;
+			case 'r':
+				if(strcasecmp(optarg, "csv") == 0)
+					opts->report = BENCH_REPORT_CSV;
+				else if(strcasecmp(optarg, "json") == 0)
+					opts->report = BENCH_REPORT_JSON;
+				else
+					opts->report = BENCH_REPORT_TEXT;
+				break;
+			case 'v':
+				debug_level = atoi(optarg);
+				break;
+			case 'h':
+				bench_usage();
+				return 1;
+			default:
+				bench_usage();
+				return -1;
+		}
+	}
+
+	if(opts->width <= 0 || opts->height <= 0 ||
+		(opts->width & 1) || (opts->height & 1))
+	{
+		fprintf(stderr, "GUVCVIEW-BENCH: frame size must be even and positive (%ix%i)\n",
+			opts->width, opts->height);
+		return -1;
+	}
+
+	if(opts->frames <= 0)
+		opts->frames = 1;
+	if(opts->warmup < 0)
+		opts->warmup = 0;
+	if(opts->fps <= 0)
+		opts->fps = 30;
+
+	opts->pixelformat = v4l2core_fourcc_2_v4l2_pixelformat(opts->fourcc);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	bench_options_t opts;
+	memset(&opts, 0, sizeof(bench_options_t));
+
+	strncpy(opts.fourcc, "YUYV", 5);
+	opts.width = 640;
+	opts.height = 480;
+	opts.frames = 300;
+	opts.warmup = 10;
+	opts.fps = 30;
+	opts.codec = "MJPG";
+	opts.muxer = ENCODER_MUX_MKV;
+	opts.report = BENCH_REPORT_TEXT;
+
+	int ret = bench_parse_options(argc, argv, &opts);
+	if(ret)
+		return (ret > 0) ? 0 : -1;
+
+	v4l2core_set_verbosity(debug_level);
+	render_set_verbosity(debug_level);
+	encoder_set_verbosity(debug_level);
+
+	/*raw input pool*/
+	bench_frame_t *pool = NULL;
+	int pool_size = bench_load_frames(&opts, &pool);
+	if(pool_size <= 0)
+		return -1;
+
+	v4l2_dev_t *vd = v4l2core_init_offline_dev(opts.pixelformat, opts.width, opts.height);
+	if(vd == NULL)
+		return -1;
+
+	int yu12_size = (opts.width * opts.height * 3) / 2;
+	uint64_t frame_ns = (NSEC_PER_SEC) / opts.fps;
+
+	/*fx stage (render api without output)*/
+	stages[BENCH_STAGE_DECODE].run = 1;
+	stages[BENCH_STAGE_TOTAL].run = 1;
+	if(opts.fx_mask != REND_FX_YUV_NOFILT)
+	{
+		render_init(RENDER_NONE, opts.width, opts.height, 0, 0, 0);
+		stages[BENCH_STAGE_FX].run = 1;
+	}
+
+	/*encoder and muxer stages*/
+	encoder_context_t *encoder_ctx = NULL;
+	char output[] = "/tmp/guvcview-bench-XXXXXX";
+	char *output_file = opts.output;
+
+	if(strcasecmp(opts.codec, "none") != 0)
+	{
+		int codec_ind = encoder_get_video_codec_ind_4cc(opts.codec);
+		if(codec_ind < 0)
+		{
+			fprintf(stderr, "GUVCVIEW-BENCH: unknown video codec %s\n", opts.codec);
+			v4l2core_close_dev(vd);
+			return -1;
+		}
+
+		encoder_ctx = encoder_init(
+			opts.pixelformat,
+			codec_ind,
+			-1, /*no audio*/
+			opts.muxer,
+			opts.width,
+			opts.height,
+			1,
+			opts.fps,
+			0,
+			0);
+
+		if(encoder_ctx == NULL || encoder_ctx->enc_video_ctx == NULL)
+		{
+			fprintf(stderr, "GUVCVIEW-BENCH: couldn't init %s encoder\n", opts.codec);
+			v4l2core_close_dev(vd);
+			return -1;
+		}
+
+		/*raw h264 muxing needs the stream SPS and PPS*/
+		if(codec_ind == 0 && opts.pixelformat == V4L2_PIX_FMT_H264)
+		{
+			v4l2core_decode_raw_frame(vd, pool[0].data, pool[0].size, 0);
+			encoder_ctx->h264_sps_size = v4l2core_get_h264_sps_size(vd);
+			encoder_ctx->h264_sps = encoder_ctx->h264_sps_size > 0 ?
+				malloc(encoder_ctx->h264_sps_size) : NULL;
+			if(encoder_ctx->h264_sps)
+				memcpy(encoder_ctx->h264_sps, v4l2core_get_h264_sps(vd), encoder_ctx->h264_sps_size);
+			encoder_ctx->h264_pps_size = v4l2core_get_h264_pps_size(vd);
+			encoder_ctx->h264_pps = encoder_ctx->h264_pps_size > 0 ?
+				malloc(encoder_ctx->h264_pps_size) : NULL;
+			if(encoder_ctx->h264_pps)
+				memcpy(encoder_ctx->h264_pps, v4l2core_get_h264_pps(vd), encoder_ctx->h264_pps_size);
+		}
+
+		if(output_file == NULL)
+		{
+			int fd = mkstemp(output);
+			if(fd < 0)
+			{
+				fprintf(stderr, "GUVCVIEW-BENCH: couldn't create temp file: %s\n", strerror(errno));
+				encoder_close(encoder_ctx);
+				v4l2core_close_dev(vd);
+				return -1;
+			}
+			close(fd);
+			output_file = output;
+		}
+
+		encoder_muxer_init(encoder_ctx, output_file);
+
+		stages[BENCH_STAGE_ENCODE].run = 1;
+		stages[BENCH_STAGE_MUX].run = 1;
+	}
+
+	/*run the pipeline*/
+	int total_frames = opts.warmup + opts.frames;
+	int decode_errors = 0;
+	int i = 0;
+	for(i = 0; i < total_frames; i++)
+	{
+		bench_frame_t *raw = &pool[i % pool_size];
+		uint64_t timestamp = i * frame_ns;
+		int timed = (i >= opts.warmup);
+
+		uint64_t t0 = 0, t1 = 0, a0 = 0, b0 = 0;
+		uint64_t frame_start = v4l2core_time_get_timestamp();
+		uint64_t frame_allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+		uint64_t frame_alloc_bytes = __atomic_load_n(&alloc_size, __ATOMIC_RELAXED);
+
+		/*decode*/
+		a0 = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+		b0 = __atomic_load_n(&alloc_size, __ATOMIC_RELAXED);
+		t0 = v4l2core_time_get_timestamp();
+		v4l2_frame_buff_t *frame = v4l2core_decode_raw_frame(vd, raw->data, raw->size, timestamp);
+		t1 = v4l2core_time_get_timestamp();
+		if(timed)
+			bench_account(&stages[BENCH_STAGE_DECODE], t1 - t0, raw->size,
+				__atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - a0,
+				__atomic_load_n(&alloc_size, __ATOMIC_RELAXED) - b0);
+
+		if(frame == NULL)
+		{
+			decode_errors++;
+			continue;
+		}
+
+		/*fx*/
+		if(stages[BENCH_STAGE_FX].run)
+		{
+			a0 = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+			b0 = __atomic_load_n(&alloc_size, __ATOMIC_RELAXED);
+			t0 = v4l2core_time_get_timestamp();
+			render_frame_fx(frame->yuv_frame, opts.fx_mask);
+			t1 = v4l2core_time_get_timestamp();
+			if(timed)
+				bench_account(&stages[BENCH_STAGE_FX], t1 - t0, yu12_size,
+					__atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - a0,
+					__atomic_load_n(&alloc_size, __ATOMIC_RELAXED) - b0);
+		}
+
+		if(encoder_ctx)
+		{
+			uint8_t *input_frame = frame->yuv_frame;
+			int input_size = yu12_size;
+
+			encoder_ctx->enc_video_ctx->pts = timestamp;
+
+			/*raw (direct input)*/
+			if(encoder_ctx->video_codec_ind == 0)
+			{
+				if(opts.pixelformat == V4L2_PIX_FMT_H264)
+				{
+					input_frame = frame->h264_frame;
+					input_size = (int) frame->h264_frame_size;
+				}
+				else
+				{
+					input_frame = frame->raw_frame;
+					input_size = (int) frame->raw_frame_size;
+				}
+				encoder_ctx->enc_video_ctx->outbuf_coded_size = input_size;
+				if(frame->isKeyframe)
+					encoder_ctx->enc_video_ctx->flags |= AV_PKT_FLAG_KEY;
+			}
+
+			/*encode*/
+			a0 = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+			b0 = __atomic_load_n(&alloc_size, __ATOMIC_RELAXED);
+			t0 = v4l2core_time_get_timestamp();
+			encoder_encode_video(encoder_ctx, input_frame);
+			t1 = v4l2core_time_get_timestamp();
+			if(timed)
+				bench_account(&stages[BENCH_STAGE_ENCODE], t1 - t0, input_size,
+					__atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - a0,
+					__atomic_load_n(&alloc_size, __ATOMIC_RELAXED) - b0);
+
+			/*mux*/
+			int coded_size = encoder_ctx->enc_video_ctx->outbuf_coded_size;
+			a0 = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+			b0 = __atomic_load_n(&alloc_size, __ATOMIC_RELAXED);
+			t0 = v4l2core_time_get_timestamp();
+			encoder_write_video_data(encoder_ctx);
+			t1 = v4l2core_time_get_timestamp();
+			if(timed)
+				bench_account(&stages[BENCH_STAGE_MUX], t1 - t0,
+					coded_size > 0 ? coded_size : 0,
+					__atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - a0,
+					__atomic_load_n(&alloc_size, __ATOMIC_RELAXED) - b0);
+		}
+
+		if(timed)
+			bench_account(&stages[BENCH_STAGE_TOTAL],
+				v4l2core_time_get_timestamp() - frame_start, raw->size,
+				__atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - frame_allocs,
+				__atomic_load_n(&alloc_size, __ATOMIC_RELAXED) - frame_alloc_bytes);
+	}
+
+	/*flush delayed frames (not timed)*/
+	if(encoder_ctx)
+	{
+		encoder_ctx->enc_video_ctx->flush_delayed_frames = 1;
+		while(!encoder_ctx->enc_video_ctx->flush_done)
+		{
+			encoder_encode_video(encoder_ctx, NULL);
+			encoder_write_video_data(encoder_ctx);
+		}
+
+		encoder_muxer_close(encoder_ctx);
+		encoder_close(encoder_ctx);
+
+		if(opts.output == NULL)
+			unlink(output_file);
+	}
+
+	if(stages[BENCH_STAGE_FX].run)
+		render_close();
+
+	v4l2core_close_dev(vd);
+
+	if(decode_errors > 0)
+		fprintf(stderr, "GUVCVIEW-BENCH: %i frames failed to decode\n", decode_errors);
+
+	bench_report(&opts);
+
+	for(i = 0; i < pool_size; i++)
+		free(pool[i].data);
+	free(pool);
+
+	return (decode_errors < total_frames) ? 0 : -1;
+}
@@ -67,8 +67,13 @@ static config_t my_config =
 	.audio_device = -1,/*guvcview will use API default in this case*/
 	.video_fx = 0, /*no video fx*/
 	.audio_fx = 0, /*no audio fx*/
+	.audio_dither = 0, /*no dither*/
+	.audio_drift_comp = 1, /*compensate audio clock drift*/
 	.osd_mask = 0, /*REND_OSD_NONE*/
 	.crosshair_color=0x0000FF00, /*osd crosshair rgb color (0x00RRGGBB)*/
+	.preview_fps = 0, /*render every frame*/
+	.preview_width = 0, /*frame width*/
+	.preview_height = 0, /*frame height*/
 };
 
 /*
@@ -157,9 +162,19 @@ int config_save(const char *filename)
 	fprintf(fp, "video_fx=0x%x\n", my_config.video_fx);
 	fprintf(fp, "#audio fx mask \n");
 	fprintf(fp, "audio_fx=0x%x\n", my_config.audio_fx);
+	fprintf(fp, "#tpdf dither on int16 audio (0 - off)\n");
+	fprintf(fp, "audio_dither=%i\n", my_config.audio_dither);
+	fprintf(fp, "#audio clock drift compensation (0 - off)\n");
+	fprintf(fp, "audio_drift_comp=%i\n", my_config.audio_drift_comp);
 	fprintf(fp, "#OSD mask \n");
 	fprintf(fp, "osd_mask=0x%x\n", my_config.osd_mask);
 	fprintf(fp, "crosshair_color=0x%x\n", my_config.crosshair_color);
+	fprintf(fp, "#max preview frame rate (0 - every frame)\n");
+	fprintf(fp, "preview_fps=%f\n", my_config.preview_fps);
+	fprintf(fp, "#max preview width (0 - frame width)\n");
+	fprintf(fp, "preview_width=%i\n", my_config.preview_width);
+	fprintf(fp, "#max preview height (0 - frame height)\n");
+	fprintf(fp, "preview_height=%i\n", my_config.preview_height);
 
 	/* return to system locale */
     setlocale(LC_NUMERIC, "");
@@ -327,10 +342,20 @@ int config_load(const char *filename)
 			my_config.video_fx = (uint32_t) strtoul(value, NULL, 16);
 		else if(strcmp(token, "audio_fx") == 0)
 			my_config.audio_fx = (uint32_t) strtoul(value, NULL, 16);
+		else if(strcmp(token, "audio_dither") == 0)
+			my_config.audio_dither = (int) strtoul(value, NULL, 10);
+		else if(strcmp(token, "audio_drift_comp") == 0)
+			my_config.audio_drift_comp = (int) strtoul(value, NULL, 10);
 		else if(strcmp(token, "osd_mask") == 0)
 			my_config.osd_mask = (uint32_t) strtoul(value, NULL, 16);
 		else if(strcmp(token, "crosshair_color") == 0)
 			my_config.crosshair_color = (uint32_t) strtoul(value, NULL, 16);
+		else if(strcmp(token, "preview_fps") == 0)
+			my_config.preview_fps = strtod(value, NULL);
+		else if(strcmp(token, "preview_width") == 0)
+			my_config.preview_width = (int) strtoul(value, NULL, 10);
+		else if(strcmp(token, "preview_height") == 0)
+			my_config.preview_height = (int) strtoul(value, NULL, 10);
 		else
 			fprintf(stderr, "GUVCVIEW: (config) skiping invalid entry at line %i ('%s', '%s')\n", line, token, value);
 
@@ -383,6 +408,15 @@ void config_update(options_t *my_options)
 	if(strlen(my_options->render) > 2)
 		strncpy(my_config.render, my_options->render, 4);
 
+	/*preview policy*/
+	if(my_options->preview_fps >= 0)
+		my_config.preview_fps = my_options->preview_fps;
+	if(my_options->preview_width >= 0 && my_options->preview_height >= 0)
+	{
+		my_config.preview_width = my_options->preview_width;
+		my_config.preview_height = my_options->preview_height;
+	}
+
 	/*gui API*/
 	if(strlen(my_options->gui) > 2)
 		strncpy(my_config.gui, my_options->gui, 4);
@@ -48,8 +48,13 @@ typedef struct _config_t
 	int audio_device;/*audio device index*/
 	uint32_t video_fx;
 	uint32_t audio_fx;
+	int audio_dither; /*tpdf dither on int16 audio conversion*/
+	int audio_drift_comp; /*resample audio to the video (monotonic) clock*/
 	uint32_t osd_mask; /*OSD bit mask*/
 	uint32_t crosshair_color; /*osd crosshair rgb color (0x00RRGGBB)*/
+	double preview_fps; /*max preview frame rate (0 - every frame)*/
+	int preview_width; /*max preview width (0 - frame width)*/
+	int preview_height; /*max preview height (0 - frame height)*/
 } config_t;
 
 /*
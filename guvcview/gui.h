@@ -474,6 +474,7 @@ void gui_error(
 
 /*
  * adds a message to the status bar
+ *  (the gui copies the message, so it can be a temporary buffer)
  * args:
  *    message - message string
  *
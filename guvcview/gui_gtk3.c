@@ -68,22 +68,26 @@ static GtkWidget *wgtDevices = NULL;
 static int gtk_devices_timer_id = 0;
 /*timer id for control events check*/
 static int gtk_control_events_timer_id = 0;
+/*timer id for control write queue flush*/
+static int gtk_control_queue_timer_id = 0;
 
 
 /*
  * sets the status message
  * args:
- *   message - message string
+ *   message - message string (owned copy - it's freed)
  * 
  * returns: FALSE
  */
-static gboolean set_status_message(const char *message)
+static gboolean set_status_message(char *message)
 {
 	if(status_bar)
 	{
 		gtk_statusbar_pop (GTK_STATUSBAR(status_bar), status_warning_id);
 		gtk_statusbar_push (GTK_STATUSBAR(status_bar), status_warning_id, message);
 	}
+
+	g_free(message);
 	
 	/*execute only once*/
 	return FALSE;
@@ -101,8 +105,11 @@ static gboolean set_status_message(const char *message)
  */
 void gui_status_message_gtk3(const char *message)
 {
-	/*this maybe called from a different thread, so protect it*/
-	gdk_threads_add_idle ((GSourceFunc)set_status_message, (gpointer) message);
+	/*
+	 * this maybe called from a different thread, so protect it
+	 * (the idle handler runs later: pass it an owned copy of the message)
+	 */
+	gdk_threads_add_idle ((GSourceFunc)set_status_message, (gpointer) g_strdup(message));
 }
 
 /*
@@ -913,7 +920,9 @@ int gui_attach_gtk3(int width, int height)
 	 */
 	gtk_devices_timer_id = g_timeout_add( 1000, check_device_events, NULL);
 	/*controls*/
-	gtk_control_events_timer_id = g_timeout_add(1000, check_control_events, NULL);
+	gtk_control_events_timer_id = g_timeout_add(CTRL_EVENTS_CHECK_INTERVAL, check_control_events, NULL);
+	/*control write queue*/
+	gtk_control_queue_timer_id = g_timeout_add(CTRL_QUEUE_FLUSH_INTERVAL, check_control_queue, NULL);
 
 	return 0;
 }
@@ -965,7 +965,8 @@ void slider_changed (GtkRange * range, void *data)
 
     control->value = val;
 
-    if(v4l2core_set_control_value_by_id(get_v4l2_device_handler(), id))
+    /*slider drags are coalesced and flushed by the control queue timer*/
+    if(v4l2core_queue_control_value_by_id(get_v4l2_device_handler(), id))
 		fprintf(stderr, "GUVCVIEW: error setting slider value\n");
 
    /*
@@ -1001,7 +1002,7 @@ void spin_changed (GtkSpinButton * spin, void *data)
 	int val = gtk_spin_button_get_value_as_int (spin);
     control->value = val;
 
-     if(v4l2core_set_control_value_by_id(get_v4l2_device_handler(), id))
+     if(v4l2core_queue_control_value_by_id(get_v4l2_device_handler(), id))
 		fprintf(stderr, "GUVCVIEW: error setting spin value\n");
 
 	/*
@@ -2525,3 +2526,24 @@ gboolean check_control_events(gpointer data)
 
 	return (TRUE);
 }
+
+/*
+ * control write queue timer callback
+ * args:
+ *   data - pointer to user data
+ *
+ * asserts:
+ *   none
+ *
+ * returns: true if timer is to be reset or false otherwise
+ */
+gboolean check_control_queue(gpointer data)
+{
+	if(v4l2core_flush_control_queue(get_v4l2_device_handler()) > 0)
+	{
+		/*update the control list (only changed controls)*/
+		gui_gtk3_update_controls_state();
+	}
+
+	return (TRUE);
+}
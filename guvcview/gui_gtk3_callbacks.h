@@ -622,4 +622,16 @@ gboolean check_device_events(gpointer data);
  */
 gboolean check_control_events(gpointer data);
 
+/*
+ * control write queue timer callback
+ * args:
+ *   data - pointer to user data
+ *
+ * asserts:
+ *   none
+ *
+ * returns: true if timer is to be reset or false otherwise
+ */
+gboolean check_control_queue(gpointer data);
+
 #endif
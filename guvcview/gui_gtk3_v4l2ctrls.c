@@ -52,6 +52,7 @@ extern int is_control_panel;
  */
 static control_widgets_t *control_widgets_list = NULL; /*control widgets list*/
 static int widget_list_size = 0; /*list size*/
+static uint32_t controls_generation = 0; /*control generation of the last widgets update*/
 
 /*
  * clean gtk3 control widgets list
@@ -621,6 +622,8 @@ int gui_attach_gtk3_v4l2ctrls(GtkWidget *parent)
 	/*add control grid to parent container*/
 	gtk_container_add(GTK_CONTAINER(parent), img_controls_grid);
 
+	/*new widgets: update all controls*/
+	controls_generation = 0;
 	gui_gtk3_update_controls_state();
 
 	return 0;
@@ -648,6 +651,10 @@ void gui_gtk3_update_controls_state()
 			break;
 		}
 
+		/*only update widgets for controls changed since the last update*/
+		if(current->generation <= controls_generation)
+			continue;
+
 		control_widgets_t *cur_widget = gui_gtk3_get_widgets_by_id(current->control.id);
 
 		if(!cur_widget)
@@ -770,4 +777,6 @@ void gui_gtk3_update_controls_state()
                 gtk_widget_set_sensitive (cur_widget->widget2, TRUE);
         }
 	}
+
+	controls_generation = v4l2core_get_control_generation(get_v4l2_device_handler());
 }
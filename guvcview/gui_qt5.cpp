@@ -219,7 +219,12 @@ MainWindow::MainWindow()
 	timer_check_control_events = new QTimer(this);
 	connect(timer_check_control_events, SIGNAL(timeout()), 
 		this, SLOT(check_control_events()));
-	timer_check_control_events->start(1000);
+	timer_check_control_events->start(CTRL_EVENTS_CHECK_INTERVAL);
+
+	timer_flush_control_queue = new QTimer(this);
+	connect(timer_flush_control_queue, SIGNAL(timeout()), 
+		this, SLOT(check_control_queue()));
+	timer_flush_control_queue->start(CTRL_QUEUE_FLUSH_INTERVAL);
 }
 
 MainWindow::~MainWindow()
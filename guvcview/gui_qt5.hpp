@@ -115,6 +115,7 @@ private slots:
     /*timer*/
     void check_device_events();
 	void check_control_events();
+	void check_control_queue();
 
 
 private:
@@ -132,6 +133,7 @@ private:
 
    QTimer *timer_check_device;
    QTimer *timer_check_control_events;
+   QTimer *timer_flush_control_queue;
 
    QWidget *img_controls_grid;
    QWidget *h264_controls_grid;
@@ -748,7 +748,8 @@ void MainWindow::slider_value_changed(int value)
 
     control->value = value;
 
-    if(v4l2core_set_control_value_by_id(get_v4l2_device_handler(), id))
+    /*slider drags are coalesced and flushed by the control queue timer*/
+    if(v4l2core_queue_control_value_by_id(get_v4l2_device_handler(), id))
 		std::cerr << "GUVCVIEW (Qt5): error setting slider value" <<std::endl;
 }
 
@@ -772,7 +773,7 @@ void MainWindow::spin_value_changed (int value)
 
     control->value = value;
 
-     if(v4l2core_set_control_value_by_id(get_v4l2_device_handler(), id))
+     if(v4l2core_queue_control_value_by_id(get_v4l2_device_handler(), id))
 		std::cerr << "GUVCVIEW (Qt5): error setting spin value" <<std::endl;
 
 }
@@ -1840,3 +1841,22 @@ void MainWindow::check_control_events()
 		gui_qt5_update_controls_state();
 	}
 }
+
+/*
+ * control write queue timer callback
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void MainWindow::check_control_queue()
+{
+	if(v4l2core_flush_control_queue(get_v4l2_device_handler()) > 0)
+	{
+		//update the control list (only changed controls)
+		gui_qt5_update_controls_state();
+	}
+}
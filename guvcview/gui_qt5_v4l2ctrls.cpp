@@ -45,6 +45,8 @@ extern "C" {
 extern int debug_level;
 extern int is_control_panel;
 
+static uint32_t controls_generation = 0; /*control generation of the last widgets update*/
+
 /*
  * get Qt control widgets for control id
  * args:
@@ -548,6 +550,8 @@ int MainWindow::gui_attach_qt5_v4l2ctrls(QWidget *parent)
 	QSpacerItem *spacer = new QSpacerItem(40, 20, QSizePolicy::Minimum, QSizePolicy::Expanding);
 	grid_layout->addItem(spacer, n+1, 0);
 	
+	/*new widgets: update all controls*/
+	controls_generation = 0;
 	gui_qt5_update_controls_state();
 	
 	return 0;
@@ -575,6 +579,10 @@ void MainWindow::gui_qt5_update_controls_state()
 			break;
 		}
 
+		/*only update widgets for controls changed since the last update*/
+		if(current->generation <= controls_generation)
+			continue;
+
 		ControlWidgets *thisone =  gui_qt5_get_widgets_by_id(current->control.id);
 
 		if(!thisone)
@@ -696,4 +704,6 @@ void MainWindow::gui_qt5_update_controls_state()
                 thisone->widget2->setDisabled(false);
         }
 	}
+
+	controls_generation = v4l2core_get_control_generation(get_v4l2_device_handler());
 }
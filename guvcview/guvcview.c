@@ -122,6 +122,10 @@ int main(int argc, char *argv[])
 	char *config_path = smart_cat(getenv("HOME"), '/', ".config/guvcview2");
 	mkdir(config_path, 0777);
 
+	/*cache the control descriptors with the config files*/
+	if(my_options->control_cache)
+		v4l2core_set_control_cache_dir(config_path);
+
 	char *device_name = get_file_basename(my_options->device);
 
 	char *config_file = smart_cat(config_path, '/', device_name);
@@ -149,6 +153,8 @@ int main(int argc, char *argv[])
 
 	if(strcasecmp(my_config->render, "none") == 0)
 		render = RENDER_NONE;
+	else if(strcasecmp(my_config->render, "shm") == 0)
+		render = RENDER_SHM;
 	else if(strcasecmp(my_config->render, "sdl") == 0)
 	{
 #if ENABLE_SDL2
@@ -242,6 +248,10 @@ int main(int argc, char *argv[])
 	/*set the v4l2 core verbosity*/
 	v4l2core_set_verbosity(debug_level);
 
+	/*must be set before opening the device (used for control enumeration)*/
+	if(my_options->disable_libv4l2)
+		v4l2core_disable_libv4l2();
+
 	/*set the v4l2core device (redefines language catalog)*/
 	v4l2_dev_t *vd = create_v4l2_device_handler(my_options->device);
 	if(!vd)
@@ -255,17 +265,19 @@ int main(int argc, char *argv[])
 	else		
 		set_render_flag(render);
 	
-	if(my_options->disable_libv4l2)
-		v4l2core_disable_libv4l2(vd);
-
 	/*select capture method*/
 	if(strcasecmp(my_config->capture, "read") == 0)
 		v4l2core_set_capture_method(vd, IO_READ);
 	else
 		v4l2core_set_capture_method(vd, IO_MMAP);
 
-	/*set software autofocus sort method*/
-	v4l2core_soft_autofocus_set_sort(AUTOF_SORT_INSERT);
+	/*set software autofocus sharpness measure and roi*/
+	v4l2core_soft_autofocus_set_metric(my_options->focus_metric);
+	v4l2core_soft_autofocus_set_roi(
+		my_options->focus_roi[0],
+		my_options->focus_roi[1],
+		my_options->focus_roi[2],
+		my_options->focus_roi[3]);
 
 	/*set the intended fps*/
 	v4l2core_define_fps(vd, my_config->fps_num,my_config->fps_denom);
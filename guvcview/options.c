@@ -91,6 +91,13 @@ static opt_values_t opt_values[] =
 		.opt_help_arg = "",
 		.opt_help = N_("disable calls to libv4l2"),
 	},
+	{
+		.opt_short = 'C',
+		.opt_long = "control_cache",
+		.req_arg = 0,
+		.opt_help_arg = "",
+		.opt_help = N_("cache the device control descriptors (faster device open)"),
+	},
 	{
 		.opt_short = 'x',
 		.opt_long = "resolution",
@@ -117,7 +124,14 @@ static opt_values_t opt_values[] =
 		.opt_long = "render",
 		.req_arg = 1,
 		.opt_help_arg = N_("RENDER_API"),
-		.opt_help = N_("Select render API (e.g none; sdl; sfml)")
+		.opt_help = N_("Select render API (e.g none; sdl; sfml; shm)")
+	},
+	{
+		.opt_short = 'G',
+		.opt_long = "shm_group",
+		.req_arg = 0,
+		.opt_help_arg = "",
+		.opt_help = N_("let our group read the shm render preview (default: owner only)"),
 	},
 	{
 		.opt_short = 'm',
@@ -126,6 +140,20 @@ static opt_values_t opt_values[] =
 		.opt_help_arg = N_("RENDER_WINDOW_FLAGS"),
 		.opt_help = N_("Set render window flags (e.g none; full; max; WIDTHxHEIGHT)")
 	},
+	{
+		.opt_short = 'P',
+		.opt_long = "preview_fps",
+		.req_arg = 1,
+		.opt_help_arg = N_("FPS"),
+		.opt_help = N_("Set max preview frame rate (def: 0 - every frame)")
+	},
+	{
+		.opt_short = 'S',
+		.opt_long = "preview_size",
+		.req_arg = 1,
+		.opt_help_arg = N_("WIDTHxHEIGHT"),
+		.opt_help = N_("Set max preview size (def: 0x0 - frame size)")
+	},
 	{
 		.opt_short = 'a',
 		.opt_long = "audio",
@@ -212,6 +240,34 @@ static opt_values_t opt_values[] =
 		.opt_help_arg = N_("TOTAL"),
 		.opt_help = N_("total number of captured photos)")
 	},
+	{
+		.opt_short = 'B',
+		.opt_long = "photo_burst",
+		.req_arg = 1,
+		.opt_help_arg = N_("FRAMES[:STEP]"),
+		.opt_help = N_("capture a burst of FRAMES photos (every STEP frame) per shot")
+	},
+	{
+		.opt_short = 'Z',
+		.opt_long = "png_compression",
+		.req_arg = 1,
+		.opt_help_arg = N_("PRESET[:THREADS]"),
+		.opt_help = N_("png compression preset (fast|default|small) and deflate threads")
+	},
+	{
+		.opt_short = 'R',
+		.opt_long = "raw_dump",
+		.req_arg = 1,
+		.opt_help_arg = N_("FILENAME"),
+		.opt_help = N_("dump every captured frame (lossless, indexed) to FILENAME")
+	},
+	{
+		.opt_short = 'A',
+		.opt_long = "focus_metric",
+		.req_arg = 1,
+		.opt_help_arg = N_("METRIC[:X,Y,W,H]"),
+		.opt_help = N_("software autofocus sharpness measure (dct|laplacian|tenengrad) and roi (in percent of frame)")
+	},
 	{
 		.opt_short = 'e',
 		.opt_long = "exit_on_term",
@@ -243,6 +299,7 @@ static options_t my_options =
 	.height = 0,
 	.control_panel = 0,
 	.disable_libv4l2 = 0,
+	.control_cache = 0,
 	.format = "",
 	.render = "",
 	.gui = "",
@@ -261,10 +318,21 @@ static options_t my_options =
 	.video_timer = 0,
 	.photo_timer = 0,
 	.photo_npics = 0,
+	.photo_burst = 0,
+	.photo_burst_step = 1,
+	.png_preset = PNG_PRESET_DEFAULT,
+	.png_threads = 1,
+	.raw_dump = NULL,
+	.focus_metric = AUTOF_METRIC_LAPLACIAN,
+	.focus_roi = {25, 25, 50, 50}, /*central half*/
 	.exit_on_term = 0,
 	.render_flag = "none",
+	.shm_group = 0,
 	.render_width = 0,
-	.render_height = 0
+	.render_height = 0,
+	.preview_fps = -1, /*use config value*/
+	.preview_width = -1,
+	.preview_height = -1
 };
 
 /*
@@ -496,6 +564,11 @@ int options_parse(int argc, char *argv[])
 				my_options.disable_libv4l2 = 1;
 				break;
 			}
+			case 'C':
+			{
+				my_options.control_cache = 1;
+				break;
+			}
 			case 'x':
 				my_options.width = (int) strtoul(optarg, &stopstring, 10);
 				if( *stopstring != 'x')
@@ -545,6 +618,11 @@ int options_parse(int argc, char *argv[])
 					strncpy(my_options.render, optarg, 4);
 				break;
 			}
+			case 'G':
+			{
+				my_options.shm_group = 1;
+				break;
+			}
 			case 'm':
 			{
 				int str_size = strlen(optarg);
@@ -569,6 +647,24 @@ int options_parse(int argc, char *argv[])
 
 				break;
 			}
+			case 'P':
+				my_options.preview_fps = strtod(optarg, (char **)NULL);
+				if(my_options.preview_fps < 0)
+					my_options.preview_fps = 0;
+				break;
+			case 'S':
+				my_options.preview_width = (int) strtoul(optarg, &stopstring, 10);
+				if( *stopstring != 'x')
+				{
+					fprintf(stderr, "GUVCVIEW: (options) Error in preview size usage: -S[--preview_size] WIDTHxHEIGHT \n");
+					my_options.preview_width = -1;
+				}
+				else
+				{
+					++stopstring;
+					my_options.preview_height = (int) strtoul(stopstring, &stopstring, 10);
+				}
+				break;
 			case 'g':
 			{
 				int str_size = strlen(optarg);
@@ -681,6 +777,76 @@ int options_parse(int argc, char *argv[])
 			case 'n':
 				my_options.photo_npics = atoi(optarg);
 				break;
+			case 'B':
+				my_options.photo_burst = (int) strtoul(optarg, &stopstring, 10);
+				my_options.photo_burst_step = 1;
+				if(*stopstring == ':')
+				{
+					++stopstring;
+					my_options.photo_burst_step = (int) strtoul(stopstring, &stopstring, 10);
+				}
+				if(my_options.photo_burst < 0 || my_options.photo_burst_step < 1)
+				{
+					fprintf(stderr, "GUVCVIEW: (options) Error in photo burst usage: -B[--photo_burst] FRAMES[:STEP] \n");
+					my_options.photo_burst = 0;
+					my_options.photo_burst_step = 1;
+				}
+				break;
+			case 'Z':
+			{
+				my_options.png_threads = 1;
+				stopstring = strchr(optarg, ':');
+				if(stopstring != NULL)
+				{
+					my_options.png_threads = (int) strtoul(stopstring + 1, NULL, 10);
+					*stopstring = '\0';
+				}
+
+				if(strcmp(optarg, "fast") == 0)
+					my_options.png_preset = PNG_PRESET_FAST;
+				else if(strcmp(optarg, "small") == 0)
+					my_options.png_preset = PNG_PRESET_SMALL;
+				else
+				{
+					if(strcmp(optarg, "default") != 0)
+						fprintf(stderr, "GUVCVIEW: (options) Error in png compression usage: -Z[--png_compression] fast|default|small[:THREADS] \n");
+					my_options.png_preset = PNG_PRESET_DEFAULT;
+				}
+
+				if(my_options.png_threads < 1)
+					my_options.png_threads = 1;
+				break;
+			}
+			case 'R':
+				if(my_options.raw_dump != NULL)
+					free(my_options.raw_dump);
+				my_options.raw_dump = strdup(optarg);
+				break;
+			case 'A':
+			{
+				stopstring = strchr(optarg, ':');
+				if(stopstring != NULL)
+				{
+					int roi[4] = {0, 0, 0, 0};
+					if(sscanf(stopstring + 1, "%i,%i,%i,%i", &roi[0], &roi[1], &roi[2], &roi[3]) == 4)
+						memcpy(my_options.focus_roi, roi, sizeof(roi));
+					else
+						fprintf(stderr, "GUVCVIEW: (options) Error in focus metric usage: -A[--focus_metric] dct|laplacian|tenengrad[:X,Y,W,H] \n");
+					*stopstring = '\0';
+				}
+
+				if(strcmp(optarg, "dct") == 0)
+					my_options.focus_metric = AUTOF_METRIC_DCT;
+				else if(strcmp(optarg, "tenengrad") == 0)
+					my_options.focus_metric = AUTOF_METRIC_TENENGRAD;
+				else
+				{
+					if(strcmp(optarg, "laplacian") != 0)
+						fprintf(stderr, "GUVCVIEW: (options) Error in focus metric usage: -A[--focus_metric] dct|laplacian|tenengrad[:X,Y,W,H] \n");
+					my_options.focus_metric = AUTOF_METRIC_LAPLACIAN;
+				}
+				break;
+			}
 			case 'e' :
 				my_options.exit_on_term = 1;
 				break;
@@ -734,4 +900,8 @@ void options_clean()
 	if(my_options.photo_path != NULL)
 		free(my_options.photo_path);
 	my_options.photo_path = NULL;
+
+	if(my_options.raw_dump != NULL)
+		free(my_options.raw_dump);
+	my_options.raw_dump = NULL;
 }
@@ -32,6 +32,7 @@ typedef struct _options_t
 	int fps_denom;   /*fps denominator*/
 	int  control_panel; /*flag control panel mode*/
 	int  disable_libv4l2; /*set to 1 to disable libv4l2 calls*/
+	int  control_cache; /*set to 1 to cache the device control descriptors*/
 	char format[5];  /*pixelformat fourcc*/
 	char render[5];  /*render api*/
 	char gui[5];     /*gui api*/
@@ -50,10 +51,21 @@ typedef struct _options_t
 	double video_timer; /*video capture time in seconds (double)*/
 	double photo_timer; /*photo capture timer interval in seconds (double)*/
 	int photo_npics; /*number of photo captures*/
+	int photo_burst; /*frames captured per photo shot (0 - single frame)*/
+	int photo_burst_step; /*burst frame step (1 - every frame)*/
+	int png_preset; /*png compression preset (PNG_PRESET_XXX)*/
+	int png_threads; /*png deflate threads (1 - single threaded)*/
+	char *raw_dump; /*raw frame dump file (NULL - disabled)*/
+	int focus_metric; /*software autofocus sharpness measure (AUTOF_METRIC_XXX)*/
+	int focus_roi[4]; /*software autofocus roi: x, y, width, height (% of frame)*/
 	int exit_on_term; /*flag if we should exit after video or image capture ends*/
 	char render_flag[5]; /*render window flag => default (none) | FULLSCREEN (full) | MAXIMIZED (max)*/
+	int shm_group; /*set to 1 to let our group read the shm render preview*/
 	int render_width; //render window width (default 0), if set, render window flag is none
 	int render_height; //render window height (default 0), if set, render window flag is none
+	double preview_fps; /*max preview frame rate (0 - every frame; -1 - not set)*/
+	int preview_width; /*max preview width (0 - frame width; -1 - not set)*/
+	int preview_height; /*max preview height (0 - frame height; -1 - not set)*/
 } options_t;
 
 /*
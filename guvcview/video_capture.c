@@ -87,6 +87,31 @@ static int my_encoder_status = 0;
 
 static char status_message[80];
 
+/*photo burst: frames captured per photo shot*/
+typedef struct _photo_burst_t
+{
+	int frames;           /*frames per burst (0 - single frame shots)*/
+	int step;             /*capture every step frame*/
+	int format;           /*image format*/
+	int count;            /*frames captured in the current burst*/
+	int skip;             /*frames to skip before the next capture*/
+	char *name;           /*burst base filename - no extension (NULL if idle)*/
+	char *ext;            /*filename extension*/
+	uint64_t *timestamps; /*captured frame timestamps (ns)*/
+} photo_burst_t;
+
+static photo_burst_t burst =
+{
+	.frames = 0,
+	.step = 1,
+	.name = NULL,
+	.ext = NULL,
+	.timestamps = NULL
+};
+
+/*raw frame dump (every captured frame)*/
+static v4l2_raw_writer_t *raw_writer = NULL;
+
 /*
  * set render flag
  * args:
@@ -163,6 +188,9 @@ uint32_t get_audio_fx_mask()
 void set_audio_fx_mask(uint32_t new_mask)
 {
 	my_audio_mask = new_mask;
+	/*prepare the fx filters outside the audio path*/
+	if(my_audio_ctx != NULL)
+		audio_fx_set_mask(my_audio_ctx, my_audio_mask);
 	/* update config */
 	config_t *my_config = config_get();
 	my_config->audio_fx = my_audio_mask;
@@ -231,6 +259,289 @@ void video_capture_save_image()
 	save_image = 1;
 }
 
+/*
+ * snapshot service completion callback (writer thread)
+ * args:
+ *    filename - image file name
+ *    format - image format
+ *    status - error code (E_OK on success)
+ *    data - unused
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void snapshot_done_callback(const char *filename, int format, int status, void *data)
+{
+	(void) format;
+	(void) data;
+
+	/*the gui keeps its own copy of the message*/
+	char snapshot_message[80];
+
+	if(status == E_OK)
+		snprintf(snapshot_message, 79, _("image saved to %s"), filename);
+	else if(status == E_QUEUE_FULL_ERR)
+		snprintf(snapshot_message, 79, _("image dropped (too many pending): %s"), filename);
+	else
+		snprintf(snapshot_message, 79, _("error saving image to %s"), filename);
+
+	gui_status_message(snapshot_message);
+}
+
+/*
+ * build the photo filename (full path) from the gui settings
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: newly allocated filename (must free)
+ */
+static char *get_photo_filename()
+{
+	char *img_filename = NULL;
+
+	/*get_photo_[name|path] always return a non NULL value*/
+	char *name = strdup(get_photo_name());
+	char *path = strdup(get_photo_path());
+
+	if(get_photo_sufix_flag())
+	{
+		char *new_name = add_file_suffix(path, name);
+		free(name); /*free old name*/
+		name = new_name; /*replace with suffixed name*/
+	}
+	int pathsize = strlen(path);
+	if(path[pathsize - 1] != '/')
+		img_filename = smart_cat(path, '/', name);
+	else
+		img_filename = smart_cat(path, 0, name);
+
+	free(path);
+	free(name);
+
+	return img_filename;
+}
+
+/*
+ * get the image format for a snapshot: jpeg photos of unfiltered
+ *   mjpeg streams are written from the camera bitstream (no re-encoding)
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: image format (IMG_FMT_XXX)
+ */
+static int get_snapshot_format()
+{
+	int format = get_photo_format();
+
+	if(format == IMG_FMT_JPG &&
+		my_render_mask == REND_FX_YUV_NOFILT &&
+		(v4l2core_get_requested_frame_format(my_vd) == V4L2_PIX_FMT_MJPEG ||
+		 v4l2core_get_requested_frame_format(my_vd) == V4L2_PIX_FMT_JPEG))
+		format = IMG_FMT_JPG_RAW;
+
+	return format;
+}
+
+/*
+ * set the photo burst mode
+ * args:
+ *    frames - frames captured per photo shot (0 - disable)
+ *    step - capture every step frame (1 - consecutive frames)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void photo_burst_init(int frames, int step)
+{
+	free(burst.timestamps);
+	burst.timestamps = NULL;
+
+	burst.frames = frames > 0 ? frames : 0;
+	burst.step = step > 0 ? step : 1;
+
+	if(burst.frames > 0)
+	{
+		burst.timestamps = calloc(burst.frames, sizeof(uint64_t));
+		if(burst.timestamps == NULL)
+		{
+			fprintf(stderr, "GUVCVIEW: FATAL memory allocation failure (photo_burst_init): %s\n", strerror(errno));
+			exit(-1);
+		}
+
+		if(debug_level > 0)
+			printf("GUVCVIEW: photo burst of %i frames (every %i frame)\n",
+				burst.frames, burst.step);
+	}
+}
+
+/*
+ * preallocate the snapshot arena for a burst at the current format
+ *   (sized for yu12 and raw/passthrough frames)
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void photo_burst_reserve()
+{
+	if(burst.frames <= 0)
+		return;
+
+	size_t pixels = (size_t) v4l2core_get_frame_width(my_vd) *
+		v4l2core_get_frame_height(my_vd);
+
+	/*largest of the decoded (yu12) and the raw frame*/
+	size_t frame_size = pixels * 3 / 2;
+	size_t raw_size = v4l2core_get_frame_max_size(my_vd);
+	if(raw_size == 0)
+		raw_size = pixels * 2; /*not negotiated: packed 4:2:2*/
+	if(raw_size > frame_size)
+		frame_size = raw_size;
+
+	v4l2core_snapshot_reserve(burst.frames, frame_size);
+}
+
+/*
+ * start a photo burst
+ * args:
+ *    filename - photo filename (full path)
+ *    format - image format
+ *
+ * asserts:
+ *    filename is not null
+ *
+ * returns: none
+ */
+static void photo_burst_start(const char *filename, int format)
+{
+	assert(filename != NULL);
+
+	if(burst.name != NULL)
+		return; /*burst in progress*/
+
+	char *pext = strrchr(filename, '.');
+	char *pdir = strrchr(filename, '/');
+
+	if(pext && (!pdir || pext > pdir))
+	{
+		burst.name = strndup(filename, pext - filename);
+		burst.ext = strdup(pext + 1);
+	}
+	else
+	{
+		burst.name = strdup(filename);
+		burst.ext = NULL;
+	}
+
+	burst.format = format;
+	burst.count = 0;
+	burst.skip = 0;
+}
+
+/*
+ * end the current photo burst: write the timestamps sidecar
+ *   (name.csv - one line per frame with ns timestamps)
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void photo_burst_end()
+{
+	if(burst.name == NULL)
+		return;
+
+	char *csv_filename = smart_cat(burst.name, '.', "csv");
+
+	FILE *fp = fopen(csv_filename, "w");
+	if(fp == NULL)
+		fprintf(stderr, "GUVCVIEW: couldn't open %s for write: %s\n", csv_filename, strerror(errno));
+	else
+	{
+		fprintf(fp, "# index,filename,timestamp_ns,interval_ns\n");
+
+		int i = 0;
+		for(i = 0; i < burst.count; i++)
+		{
+			uint64_t interval = i > 0 ? burst.timestamps[i] - burst.timestamps[i-1] : 0;
+
+			fprintf(fp, "%i,%s-%04i-%" PRIu64 "us%s%s,%" PRIu64 ",%" PRIu64 "\n",
+				i, burst.name, i, burst.timestamps[i] / 1000,
+				burst.ext ? "." : "", burst.ext ? burst.ext : "",
+				burst.timestamps[i], interval);
+		}
+
+		fclose(fp);
+	}
+
+	if(debug_level > 0 && burst.count > 1)
+		printf("GUVCVIEW: photo burst of %i frames in %.3f ms\n", burst.count,
+			(burst.timestamps[burst.count - 1] - burst.timestamps[0]) / 1E6);
+
+	free(csv_filename);
+	free(burst.name);
+	free(burst.ext);
+	burst.name = NULL;
+	burst.ext = NULL;
+	burst.count = 0;
+}
+
+/*
+ * capture a burst frame (skipping step - 1 frames between captures)
+ *   the frame is copied to the snapshot arena and saved in the background,
+ *   the filename carries the frame timestamp (in microseconds)
+ * args:
+ *    frame - pointer to frame buffer
+ *
+ * asserts:
+ *    frame is not null
+ *
+ * returns: none
+ */
+static void photo_burst_frame(v4l2_frame_buff_t *frame)
+{
+	assert(frame != NULL);
+
+	if(burst.name == NULL)
+		return;
+
+	if(burst.skip > 0)
+	{
+		burst.skip--;
+		return;
+	}
+
+	char filename[512];
+	snprintf(filename, sizeof(filename), "%s-%04i-%" PRIu64 "us%s%s",
+		burst.name, burst.count, frame->timestamp / 1000,
+		burst.ext ? "." : "", burst.ext ? burst.ext : "");
+
+	v4l2core_snapshot_submit(frame, filename, burst.format);
+
+	burst.timestamps[burst.count] = frame->timestamp;
+	burst.count++;
+	burst.skip = burst.step - 1;
+
+	if(burst.count >= burst.frames)
+		photo_burst_end();
+}
+
 /*
  * get encoder started flag
  * args:
@@ -626,6 +937,11 @@ audio_context_t *create_audio_context(int api, int device)
 
 	if(my_audio_ctx == NULL)
 		fprintf(stderr, "GUVCVIEW: couldn't allocate audio context\n");
+	else
+	{
+		audio_set_dither(my_audio_ctx, config_get()->audio_dither);
+		audio_set_drift_compensation(my_audio_ctx, config_get()->audio_drift_comp);
+	}
 
 	return my_audio_ctx;
 }
@@ -705,6 +1021,8 @@ static void *audio_processing_loop(void *data)
 	audio_set_cap_buffer_size(audio_ctx,
 		frame_size * audio_get_channels(audio_ctx));
 	audio_start(audio_ctx);
+	/*prepare the fx filters for the stream*/
+	audio_fx_set_mask(audio_ctx, my_audio_mask);
 	/*
 	 * alloc the buffer after audio_start
 	 * otherwise capture_buff_size may not
@@ -716,6 +1034,11 @@ static void *audio_processing_loop(void *data)
 
 	int sample_type = encoder_get_audio_sample_fmt(encoder_ctx);
 
+	/*pcm passthrough: mux straight from the audio ring (no copy)*/
+	int passthrough = encoder_get_audio_passthrough(encoder_ctx);
+	audio_buff_t mapped_buff;
+	memset(&mapped_buff, 0, sizeof(audio_buff_t));
+
 	uint32_t osd_mask = render_get_osd_mask();
 
 	/*enable vu meter OSD display*/
@@ -728,7 +1051,11 @@ static void *audio_processing_loop(void *data)
 
 	while(video_capture_get_save_video())
 	{
-		int ret = audio_get_next_buffer(audio_ctx, audio_buff,
+		int ret = 0;
+		if(passthrough)
+			ret = audio_map_next_buffer(audio_ctx, &mapped_buff, my_audio_mask);
+		else
+			ret = audio_get_next_buffer(audio_ctx, audio_buff,
 				sample_type, my_audio_mask);
 
 		if(ret > 0)
@@ -744,12 +1071,21 @@ static void *audio_processing_loop(void *data)
 		}
 		else if(ret == 0)
 		{
-			encoder_ctx->enc_audio_ctx->pts = audio_buff->timestamp;
+			audio_buff_t *buff = passthrough ? &mapped_buff : audio_buff;
 
-			/*OSD vu meter level*/
-			render_set_vu_level(audio_buff->level_meter);
+			encoder_ctx->enc_audio_ctx->pts = buff->timestamp;
 
-			encoder_process_audio_buffer(encoder_ctx, audio_buff->data);
+			/*OSD vu meter level (meter snapshot of the processed audio)*/
+			audio_meter_levels_t levels;
+			if(audio_get_meter_levels(audio_ctx, &levels) == 0)
+				render_set_vu_level(levels.peak);
+			else
+				render_set_vu_level(buff->level_meter);
+
+			encoder_process_audio_buffer(encoder_ctx, buff->data);
+
+			if(passthrough)
+				audio_release_next_buffer(audio_ctx, &mapped_buff);
 		}
 
 	}
@@ -1014,6 +1350,22 @@ void *capture_loop(void *data)
 
 	render_set_crosshair_color(my_config->crosshair_color);
 
+	render_set_preview_policy(
+		my_config->preview_fps,
+		my_config->preview_width,
+		my_config->preview_height);
+
+	/*shm render: one preview ring per video device (e.g. /guvcview_video0)*/
+	if(render == RENDER_SHM)
+	{
+		char shm_name[64];
+		char *dev_name = strrchr(my_options->device, '/');
+		dev_name = (dev_name != NULL) ? dev_name + 1 : my_options->device;
+		snprintf(shm_name, 63, "/guvcview_%s", dev_name);
+		render_set_shm_name(shm_name);
+		render_set_shm_group_access(my_options->shm_group);
+	}
+
 	if(render_init(
 		render,
 		v4l2core_get_frame_width(my_vd),
@@ -1053,6 +1405,22 @@ void *capture_loop(void *data)
 	if(my_options->photo_npics > 0)
 		my_photo_npics = my_options->photo_npics;
 
+	v4l2core_set_png_compression(my_options->png_preset, my_options->png_threads);
+
+	/*
+	 * encode and write photos off the capture thread:
+	 * no photo is lost - capture only waits if 16 are pending
+	 */
+	v4l2core_snapshot_start(2, 16, SNAPSHOT_POLICY_BLOCK,
+		snapshot_done_callback, NULL);
+
+	/*burst mode: frames go to a preallocated arena*/
+	photo_burst_init(my_options->photo_burst, my_options->photo_burst_step);
+	photo_burst_reserve();
+
+	if(my_options->raw_dump != NULL)
+		raw_writer = v4l2core_raw_writer_open(my_options->raw_dump);
+
 	v4l2core_start_stream(my_vd);
 
 	v4l2_frame_buff_t *frame = NULL; //pointer to frame buffer
@@ -1066,6 +1434,7 @@ void *capture_loop(void *data)
 		{
 			int current_width = v4l2core_get_frame_width(my_vd);
 			int current_height = v4l2core_get_frame_height(my_vd);
+			size_t current_frame_size = v4l2core_get_frame_max_size(my_vd);
 
 			restart = 0; /*reset*/
 			v4l2core_stop_stream(my_vd);
@@ -1090,10 +1459,25 @@ void *capture_loop(void *data)
 
 					gui_error("Guvcview error", "could not start a video stream in the device", 1);
 
+					if(raw_writer != NULL)
+					{
+						v4l2core_raw_writer_close(raw_writer);
+						raw_writer = NULL;
+					}
+					v4l2core_snapshot_stop();
 					return ((void *) -1);
 				}
 			}
 
+			/*resize the burst arena (the raw frame size also depends on the format)*/
+			if((current_width != v4l2core_get_frame_width(my_vd)) ||
+				current_height != v4l2core_get_frame_height(my_vd) ||
+				current_frame_size != v4l2core_get_frame_max_size(my_vd))
+			{
+				photo_burst_end();
+				photo_burst_reserve();
+			}
+
 			if((current_width != v4l2core_get_frame_width(my_vd)) ||
 				current_height != v4l2core_get_frame_height(my_vd))
 			{
@@ -1140,7 +1524,12 @@ void *capture_loop(void *data)
 		{
 			/*run software autofocus (must be called after frame was grabbed and decoded)*/
 			if(do_soft_autofocus || do_soft_focus)
+			{
+				/*don't hunt while recording*/
+				v4l2core_soft_autofocus_set_tracking(get_encoder_status() ?
+					AUTOF_TRACK_QUIET : AUTOF_TRACK_CONTINUOUS);
 				do_soft_focus = v4l2core_soft_autofocus_run(my_vd, frame);
+			}
 
 			/* apply fx effects to the frame
 			 * do it before saving the frame
@@ -1151,10 +1540,13 @@ void *capture_loop(void *data)
 			/*check the timers*/
 			if(check_photo_timer())
 			{
-				if((frame->timestamp - my_last_photo_time) > my_photo_timer)
+				if((frame->timestamp - my_last_photo_time) >= my_photo_timer)
 				{
 					save_image = 1;
-					my_last_photo_time = frame->timestamp;
+					/*keep the timer cadence (resync if we fell behind)*/
+					my_last_photo_time += my_photo_timer;
+					if((frame->timestamp - my_last_photo_time) >= my_photo_timer)
+						my_last_photo_time = frame->timestamp;
 
 					if(my_options->photo_npics > 0)
 					{
@@ -1184,39 +1576,46 @@ void *capture_loop(void *data)
 			/*save the frame (photo)*/
 			if(save_image)
 			{
-				char *img_filename = NULL;
+				char *img_filename = get_photo_filename();
 
-				/*get_photo_[name|path] always return a non NULL value*/
-				char *name = strdup(get_photo_name());
-				char *path = strdup(get_photo_path());
+				//if(debug_level > 1)
+				//	printf("GUVCVIEW: saving image to %s\n", img_filename);
 
-				if(get_photo_sufix_flag())
+				if(burst.frames > 0)
 				{
-					char *new_name = add_file_suffix(path, name);
-					free(name); /*free old name*/
-					name = new_name; /*replace with suffixed name*/
+					/*starts with this frame (ignored if a burst is running)*/
+					snprintf(status_message, 79, _("saving photo burst to %s"), img_filename);
+					gui_status_message(status_message);
+
+					photo_burst_start(img_filename, get_snapshot_format());
 				}
-				int pathsize = strlen(path);
-				if(path[pathsize - 1] != '/')
-					img_filename = smart_cat(path, '/', name);
 				else
-					img_filename = smart_cat(path, 0, name);
-
-				//if(debug_level > 1)
-				//	printf("GUVCVIEW: saving image to %s\n", img_filename);
-
-				snprintf(status_message, 79, _("saving image to %s"), img_filename);
-				gui_status_message(status_message);
+				{
+					snprintf(status_message, 79, _("saving image to %s"), img_filename);
+					gui_status_message(status_message);
 
-				v4l2core_save_image(frame, img_filename, get_photo_format());
+					/*encoded and written by the snapshot service*/
+					v4l2core_snapshot_submit(frame, img_filename, get_snapshot_format());
+				}
 
-				free(path);
-				free(name);
 				free(img_filename);
 
 				save_image = 0; /*reset*/
 			}
 
+			/*save the frame (photo burst)*/
+			photo_burst_frame(frame);
+
+			/*save the frame (raw dump)*/
+			if(raw_writer != NULL &&
+				v4l2core_raw_writer_add_frame(raw_writer, frame,
+					v4l2core_get_requested_frame_format(my_vd)) == E_FILE_IO_ERR)
+			{
+				gui_status_message(_("raw dump write error - stopped"));
+				v4l2core_raw_writer_close(raw_writer);
+				raw_writer = NULL;
+			}
+
 			/*save the frame (video)*/
 			if(video_capture_get_save_video())
 			{
@@ -1273,17 +1672,28 @@ void *capture_loop(void *data)
 				}
 			}
 
-			/* render the osd
-			 * must be done after saving the frame
-			 * (we don't want to record the osd effects)
+			/*
+			 * preview policy: only render frames at the preview
+			 * rate and at the preview size
 			 */
-			render_frame_osd(frame->yuv_frame);
+			if(render_preview_is_due(frame->timestamp))
+			{
+				uint8_t *preview_frame = render_get_preview_frame(frame->yuv_frame);
+
+				/* render the osd
+				 * must be done after saving the frame
+				 * (we don't want to record the osd effects)
+				 */
+				render_frame_osd(preview_frame);
 
-			/* finally render the frame */
-			snprintf(render_caption, 29, "Guvcview  (%2.2f fps)",
-				v4l2core_get_realfps(my_vd));
-			render_set_caption(render_caption);
-			render_frame(frame->yuv_frame);
+				/* finally render the frame */
+				snprintf(render_caption, 29, "Guvcview  (%2.2f fps)",
+					v4l2core_get_realfps(my_vd));
+				render_set_caption(render_caption);
+				render_frame(preview_frame);
+			}
+			else
+				render_dispatch_events();
 
 			/*we are done with the frame buffer release it*/
 			v4l2core_release_frame(my_vd, frame);
@@ -1292,6 +1702,17 @@ void *capture_loop(void *data)
 
 	v4l2core_stop_stream(my_vd);
 
+	if(raw_writer != NULL)
+	{
+		v4l2core_raw_writer_close(raw_writer);
+		raw_writer = NULL;
+	}
+
+	/*write any pending photos*/
+	photo_burst_end();
+	v4l2core_snapshot_stop();
+	photo_burst_init(0, 1);
+
 	/*if we are still saving video then stop it*/
 	if(video_capture_get_save_video())
 		stop_encoder_thread();
@@ -45,17 +45,17 @@
 #include "../config.h"
 #include "gviewaudio.h"
 #include "audio.h"
+#include "audio_convert.h"
+#include "audio_meter.h"
+#include "core_time.h"
 #include "gview.h"
 #include "audio_portaudio.h"
 #if HAS_PULSEAUDIO
   #include "audio_pulseaudio.h"
 #endif
 
-#define AUDBUFF_NUM     80    /*number of audio buffers*/
+#define AUDBUFF_NUM     80    /*number of audio buffers in the ring*/
 #define AUDBUFF_FRAMES  1152  /*number of audio frames per buffer*/
-static audio_buff_t *audio_buffers = NULL; /*pointer to buffers list*/
-static int buffer_read_index = 0; /*current read index of buffer list*/
-static int buffer_write_index = 0;/*current write index of buffer list*/
 
 int verbosity = 0;
 
@@ -107,35 +107,34 @@ void audio_unlock_mutex(audio_context_t *audio_ctx)
 /*
  * free audio buffers
  * args:
- *    none
+ *    audio_ctx - pointer to audio context data
  *
  * asserts:
- *    none
+ *    audio_ctx is not null
  *
- * returns: error code
+ * returns: none
  */
-static void audio_free_buffers()
+static void audio_free_buffers(audio_context_t *audio_ctx)
 {
-	buffer_read_index = 0;
-	buffer_write_index = 0;
+	/*assertions*/
+	assert(audio_ctx != NULL);
 
 	/*return if no buffers set*/
-	if(!audio_buffers)
+	if(!audio_ctx->ring)
 	{
 		if(verbosity > 0)
-			fprintf(stderr,"AUDIO: can't free audio buffers (audio_free_buffers): audio_buffers is null\n");
+			fprintf(stderr,"AUDIO: can't free audio buffers (audio_free_buffers): ring is null\n");
 		return;
 	}
 
-	int i = 0;
-
-	for(i = 0; i < AUDBUFF_NUM; ++i)
-	{
-		free(audio_buffers[i].data);
-	}
+	audio_ring_destroy(audio_ctx->ring);
+	audio_ctx->ring = NULL;
 
-	free(audio_buffers);
-	audio_buffers = NULL;
+	audio_clock_destroy(audio_ctx->clock);
+	audio_ctx->clock = NULL;
+	if(audio_ctx->clock_buff)
+		free(audio_ctx->clock_buff);
+	audio_ctx->clock_buff = NULL;
 }
 
 /*
@@ -214,12 +213,7 @@ static int audio_init_buffers(audio_context_t *audio_ctx)
 
 	/*don't allocate if no audio*/
 	if(audio_ctx->api == AUDIO_NONE)
-	{
-		audio_buffers = NULL;
 		return 0;
-	}
-	
-	int i = 0;
 
 	/*set the buffers size*/
 	if(!audio_ctx->capture_buff_size)
@@ -236,33 +230,43 @@ static int audio_init_buffers(audio_context_t *audio_ctx)
 		exit(-1);
 	}
 	
-	/*free audio_buffers (if any)*/
-	audio_free_buffers();
+	/*free the ring (if any)*/
+	if(audio_ctx->ring)
+		audio_free_buffers(audio_ctx);
 
-	audio_buffers = calloc(AUDBUFF_NUM, sizeof(audio_buff_t));
-	if(audio_buffers == NULL)
-	{
-		fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_init_buffers): %s\n", strerror(errno));
-		exit(-1);
-	}
+	audio_ctx->ring = audio_ring_create(
+		audio_ctx->capture_buff_size * sizeof(sample_t), AUDBUFF_NUM);
+	if(audio_ctx->ring == NULL)
+		return -1;
 
-	for(i = 0; i < AUDBUFF_NUM; ++i)
+	/*clock recovery (resamples to the monotonic clock)*/
+	if(audio_ctx->drift_comp)
 	{
-		audio_buffers[i].data = calloc(
+		audio_ctx->clock = audio_clock_create(audio_ctx->channels,
+			audio_ctx->samprate,
+			audio_ctx->capture_buff_size / audio_ctx->channels);
+
+		audio_ctx->clock_buff = calloc(
 			audio_ctx->capture_buff_size, sizeof(sample_t));
-		if(audio_buffers[i].data == NULL)
+		if(audio_ctx->clock_buff == NULL)
 		{
 			fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_init_buffers): %s\n", strerror(errno));
 			exit(-1);
 		}
-		audio_buffers[i].flag = AUDIO_BUFF_FREE;
 	}
 
+	audio_lock_mutex(audio_ctx);
+	memset(&audio_ctx->drift_stats, 0, sizeof(audio_drift_stats_t));
+	audio_unlock_mutex(audio_ctx);
+
+	audio_meter_reset(audio_ctx->meter, audio_ctx->channels, audio_ctx->samprate);
+
 	return 0;
 }
 
 /*
- * fill a audio buffer data and move write index to next one
+ * push the capture buffer data into the ring
+ *   (called from the capture callback - never blocks)
  * args:
  *   audio_ctx - pointer to audio context data
  *   ts - timestamp for end of data
@@ -287,45 +291,160 @@ void audio_fill_buffer(audio_context_t *audio_ctx, int64_t ts)
 
 	audio_ctx->ts_drift = audio_ctx->current_ts - ts;
 
-	/*get the current write indexed buffer flag*/
-	audio_lock_mutex(audio_ctx);
-	int flag = audio_buffers[buffer_write_index].flag;
-	audio_unlock_mutex(audio_ctx);
+	if(!audio_ctx->ring)
+		return;
 
-	if(flag == AUDIO_BUFF_USED)
+	/*buffer begin time*/
+	int64_t timestamp = audio_ctx->current_ts - buffer_length;
+
+	/*
+	 * write max_frames into the ring - if the consumer is
+	 * lagging behind the block is dropped and counted (no waiting)
+	 */
+	if(audio_ring_write(audio_ctx->ring,
+		audio_ctx->capture_buff,
+		audio_ctx->capture_buff_size * sizeof(sample_t),
+		audio_ctx->capture_buff_size / audio_ctx->channels,
+		timestamp,
+		ts,
+		audio_ctx->capture_buff_level) < 0)
 	{
-		fprintf(stderr, "AUDIO: write buffer(%i) is still in use - dropping data\n", buffer_write_index);
+		/*overruns are reported by the consumer (no stdio in the callback)*/
 		return;
 	}
 
-	/*write max_frames and fill a buffer*/
-	memcpy(audio_buffers[buffer_write_index].data,
-		audio_ctx->capture_buff,
-		audio_ctx->capture_buff_size * sizeof(sample_t));
-	/*buffer begin time*/
-	audio_buffers[buffer_write_index].timestamp = audio_ctx->current_ts - buffer_length;
-	if(audio_buffers[buffer_write_index].timestamp < 0)
-		fprintf(stderr, "AUDIO: write buffer(%i) - invalid timestamp (< 0): cur_ts:%" PRId64 " buf_length:%" PRId64 "\n", 
-			buffer_write_index, audio_ctx->current_ts, buffer_length);
+	if(timestamp < 0 && verbosity > 0)
+		fprintf(stderr, "AUDIO: write buffer - invalid timestamp (< 0): cur_ts:%" PRId64 " buf_length:%" PRId64 "\n",
+			audio_ctx->current_ts, buffer_length);
+}
 
-	audio_buffers[buffer_write_index].level_meter[0] = audio_ctx->capture_buff_level[0];
-	audio_buffers[buffer_write_index].level_meter[1] = audio_ctx->capture_buff_level[1];
+/*
+ * acquire the next processed block (fx and meter applied in place)
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   mask - audio fx mask
+ *   block - pointer to ring block (NULL if data comes from the resampler)
+ *   data - pointer to processed interleaved sample data
+ *   timestamp - pointer to the block timestamp
+ *
+ * asserts:
+ *   none
+ *
+ * returns: 0 on success, 1 if no data available
+ */
+static int audio_acquire_next_block(audio_context_t *audio_ctx, uint32_t mask,
+	audio_ring_block_t **block, sample_t **data, int64_t *timestamp)
+{
+	if(!audio_ctx->ring)
+		return 1;
 
-	audio_lock_mutex(audio_ctx);
-	audio_buffers[buffer_write_index].flag = AUDIO_BUFF_USED;
-	NEXT_IND(buffer_write_index, AUDBUFF_NUM);
-	audio_unlock_mutex(audio_ctx);
+	/*report new overruns (from the consumer side)*/
+	uint64_t overruns = __atomic_load_n(&audio_ctx->ring->overruns, __ATOMIC_RELAXED);
+	if(overruns != audio_ctx->ring->reported_overruns)
+	{
+		fprintf(stderr, "AUDIO: capture ring full - dropped %" PRIu64 " buffer(s) (total %" PRIu64 ")\n",
+			overruns - audio_ctx->ring->reported_overruns, overruns);
+		audio_ctx->ring->reported_overruns = overruns;
+	}
+
+	audio_ring_block_t *blk = NULL;
+	sample_t *block_data = NULL;
+	int64_t ts = 0;
+
+	if(audio_ctx->clock)
+	{
+		/*feed the resampler until a full output block is ready*/
+		while(audio_clock_pull(audio_ctx->clock, audio_ctx->clock_buff, &ts) != 0)
+		{
+			blk = audio_ring_peek(audio_ctx->ring);
+			if(blk == NULL)
+				return 1; /*all done*/
+
+			if(!audio_clock_can_push(audio_ctx->clock, blk->frames))
+			{
+				/*
+				 * never bypass the resampler: older samples are still in
+				 * its fifo and the block is on the input timeline
+				 */
+				fprintf(stderr, "AUDIO: (clock) resampler fifo full - dropping %i frames\n",
+					blk->frames);
+				audio_clock_drop(audio_ctx->clock, blk->frames);
+				audio_ring_release(audio_ctx->ring, blk);
+				return 1;
+			}
+
+			audio_clock_push(audio_ctx->clock,
+				(sample_t *) audio_ring_block_data(blk),
+				blk->frames,
+				blk->capture_ts);
+			audio_ctx->clock_level[0] = blk->level_meter[0];
+			audio_ctx->clock_level[1] = blk->level_meter[1];
+
+			audio_ring_release(audio_ctx->ring, blk);
+			blk = NULL;
+		}
+
+		block_data = audio_ctx->clock_buff;
+
+		audio_lock_mutex(audio_ctx);
+		audio_clock_get_stats(audio_ctx->clock, &audio_ctx->drift_stats);
+		audio_unlock_mutex(audio_ctx);
+	}
+	else
+	{
+		blk = audio_ring_peek(audio_ctx->ring);
+		if(blk == NULL)
+			return 1; /*all done*/
+	}
 
+	if(blk != NULL)
+	{
+		block_data = (sample_t *) audio_ring_block_data(blk);
+		ts = blk->timestamp;
+	}
+
+	/*aplly fx (in place - the block is owned until released)*/
+	audio_fx_apply(audio_ctx, block_data, mask);
+
+	/*meter the processed block (lock free snapshot for osd/gui)*/
+	audio_meter_process(audio_ctx->meter, block_data,
+		audio_ctx->capture_buff_size / audio_ctx->channels, ts);
+
+	*block = blk;
+	*data = block_data;
+	*timestamp = ts;
+
+	return 0;
 }
 
-/* saturate float samples to int16 limits*/
-static int16_t clip_int16 (float in)
+/*
+ * set the buffer levels and hand the block back to the producer
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   block - pointer to ring block (NULL if data came from the resampler)
+ *   buff - pointer to audio buffer
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void audio_release_block(audio_context_t *audio_ctx,
+	audio_ring_block_t *block, audio_buff_t *buff)
 {
-	//int16_t out = (int16_t) (in < -32768) ? -32768 : (in > 32767) ? 32767 : in;
+	if(block != NULL)
+	{
+		buff->level_meter[0] = block->level_meter[0];
+		buff->level_meter[1] = block->level_meter[1];
 
-	long lout =  lroundf(in);
-	int16_t out = (lout < INT16_MIN) ? INT16_MIN : (lout > INT16_MAX) ? INT16_MAX: (int16_t) lout;
-	return (out);
+		/*hand the block back to the producer*/
+		audio_ring_release(audio_ctx->ring, block);
+	}
+	else
+	{
+		buff->level_meter[0] = audio_ctx->clock_level[0];
+		buff->level_meter[1] = audio_ctx->clock_level[1];
+	}
 }
 
 /*
@@ -343,85 +462,288 @@ static int16_t clip_int16 (float in)
  */
 int audio_get_next_buffer(audio_context_t *audio_ctx, audio_buff_t *buff, int type, uint32_t mask)
 {
-	audio_lock_mutex(audio_ctx);
-	int flag = audio_buffers[buffer_read_index].flag;
-	audio_unlock_mutex(audio_ctx);
+	audio_ring_block_t *block = NULL;
+	sample_t *block_data = NULL;
+	int64_t timestamp = 0;
 
-	if(flag == AUDIO_BUFF_FREE)
-		return 1; /*all done*/
+	if(audio_acquire_next_block(audio_ctx, mask, &block, &block_data, &timestamp) != 0)
+		return 1;
 
-	/*aplly fx*/
-	audio_fx_apply(audio_ctx, (sample_t *) audio_buffers[buffer_read_index].data, mask);
+	int frames = audio_ctx->capture_buff_size / audio_ctx->channels;
+
+	/*
+	 * convert straight into the encoder frame layout
+	 * (planar formats use a plane stride of frames - no alignment)
+	 */
+	audio_dither_t *dither = audio_ctx->dither ? &audio_ctx->dither_state : NULL;
 
-	/*copy data into requested format type*/
-	int i = 0;
 	switch(type)
 	{
 		case GV_SAMPLE_TYPE_FLOAT:
-		{
-			sample_t *my_data = (sample_t *) buff->data;
-			memcpy( my_data, audio_buffers[buffer_read_index].data,
+			memcpy(buff->data, block_data,
 				audio_ctx->capture_buff_size * sizeof(sample_t));
 			break;
-		}
+
 		case GV_SAMPLE_TYPE_INT16:
-		{
-			int16_t *my_data = (int16_t *) buff->data;
-			sample_t *buff_p = (sample_t *) audio_buffers[buffer_read_index].data;
-			for(i = 0; i < audio_ctx->capture_buff_size; ++i)
-			{
-				my_data[i] = clip_int16( (buff_p[i]) * INT16_MAX);
-			}
+			audio_convert_float_to_s16((int16_t *) buff->data, block_data,
+				audio_ctx->capture_buff_size, dither);
 			break;
-		}
+
 		case GV_SAMPLE_TYPE_FLOATP:
-		{
-			int j=0;
+			audio_deinterleave_float((float *) buff->data, block_data,
+				frames, audio_ctx->channels);
+			break;
 
-			float *my_data[audio_ctx->channels];
-			sample_t *buff_p = (sample_t *) audio_buffers[buffer_read_index].data;
+		case GV_SAMPLE_TYPE_INT16P:
+			audio_deinterleave_s16((int16_t *) buff->data, block_data,
+				frames, audio_ctx->channels, dither);
+			break;
+	}
 
-			for(j = 0; j < audio_ctx->channels; ++j)
-				my_data[j] = (float *) (((float *) buff->data) +
-					(j * audio_ctx->capture_buff_size/audio_ctx->channels));
+	buff->timestamp = timestamp;
 
-			for(i = 0; i < audio_ctx->capture_buff_size/audio_ctx->channels; ++i)
-				for(j = 0; j < audio_ctx->channels; ++j)
-				{
-					my_data[j][i] = *buff_p++;
-				}
-			break;
-		}
-		case GV_SAMPLE_TYPE_INT16P:
-		{
-			int j=0;
+	audio_release_block(audio_ctx, block, buff);
 
-			int16_t *my_data[audio_ctx->channels];
-			sample_t *buff_p = (sample_t *) audio_buffers[buffer_read_index].data;
+	return 0;
+}
 
-			for(j = 0; j < audio_ctx->channels; ++j)
-				my_data[j] = (int16_t *) (((int16_t *) buff->data) +
-					(j * audio_ctx->capture_buff_size/audio_ctx->channels));
+/*
+ * map the next used buffer from the ring buffer (no copy) and apply fx
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   buff - pointer to a (non allocated) audio buffer
+ *   mask - audio fx mask
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   buff is not null
+ *
+ * returns: error code (buff->data points to interleaved float samples
+ *   owned by the audio ring until audio_release_next_buffer is called)
+ */
+int audio_map_next_buffer(audio_context_t *audio_ctx, audio_buff_t *buff, uint32_t mask)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+	assert(buff != NULL);
 
-			for(i = 0; i < audio_ctx->capture_buff_size/audio_ctx->channels; ++i)
-				for(j = 0; j < audio_ctx->channels; ++j)
-				{
-					my_data[j][i] = clip_int16((*buff_p++) * INT16_MAX);
-				}
-			break;
-		}
+	if(audio_ctx->mapped_data != NULL)
+	{
+		fprintf(stderr, "AUDIO: (map) previous buffer was not released\n");
+		return -1;
+	}
+
+	audio_ring_block_t *block = NULL;
+	sample_t *block_data = NULL;
+	int64_t timestamp = 0;
+
+	if(audio_acquire_next_block(audio_ctx, mask, &block, &block_data, &timestamp) != 0)
+		return 1;
+
+	audio_ctx->mapped_block = block;
+	audio_ctx->mapped_data = block_data;
+
+	buff->data = block_data;
+	buff->timestamp = timestamp;
+
+	if(block != NULL)
+	{
+		buff->level_meter[0] = block->level_meter[0];
+		buff->level_meter[1] = block->level_meter[1];
 	}
+	else
+	{
+		buff->level_meter[0] = audio_ctx->clock_level[0];
+		buff->level_meter[1] = audio_ctx->clock_level[1];
+	}
+
+	return 0;
+}
+
+/*
+ * release a buffer mapped with audio_map_next_buffer
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   buff - pointer to the mapped audio buffer
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   buff is not null
+ *
+ * returns: none
+ */
+void audio_release_next_buffer(audio_context_t *audio_ctx, audio_buff_t *buff)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+	assert(buff != NULL);
+
+	if(audio_ctx->mapped_data == NULL)
+		return;
+
+	audio_release_block(audio_ctx, audio_ctx->mapped_block, buff);
 
-	buff->timestamp = audio_buffers[buffer_read_index].timestamp;
+	audio_ctx->mapped_block = NULL;
+	audio_ctx->mapped_data = NULL;
+	buff->data = NULL;
+}
+
+/*
+ * enable/disable tpdf dither for int16 sample conversions
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *   enable - dither flag (0 - disable)
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: none
+ */
+void audio_set_dither(audio_context_t *audio_ctx, int enable)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+
+	if(enable && !audio_ctx->dither)
+		audio_dither_init(&audio_ctx->dither_state, (uint32_t) ns_time_monotonic());
+
+	audio_ctx->dither = enable ? 1 : 0;
+}
+
+/*
+ * get the tpdf dither flag
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: dither flag
+ */
+int audio_get_dither(audio_context_t *audio_ctx)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+
+	return audio_ctx->dither;
+}
+
+/*
+ * enable/disable audio clock drift compensation
+ *   (resamples the captured audio to the monotonic clock)
+ *   must be set before audio_start
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *   enable - compensation flag (0 - disable)
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: none
+ */
+void audio_set_drift_compensation(audio_context_t *audio_ctx, int enable)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+
+	audio_ctx->drift_comp = enable ? 1 : 0;
+}
+
+/*
+ * get the audio clock drift compensation flag
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: compensation flag
+ */
+int audio_get_drift_compensation(audio_context_t *audio_ctx)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+
+	return audio_ctx->drift_comp;
+}
 
-	buff->level_meter[0] = audio_buffers[buffer_read_index].level_meter[0];
-	buff->level_meter[1] = audio_buffers[buffer_read_index].level_meter[1];
+/*
+ * get the audio clock drift statistics
+ *   safe to call from any thread while capturing
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   stats is not null
+ *
+ * returns: error code (-1 if compensation is not running)
+ */
+int audio_get_drift_stats(audio_context_t *audio_ctx, audio_drift_stats_t *stats)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+	assert(stats != NULL);
 
 	audio_lock_mutex(audio_ctx);
-	audio_buffers[buffer_read_index].flag = AUDIO_BUFF_FREE;
-	NEXT_IND(buffer_read_index, AUDBUFF_NUM);
+	*stats = audio_ctx->drift_stats;
 	audio_unlock_mutex(audio_ctx);
 
+	return stats->enabled ? 0 : -1;
+}
+
+/*
+ * get the current audio levels (lock free - can be called from any thread)
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   levels - pointer to levels snapshot to fill
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   levels is not null
+ *
+ * returns: error code (-1 if no audio was metered yet)
+ */
+int audio_get_meter_levels(audio_context_t *audio_ctx, audio_meter_levels_t *levels)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+	assert(levels != NULL);
+
+	if(audio_meter_get_levels(audio_ctx->meter, levels) == 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * get the capture ring statistics (overruns, fill level)
+ *   safe to call from any thread while capturing
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   stats is not null
+ *
+ * returns: error code (-1 if capture is not running)
+ */
+int audio_get_ring_stats(audio_context_t *audio_ctx, audio_ring_stats_t *stats)
+{
+	/*assertions*/
+	assert(audio_ctx != NULL);
+	assert(stats != NULL);
+
+	if(!audio_ctx->ring)
+	{
+		memset(stats, 0, sizeof(audio_ring_stats_t));
+		return -1;
+	}
+
+	audio_ring_get_stats(audio_ctx->ring, stats);
+
 	return 0;
 }
 
@@ -449,6 +771,9 @@ audio_context_t *audio_init(int api, int device)
 
 	/*initialize the mutex*/
 	__INIT_MUTEX(&(audio_ctx->mutex));
+
+	/*level meter (lives as long as the context)*/
+	audio_ctx->meter = audio_meter_create();
 	
 	int ret = 0;
 
@@ -750,7 +1075,8 @@ int audio_start(audio_context_t *audio_ctx)
 	assert(audio_ctx != NULL);
 
 	/*alloc the ring buffer*/
-	audio_init_buffers(audio_ctx);
+	if(audio_init_buffers(audio_ctx) != 0)
+		return -1;
 	
 	/*reset timestamp values*/
 	audio_ctx->current_ts = 0;
@@ -813,8 +1139,57 @@ int audio_stop(audio_context_t *audio_ctx)
 	}
 
 	/*free the ring buffer (if any)*/
-	audio_free_buffers();
-		
+	if(audio_ctx->ring)
+	{
+		if(verbosity > 0)
+		{
+			audio_ring_stats_t stats;
+			audio_ring_get_stats(audio_ctx->ring, &stats);
+			printf("AUDIO: ring stats: %" PRIu64 " buffers, %" PRIu64 " overruns (%" PRIu64 " frames dropped), high water %" PRIu64 "/%" PRIu64 " bytes\n",
+				stats.blocks, stats.overruns, stats.dropped_frames,
+				stats.high_water, stats.size);
+		}
+		if(audio_ctx->clock && verbosity > 0)
+		{
+			audio_drift_stats_t stats;
+			audio_get_drift_stats(audio_ctx, &stats);
+			printf("AUDIO: clock stats: skew %.2f ppm, drift %.3f ms (compensated %.3f ms, max %.3f ms), %i resets, %" PRIu64 " frames dropped\n",
+				stats.ppm, stats.drift / 1000000.0,
+				stats.sync_error / 1000000.0, stats.max_sync_error / 1000000.0,
+				stats.resets, stats.frames_dropped);
+		}
+		audio_free_buffers(audio_ctx);
+	}
+
+	/*any mapped block went away with the ring*/
+	audio_ctx->mapped_block = NULL;
+	audio_ctx->mapped_data = NULL;
+
+	if(verbosity > 0)
+	{
+		audio_meter_levels_t levels;
+		if(audio_get_meter_levels(audio_ctx, &levels) == 0 && levels.timestamp > 0)
+		{
+			int ch = 0;
+			float tp_max = 0;
+			for(ch = 0; ch < levels.channels; ch++)
+				tp_max = MAX(tp_max, levels.true_peak_max[ch]);
+			printf("AUDIO: levels: true peak max %.2f dBTP, short-term loudness %.1f LUFS\n",
+				tp_max > 0 ? 20 * log10(tp_max) : -INFINITY, levels.lufs_short);
+		}
+
+		audio_fx_stats_t stats;
+		if(audio_fx_get_stats(&stats) == 0 && stats.frames > 0)
+		{
+			int i = 0;
+			for(i = 0; i < AUDIO_FX_COUNT; i++)
+				if(stats.mask & (1 << i))
+					printf("AUDIO: fx 0x%x cpu: %.3f%% (max %.3f ms per buffer)\n",
+						1 << i, stats.load[i] * 100,
+						stats.max_ns[i] / 1000000.0);
+		}
+	}
+
 	return err;
 }
 
@@ -842,6 +1217,13 @@ void audio_close(audio_context_t *audio_ctx)
 	/*destroy the mutex*/
 	__CLOSE_MUTEX(&(audio_ctx->mutex));
 
+	/*free the ring (context is freed by the api close)*/
+	if(audio_ctx->ring != NULL)
+		audio_free_buffers(audio_ctx);
+
+	audio_meter_destroy(audio_ctx->meter);
+	audio_ctx->meter = NULL;
+
 	switch(audio_ctx->api)
 	{
 		case AUDIO_NONE:
@@ -857,7 +1239,4 @@ void audio_close(audio_context_t *audio_ctx)
 			audio_close_portaudio(audio_ctx);
 			break;
 	}
-
-	if(audio_buffers != NULL)
-		audio_free_buffers();
 }
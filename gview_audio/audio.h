@@ -30,6 +30,10 @@
 #include <sys/types.h>
 
 #include "gviewaudio.h"
+#include "audio_ring.h"
+#include "audio_convert.h"
+#include "audio_clock.h"
+#include "audio_meter.h"
 
 struct _audio_context_t
 {
@@ -54,13 +58,30 @@ struct _audio_context_t
 	void *stream;                 /*pointer to audio stream (portaudio)*/
 
 	int stream_flag;              /*stream flag*/
+
+	audio_ring_t *ring;           /*capture ring (lock free)*/
+
+	int dither;                   /*tpdf dither on int16 conversions*/
+	audio_dither_t dither_state;  /*dither generator state*/
+
+	int drift_comp;               /*clock drift compensation flag*/
+	audio_clock_t *clock;         /*clock recovery (consumer side)*/
+	sample_t *clock_buff;         /*resampled block*/
+	float clock_level[2];         /*level of the last captured block*/
+	audio_drift_stats_t drift_stats; /*drift stats (mutex protected)*/
+
+	audio_meter_t *meter;         /*level meter (lock free snapshots)*/
+
+	audio_ring_block_t *mapped_block; /*block mapped by the consumer (zero copy)*/
+	sample_t *mapped_data;        /*mapped sample data (ring or resampler)*/
 	
 	pthread_mutex_t mutex;       /*audio mutex*/
 
 };
 
 /*
- * fill a audio buffer data and move write index to next one
+ * push the capture buffer data into the ring
+ *   (called from the capture callback - never blocks)
  * args:
  *   audio_ctx - pointer to audio context data
  *   ts - timestamp for end of data
@@ -0,0 +1,514 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+#  audio clock recovery: dll filtered device clock + adaptive resampler         #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "audio_clock.h"
+#include "gview.h"
+
+#define CLOCK_HALF_TAPS   (16)  /*resampler filter half length*/
+#define CLOCK_TAPS        (2 * CLOCK_HALF_TAPS)
+#define CLOCK_PHASES      (256) /*filter table phases (linear interpolated)*/
+#define CLOCK_CUTOFF      (0.97) /*filter cutoff (relative to nyquist)*/
+#define CLOCK_KAISER_BETA (8.0)
+#define CLOCK_MAX_DEV     (0.005) /*max resampling ratio deviation (5000 ppm)*/
+#define CLOCK_MAX_SKEW    (0.01)  /*max device clock skew accepted by the dll*/
+
+#define CLOCK_DLL_BW_FAST (1.0)  /*dll bandwidth (Hz) while locking*/
+#define CLOCK_DLL_BW      (0.05) /*dll bandwidth (Hz) when locked*/
+#define CLOCK_DLL_LOCK_TIME (10.0) /*locking period (seconds)*/
+#define CLOCK_MAX_ERROR   (200000000.0) /*timestamp error (ns) that resets the dll*/
+
+#define CLOCK_FIFO_BLOCKS (8) /*input fifo size (in blocks)*/
+
+extern int verbosity;
+
+struct _audio_clock_t
+{
+	int channels;
+	int samprate;
+	int block_frames;
+	double frame_ns;        /*nominal frame period (ns)*/
+
+	float *table;           /*filter table: (CLOCK_PHASES + 1) x CLOCK_TAPS*/
+	float coef[CLOCK_TAPS]; /*interpolated filter for current frame*/
+
+	sample_t *fifo;         /*input fifo (interleaved)*/
+	int fifo_size;          /*fifo size in frames*/
+	int fifo_frames;        /*frames in fifo*/
+	int64_t fifo_pos;       /*input position of the first fifo frame*/
+
+	double read_pos;        /*resampler input position (frames)*/
+	int64_t out_frames;     /*output frames*/
+
+	/*dll (times in ns relative to base_ts)*/
+	int locked;
+	int64_t base_ts;        /*device timestamp of the first block*/
+	double t0;              /*filtered time of the last input frame*/
+	double period;          /*filtered device frame period (ns)*/
+	int64_t in_frames;      /*input frames (position at t0)*/
+	double start_time;      /*time of output frame 0*/
+	double origin;          /*time of input frame 0*/
+
+	/*statistics*/
+	double sync_error;
+	double max_sync_error;
+	int resets;
+	uint64_t dropped_frames;
+};
+
+/*
+ * modified bessel function of the first kind (order 0)
+ * args:
+ *   x - function argument
+ *
+ * asserts:
+ *   none
+ *
+ * returns: I0(x)
+ */
+static double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	int k = 1;
+
+	for(k = 1; k < 50; ++k)
+	{
+		double t = x / (2.0 * k);
+		term *= t * t;
+		sum += term;
+		if(term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+/*
+ * build the kaiser windowed sinc filter table
+ * args:
+ *   table - pointer to table ((CLOCK_PHASES + 1) x CLOCK_TAPS)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void build_filter_table(float *table)
+{
+	double i0_beta = bessel_i0(CLOCK_KAISER_BETA);
+	int p = 0;
+	int j = 0;
+
+	for(p = 0; p <= CLOCK_PHASES; ++p)
+	{
+		double frac = (double) p / CLOCK_PHASES;
+		double h[CLOCK_TAPS];
+		double sum = 0;
+
+		for(j = 0; j < CLOCK_TAPS; ++j)
+		{
+			/*distance from the input position*/
+			double x = (double) (j - CLOCK_HALF_TAPS + 1) - frac;
+			double u = x / CLOCK_HALF_TAPS;
+			double w = (u * u < 1.0) ?
+				bessel_i0(CLOCK_KAISER_BETA * sqrt(1.0 - u * u)) / i0_beta : 0;
+			double s = (x == 0) ? 1.0 :
+				sin(M_PI * CLOCK_CUTOFF * x) / (M_PI * CLOCK_CUTOFF * x);
+
+			h[j] = s * w;
+			sum += h[j];
+		}
+
+		/*unity gain at dc*/
+		for(j = 0; j < CLOCK_TAPS; ++j)
+			table[p * CLOCK_TAPS + j] = (float) (h[j] / sum);
+	}
+}
+
+/*
+ * create a audio clock recovery context
+ * args:
+ *   channels - number of channels
+ *   samprate - nominal sample rate
+ *   block_frames - frames per output block
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to clock context (NULL on error)
+ */
+audio_clock_t *audio_clock_create(int channels, int samprate, int block_frames)
+{
+	if(channels <= 0 || samprate <= 0 || block_frames <= 0)
+	{
+		fprintf(stderr, "AUDIO: (clock) invalid format: %i channels %i Hz %i frames\n",
+			channels, samprate, block_frames);
+		return NULL;
+	}
+
+	audio_clock_t *clock = calloc(1, sizeof(audio_clock_t));
+	if(clock == NULL)
+	{
+		fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_clock_create): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	clock->channels = channels;
+	clock->samprate = samprate;
+	clock->block_frames = block_frames;
+	clock->frame_ns = (double) NSEC_PER_SEC / samprate;
+
+	clock->table = calloc((CLOCK_PHASES + 1) * CLOCK_TAPS, sizeof(float));
+	clock->fifo_size = CLOCK_FIFO_BLOCKS * block_frames + CLOCK_TAPS;
+	clock->fifo = calloc(clock->fifo_size * channels, sizeof(sample_t));
+	if(clock->table == NULL || clock->fifo == NULL)
+	{
+		fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_clock_create): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	build_filter_table(clock->table);
+
+	/*prime the fifo with silence (filter history for the first frames)*/
+	clock->fifo_frames = CLOCK_HALF_TAPS;
+	clock->fifo_pos = -CLOCK_HALF_TAPS;
+
+	return clock;
+}
+
+/*
+ * destroy a audio clock recovery context
+ * args:
+ *   clock - pointer to clock context
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_clock_destroy(audio_clock_t *clock)
+{
+	if(!clock)
+		return;
+
+	free(clock->table);
+	free(clock->fifo);
+	free(clock);
+}
+
+/*
+ * check if the input fifo can hold a block
+ * args:
+ *   clock - pointer to clock context
+ *   frames - number of frames in block
+ *
+ * asserts:
+ *   clock is not null
+ *
+ * returns: 1 if the block fits, 0 otherwise
+ */
+int audio_clock_can_push(audio_clock_t *clock, int frames)
+{
+	/*assertions*/
+	assert(clock != NULL);
+
+	return (clock->fifo_frames + frames <= clock->fifo_size) ? 1 : 0;
+}
+
+/*
+ * count a captured block that didn't fit in the input fifo
+ *  (the dll sees the timestamp gap - large gaps reset it)
+ * args:
+ *   clock - pointer to clock context
+ *   frames - number of frames in block
+ *
+ * asserts:
+ *   clock is not null
+ *
+ * returns: none
+ */
+void audio_clock_drop(audio_clock_t *clock, int frames)
+{
+	/*assertions*/
+	assert(clock != NULL);
+
+	if(frames > 0)
+		clock->dropped_frames += frames;
+}
+
+/*
+ * time (relative to base_ts) of an input position
+ * args:
+ *   clock - pointer to clock context
+ *   pos - input position (frames)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: time in ns
+ */
+static inline double time_of_pos(audio_clock_t *clock, double pos)
+{
+	return clock->t0 - ((double) clock->in_frames - pos) * clock->period;
+}
+
+/*
+ * push a captured block and update the clock estimate
+ * args:
+ *   clock - pointer to clock context
+ *   data - pointer to interleaved samples
+ *   frames - number of frames in block
+ *   capture_ts - device timestamp for end of data (ns)
+ *
+ * asserts:
+ *   clock is not null
+ *   data is not null
+ *
+ * returns: error code (-1 if the fifo is full)
+ */
+int audio_clock_push(audio_clock_t *clock, const sample_t *data,
+	int frames, int64_t capture_ts)
+{
+	/*assertions*/
+	assert(clock != NULL);
+	assert(data != NULL);
+
+	if(frames <= 0)
+		return 0;
+
+	if(!audio_clock_can_push(clock, frames))
+		return -1;
+
+	memcpy(clock->fifo + clock->fifo_frames * clock->channels, data,
+		frames * clock->channels * sizeof(sample_t));
+	clock->fifo_frames += frames;
+
+	if(!clock->locked)
+	{
+		clock->base_ts = capture_ts;
+		clock->t0 = 0;
+		clock->period = clock->frame_ns;
+		clock->in_frames = frames;
+		/*output frame 0 is input frame 0*/
+		clock->origin = clock->t0 - frames * clock->period;
+		clock->start_time = clock->origin;
+		clock->locked = 1;
+		return 0;
+	}
+
+	double t = (double) (capture_ts - clock->base_ts);
+	double pred = clock->t0 + frames * clock->period;
+	double e = t - pred;
+
+	if(fabs(e) > CLOCK_MAX_ERROR)
+	{
+		/*timestamp discontinuity: restart the dll without moving the output*/
+		double read_time = 0;
+
+		clock->t0 = t;
+		clock->period = clock->frame_ns;
+		clock->in_frames += frames;
+
+		read_time = time_of_pos(clock, clock->read_pos);
+		clock->start_time = read_time - clock->out_frames * clock->frame_ns;
+		clock->origin = clock->t0 - clock->in_frames * clock->frame_ns;
+		clock->resets++;
+
+		if(verbosity > 0)
+			fprintf(stderr, "AUDIO: (clock) timestamp discontinuity (%.3f ms) - resetting\n",
+				e / 1000000.0);
+		return 0;
+	}
+
+	/*second order dll (block based)*/
+	double bw = (t < CLOCK_DLL_LOCK_TIME * NSEC_PER_SEC) ? CLOCK_DLL_BW_FAST : CLOCK_DLL_BW;
+	double w = 2 * M_PI * bw * (frames * clock->frame_ns / NSEC_PER_SEC);
+	double b = M_SQRT2 * w;
+	double c = w * w;
+
+	clock->t0 = pred + b * e;
+	clock->period += c * e / frames;
+	clock->in_frames += frames;
+
+	/*keep the estimate within sane device limits*/
+	if(clock->period < clock->frame_ns * (1 - CLOCK_MAX_SKEW))
+		clock->period = clock->frame_ns * (1 - CLOCK_MAX_SKEW);
+	if(clock->period > clock->frame_ns * (1 + CLOCK_MAX_SKEW))
+		clock->period = clock->frame_ns * (1 + CLOCK_MAX_SKEW);
+
+	return 0;
+}
+
+/*
+ * resample the next output block
+ * args:
+ *   clock - pointer to clock context
+ *   out - pointer to output buffer (block_frames interleaved frames)
+ *   timestamp - pointer to output block timestamp (ns)
+ *
+ * asserts:
+ *   clock is not null
+ *   out is not null
+ *   timestamp is not null
+ *
+ * returns: 0 on success, 1 if more input is needed
+ */
+int audio_clock_pull(audio_clock_t *clock, sample_t *out, int64_t *timestamp)
+{
+	/*assertions*/
+	assert(clock != NULL);
+	assert(out != NULL);
+	assert(timestamp != NULL);
+
+	if(!clock->locked)
+		return 1;
+
+	int frames = clock->block_frames;
+	int channels = clock->channels;
+
+	/*input position matching the (monotonic) time of the block end*/
+	double end_time = clock->start_time + (clock->out_frames + frames) * clock->frame_ns;
+	double target = clock->in_frames + (end_time - clock->t0) / clock->period;
+
+	double step = (target - clock->read_pos) / frames;
+	if(step < 1.0 - CLOCK_MAX_DEV)
+		step = 1.0 - CLOCK_MAX_DEV;
+	if(step > 1.0 + CLOCK_MAX_DEV)
+		step = 1.0 + CLOCK_MAX_DEV;
+
+	/*make sure the filter has all the input it needs*/
+	double last_pos = clock->read_pos + step * (frames - 1);
+	if((int64_t) floor(last_pos) + CLOCK_HALF_TAPS >= clock->fifo_pos + clock->fifo_frames)
+		return 1;
+
+	int i = 0;
+	int j = 0;
+	int k = 0;
+
+	for(i = 0; i < frames; ++i)
+	{
+		double pos = clock->read_pos + step * i;
+		int64_t ipos = (int64_t) floor(pos);
+		float phase = (float) (pos - ipos) * CLOCK_PHASES;
+		int p = (int) phase;
+		float a = phase - p;
+
+		if(p >= CLOCK_PHASES)
+		{
+			p = CLOCK_PHASES - 1;
+			a = 1.0f;
+		}
+
+		const float *t0 = clock->table + p * CLOCK_TAPS;
+		const float *t1 = t0 + CLOCK_TAPS;
+		for(k = 0; k < CLOCK_TAPS; ++k)
+			clock->coef[k] = t0[k] + a * (t1[k] - t0[k]);
+
+		const sample_t *src = clock->fifo +
+			(ipos - CLOCK_HALF_TAPS + 1 - clock->fifo_pos) * channels;
+
+		for(j = 0; j < channels; ++j)
+		{
+			float acc = 0;
+			const sample_t *s = src + j;
+			for(k = 0; k < CLOCK_TAPS; ++k, s += channels)
+				acc += clock->coef[k] * *s;
+			out[i * channels + j] = acc;
+		}
+	}
+
+	/*output timeline (nominal sample rate)*/
+	*timestamp = (clock->out_frames / clock->samprate) * NSEC_PER_SEC +
+		((clock->out_frames % clock->samprate) * NSEC_PER_SEC) / clock->samprate;
+
+	clock->read_pos += step * frames;
+	clock->out_frames += frames;
+
+	/*sync error: capture time of the output position against its timeline*/
+	clock->sync_error = time_of_pos(clock, clock->read_pos) -
+		(clock->start_time + clock->out_frames * clock->frame_ns);
+	if(fabs(clock->sync_error) > clock->max_sync_error &&
+		clock->t0 >= CLOCK_DLL_LOCK_TIME * NSEC_PER_SEC)
+		clock->max_sync_error = fabs(clock->sync_error);
+
+	/*drop the consumed input (keep the filter history)*/
+	int64_t keep = (int64_t) floor(clock->read_pos) - CLOCK_HALF_TAPS + 1;
+	int consumed = (int) (keep - clock->fifo_pos);
+	if(consumed > 0)
+	{
+		clock->fifo_frames -= consumed;
+		memmove(clock->fifo, clock->fifo + consumed * channels,
+			clock->fifo_frames * channels * sizeof(sample_t));
+		clock->fifo_pos = keep;
+	}
+
+	return 0;
+}
+
+/*
+ * get the clock recovery statistics
+ * args:
+ *   clock - pointer to clock context
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   clock is not null
+ *   stats is not null
+ *
+ * returns: none
+ */
+void audio_clock_get_stats(audio_clock_t *clock, audio_drift_stats_t *stats)
+{
+	/*assertions*/
+	assert(clock != NULL);
+	assert(stats != NULL);
+
+	stats->enabled = 1;
+	/*long term ratio (the dll period is noisy with timestamp jitter)*/
+	double elapsed = clock->t0 - clock->origin;
+	stats->ratio = (elapsed > 0) ?
+		(clock->in_frames * clock->frame_ns) / elapsed :
+		clock->frame_ns / clock->period;
+	stats->ppm = (stats->ratio - 1.0) * 1000000.0;
+	/*uncompensated: nominal time of the captured frames against elapsed time*/
+	stats->drift = (int64_t) (clock->in_frames * clock->frame_ns - (clock->t0 - clock->origin));
+	stats->sync_error = (int64_t) clock->sync_error;
+	stats->max_sync_error = (int64_t) clock->max_sync_error;
+	stats->frames_in = clock->in_frames;
+	stats->frames_out = clock->out_frames;
+	stats->resets = clock->resets;
+	stats->frames_dropped = clock->dropped_frames;
+}
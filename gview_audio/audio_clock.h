@@ -0,0 +1,147 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+********************************************************************************/
+
+#ifndef AUDIO_CLOCK_H
+#define AUDIO_CLOCK_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "gviewaudio.h"
+
+/*
+ * audio clock recovery
+ * a delay locked loop filters the device timestamps of the captured
+ * blocks, giving the device sample rate against the monotonic clock;
+ * an adaptive (windowed sinc) resampler then reads the input at the
+ * position matching the monotonic time of each output frame, so the
+ * output sample timeline (nominal rate) stays locked to the video clock
+ */
+
+/*audio clock context - opaque structure*/
+typedef struct _audio_clock_t audio_clock_t;
+
+/*
+ * create a audio clock recovery context
+ * args:
+ *   channels - number of channels
+ *   samprate - nominal sample rate
+ *   block_frames - frames per output block
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to clock context (NULL on error)
+ */
+audio_clock_t *audio_clock_create(int channels, int samprate, int block_frames);
+
+/*
+ * destroy a audio clock recovery context
+ * args:
+ *   clock - pointer to clock context
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_clock_destroy(audio_clock_t *clock);
+
+/*
+ * check if the input fifo can hold a block
+ * args:
+ *   clock - pointer to clock context
+ *   frames - number of frames in block
+ *
+ * asserts:
+ *   clock is not null
+ *
+ * returns: 1 if the block fits, 0 otherwise
+ */
+int audio_clock_can_push(audio_clock_t *clock, int frames);
+
+/*
+ * count a captured block that didn't fit in the input fifo
+ * args:
+ *   clock - pointer to clock context
+ *   frames - number of frames in block
+ *
+ * asserts:
+ *   clock is not null
+ *
+ * returns: none
+ */
+void audio_clock_drop(audio_clock_t *clock, int frames);
+
+/*
+ * push a captured block and update the clock estimate
+ * args:
+ *   clock - pointer to clock context
+ *   data - pointer to interleaved samples
+ *   frames - number of frames in block
+ *   capture_ts - device timestamp for end of data (ns)
+ *
+ * asserts:
+ *   clock is not null
+ *   data is not null
+ *
+ * returns: error code (-1 if the fifo is full)
+ */
+int audio_clock_push(audio_clock_t *clock, const sample_t *data,
+	int frames, int64_t capture_ts);
+
+/*
+ * resample the next output block
+ * args:
+ *   clock - pointer to clock context
+ *   out - pointer to output buffer (block_frames interleaved frames)
+ *   timestamp - pointer to output block timestamp (ns)
+ *
+ * asserts:
+ *   clock is not null
+ *   out is not null
+ *   timestamp is not null
+ *
+ * returns: 0 on success, 1 if more input is needed
+ */
+int audio_clock_pull(audio_clock_t *clock, sample_t *out, int64_t *timestamp);
+
+/*
+ * get the clock recovery statistics
+ * args:
+ *   clock - pointer to clock context
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   clock is not null
+ *   stats is not null
+ *
+ * returns: none
+ */
+void audio_clock_get_stats(audio_clock_t *clock, audio_drift_stats_t *stats);
+
+#endif
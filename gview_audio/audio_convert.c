@@ -0,0 +1,466 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+#  sample format conversion and (de)interleaving                                #
+#  float to int16 rounds to nearest (ties to even) with saturation, so the      #
+#  sse2 and the scalar paths produce the same output (without dither)           #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "audio_convert.h"
+#include "gview.h"
+
+#define S16_SCALE ((float) INT16_MAX)
+/*xorshift output to [-0.5, 0.5[*/
+#define DITHER_SCALE (1.0f / 4294967296.0f)
+
+/*
+ * init the dither generator
+ * args:
+ *   dither - pointer to dither state
+ *   seed - generator seed
+ *
+ * asserts:
+ *   dither is not null
+ *
+ * returns: none
+ */
+void audio_dither_init(audio_dither_t *dither, uint32_t seed)
+{
+	/*assertions*/
+	assert(dither != NULL);
+
+	int i = 0;
+	for(i = 0; i < 4; ++i)
+	{
+		/*xorshift state must never be zero*/
+		dither->seed[i] = (seed + 1) * (2654435761u + 2 * i);
+		if(dither->seed[i] == 0)
+			dither->seed[i] = 0x9e3779b9;
+		dither->prev[i] = 0;
+	}
+}
+
+/*
+ * next high pass tpdf dither value (+-1 lsb) for a generator lane
+ * args:
+ *   dither - pointer to dither state
+ *   lane - generator lane
+ *
+ * asserts:
+ *   none
+ *
+ * returns: dither value (in lsb units)
+ */
+static inline float dither_next(audio_dither_t *dither, int lane)
+{
+	uint32_t x = dither->seed[lane];
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	dither->seed[lane] = x;
+
+	float r = (float) ((int32_t) x) * DITHER_SCALE;
+	float d = r - dither->prev[lane];
+	dither->prev[lane] = r;
+
+	return d;
+}
+
+/*
+ * convert a float sample to int16 (scalar)
+ * args:
+ *   in - float sample
+ *   dither - dither value (lsb units)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: int16 sample
+ */
+static inline int16_t float_to_s16(float in, float dither)
+{
+	float s = in * S16_SCALE + dither;
+
+	/*same operand order as maxps/minps (nan goes to INT16_MIN)*/
+	s = (s > (float) INT16_MIN) ? s : (float) INT16_MIN;
+	s = (s < (float) INT16_MAX) ? s : (float) INT16_MAX;
+
+	return (int16_t) lrintf(s);
+}
+
+#if defined(__SSE2__)
+/*
+ * next 4 high pass tpdf dither values (sse2)
+ * args:
+ *   seed - pointer to generator state
+ *   prev - pointer to previous random values
+ *
+ * asserts:
+ *   none
+ *
+ * returns: dither values (lsb units)
+ */
+static inline __m128 dither_next_sse2(__m128i *seed, __m128 *prev)
+{
+	__m128i x = *seed;
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+	x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+	x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+	*seed = x;
+
+	__m128 r = _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(DITHER_SCALE));
+	__m128 d = _mm_sub_ps(r, *prev);
+	*prev = r;
+
+	return d;
+}
+
+/*
+ * convert 4 float samples to int32 in the int16 range (sse2)
+ * args:
+ *   v - float samples
+ *
+ * asserts:
+ *   none
+ *
+ * returns: int32 samples (saturated to int16 limits)
+ */
+static inline __m128i float_to_s16_sse2(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_set1_ps((float) INT16_MIN));
+	v = _mm_min_ps(v, _mm_set1_ps((float) INT16_MAX));
+
+	return _mm_cvtps_epi32(v);
+}
+#endif
+
+/*
+ * convert float samples to int16
+ * args:
+ *   out - pointer to int16 output samples
+ *   in - pointer to float input samples
+ *   n - number of samples
+ *   dither - pointer to dither state (NULL - no dither)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_convert_float_to_s16(int16_t *out, const sample_t *in, int n,
+	audio_dither_t *dither)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 scale = _mm_set1_ps(S16_SCALE);
+
+	if(dither)
+	{
+		__m128i seed = _mm_loadu_si128((__m128i *) dither->seed);
+		__m128 prev = _mm_loadu_ps(dither->prev);
+
+		for(; i + 8 <= n; i += 8)
+		{
+			__m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+			__m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+			a = _mm_add_ps(a, dither_next_sse2(&seed, &prev));
+			b = _mm_add_ps(b, dither_next_sse2(&seed, &prev));
+
+			_mm_storeu_si128((__m128i *) (out + i),
+				_mm_packs_epi32(float_to_s16_sse2(a), float_to_s16_sse2(b)));
+		}
+
+		_mm_storeu_si128((__m128i *) dither->seed, seed);
+		_mm_storeu_ps(dither->prev, prev);
+	}
+	else
+	{
+		for(; i + 8 <= n; i += 8)
+		{
+			__m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), scale);
+			__m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+
+			_mm_storeu_si128((__m128i *) (out + i),
+				_mm_packs_epi32(float_to_s16_sse2(a), float_to_s16_sse2(b)));
+		}
+	}
+#endif
+
+	for(; i < n; ++i)
+		out[i] = float_to_s16(in[i], dither ? dither_next(dither, i & 3) : 0);
+}
+
+/*
+ * convert int16 samples to float
+ * args:
+ *   out - pointer to float output samples
+ *   in - pointer to int16 input samples
+ *   n - number of samples
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_convert_s16_to_float(sample_t *out, const int16_t *in, int n)
+{
+	int i = 0;
+	float scale = 1.0f / S16_SCALE;
+
+#if defined(__SSE2__)
+	__m128 vscale = _mm_set1_ps(scale);
+
+	for(; i + 8 <= n; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((__m128i *) (in + i));
+		/*sign extend to int32*/
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+	}
+#endif
+
+	for(; i < n; ++i)
+		out[i] = (float) in[i] * scale;
+}
+
+/*
+ * deinterleave float samples into float planes
+ * args:
+ *   out - pointer to planar output buffer (plane stride = frames)
+ *   in - pointer to interleaved float samples
+ *   frames - number of audio frames
+ *   channels - number of channels
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_deinterleave_float(float *out, const sample_t *in,
+	int frames, int channels)
+{
+	int i = 0;
+	int j = 0;
+
+	if(channels == 1)
+	{
+		memcpy(out, in, frames * sizeof(float));
+		return;
+	}
+
+	if(channels == 2)
+	{
+		float *left = out;
+		float *right = out + frames;
+#if defined(__SSE2__)
+		for(; i + 4 <= frames; i += 4)
+		{
+			__m128 a = _mm_loadu_ps(in + 2 * i);     /*l0 r0 l1 r1*/
+			__m128 b = _mm_loadu_ps(in + 2 * i + 4); /*l2 r2 l3 r3*/
+
+			_mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+#endif
+		for(; i < frames; ++i)
+		{
+			left[i] = in[2 * i];
+			right[i] = in[2 * i + 1];
+		}
+		return;
+	}
+
+	/*generic: sequential writes, one plane at a time*/
+	for(j = 0; j < channels; ++j)
+	{
+		float *plane = out + j * frames;
+		const sample_t *p = in + j;
+		for(i = 0; i < frames; ++i, p += channels)
+			plane[i] = *p;
+	}
+}
+
+/*
+ * deinterleave and convert float samples into int16 planes
+ * args:
+ *   out - pointer to planar output buffer (plane stride = frames)
+ *   in - pointer to interleaved float samples
+ *   frames - number of audio frames
+ *   channels - number of channels
+ *   dither - pointer to dither state (NULL - no dither)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_deinterleave_s16(int16_t *out, const sample_t *in,
+	int frames, int channels, audio_dither_t *dither)
+{
+	int i = 0;
+	int j = 0;
+
+	if(channels == 1)
+	{
+		audio_convert_float_to_s16(out, in, frames, dither);
+		return;
+	}
+
+	if(channels == 2)
+	{
+		int16_t *left = out;
+		int16_t *right = out + frames;
+#if defined(__SSE2__)
+		__m128 scale = _mm_set1_ps(S16_SCALE);
+		__m128i seed = _mm_setzero_si128();
+		__m128 prev = _mm_setzero_ps();
+
+		if(dither)
+		{
+			seed = _mm_loadu_si128((__m128i *) dither->seed);
+			prev = _mm_loadu_ps(dither->prev);
+		}
+
+		for(; i + 8 <= frames; i += 8)
+		{
+			const sample_t *p = in + 2 * i;
+			__m128 a = _mm_loadu_ps(p);
+			__m128 b = _mm_loadu_ps(p + 4);
+			__m128 c = _mm_loadu_ps(p + 8);
+			__m128 d = _mm_loadu_ps(p + 12);
+
+			__m128 l0 = _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), scale);
+			__m128 r0 = _mm_mul_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)), scale);
+			__m128 l1 = _mm_mul_ps(_mm_shuffle_ps(c, d, _MM_SHUFFLE(2, 0, 2, 0)), scale);
+			__m128 r1 = _mm_mul_ps(_mm_shuffle_ps(c, d, _MM_SHUFFLE(3, 1, 3, 1)), scale);
+
+			if(dither)
+			{
+				l0 = _mm_add_ps(l0, dither_next_sse2(&seed, &prev));
+				r0 = _mm_add_ps(r0, dither_next_sse2(&seed, &prev));
+				l1 = _mm_add_ps(l1, dither_next_sse2(&seed, &prev));
+				r1 = _mm_add_ps(r1, dither_next_sse2(&seed, &prev));
+			}
+
+			_mm_storeu_si128((__m128i *) (left + i),
+				_mm_packs_epi32(float_to_s16_sse2(l0), float_to_s16_sse2(l1)));
+			_mm_storeu_si128((__m128i *) (right + i),
+				_mm_packs_epi32(float_to_s16_sse2(r0), float_to_s16_sse2(r1)));
+		}
+
+		if(dither)
+		{
+			_mm_storeu_si128((__m128i *) dither->seed, seed);
+			_mm_storeu_ps(dither->prev, prev);
+		}
+#endif
+		for(; i < frames; ++i)
+		{
+			left[i] = float_to_s16(in[2 * i], dither ? dither_next(dither, 0) : 0);
+			right[i] = float_to_s16(in[2 * i + 1], dither ? dither_next(dither, 1) : 0);
+		}
+		return;
+	}
+
+	/*generic: sequential writes, one plane at a time*/
+	for(j = 0; j < channels; ++j)
+	{
+		int16_t *plane = out + j * frames;
+		const sample_t *p = in + j;
+		for(i = 0; i < frames; ++i, p += channels)
+			plane[i] = float_to_s16(*p, dither ? dither_next(dither, i & 3) : 0);
+	}
+}
+
+/*
+ * interleave float planes into float samples
+ * args:
+ *   out - pointer to interleaved float output samples
+ *   in - pointer to planar input buffer (plane stride = frames)
+ *   frames - number of audio frames
+ *   channels - number of channels
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_interleave_float(sample_t *out, const float *in,
+	int frames, int channels)
+{
+	int i = 0;
+	int j = 0;
+
+	if(channels == 1)
+	{
+		memcpy(out, in, frames * sizeof(float));
+		return;
+	}
+
+	if(channels == 2)
+	{
+		const float *left = in;
+		const float *right = in + frames;
+#if defined(__SSE2__)
+		for(; i + 4 <= frames; i += 4)
+		{
+			__m128 l = _mm_loadu_ps(left + i);
+			__m128 r = _mm_loadu_ps(right + i);
+
+			_mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+			_mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+		}
+#endif
+		for(; i < frames; ++i)
+		{
+			out[2 * i] = left[i];
+			out[2 * i + 1] = right[i];
+		}
+		return;
+	}
+
+	for(j = 0; j < channels; ++j)
+	{
+		const float *plane = in + j * frames;
+		sample_t *p = out + j;
+		for(i = 0; i < frames; ++i, p += channels)
+			*p = plane[i];
+	}
+}
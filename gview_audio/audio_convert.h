@@ -0,0 +1,135 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+********************************************************************************/
+
+#ifndef AUDIO_CONVERT_H
+#define AUDIO_CONVERT_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "gviewaudio.h"
+
+/*tpdf dither state (one generator per simd lane)*/
+typedef struct _audio_dither_t
+{
+	uint32_t seed[4];  /*xorshift generator state*/
+	float prev[4];     /*previous random value (high pass tpdf)*/
+} audio_dither_t;
+
+/*
+ * init the dither generator
+ * args:
+ *   dither - pointer to dither state
+ *   seed - generator seed
+ *
+ * asserts:
+ *   dither is not null
+ *
+ * returns: none
+ */
+void audio_dither_init(audio_dither_t *dither, uint32_t seed);
+
+/*
+ * convert float samples to int16
+ * args:
+ *   out - pointer to int16 output samples
+ *   in - pointer to float input samples
+ *   n - number of samples
+ *   dither - pointer to dither state (NULL - no dither)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_convert_float_to_s16(int16_t *out, const sample_t *in, int n,
+	audio_dither_t *dither);
+
+/*
+ * convert int16 samples to float
+ * args:
+ *   out - pointer to float output samples
+ *   in - pointer to int16 input samples
+ *   n - number of samples
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_convert_s16_to_float(sample_t *out, const int16_t *in, int n);
+
+/*
+ * deinterleave float samples into float planes
+ * args:
+ *   out - pointer to planar output buffer (plane stride = frames)
+ *   in - pointer to interleaved float samples
+ *   frames - number of audio frames
+ *   channels - number of channels
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_deinterleave_float(float *out, const sample_t *in,
+	int frames, int channels);
+
+/*
+ * deinterleave and convert float samples into int16 planes
+ * args:
+ *   out - pointer to planar output buffer (plane stride = frames)
+ *   in - pointer to interleaved float samples
+ *   frames - number of audio frames
+ *   channels - number of channels
+ *   dither - pointer to dither state (NULL - no dither)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_deinterleave_s16(int16_t *out, const sample_t *in,
+	int frames, int channels, audio_dither_t *dither);
+
+/*
+ * interleave float planes into float samples
+ * args:
+ *   out - pointer to interleaved float output samples
+ *   in - pointer to planar input buffer (plane stride = frames)
+ *   frames - number of audio frames
+ *   channels - number of channels
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_interleave_float(sample_t *out, const float *in,
+	int frames, int channels);
+
+#endif
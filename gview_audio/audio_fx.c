@@ -19,11 +19,25 @@
 #                                                                               #
 ********************************************************************************/
 
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+#  audio fx engine                                                              #
+#  all filter state is allocated by audio_fx_set_mask (outside the audio path)  #
+#  audio_fx_apply only processes, in fixed size blocks, and never allocates     #
+#                                                                               #
+#  the dsp core works on planar lane groups: channels are split in groups of   #
+#  FX_LANES (one channel per vector lane) and each group is a plane of frames,  #
+#  so any number of channels is supported and the cost grows with              #
+#  channels / FX_LANES                                                          #
+#                                                                               #
+********************************************************************************/
+
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/types.h>
-#include <unistd.h>
-#include <fcntl.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <math.h>
 #include <string.h>
 #include <errno.h>
@@ -32,200 +46,210 @@
 #include <locale.h>
 #include <libintl.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "../config.h"
 #include "gviewaudio.h"
 #include "audio.h"
+#include "core_time.h"
 #include "gview.h"
 
 #ifndef M_PI
 #define M_PI		3.14159265358979323846
 #endif
 
+/*frames processed per block (bounds the work buffers)*/
+#define FX_BLOCK_FRAMES (256)
+/*channels per lane group (vector width)*/
+#define FX_LANES        (4)
+/*samples in a lane group block*/
+#define FX_PLANE_SIZE   (FX_BLOCK_FRAMES * FX_LANES)
+/*buffer alignment*/
+#define FX_ALIGN        (16)
+
+/*wahwah lfo update rate (frames)*/
+#define lfoskipsamples 30
+
 extern int verbosity;
 
 /*----------- structs for audio effects ------------*/
 
-/*data for Butterworth filter (LP or HP)*/
-typedef struct _fx_filt_data_t
+/*
+ * biquad filter (transposed direct form II)
+ * y = b0*x + s1; s1 = b1*x - a1*y + s2; s2 = b2*x - a2*y
+ */
+typedef struct _fx_biquad_t
 {
-	sample_t buff_in1[2];
-	sample_t buff_in2[2];
-	sample_t buff_out1[2];
-	sample_t buff_out2[2];
-	float c;
-	float a1;
-	float a2;
-	float a3;
+	float b0;
 	float b1;
 	float b2;
-} fx_filt_data_t;
+	float a1;
+	float a2;
+	sample_t *state; /*s1 and s2 lanes for each group*/
+} fx_biquad_t;
 
-/*data for Comb4 filter*/
-typedef struct _fx_comb4_data_t
+/*delay line (one plane of frames * FX_LANES samples per group)*/
+typedef struct _fx_delay_t
 {
-	int buff_size1;
-	int buff_size2;
-	int buff_size3;
-	int buff_size4;
-
-	sample_t *CombBuff10; // four parallel  comb filters - first channel
-	sample_t *CombBuff11; // four parallel comb filters - second channel
-	sample_t *CombBuff20; // four parallel  comb filters - first channel
-	sample_t *CombBuff21; // four parallel comb filters - second channel
-	sample_t *CombBuff30; // four parallel  comb filters - first channel
-	sample_t *CombBuff31; // four parallel comb filters - second channel
-	sample_t *CombBuff40; // four parallel  comb filters - first channel
-	sample_t *CombBuff41; // four parallel comb filters - second channel
-
-	int CombIndex1; //comb filter 1 index
-	int CombIndex2; //comb filter 2 index
-	int CombIndex3; //comb filter 3 index
-	int CombIndex4; //comb filter 4 index
-} fx_comb4_data_t;
-
-/* data for delay*/
-typedef struct _fx_delay_data_t
-{
-	int buff_size;
-	sample_t *delayBuff1; // delay buffer 1 - first channel
-	sample_t *delayBuff2; // delay buffer 2 - second channel (stereo)
-	int delayIndex; // delay buffer index
-} fx_delay_data_t;
+	int frames;      /*delay length in frames*/
+	int index;       /*current frame*/
+	sample_t *buff;
+} fx_delay_t;
 
 /* data for WahWah effect*/
 typedef struct _fx_wah_data_t
 {
 	float lfoskip;
 	unsigned long skipcount;
-	float xn1;
-	float xn2;
-	float yn1;
-	float yn2;
+	/*coefficients normalized by a0 (shared by all channels)*/
 	float b0;
 	float b1;
 	float b2;
-	float a0;
 	float a1;
 	float a2;
 	float phase;
+	sample_t *state; /*xn1, xn2, yn1 and yn2 lanes for each group*/
 } fx_wah_data_t;
 
-typedef struct _fx_rate_data_t
+/*
+ * pitch shifter (ducky):
+ * keeps 1 in rate frames into a window of wsize frames
+ * and plays each full window rate times
+ */
+typedef struct _fx_pitch_data_t
 {
-	sample_t *rBuff1;
-	sample_t *rBuff2;
-	sample_t *wBuff1;
-	sample_t *wBuff2;
-	int wSize;
-	int numsamples;
-} fx_rate_data_t;
+	int rate;
+	int phase;        /*decimation phase*/
+	int wsize;        /*window size (frames)*/
+	int wfill;        /*frames in window*/
+	sample_t *window; /*wsize * FX_LANES samples per group*/
+	int fifo_size;    /*output fifo size (frames)*/
+	int fifo_read;    /*output fifo read frame*/
+	int fifo_count;   /*frames in output fifo*/
+	sample_t *fifo;   /*fifo_size * FX_LANES samples per group*/
+} fx_pitch_data_t;
 
 typedef struct _audio_fx_t
 {
-	fx_delay_data_t *ECHO;
-	fx_delay_data_t *AP1;
-	fx_comb4_data_t *COMB4;
-	fx_filt_data_t  *HPF;
-	fx_filt_data_t  *LPF1;
-	fx_rate_data_t  *RT1;
-	fx_wah_data_t   *wahData;
+	uint32_t mask;    /*prepared fx*/
+	int samprate;
+	int channels;
+	int groups;       /*lane groups (channels / FX_LANES rounded up)*/
+	int warned;       /*mismatch already reported*/
+
+	sample_t *work;    /*current block - FX_PLANE_SIZE samples per group*/
+	sample_t *scratch; /*reverb accumulator - FX_PLANE_SIZE samples per group*/
+
+	fx_delay_t echo;
+	float echo_decay;
+
+	fx_delay_t comb[4];
+	float comb_gain[4];
+	float comb_in_gain;
+	fx_delay_t ap;
+	float ap_gain;
+
+	fx_biquad_t hpf;
+
+	fx_wah_data_t wah;
+	float wah_depth;
+	float wah_freqofs;
+	float wah_res;
+
+	fx_pitch_data_t pitch;
+	fx_biquad_t lpf;
+
+	/*cpu cost*/
+	uint64_t buffers;
+	uint64_t frames;
+	uint64_t total_ns[AUDIO_FX_COUNT];
+	uint64_t max_ns[AUDIO_FX_COUNT];
 } audio_fx_t;
 
-/*audio fx data*/
+/*delay line kernel: processes n samples of a lane group plane*/
+typedef void (*fx_delay_kernel_t)(sample_t *out, const sample_t *in,
+	sample_t *buff, int n, float gain, float in_gain);
+
+/*audio fx data (swapped under fx_mutex)*/
 static audio_fx_t *aud_fx = NULL;
+static __MUTEX_TYPE fx_mutex = __STATIC_MUTEX_INIT;
 
 /*
- * initialize audio fx data
+ * allocate an aligned and zeroed sample buffer
+ * (pages are touched here and not in the audio path)
  * args:
- *    none
+ *   samples - number of samples
  *
  * asserts:
- *    none
+ *   none
  *
- * returns: none
+ * returns: pointer to sample buffer
  */
-static void audio_fx_init ()
+static sample_t *fx_alloc_samples(int samples)
 {
-	aud_fx = calloc(1, sizeof(audio_fx_t));
-	if(aud_fx == NULL)
+	sample_t *buff = NULL;
+	size_t size = (size_t) samples * sizeof(sample_t);
+
+	if(size == 0)
+		size = sizeof(sample_t);
+
+	if(posix_memalign((void **) &buff, FX_ALIGN, size) != 0)
 	{
-		fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_init): %s\n", strerror(errno));
+		fprintf(stderr,"AUDIO: FATAL memory allocation failure (fx_alloc_samples): %s\n", strerror(errno));
 		exit(-1);
 	}
-	/*Echo effect data */
-	aud_fx->ECHO = NULL;
-	/* 4 parallel comb filters data*/
-	aud_fx->COMB4 = NULL;
-	/*all pass 1 filter data*/
-	aud_fx->AP1 = NULL;
-	/*WahWah effect data*/
-	aud_fx->wahData = NULL;
-	/*high pass filter data*/
-	aud_fx->HPF = NULL;
-	/*rate transposer*/
-	aud_fx->RT1 = NULL;
-	/*low pass filter*/
-	aud_fx->LPF1 = NULL;
+	memset(buff, 0, size);
+
+	return buff;
 }
 
 /*
- * clip float samples [-1.0 ; 1.0]
+ * init a delay line
  * args:
- *   in - float sample
+ *   delay - pointer to delay line
+ *   delay_ms - delay in ms
+ *   samprate - sample rate
+ *   groups - lane groups
  *
  * asserts:
  *   none
  *
- * returns: float sample
+ * returns: none
  */
-static float clip_float (float in)
+static void delay_init(fx_delay_t *delay, int delay_ms, int samprate, int groups)
 {
-	in = (in < -1.0) ? -1.0 : (in > 1.0) ? 1.0 : in;
-
-	return in;
+	delay->frames = (int) (delay_ms * (samprate * 0.001));
+	if(delay->frames < 1)
+		delay->frames = 1;
+	delay->index = 0;
+	delay->buff = fx_alloc_samples(delay->frames * FX_LANES * groups);
 }
 
 /*
- * Butterworth Filter for HP or LP
+ * set biquad coefficients
  * out(n) = a1 * in + a2 * in(n-1) + a3 * in(n-2) - b1*out(n-1) - b2*out(n-2)
  * args:
- *   FILT - pointer to fx_filt_data_t
- *   Buff - sampe buffer
- *   NumSamples - samples in buffer
- *   channels - number of audio channels
+ *   bq - pointer to biquad
+ *   groups - lane groups
+ *   a1, a2, a3 - feed forward coefficients
+ *   b1, b2 - feedback coefficients
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
  */
-static void Butt(fx_filt_data_t *FILT,
-	sample_t *Buff,
-	int NumSamples,
-	int channels)
+static void biquad_init(fx_biquad_t *bq, int groups,
+	float a1, float a2, float a3, float b1, float b2)
 {
-	int index = 0;
-
-	for (index = 0; index < NumSamples; index = index + channels)
-	{
-		sample_t out = FILT->a1 * Buff[index] + FILT->a2 * FILT->buff_in1[0] +
-			FILT->a3 * FILT->buff_in1[1] - FILT->b1 * FILT->buff_out1[0] -
-			FILT->b2 * FILT->buff_out1[1];
-		FILT->buff_in1[1] = FILT->buff_in1[0]; //in(n-2) = in(n-1)
-		FILT->buff_in1[0] = Buff[index]; // in(n-1) = in
-		FILT->buff_out1[1] = FILT->buff_out1[0]; //out(n-2) = out(n-1)
-		FILT->buff_out1[0] = out; //out(n-1) = out
-
-		Buff[index] = clip_float(out);
-		/*process second channel*/
-		if(channels > 1)
-		{
-			out = FILT->a1 * Buff[index+1] + FILT->a2 * FILT->buff_in2[0] +
-				FILT->a3 * FILT->buff_in2[1] - FILT->b1 * FILT->buff_out2[0] -
-				FILT->b2 * FILT->buff_out2[1];
-			FILT->buff_in2[1] = FILT->buff_in2[0]; //in(n-2) = in(n-1)
-			FILT->buff_in2[0] = Buff[index+1]; // in(n-1) = in
-			FILT->buff_out2[1] = FILT->buff_out2[0]; //out(n-2) = out(n-1)
-			FILT->buff_out2[0] = out; //out(n-1) = out
-
-			Buff[index+1] = clip_float(out);
-		}
-	}
+	bq->b0 = a1;
+	bq->b1 = a2;
+	bq->b2 = a3;
+	bq->a1 = b1;
+	bq->a2 = b2;
+	bq->state = fx_alloc_samples(2 * FX_LANES * groups);
 }
 
 /*
@@ -240,8 +264,9 @@ static void Butt(fx_filt_data_t *FILT,
  *  b1 = 2.0 * ( c*c - 1.0) * a1;
  *  b2 = ( 1.0 - r * c + c * c) * a1;
  * args:
- *   audio_ctx - pointer to audio context
- *   data -pointer to audio buffer to be processed
+ *   bq - pointer to biquad
+ *   groups - lane groups
+ *   samprate - sample rate
  *   cutoff_freq - filter cut off frequency
  *   res - rez amount
  *
@@ -250,29 +275,14 @@ static void Butt(fx_filt_data_t *FILT,
  *
  * returns: none
  */
-static void HPF(audio_context_t *audio_ctx,
-	sample_t *data,
-	int cutoff_freq,
-	float res)
+static void HPF_init(fx_biquad_t *bq, int groups, int samprate, float cutoff_freq, float res)
 {
-	if(aud_fx->HPF == NULL)
-	{
-		float inv_samprate = 1.0 / audio_ctx->samprate;
-		aud_fx->HPF = calloc(1, sizeof(fx_filt_data_t));
-		if(aud_fx->HPF == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (HPF): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->HPF->c = tan(M_PI * cutoff_freq * inv_samprate);
-		aud_fx->HPF->a1 = 1.0 / (1.0 + (res * aud_fx->HPF->c) + (aud_fx->HPF->c * aud_fx->HPF->c));
-		aud_fx->HPF->a2 = -2.0 * aud_fx->HPF->a1;
-		aud_fx->HPF->a3 = aud_fx->HPF->a1;
-		aud_fx->HPF->b1 = 2.0 * ((aud_fx->HPF->c * aud_fx->HPF->c) - 1.0) * aud_fx->HPF->a1;
-		aud_fx->HPF->b2 = (1.0 - (res * aud_fx->HPF->c) + (aud_fx->HPF->c * aud_fx->HPF->c)) * aud_fx->HPF->a1;
-	}
+	float c = tan(M_PI * cutoff_freq / samprate);
+	float a1 = 1.0 / (1.0 + (res * c) + (c * c));
 
-	Butt(aud_fx->HPF, data, audio_ctx->capture_buff_size, audio_ctx->channels);
+	biquad_init(bq, groups, a1, -2.0 * a1, a1,
+		2.0 * ((c * c) - 1.0) * a1,
+		(1.0 - (res * c) + (c * c)) * a1);
 }
 
 /*
@@ -289,8 +299,9 @@ static void HPF(audio_context_t *audio_ctx,
  * b2 = ( 1.0 - r * c + c * c) * a1;
  *
  * args:
- *   audio_ctx - pointer to audio context
- *   data -pointer to audio buffer to be processed
+ *   bq - pointer to biquad
+ *   groups - lane groups
+ *   samprate - sample rate
  *   cutoff_freq - filter cut off frequency
  *   res - rez amount
  *
@@ -299,790 +310,910 @@ static void HPF(audio_context_t *audio_ctx,
  *
  * returns: none
  */
-static void LPF(audio_context_t *audio_ctx,
-	sample_t *data,
-	float cutoff_freq,
-	float res)
+static void LPF_init(fx_biquad_t *bq, int groups, int samprate, float cutoff_freq, float res)
 {
-	if(aud_fx->LPF1 == NULL)
-	{
-		aud_fx->LPF1 = calloc(1, sizeof(fx_filt_data_t));
-		if(aud_fx->LPF1 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (LPF): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->LPF1->c = 1.0 / tan(M_PI * cutoff_freq / audio_ctx->samprate);
-		aud_fx->LPF1->a1 = 1.0 / (1.0 + (res * aud_fx->LPF1->c) + (aud_fx->LPF1->c * aud_fx->LPF1->c));
-		aud_fx->LPF1->a2 = 2.0 * aud_fx->LPF1->a1;
-		aud_fx->LPF1->a3 = aud_fx->LPF1->a1;
-		aud_fx->LPF1->b1 = 2.0 * (1.0 - (aud_fx->LPF1->c * aud_fx->LPF1->c)) * aud_fx->LPF1->a1;
-		aud_fx->LPF1->b2 = (1.0 - (res * aud_fx->LPF1->c) + (aud_fx->LPF1->c * aud_fx->LPF1->c)) * aud_fx->LPF1->a1;
-	}
+	float c = 1.0 / tan(M_PI * cutoff_freq / samprate);
+	float a1 = 1.0 / (1.0 + (res * c) + (c * c));
 
-	Butt(aud_fx->LPF1, data, audio_ctx->capture_buff_size, audio_ctx->channels);
+	biquad_init(bq, groups, a1, 2.0 * a1, a1,
+		2.0 * (1.0 - (c * c)) * a1,
+		(1.0 - (res * c) + (c * c)) * a1);
 }
 
-/* Non-linear amplifier with soft distortion curve.
+/*
+ * clip float samples [-1.0 ; 1.0]
  * args:
- *   input - sample input
+ *   in - float sample
  *
  * asserts:
  *   none
  *
- * returns: processed sample
+ * returns: float sample
  */
-static sample_t CubicAmplifier( sample_t input )
+static inline float clip_float (float in)
 {
-	sample_t out;
-	float temp;
-	if( input < 0 ) /*silence*/
-	{
+	in = (in < -1.0f) ? -1.0f : (in > 1.0f) ? 1.0f : in;
 
-		temp = input + 1.0f;
-		out = (temp * temp * temp) - 1.0f;
-	}
-	else
-	{
-		temp = input - 1.0f;
-		out = (temp * temp * temp) + 1.0f;
-	}
-	return clip_float(out);
+	return in;
 }
 
 /*
- * four paralell Comb filters for reverb
+ * load a block of interleaved frames into the lane group planes
+ * (unused lanes are zeroed)
  * args:
- *   audio_ctx - audio context
- *   data - audio buffer to be processed
- *   delay1_ms - delay for filter 1
- *   delay2_ms - delay for filter 2
- *   delay3_ms - delay for filter 3
- *   delay4_ms - delay for filter 4
- *   gain1 - feed gain for filter 1
- *   gain2 - feed gain for filter 2
- *   gain3 - feed gain for filter 3
- *   gain4 - feed gain for filter 4
- *   in_gain - input line gain
+ *   fx - pointer to fx engine
+ *   in - interleaved samples
+ *   frames - frames to load (<= FX_BLOCK_FRAMES)
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void CombFilter4 (audio_context_t *audio_ctx,
-	sample_t *data,
-	int delay1_ms,
-	int delay2_ms,
-	int delay3_ms,
-	int delay4_ms,
-	float gain1,
-	float gain2,
-	float gain3,
-	float gain4,
-	float in_gain)
+static void fx_load_block(audio_fx_t *fx, const sample_t *in, int frames)
 {
-	int samp=0;
-	/*buff_size in samples*/
+	int ch = fx->channels;
+	int g = 0;
 
-	if (aud_fx->COMB4 == NULL)
+	for(g = 0; g < fx->groups; g++)
 	{
-		aud_fx->COMB4 = calloc(1, sizeof(fx_comb4_data_t));
-		if(aud_fx->COMB4 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-			exit(-1);
-		}
-		/*buff_size in samples*/
-		aud_fx->COMB4->buff_size1 = (int) delay1_ms * (audio_ctx->samprate * 0.001);
-		aud_fx->COMB4->buff_size2 = (int) delay2_ms * (audio_ctx->samprate * 0.001);
-		aud_fx->COMB4->buff_size3 = (int) delay3_ms * (audio_ctx->samprate * 0.001);
-		aud_fx->COMB4->buff_size4 = (int) delay4_ms * (audio_ctx->samprate * 0.001);
-
-		aud_fx->COMB4->CombBuff10 = calloc(aud_fx->COMB4->buff_size1, sizeof(sample_t));
-		if(aud_fx->COMB4->CombBuff10 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->COMB4->CombBuff20 = calloc(aud_fx->COMB4->buff_size2, sizeof(sample_t));
-		if(aud_fx->COMB4->CombBuff20 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->COMB4->CombBuff30 = calloc(aud_fx->COMB4->buff_size3, sizeof(sample_t));
-		if(aud_fx->COMB4->CombBuff30 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->COMB4->CombBuff40 = calloc(aud_fx->COMB4->buff_size4, sizeof(sample_t));
-		if(aud_fx->COMB4->CombBuff40 == NULL)
+		sample_t *plane = fx->work + g * FX_PLANE_SIZE;
+		const sample_t *src = in + g * FX_LANES;
+		int lanes = ch - g * FX_LANES;
+		int i = 0;
+
+		if(lanes >= FX_LANES)
 		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-			exit(-1);
+			for(i = 0; i < frames; i++)
+				memcpy(plane + i * FX_LANES, src + i * ch, FX_LANES * sizeof(sample_t));
 		}
-		aud_fx->COMB4->CombBuff11 = NULL;
-		aud_fx->COMB4->CombBuff21 = NULL;
-		aud_fx->COMB4->CombBuff31 = NULL;
-		aud_fx->COMB4->CombBuff41 = NULL;
-		if(audio_ctx->channels > 1)
+		else
 		{
-			aud_fx->COMB4->CombBuff11 = calloc(aud_fx->COMB4->buff_size1, sizeof(sample_t));
-			if(aud_fx->COMB4->CombBuff11 == NULL)
-			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-				exit(-1);
-			}
-			aud_fx->COMB4->CombBuff21 = calloc(aud_fx->COMB4->buff_size2, sizeof(sample_t));
-			if(aud_fx->COMB4->CombBuff21 == NULL)
-			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-				exit(-1);
-			}
-			aud_fx->COMB4->CombBuff31 = calloc(aud_fx->COMB4->buff_size3, sizeof(sample_t));
-			if(aud_fx->COMB4->CombBuff31 == NULL)
-			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-				exit(-1);
-			}
-			aud_fx->COMB4->CombBuff41 = calloc(aud_fx->COMB4->buff_size4, sizeof(sample_t));
-			if(aud_fx->COMB4->CombBuff41 == NULL)
+			memset(plane, 0, frames * FX_LANES * sizeof(sample_t));
+			for(i = 0; i < frames; i++)
 			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (CombFilter4): %s\n", strerror(errno));
-				exit(-1);
+				int l = 0;
+				for(l = 0; l < lanes; l++)
+					plane[i * FX_LANES + l] = src[i * ch + l];
 			}
 		}
 	}
-
-	for(samp = 0; samp < audio_ctx->capture_buff_size; samp = samp + audio_ctx->channels)
-	{
-		sample_t out1 = in_gain * data[samp] +
-			gain1 * aud_fx->COMB4->CombBuff10[aud_fx->COMB4->CombIndex1];
-		sample_t out2 = in_gain * data[samp] +
-			gain2 * aud_fx->COMB4->CombBuff20[aud_fx->COMB4->CombIndex2];
-		sample_t out3 = in_gain * data[samp] +
-			gain3 * aud_fx->COMB4->CombBuff30[aud_fx->COMB4->CombIndex3];
-		sample_t out4 = in_gain * data[samp] +
-			gain4 * aud_fx->COMB4->CombBuff40[aud_fx->COMB4->CombIndex4];
-
-		aud_fx->COMB4->CombBuff10[aud_fx->COMB4->CombIndex1] = data[samp] +
-			gain1 * aud_fx->COMB4->CombBuff10[aud_fx->COMB4->CombIndex1];
-		aud_fx->COMB4->CombBuff20[aud_fx->COMB4->CombIndex2] = data[samp] +
-			gain2 * aud_fx->COMB4->CombBuff20[aud_fx->COMB4->CombIndex2];
-		aud_fx->COMB4->CombBuff30[aud_fx->COMB4->CombIndex3] = data[samp] +
-			gain3 * aud_fx->COMB4->CombBuff30[aud_fx->COMB4->CombIndex3];
-		aud_fx->COMB4->CombBuff40[aud_fx->COMB4->CombIndex4] = data[samp] +
-			gain4 * aud_fx->COMB4->CombBuff40[aud_fx->COMB4->CombIndex4];
-
-		data[samp] = clip_float(out1 + out2 + out3 + out4);
-
-		/*if stereo process second channel */
-		if(audio_ctx->channels > 1)
-		{
-			out1 = in_gain * data[samp+1] +
-				gain1 * aud_fx->COMB4->CombBuff11[aud_fx->COMB4->CombIndex1];
-			out2 = in_gain * data[samp+1] +
-				gain2 * aud_fx->COMB4->CombBuff21[aud_fx->COMB4->CombIndex2];
-			out3 = in_gain * data[samp+1] +
-				gain3 * aud_fx->COMB4->CombBuff31[aud_fx->COMB4->CombIndex3];
-			out4 = in_gain * data[samp+1] +
-				gain4 * aud_fx->COMB4->CombBuff41[aud_fx->COMB4->CombIndex4];
-
-			aud_fx->COMB4->CombBuff11[aud_fx->COMB4->CombIndex1] = data[samp+1] +
-				gain1 * aud_fx->COMB4->CombBuff11[aud_fx->COMB4->CombIndex1];
-			aud_fx->COMB4->CombBuff21[aud_fx->COMB4->CombIndex2] = data[samp+1] +
-				gain2 * aud_fx->COMB4->CombBuff21[aud_fx->COMB4->CombIndex2];
-			aud_fx->COMB4->CombBuff31[aud_fx->COMB4->CombIndex3] = data[samp+1] +
-				gain3 * aud_fx->COMB4->CombBuff31[aud_fx->COMB4->CombIndex3];
-			aud_fx->COMB4->CombBuff41[aud_fx->COMB4->CombIndex4] = data[samp+1] +
-				gain4 * aud_fx->COMB4->CombBuff41[aud_fx->COMB4->CombIndex4];
-
-			data[samp+1] = clip_float(out1 + out2 + out3 + out4);
-		}
-
-		if(++(aud_fx->COMB4->CombIndex1) >= aud_fx->COMB4->buff_size1) aud_fx->COMB4->CombIndex1=0;
-		if(++(aud_fx->COMB4->CombIndex2) >= aud_fx->COMB4->buff_size2) aud_fx->COMB4->CombIndex2=0;
-		if(++(aud_fx->COMB4->CombIndex3) >= aud_fx->COMB4->buff_size3) aud_fx->COMB4->CombIndex3=0;
-		if(++(aud_fx->COMB4->CombIndex4) >= aud_fx->COMB4->buff_size4) aud_fx->COMB4->CombIndex4=0;
-	}
 }
 
 /*
- * All pass filter
+ * store the lane group planes back to interleaved frames
  * args:
- *   AP - pointer to fx_delay_data_t
- *   Buff -pointer to sample buffer
- *   NumSamples - number of samples in buffer
- *   channels -number of audio channels
- *   gain- filter gain
+ *   fx - pointer to fx engine
+ *   out - interleaved samples
+ *   frames - frames to store (<= FX_BLOCK_FRAMES)
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void all_pass (fx_delay_data_t *AP,
-	sample_t *Buff,
-	int NumSamples,
-	int channels,
-	float gain)
+static void fx_store_block(audio_fx_t *fx, sample_t *out, int frames)
 {
-	int samp = 0;
-	float inv_gain = 1.0 / gain;
+	int ch = fx->channels;
+	int g = 0;
 
-	for(samp = 0; samp < NumSamples; samp += channels)
+	for(g = 0; g < fx->groups; g++)
 	{
-		AP->delayBuff1[AP->delayIndex] = Buff[samp] +
-			(gain * AP->delayBuff1[AP->delayIndex]);
-		Buff[samp] = ((AP->delayBuff1[AP->delayIndex] * (1 - gain*gain)) -
-			Buff[samp]) * inv_gain;
-		if(channels > 1)
-		{
-			AP->delayBuff2[AP->delayIndex] = Buff[samp+1] +
-				(gain * AP->delayBuff2[AP->delayIndex]);
-			Buff[samp+1] = ((AP->delayBuff2[AP->delayIndex] * (1 - gain*gain)) -
-				Buff[samp+1]) * inv_gain;
-		}
+		const sample_t *plane = fx->work + g * FX_PLANE_SIZE;
+		sample_t *dst = out + g * FX_LANES;
+		int lanes = ch - g * FX_LANES;
+		int i = 0;
+
+		if(lanes > FX_LANES)
+			lanes = FX_LANES;
 
-		if(++(AP->delayIndex) >= AP->buff_size) AP->delayIndex=0;
+		for(i = 0; i < frames; i++)
+			memcpy(dst + i * ch, plane + i * FX_LANES, lanes * sizeof(sample_t));
 	}
 }
 
 /*
- * All pass for reverb
+ * biquad filter (one channel per vector lane)
  * args:
- * 	 audio_ctx - audio context
- *   data - audio buffer to be processed
- *   delay_ms - delay in ms
- *   gain - filter gain
+ *   bq - pointer to biquad
+ *   fx - pointer to fx engine
+ *   frames - frames in block
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void all_pass1 (audio_context_t *audio_ctx,
-	sample_t *data,
-	int delay_ms,
-	float gain)
+static void biquad_process(fx_biquad_t *bq, audio_fx_t *fx, int frames)
 {
-	if(aud_fx->AP1 == NULL)
+	int g = 0;
+
+	for(g = 0; g < fx->groups; g++)
 	{
-		aud_fx->AP1 = calloc(1, sizeof(fx_delay_data_t));
-		if(aud_fx->AP1 == NULL)
+		sample_t *plane = fx->work + g * FX_PLANE_SIZE;
+		sample_t *state = bq->state + g * 2 * FX_LANES;
+		int i = 0;
+
+#if defined(__SSE2__)
+		__m128 b0 = _mm_set1_ps(bq->b0);
+		__m128 b1 = _mm_set1_ps(bq->b1);
+		__m128 b2 = _mm_set1_ps(bq->b2);
+		__m128 a1 = _mm_set1_ps(bq->a1);
+		__m128 a2 = _mm_set1_ps(bq->a2);
+		__m128 lo = _mm_set1_ps(-1.0f);
+		__m128 hi = _mm_set1_ps(1.0f);
+		__m128 s1 = _mm_load_ps(state);
+		__m128 s2 = _mm_load_ps(state + FX_LANES);
+
+		for(i = 0; i < frames; i++)
 		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (all_pass1): %s\n", strerror(errno));
-			exit(-1);
+			__m128 x = _mm_load_ps(plane + i * FX_LANES);
+			__m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+			s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), s2);
+			s2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+			_mm_store_ps(plane + i * FX_LANES, _mm_min_ps(_mm_max_ps(y, lo), hi));
 		}
-		aud_fx->AP1->buff_size = (int) delay_ms  * (audio_ctx->samprate * 0.001);
-		aud_fx->AP1->delayBuff1 = calloc(aud_fx->AP1->buff_size, sizeof(sample_t));
-		if(aud_fx->AP1->delayBuff1 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (all_pass1): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->AP1->delayBuff2 = NULL;
-		if(audio_ctx->channels > 1)
+
+		_mm_store_ps(state, s1);
+		_mm_store_ps(state + FX_LANES, s2);
+#else
+		for(i = 0; i < frames; i++)
 		{
-			aud_fx->AP1->delayBuff2 = calloc(aud_fx->AP1->buff_size, sizeof(sample_t));
-			if(aud_fx->AP1->delayBuff2 == NULL)
+			int l = 0;
+			for(l = 0; l < FX_LANES; l++)
 			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (all_pass1): %s\n", strerror(errno));
-				exit(-1);
+				float x = plane[i * FX_LANES + l];
+				float y = bq->b0 * x + state[l];
+				state[l] = bq->b1 * x - bq->a1 * y + state[FX_LANES + l];
+				state[FX_LANES + l] = bq->b2 * x - bq->a2 * y;
+				plane[i * FX_LANES + l] = clip_float(y);
 			}
 		}
+#endif
 	}
-
-	all_pass (aud_fx->AP1, data,
-		audio_ctx->capture_buff_size, audio_ctx->channels, gain);
 }
 
 /*
- * reduce number of samples with linear interpolation
- *    rate - rate of samples to remove [1,...[
- *    rate = 1-> XXX (splits channels) 2 -> X0X0X  3 -> X00X00X 4 -> X000X000X
+ * echo kernel: out = clip(in_gain * in + (1 - in_gain) * delay); delay = in + decay * delay
  * args:
- *   RT - pointer to fx_rate_data_t
- *   Buff - pointer to sample buffer
- *   rate - rate of samples to remove
- *   NumSamples - samples in buffer
- *   channels - audio channels
+ *   out - output samples (may be in)
+ *   in - input samples
+ *   buff - delay line samples (same positions)
+ *   n - number of samples
+ *   decay - feedback gain
+ *   in_gain - input line gain
  *
  * asserts:
+ *   none
  *
  * returns: none
  */
-static void change_rate_less(fx_rate_data_t *RT,
-	sample_t *Buff,
-	int rate,
-	int NumSamples,
-	int channels)
+static void echo_kernel(sample_t *out, const sample_t *in, sample_t *buff,
+	int n, float decay, float in_gain)
 {
-	int samp = 0;
-	int n = 0, i = 0;
+	int i = 0;
+	float dl_gain = 1.0f - in_gain;
 
-	for (samp = 0; samp < NumSamples; samp += channels)
-	{
-		if (n==0)
-		{
-			RT->rBuff1[i] = Buff[samp];
-			if(channels > 1)
-				RT->rBuff2[i] = Buff[samp + 1];
+#if defined(__SSE2__)
+	__m128 g_in = _mm_set1_ps(in_gain);
+	__m128 g_dl = _mm_set1_ps(dl_gain);
+	__m128 g_fb = _mm_set1_ps(decay);
+	__m128 lo = _mm_set1_ps(-1.0f);
+	__m128 hi = _mm_set1_ps(1.0f);
 
-			i++;
-		}
-		if(++n >= rate) n=0;
+	for(; i + 4 <= n; i += 4)
+	{
+		__m128 x = _mm_load_ps(in + i);
+		__m128 d = _mm_load_ps(buff + i);
+		__m128 y = _mm_add_ps(_mm_mul_ps(g_in, x), _mm_mul_ps(g_dl, d));
+		_mm_store_ps(buff + i, _mm_add_ps(x, _mm_mul_ps(g_fb, d)));
+		_mm_store_ps(out + i, _mm_min_ps(_mm_max_ps(y, lo), hi));
+	}
+#endif
+	for(; i < n; i++)
+	{
+		float x = in[i];
+		float d = buff[i];
+		buff[i] = x + decay * d;
+		out[i] = clip_float(in_gain * x + dl_gain * d);
 	}
-	RT->numsamples = i;
 }
 
 /*
- * increase audio tempo by adding audio windows of wtime_ms in given rate
- *   rate: 2 -> [w1..w2][w1..w2][w2..w3][w2..w3]  3-> [w1..w2][w1..w2][w1..w2][w2..w3][w2..w3][w2..w3]
+ * comb kernel: out += in_gain * in + gain * delay; delay = in + gain * delay
  * args:
- *   audio_ctx - audio context
- *   data - audio buffer to be processed
- *   rate -rate of added windows
- *   wtime_ms - window time in ms
+ *   out - accumulator samples
+ *   in - input samples
+ *   buff - delay line samples (same positions)
+ *   n - number of samples
+ *   gain - feedback gain
+ *   in_gain - input line gain
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void change_tempo_more(audio_context_t *audio_ctx,
-	sample_t *data,
-	int rate,
-	int	wtime_ms)
+static void comb_kernel(sample_t *out, const sample_t *in, sample_t *buff,
+	int n, float gain, float in_gain)
 {
-	int samp = 0;
 	int i = 0;
-	int r = 0;
-	int index = 0;
 
-	if(aud_fx->RT1->wBuff1 == NULL)
+#if defined(__SSE2__)
+	__m128 g = _mm_set1_ps(gain);
+	__m128 g_in = _mm_set1_ps(in_gain);
+
+	for(; i + 4 <= n; i += 4)
 	{
-		aud_fx->RT1->wSize  = wtime_ms * audio_ctx->samprate * 0.001;
-		aud_fx->RT1->wBuff1 = calloc(aud_fx->RT1->wSize, sizeof(sample_t));
-		if(aud_fx->RT1->wBuff1 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (change_tempo_more): %s\n", strerror(errno));
-			exit(-1);
-		}
-		if (audio_ctx->channels >1)
-		{
-			aud_fx->RT1->wBuff2 = calloc(aud_fx->RT1->wSize, sizeof(sample_t));
-			if(aud_fx->RT1->wBuff2 == NULL)
-			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (change_tempo_more): %s\n", strerror(errno));
-				exit(-1);
-			}
-		}
+		__m128 x = _mm_load_ps(in + i);
+		__m128 d = _mm_mul_ps(g, _mm_load_ps(buff + i));
+		__m128 a = _mm_add_ps(_mm_load_ps(out + i), _mm_add_ps(_mm_mul_ps(g_in, x), d));
+		_mm_store_ps(out + i, a);
+		_mm_store_ps(buff + i, _mm_add_ps(x, d));
 	}
-
-	//printf("samples  = %i\n", data->RT1->numsamples);
-	for(samp = 0; samp < aud_fx->RT1->numsamples; samp++)
+#endif
+	for(; i < n; i++)
 	{
-		aud_fx->RT1->wBuff1[i] = aud_fx->RT1->rBuff1[samp];
-		if(audio_ctx->channels > 1)
-			aud_fx->RT1->wBuff2[i] = aud_fx->RT1->rBuff2[samp];
-
-		if((++i) > aud_fx->RT1->wSize)
-		{
-			for (r = 0; r < rate; r++)
-			{
-				for(i = 0; i < aud_fx->RT1->wSize; i++)
-				{
-					data[index] = aud_fx->RT1->wBuff1[i];
-					if (audio_ctx->channels > 1)
-						data[index +1] = aud_fx->RT1->wBuff2[i];
-					index += audio_ctx->channels;
-				}
-			}
-			i = 0;
-		}
+		float d = gain * buff[i];
+		out[i] += in_gain * in[i] + d;
+		buff[i] = in[i] + d;
 	}
 }
 
-#define FUZZ(x) CubicAmplifier(CubicAmplifier(CubicAmplifier(CubicAmplifier(x))))
-
 /*
- * Fuzz distortion
+ * all pass kernel: delay = in + gain * delay; out = (delay * (1 - gain^2) - in) / gain
  * args:
- *   audio_ctx - audio context
- *   data - audio buffer to be processed
+ *   out - output samples (may be in)
+ *   in - input samples
+ *   buff - delay line samples (same positions)
+ *   n - number of samples
+ *   gain - filter gain
+ *   in_gain - not used
  *
  * asserts:
- *    audio_ctx is not null
+ *   none
  *
  * returns: none
  */
-static void audio_fx_fuzz (audio_context_t *audio_ctx, sample_t *data)
+static void all_pass_kernel(sample_t *out, const sample_t *in, sample_t *buff,
+	int n, float gain, float in_gain)
 {
-	/*assertions*/
-	assert(audio_ctx != NULL);
+	int i = 0;
+	float inv_gain = 1.0f / gain;
+	float out_gain = 1.0f - gain * gain;
+
+#if defined(__SSE2__)
+	__m128 g = _mm_set1_ps(gain);
+	__m128 g_inv = _mm_set1_ps(inv_gain);
+	__m128 g_out = _mm_set1_ps(out_gain);
 
-	int samp=0;
-	for(samp = 0; samp < audio_ctx->capture_buff_size; samp++)
-		data[samp] = FUZZ(data[samp]);
-	HPF(audio_ctx, data, 1000, 0.9);
+	for(; i + 4 <= n; i += 4)
+	{
+		__m128 x = _mm_load_ps(in + i);
+		__m128 d = _mm_add_ps(x, _mm_mul_ps(g, _mm_load_ps(buff + i)));
+		_mm_store_ps(buff + i, d);
+		_mm_store_ps(out + i, _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(d, g_out), x), g_inv));
+	}
+#endif
+	for(; i < n; i++)
+	{
+		float x = in[i];
+		float d = x + gain * buff[i];
+		buff[i] = d;
+		out[i] = (d * out_gain - x) * inv_gain;
+	}
 }
 
 /*
- * Echo effect
+ * run a delay line kernel over all the lane group planes of a block
+ * (each plane is split at the delay line wrap point)
  * args:
- *   audio_ctx - audio context
- *   data - audio buffer to be processed
- *   delay_ms - echo delay in ms (e.g: 300)
- *   decay - feedback gain (<1)  (e.g: 0.5)
+ *   delay - pointer to delay line
+ *   fx - pointer to fx engine
+ *   out - output planes (FX_PLANE_SIZE stride)
+ *   in - input planes (FX_PLANE_SIZE stride)
+ *   frames - frames in block
+ *   kernel - delay kernel
+ *   gain - kernel gain
+ *   in_gain - kernel input gain
  *
  * asserts:
- *   audio_ctx is not null
+ *   none
  *
  * returns: none
  */
-static void audio_fx_echo(audio_context_t *audio_ctx,
-	sample_t *data,
-	int delay_ms,
-	float decay)
+static void delay_process(fx_delay_t *delay, audio_fx_t *fx,
+	sample_t *out, const sample_t *in, int frames,
+	fx_delay_kernel_t kernel, float gain, float in_gain)
 {
-	/*assertions*/
-	assert(audio_ctx != NULL);
-
-	int samp = 0;
+	int g = 0;
 
-	if(aud_fx->ECHO == NULL)
+	for(g = 0; g < fx->groups; g++)
 	{
-		aud_fx->ECHO = calloc(1, sizeof(fx_delay_data_t));
-		if(aud_fx->ECHO == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_echo): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->ECHO->buff_size = (int) delay_ms * audio_ctx->samprate * 0.001;
-		aud_fx->ECHO->delayBuff1 = calloc(aud_fx->ECHO->buff_size, sizeof(sample_t));
-		if(aud_fx->ECHO->delayBuff1 == NULL)
+		sample_t *buff = delay->buff + g * delay->frames * FX_LANES;
+		int index = delay->index;
+		int done = 0;
+
+		while(done < frames)
 		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_echo): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->ECHO->delayBuff2 = NULL;
-		if(audio_ctx->channels > 1)
-		{
-			aud_fx->ECHO->delayBuff2 = calloc(aud_fx->ECHO->buff_size, sizeof(sample_t));
-			if(aud_fx->ECHO->delayBuff2 == NULL)
-			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_echo): %s\n", strerror(errno));
-				exit(-1);
-			}
+			int n = delay->frames - index;
+			if(n > frames - done)
+				n = frames - done;
+
+			kernel(out + g * FX_PLANE_SIZE + done * FX_LANES,
+				in + g * FX_PLANE_SIZE + done * FX_LANES,
+				buff + index * FX_LANES, n * FX_LANES, gain, in_gain);
+
+			index += n;
+			if(index >= delay->frames)
+				index = 0;
+			done += n;
 		}
 	}
 
-	for(samp = 0; samp < audio_ctx->capture_buff_size; samp = samp + audio_ctx->channels)
+	delay->index = (delay->index + frames) % delay->frames;
+}
+
+#if defined(__SSE2__)
+/*
+ * Non-linear amplifier with soft distortion curve (sse2)
+ * args:
+ *   x - input samples
+ *
+ * asserts:
+ *   none
+ *
+ * returns: processed samples
+ */
+static inline __m128 cubic_amplifier_sse2(__m128 x)
+{
+	/*s = -1 for negative input, 1 otherwise*/
+	__m128 neg = _mm_cmplt_ps(x, _mm_setzero_ps());
+	__m128 s = _mm_or_ps(_mm_and_ps(neg, _mm_set1_ps(-1.0f)),
+		_mm_andnot_ps(neg, _mm_set1_ps(1.0f)));
+	__m128 t = _mm_sub_ps(x, s);
+	__m128 out = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), s);
+
+	return _mm_min_ps(_mm_max_ps(out, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+}
+#endif
+
+/* Non-linear amplifier with soft distortion curve.
+ * args:
+ *   input - sample input
+ *
+ * asserts:
+ *   none
+ *
+ * returns: processed sample
+ */
+static inline sample_t CubicAmplifier( sample_t input )
+{
+	sample_t out;
+	float temp;
+	if( input < 0 ) /*silence*/
 	{
-		sample_t out = (0.7 * data[samp]) +
-			(0.3 * aud_fx->ECHO->delayBuff1[aud_fx->ECHO->delayIndex]);
-		aud_fx->ECHO->delayBuff1[aud_fx->ECHO->delayIndex] = data[samp] +
-			(aud_fx->ECHO->delayBuff1[aud_fx->ECHO->delayIndex] * decay);
-		data[samp] = clip_float(out);
-		/*if stereo process second channel in separate*/
-		if (audio_ctx->channels > 1)
-		{
-			out = (0.7 * data[samp+1]) +
-				(0.3 * aud_fx->ECHO->delayBuff2[aud_fx->ECHO->delayIndex]);
-			aud_fx->ECHO->delayBuff2[aud_fx->ECHO->delayIndex] = data[samp] +
-				(aud_fx->ECHO->delayBuff2[aud_fx->ECHO->delayIndex] * decay);
-			data[samp+1] = clip_float(out);
-		}
 
-		if(++(aud_fx->ECHO->delayIndex) >= aud_fx->ECHO->buff_size) aud_fx->ECHO->delayIndex=0;
+		temp = input + 1.0f;
+		out = (temp * temp * temp) - 1.0f;
 	}
+	else
+	{
+		temp = input - 1.0f;
+		out = (temp * temp * temp) + 1.0f;
+	}
+	return clip_float(out);
 }
 
+#define FUZZ(x) CubicAmplifier(CubicAmplifier(CubicAmplifier(CubicAmplifier(x))))
+
 /*
- * Reverb effect
+ * Echo effect
  * args:
- *   audio_ctx - audio context
- *   data - audio buffer to be processed
- *   delay_ms - reverb delay in ms
+ *   fx - pointer to fx engine
+ *   frames - frames in block
  *
  * asserts:
- *   audio_ctx is not null
+ *   none
  *
  * returns: none
  */
-static void audio_fx_reverb (audio_context_t *audio_ctx,
-	sample_t *data,
-	int delay_ms)
+static void audio_fx_echo(audio_fx_t *fx, int frames)
 {
-	/*assertions*/
-	assert(audio_ctx != NULL);
-
-	/*4 parallel comb filters*/
-	CombFilter4 (audio_ctx, data,
-		delay_ms, delay_ms - 5, delay_ms -10, delay_ms -15,
-		0.55, 0.6, 0.5, 0.45, 0.7);
-	
-	/*all pass*/
-	all_pass1 (audio_ctx, data, delay_ms, 0.75);
+	delay_process(&fx->echo, fx, fx->work, fx->work, frames,
+		echo_kernel, fx->echo_decay, 0.7);
 }
 
-#define lfoskipsamples 30
-
 /*
- * WahWah effect
- * 	  !!!!!!!!!!!!! IMPORTANT!!!!!!!!! :
- * 	  depth and freqofs should be from 0(min) to 1(max) !
- * 	  res should be greater than 0 !
+ * Reverb effect: four parallel comb filters followed by an all pass
  * args:
- *   audio_ctx - audio context
- *   data - audio buffer to be processed
- *   freq - LFO frequency (1.5)
- *   startphase - LFO startphase in RADIANS - usefull for stereo WahWah (0)
- *   depth - Wah depth (0.7)
- *   freqofs - Wah frequency offset (0.3)
- *   res - Resonance (2.5)
+ *   fx - pointer to fx engine
+ *   frames - frames in block
  *
  * asserts:
- *   audio_ctx is not null
+ *   none
  *
  * returns: none
  */
-static void audio_fx_wahwah (audio_context_t *audio_ctx,
-	sample_t *data,
-	float freq,
-	float startphase,
-	float depth,
-	float freqofs,
-	float res)
+static void audio_fx_reverb (audio_fx_t *fx, int frames)
 {
-	/*assertions*/
-	assert(audio_ctx != NULL);
+	int c = 0;
+	int g = 0;
+
+	for(g = 0; g < fx->groups; g++)
+		memset(fx->scratch + g * FX_PLANE_SIZE, 0, frames * FX_LANES * sizeof(sample_t));
 
-	float frequency, omega, sn, cs, alpha;
+	for(c = 0; c < 4; c++)
+		delay_process(&fx->comb[c], fx, fx->scratch, fx->work, frames,
+			comb_kernel, fx->comb_gain[c], fx->comb_in_gain);
 
-	if(aud_fx->wahData == NULL)
+	for(g = 0; g < fx->groups; g++)
 	{
-		aud_fx->wahData = calloc(1, sizeof(fx_wah_data_t));
-		if(aud_fx->wahData == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_wahwah): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->wahData->lfoskip = freq * 2 * M_PI / audio_ctx->samprate;
-		aud_fx->wahData->phase = startphase;
-		/*if right channel set: phase += (float)M_PI;*/
+		sample_t *plane = fx->work + g * FX_PLANE_SIZE;
+		sample_t *acc = fx->scratch + g * FX_PLANE_SIZE;
+		int i = 0;
+		for(i = 0; i < frames * FX_LANES; i++)
+			plane[i] = clip_float(acc[i]);
 	}
 
-	int samp = 0;
-	for(samp = 0; samp < audio_ctx->capture_buff_size; samp++)
+	delay_process(&fx->ap, fx, fx->work, fx->work, frames,
+		all_pass_kernel, fx->ap_gain, 0);
+}
+
+/*
+ * Fuzz distortion
+ * args:
+ *   fx - pointer to fx engine
+ *   frames - frames in block
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void audio_fx_fuzz (audio_fx_t *fx, int frames)
+{
+	int g = 0;
+
+	for(g = 0; g < fx->groups; g++)
 	{
-		float in = data[samp];
+		sample_t *plane = fx->work + g * FX_PLANE_SIZE;
+		int n = frames * FX_LANES;
+		int samp = 0;
 
-		if ((aud_fx->wahData->skipcount++) % lfoskipsamples == 0)
+#if defined(__SSE2__)
+		for(; samp + 4 <= n; samp += 4)
 		{
-			frequency = (1 + cos(aud_fx->wahData->skipcount * aud_fx->wahData->lfoskip + aud_fx->wahData->phase)) * 0.5;
-			frequency = frequency * depth * (1 - freqofs) + freqofs;
-			frequency = exp((frequency - 1) * 6);
-			omega = M_PI * frequency;
-			sn = sin(omega);
-			cs = cos(omega);
-			alpha = sn / (2 * res);
-			aud_fx->wahData->b0 = (1 - cs) * 0.5;
-			aud_fx->wahData->b1 = 1 - cs;
-			aud_fx->wahData->b2 = (1 - cs) * 0.5;
-			aud_fx->wahData->a0 = 1 + alpha;
-			aud_fx->wahData->a1 = -2 * cs;
-			aud_fx->wahData->a2 = 1 - alpha;
+			__m128 x = _mm_load_ps(plane + samp);
+			x = cubic_amplifier_sse2(cubic_amplifier_sse2(x));
+			x = cubic_amplifier_sse2(cubic_amplifier_sse2(x));
+			_mm_store_ps(plane + samp, x);
 		}
-		float out = (aud_fx->wahData->b0 * in + aud_fx->wahData->b1 * aud_fx->wahData->xn1 +
-			aud_fx->wahData->b2 * aud_fx->wahData->xn2 - aud_fx->wahData->a1 * aud_fx->wahData->yn1 -
-			aud_fx->wahData->a2 * aud_fx->wahData->yn2) / aud_fx->wahData->a0;
-		aud_fx->wahData->xn2 = aud_fx->wahData->xn1;
-		aud_fx->wahData->xn1 = in;
-		aud_fx->wahData->yn2 = aud_fx->wahData->yn1;
-		aud_fx->wahData->yn1 = out;
-
-		data[samp] = clip_float(out);
+#endif
+		for(; samp < n; samp++)
+			plane[samp] = FUZZ(plane[samp]);
 	}
+
+	biquad_process(&fx->hpf, fx, frames);
 }
 
 /*
- * change pitch effect
+ * WahWah filter for a run of frames with constant coefficients
  * args:
- *   audio_ctx - audio context
- *   data - audio buffer to be processed
- *   rate - window rate
+ *   wah - pointer to wahwah data
+ *   plane - lane group plane
+ *   state - lane group state (xn1, xn2, yn1, yn2)
+ *   frames - frames to process
  *
  * asserts:
- *   audio_ctx is not null
+ *   none
  *
  * returns: none
  */
-static void audio_fx_change_pitch (audio_context_t *audio_ctx,
-	sample_t *data,
-	int rate)
+static void wahwah_run(fx_wah_data_t *wah, sample_t *plane, sample_t *state, int frames)
 {
-	if(aud_fx->RT1 == NULL)
+	int i = 0;
+
+#if defined(__SSE2__)
+	__m128 b0 = _mm_set1_ps(wah->b0);
+	__m128 b1 = _mm_set1_ps(wah->b1);
+	__m128 b2 = _mm_set1_ps(wah->b2);
+	__m128 a1 = _mm_set1_ps(wah->a1);
+	__m128 a2 = _mm_set1_ps(wah->a2);
+	__m128 lo = _mm_set1_ps(-1.0f);
+	__m128 hi = _mm_set1_ps(1.0f);
+	__m128 xn1 = _mm_load_ps(state);
+	__m128 xn2 = _mm_load_ps(state + FX_LANES);
+	__m128 yn1 = _mm_load_ps(state + 2 * FX_LANES);
+	__m128 yn2 = _mm_load_ps(state + 3 * FX_LANES);
+
+	for(i = 0; i < frames; i++)
 	{
-		aud_fx->RT1 = calloc(1, sizeof(fx_rate_data_t));
-		if(aud_fx->RT1 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_change_pitch): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->RT1->wBuff1 = NULL;
-		aud_fx->RT1->wBuff2 = NULL;
-		aud_fx->RT1->rBuff1 = calloc(audio_ctx->capture_buff_size/audio_ctx->channels, sizeof(sample_t));
-		if(aud_fx->RT1->rBuff1 == NULL)
-		{
-			fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_change_pitch): %s\n", strerror(errno));
-			exit(-1);
-		}
-		aud_fx->RT1->rBuff2 = NULL;
-		if(audio_ctx->channels > 1)
+		__m128 in = _mm_load_ps(plane + i * FX_LANES);
+		__m128 out = _mm_add_ps(_mm_mul_ps(b0, in),
+			_mm_add_ps(_mm_mul_ps(b1, xn1), _mm_mul_ps(b2, xn2)));
+		out = _mm_sub_ps(out, _mm_add_ps(_mm_mul_ps(a1, yn1), _mm_mul_ps(a2, yn2)));
+		xn2 = xn1;
+		xn1 = in;
+		yn2 = yn1;
+		yn1 = out;
+		_mm_store_ps(plane + i * FX_LANES, _mm_min_ps(_mm_max_ps(out, lo), hi));
+	}
+
+	_mm_store_ps(state, xn1);
+	_mm_store_ps(state + FX_LANES, xn2);
+	_mm_store_ps(state + 2 * FX_LANES, yn1);
+	_mm_store_ps(state + 3 * FX_LANES, yn2);
+#else
+	for(i = 0; i < frames; i++)
+	{
+		int l = 0;
+		for(l = 0; l < FX_LANES; l++)
 		{
-			aud_fx->RT1->rBuff2 = calloc(audio_ctx->capture_buff_size/audio_ctx->channels, sizeof(sample_t));
-			if(aud_fx->RT1->rBuff2 == NULL)
-			{
-				fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_fx_change_pitch): %s\n", strerror(errno));
-				exit(-1);
-			}
+			float *s = state + l;
+			float in = plane[i * FX_LANES + l];
+			float out = wah->b0 * in + wah->b1 * s[0] + wah->b2 * s[FX_LANES] -
+				wah->a1 * s[2 * FX_LANES] - wah->a2 * s[3 * FX_LANES];
+			s[FX_LANES] = s[0];
+			s[0] = in;
+			s[3 * FX_LANES] = s[2 * FX_LANES];
+			s[2 * FX_LANES] = out;
+			plane[i * FX_LANES + l] = clip_float(out);
 		}
 	}
-
-	change_rate_less(aud_fx->RT1, data, rate, audio_ctx->capture_buff_size, audio_ctx->channels);
-	change_tempo_more(audio_ctx, data, rate, 20);
-	LPF(audio_ctx, data, audio_ctx->samprate * 0.25, 0.9);
+#endif
 }
 
 /*
- * clean fx_delay_data_t
+ * WahWah effect
+ * 	  !!!!!!!!!!!!! IMPORTANT!!!!!!!!! :
+ * 	  depth and freqofs should be from 0(min) to 1(max) !
+ * 	  res should be greater than 0 !
  * args:
- *   DELAY - pointer to fx_delay_data_t
+ *   fx - pointer to fx engine
+ *   frames - frames in block
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void close_DELAY(fx_delay_data_t *DELAY)
+static void audio_fx_wahwah (audio_fx_t *fx, int frames)
 {
-	if(DELAY != NULL)
+	fx_wah_data_t *wah = &fx->wah;
+	int done = 0;
+
+	while(done < frames)
 	{
-		free(DELAY->delayBuff1);
-		free(DELAY->delayBuff2);
-		free(DELAY);
+		int skip = wah->skipcount % lfoskipsamples;
+		if (skip == 0)
+		{
+			/*update the filter coefficients*/
+			float frequency = (1 + cos((wah->skipcount + 1) * wah->lfoskip + wah->phase)) * 0.5;
+			frequency = frequency * fx->wah_depth * (1 - fx->wah_freqofs) + fx->wah_freqofs;
+			frequency = exp((frequency - 1) * 6);
+			float omega = M_PI * frequency;
+			float sn = sin(omega);
+			float cs = cos(omega);
+			float alpha = sn / (2 * fx->wah_res);
+			float inv_a0 = 1.0 / (1 + alpha);
+			wah->b0 = (1 - cs) * 0.5 * inv_a0;
+			wah->b1 = (1 - cs) * inv_a0;
+			wah->b2 = (1 - cs) * 0.5 * inv_a0;
+			wah->a1 = -2 * cs * inv_a0;
+			wah->a2 = (1 - alpha) * inv_a0;
+		}
+
+		int run = lfoskipsamples - skip;
+		if(run > frames - done)
+			run = frames - done;
+
+		int g = 0;
+		for(g = 0; g < fx->groups; g++)
+			wahwah_run(wah,
+				fx->work + g * FX_PLANE_SIZE + done * FX_LANES,
+				wah->state + g * 4 * FX_LANES, run);
+
+		wah->skipcount += run;
+		done += run;
 	}
 }
 
 /*
- * clean fx_comb4_data_t
+ * change pitch effect (ducky)
  * args:
- *   COMB4 - pointer to fx_comb4_data_t
+ *   fx - pointer to fx engine
+ *   frames - frames in block
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void close_COMB4(fx_comb4_data_t *COMB4)
+static void audio_fx_change_pitch (audio_fx_t *fx, int frames)
 {
-	if(COMB4 != NULL)
+	fx_pitch_data_t *pt = &fx->pitch;
+	size_t frame_bytes = FX_LANES * sizeof(sample_t);
+	int i = 0;
+	int g = 0;
+
+	for(i = 0; i < frames; i++)
 	{
-		free(COMB4->CombBuff10);
-		free(COMB4->CombBuff20);
-		free(COMB4->CombBuff30);
-		free(COMB4->CombBuff40);
+		/*reduce the number of samples (keep 1 in rate)*/
+		if(pt->phase == 0)
+		{
+			for(g = 0; g < fx->groups; g++)
+				memcpy(pt->window + (g * pt->wsize + pt->wfill) * FX_LANES,
+					fx->work + g * FX_PLANE_SIZE + i * FX_LANES, frame_bytes);
 
-		free(COMB4->CombBuff11);
-		free(COMB4->CombBuff21);
-		free(COMB4->CombBuff31);
-		free(COMB4->CombBuff41);
+			if(++(pt->wfill) >= pt->wsize)
+			{
+				/*increase tempo: queue the window rate times*/
+				int r = 0;
+				for(r = 0; r < pt->rate && pt->fifo_count + pt->wsize <= pt->fifo_size; r++)
+				{
+					int w = 0;
+					int wr = pt->fifo_read + pt->fifo_count;
+					while(w < pt->wsize)
+					{
+						if(wr >= pt->fifo_size)
+							wr -= pt->fifo_size;
+						int n = pt->fifo_size - wr;
+						if(n > pt->wsize - w)
+							n = pt->wsize - w;
+						for(g = 0; g < fx->groups; g++)
+							memcpy(pt->fifo + (g * pt->fifo_size + wr) * FX_LANES,
+								pt->window + (g * pt->wsize + w) * FX_LANES,
+								n * frame_bytes);
+						w += n;
+						wr += n;
+					}
+					pt->fifo_count += pt->wsize;
+				}
+				pt->wfill = 0;
+			}
+		}
+		if(++(pt->phase) >= pt->rate)
+			pt->phase = 0;
 
-		free(COMB4);
+		/*output the next queued frame (silence until the first window)*/
+		for(g = 0; g < fx->groups; g++)
+		{
+			sample_t *frame = fx->work + g * FX_PLANE_SIZE + i * FX_LANES;
+			if(pt->fifo_count > 0)
+				memcpy(frame, pt->fifo + (g * pt->fifo_size + pt->fifo_read) * FX_LANES, frame_bytes);
+			else
+				memset(frame, 0, frame_bytes);
+		}
+		if(pt->fifo_count > 0)
+		{
+			if(++(pt->fifo_read) >= pt->fifo_size)
+				pt->fifo_read = 0;
+			pt->fifo_count--;
+		}
 	}
+
+	biquad_process(&fx->lpf, fx, frames);
 }
 
+/*fx processing chain (in processing order)*/
+static const struct
+{
+	uint32_t fx;                            /*fx mask bit*/
+	int index;                              /*stats index*/
+	void (*process)(audio_fx_t *, int);
+} fx_chain[AUDIO_FX_COUNT] =
+{
+	{AUDIO_FX_ECHO,   0, audio_fx_echo},
+	{AUDIO_FX_REVERB, 2, audio_fx_reverb},
+	{AUDIO_FX_FUZZ,   1, audio_fx_fuzz},
+	{AUDIO_FX_WAHWAH, 3, audio_fx_wahwah},
+	{AUDIO_FX_DUCKY,  4, audio_fx_change_pitch}
+};
+
 /*
- * clean fx_filt_data_t
+ * free fx engine data
  * args:
- *   FILT - pointer to fx_filt_data_t
+ *   fx - pointer to fx engine
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void close_FILT(fx_filt_data_t *FILT)
+static void fx_engine_free(audio_fx_t *fx)
 {
-	if(FILT != NULL)
-	{
-		free(FILT);
-	}
+	int c = 0;
+
+	if(fx == NULL)
+		return;
+
+	free(fx->work);
+	free(fx->scratch);
+	free(fx->echo.buff);
+	for(c = 0; c < 4; c++)
+		free(fx->comb[c].buff);
+	free(fx->ap.buff);
+	free(fx->hpf.state);
+	free(fx->wah.state);
+	free(fx->pitch.window);
+	free(fx->pitch.fifo);
+	free(fx->lpf.state);
+	free(fx);
 }
 
 /*
- * clean fx_wah_data_t
+ * allocate and init fx engine data for mask
  * args:
- *   WAH - pointer to fx_wah_data_t
+ *   mask - or'ed fx combination
+ *   samprate - sample rate
+ *   channels - audio channels
  *
  * asserts:
  *   none
  *
- * returns: none
+ * returns: pointer to fx engine
  */
-static void close_WAHWAH(fx_wah_data_t *WAH)
+static audio_fx_t *fx_engine_new(uint32_t mask, int samprate, int channels)
 {
-	if(WAH != NULL)
+	audio_fx_t *fx = calloc(1, sizeof(audio_fx_t));
+	if(fx == NULL)
+	{
+		fprintf(stderr,"AUDIO: FATAL memory allocation failure (fx_engine_new): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	fx->mask = mask;
+	fx->samprate = samprate;
+	fx->channels = channels;
+	fx->groups = (channels + FX_LANES - 1) / FX_LANES;
+
+	fx->work = fx_alloc_samples(FX_PLANE_SIZE * fx->groups);
+
+	if(mask & AUDIO_FX_ECHO)
+	{
+		/*300 ms delay, 0.5 decay*/
+		delay_init(&fx->echo, 300, samprate, fx->groups);
+		fx->echo_decay = 0.5;
+	}
+
+	if(mask & AUDIO_FX_REVERB)
+	{
+		/*4 parallel comb filters (50 ms delay) and all pass*/
+		int delay_ms = 50;
+		int c = 0;
+		const float gain[4] = {0.55, 0.6, 0.5, 0.45};
+
+		for(c = 0; c < 4; c++)
+		{
+			delay_init(&fx->comb[c], delay_ms - 5 * c, samprate, fx->groups);
+			fx->comb_gain[c] = gain[c];
+		}
+		fx->comb_in_gain = 0.7;
+
+		delay_init(&fx->ap, delay_ms, samprate, fx->groups);
+		fx->ap_gain = 0.75;
+
+		fx->scratch = fx_alloc_samples(FX_PLANE_SIZE * fx->groups);
+	}
+
+	if(mask & AUDIO_FX_FUZZ)
+		HPF_init(&fx->hpf, fx->groups, samprate, 1000, 0.9);
+
+	if(mask & AUDIO_FX_WAHWAH)
+	{
+		/*freq 1.5, startphase 0, depth 0.7, freqofs 0.3, res 2.5*/
+		fx->wah.lfoskip = 1.5 * 2 * M_PI / samprate;
+		fx->wah.phase = 0;
+		fx->wah.state = fx_alloc_samples(4 * FX_LANES * fx->groups);
+		fx->wah_depth = 0.7;
+		fx->wah_freqofs = 0.3;
+		fx->wah_res = 2.5;
+	}
+
+	if(mask & AUDIO_FX_DUCKY)
 	{
-		free(WAH);
+		/*rate 2, 20 ms windows*/
+		fx->pitch.rate = 2;
+		fx->pitch.wsize = (int) (20 * samprate * 0.001);
+		if(fx->pitch.wsize < 1)
+			fx->pitch.wsize = 1;
+		fx->pitch.window = fx_alloc_samples(fx->pitch.wsize * FX_LANES * fx->groups);
+		fx->pitch.fifo_size = 2 * fx->pitch.wsize * fx->pitch.rate;
+		fx->pitch.fifo = fx_alloc_samples(fx->pitch.fifo_size * FX_LANES * fx->groups);
+
+		LPF_init(&fx->lpf, fx->groups, samprate, samprate * 0.25, 0.9);
 	}
+
+	return fx;
 }
 
 /*
- * clean reverb data
+ * prepare the fx engine for a new fx mask
+ *   allocates all the filter state, so it must be called outside
+ *   the audio path (e.g. when the user changes the fx selection)
  * args:
- *   none
+ *   audio_ctx - pointer to audio context
+ *   mask - or'ed fx combination
  *
  * asserts:
- *   none
+ *   audio_ctx is not null
  *
- * returns: none
+ * returns: error code (0 - E_OK)
  */
-static void close_reverb()
+int audio_fx_set_mask(audio_context_t *audio_ctx, uint32_t mask)
 {
-	close_DELAY(aud_fx->AP1);
-	aud_fx->AP1 = NULL;
-	close_COMB4(aud_fx->COMB4);
-	aud_fx->COMB4 = NULL;
+	/*assertions*/
+	assert(audio_ctx != NULL);
+
+	audio_fx_t *fx = NULL;
+
+	if(mask != AUDIO_FX_NONE)
+	{
+		if(audio_ctx->channels < 1 || audio_ctx->samprate <= 0)
+		{
+			fprintf(stderr, "AUDIO: fx not supported for %i channels at %i Hz\n",
+				audio_ctx->channels, audio_ctx->samprate);
+			mask = AUDIO_FX_NONE;
+		}
+		else
+			fx = fx_engine_new(mask, audio_ctx->samprate, audio_ctx->channels);
+	}
+
+	/*swap engines (the audio path only waits for the pointer swap)*/
+	__LOCK_MUTEX(&fx_mutex);
+	audio_fx_t *old_fx = aud_fx;
+	aud_fx = fx;
+	__UNLOCK_MUTEX(&fx_mutex);
+
+	fx_engine_free(old_fx);
+
+	if(verbosity > 1)
+		printf("AUDIO: fx engine prepared for mask 0x%x\n", mask);
+
+	return (fx == NULL && mask != AUDIO_FX_NONE) ? -1 : 0;
 }
 
 /*
- * clean pitch data
+ * get the fx engine statistics (per effect cpu cost)
  * args:
- *   none
+ *   stats - pointer to fx stats to fill
  *
  * asserts:
- *   none
+ *   stats is not null
  *
- * returns: none
+ * returns: error code (-1 if no fx engine is prepared)
  */
-static void close_pitch ()
+int audio_fx_get_stats(audio_fx_stats_t *stats)
 {
-	if(aud_fx->RT1 != NULL)
+	/*assertions*/
+	assert(stats != NULL);
+
+	int i = 0;
+
+	memset(stats, 0, sizeof(audio_fx_stats_t));
+
+	__LOCK_MUTEX(&fx_mutex);
+	if(aud_fx == NULL)
 	{
-		free(aud_fx->RT1->rBuff1);
-		free(aud_fx->RT1->rBuff2);
-		free(aud_fx->RT1->wBuff1);
-		free(aud_fx->RT1->wBuff2);
-		free(aud_fx->RT1);
-		aud_fx->RT1 = NULL;
-		close_FILT(aud_fx->LPF1);
-		aud_fx->LPF1 = NULL;
+		__UNLOCK_MUTEX(&fx_mutex);
+		return -1;
 	}
+
+	stats->mask = aud_fx->mask;
+	stats->buffers = aud_fx->buffers;
+	stats->frames = aud_fx->frames;
+	/*audio time of the processed frames (ns)*/
+	double audio_ns = (double) aud_fx->frames * NSEC_PER_SEC / aud_fx->samprate;
+	for(i = 0; i < AUDIO_FX_COUNT; i++)
+	{
+		stats->total_ns[i] = aud_fx->total_ns[i];
+		stats->max_ns[i] = aud_fx->max_ns[i];
+		stats->load[i] = audio_ns > 0 ? aud_fx->total_ns[i] / audio_ns : 0;
+	}
+	__UNLOCK_MUTEX(&fx_mutex);
+
+	return 0;
 }
 
 /*
@@ -1097,31 +1228,25 @@ static void close_pitch ()
  */
 void audio_fx_close()
 {
-	if(aud_fx == NULL)
-		return;
-
-	close_DELAY(aud_fx->ECHO);
-	aud_fx->ECHO = NULL;
-	close_reverb();
-	close_WAHWAH(aud_fx->wahData);
-	aud_fx->wahData = NULL;
-	close_FILT(aud_fx->HPF);
-	aud_fx->HPF = NULL;
-	close_pitch();
-
-	free(aud_fx);
+	__LOCK_MUTEX(&fx_mutex);
+	audio_fx_t *fx = aud_fx;
 	aud_fx = NULL;
+	__UNLOCK_MUTEX(&fx_mutex);
+
+	fx_engine_free(fx);
 }
 
 /*
  * apply audio fx
+ *   only effects prepared by audio_fx_set_mask are applied
+ *   (no allocation is done here)
  * args:
  *   audio_ctx - pointer to audio context
- *   proc_buff - pointer to audio buffer to process
+ *   data - pointer to audio buffer to process
  *   mask - or'ed fx combination
  *
  * asserts:
- *    none
+ *    audio_ctx is not null
  *
  * returns: none
  */
@@ -1129,48 +1254,86 @@ void audio_fx_apply(audio_context_t *audio_ctx,
 	sample_t *data,
 	uint32_t mask)
 {
-	if(mask != AUDIO_FX_NONE)
-    {
-		if(verbosity > 2)
-			printf("AUDIO: Apllying Fx (0x%x)\n", mask);
-			
-		if(aud_fx == NULL)
-			audio_fx_init();
-		
-		if(mask & AUDIO_FX_ECHO)
-			audio_fx_echo(audio_ctx, data, 300, 0.5);
-		else
-		{
-			close_DELAY(aud_fx->ECHO);
-			aud_fx->ECHO = NULL;
-		}
+	/*assertions*/
+	assert(audio_ctx != NULL);
 
-		if(mask & AUDIO_FX_REVERB)
-			audio_fx_reverb(audio_ctx, data, 50);
-		else
-			close_reverb();
+	if(mask == AUDIO_FX_NONE)
+		return;
 
-		if(mask & AUDIO_FX_FUZZ)
-			audio_fx_fuzz(audio_ctx, data);
-		else
+	__LOCK_MUTEX(&fx_mutex);
+
+	audio_fx_t *fx = aud_fx;
+
+	if(fx == NULL ||
+		fx->channels != audio_ctx->channels ||
+		fx->samprate != audio_ctx->samprate ||
+		(mask & ~fx->mask) != 0)
+	{
+		if(verbosity > 0 && (fx == NULL || !fx->warned))
+			fprintf(stderr, "AUDIO: fx (0x%x) not prepared for the current stream (call audio_fx_set_mask)\n", mask);
+		if(fx != NULL)
+			fx->warned = 1;
+
+		if(fx == NULL ||
+			fx->channels != audio_ctx->channels ||
+			fx->samprate != audio_ctx->samprate)
 		{
-			close_FILT(aud_fx->HPF);
-			aud_fx->HPF = NULL;
+			__UNLOCK_MUTEX(&fx_mutex);
+			return;
 		}
+	}
 
-		if(mask & AUDIO_FX_WAHWAH)
-			audio_fx_wahwah(audio_ctx, data, 1.5, 0, 0.7, 0.3, 2.5);
-		else
+	if(verbosity > 2)
+		printf("AUDIO: Apllying Fx (0x%x)\n", mask);
+
+	mask &= fx->mask;
+	int frames = audio_ctx->capture_buff_size / fx->channels;
+	uint64_t buff_ns[AUDIO_FX_COUNT] = {0};
+	int done = 0;
+	int i = 0;
+
+#if defined(__SSE2__)
+	/*flush denormals - FTZ and DAZ (feedback filters decaying to silence)*/
+	unsigned int csr = _mm_getcsr();
+	_mm_setcsr(csr | 0x8040);
+#endif
+
+	while(done < frames)
+	{
+		int block = frames - done;
+		if(block > FX_BLOCK_FRAMES)
+			block = FX_BLOCK_FRAMES;
+
+		sample_t *block_data = data + done * fx->channels;
+		fx_load_block(fx, block_data, block);
+
+		for(i = 0; i < AUDIO_FX_COUNT; i++)
 		{
-			close_WAHWAH(aud_fx->wahData);
-			aud_fx->wahData = NULL;
+			if(!(mask & fx_chain[i].fx))
+				continue;
+
+			uint64_t t0 = ns_time_monotonic();
+			fx_chain[i].process(fx, block);
+			buff_ns[fx_chain[i].index] += ns_time_monotonic() - t0;
 		}
 
-		if(mask & AUDIO_FX_DUCKY)
-			audio_fx_change_pitch(audio_ctx, data, 2);
-		else
-			close_pitch();
+		fx_store_block(fx, block_data, block);
+		done += block;
 	}
-	else
-		audio_fx_close();
+
+#if defined(__SSE2__)
+	_mm_setcsr(csr);
+#endif
+
+	for(i = 0; i < AUDIO_FX_COUNT; i++)
+	{
+		fx->total_ns[i] += buff_ns[i];
+		if(buff_ns[i] > fx->max_ns[i])
+			fx->max_ns[i] = buff_ns[i];
+	}
+
+	fx->buffers++;
+	fx->frames += frames;
+
+	__UNLOCK_MUTEX(&fx_mutex);
 }
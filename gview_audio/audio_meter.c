@@ -0,0 +1,654 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+#  level metering: peak, rms, true peak and loudness (ITU-R BS.1770)            #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "audio_meter.h"
+#include "gview.h"
+
+#ifndef M_PI
+#define M_PI		3.14159265358979323846
+#endif
+
+#define METER_LANES       (4)   /*channels per vector*/
+#define METER_GROUPS      (AUDIO_METER_MAX_CHANNELS / METER_LANES)
+#define TP_TAPS           (12)  /*true peak interpolator taps per phase*/
+#define TP_PHASES         (4)   /*true peak oversampling*/
+#define LUFS_BLOCK_MS     (100) /*loudness sub block*/
+#define LUFS_SHORT        (30)  /*sub blocks in the short-term window (3 s)*/
+#define LUFS_MOMENTARY    (4)   /*sub blocks in the momentary window (400 ms)*/
+#define LUFS_FLOOR        (-70.0f)
+#define RMS_TIME          (0.3) /*rms integration time (s)*/
+
+/*
+ * BS.1770-4 annex 2 true peak interpolator (48 taps, 4 phases)
+ * tp_coef[tap][phase]
+ */
+static const float tp_coef[TP_TAPS][TP_PHASES] =
+{
+	{ 0.0017089843750f, -0.0291748046875f, -0.0189208984375f, -0.0083007812500f},
+	{ 0.0109863281250f,  0.0292968750000f,  0.0330810546875f,  0.0148925781250f},
+	{-0.0196533203125f, -0.0517578125000f, -0.0582275390625f, -0.0266113281250f},
+	{ 0.0332031250000f,  0.0891113281250f,  0.1015625000000f,  0.0476074218750f},
+	{-0.0594482421875f, -0.1665039062500f, -0.2003173828125f, -0.1022949218750f},
+	{ 0.1373291015625f,  0.4650878906250f,  0.7797851562500f,  0.9721679687500f},
+	{ 0.9721679687500f,  0.7797851562500f,  0.4650878906250f,  0.1373291015625f},
+	{-0.1022949218750f, -0.2003173828125f, -0.1665039062500f, -0.0594482421875f},
+	{ 0.0476074218750f,  0.1015625000000f,  0.0891113281250f,  0.0332031250000f},
+	{-0.0266113281250f, -0.0582275390625f, -0.0517578125000f, -0.0196533203125f},
+	{ 0.0148925781250f,  0.0330810546875f,  0.0292968750000f,  0.0109863281250f},
+	{-0.0083007812500f, -0.0189208984375f, -0.0291748046875f,  0.0017089843750f}
+};
+
+struct _audio_meter_t
+{
+	int channels;      /*metered channels*/
+	int stride;        /*interleaved frame size*/
+	int samprate;
+	int groups;        /*k-weighting lane groups*/
+
+	/*k-weighting (pre filter + rlb high pass) biquads: b0 b1 b2 a1 a2*/
+	float kcoef[2][5];
+	/*transposed direct form II state [group][stage][s1/s2][lane]*/
+	float kstate[METER_GROUPS][2][2][METER_LANES];
+	/*k-weighted energy of the current sub block [group][lane]*/
+	float kenergy[METER_GROUPS][METER_LANES];
+
+	/*true peak history (duplicated so a window is always contiguous)*/
+	float tp_hist[AUDIO_METER_MAX_CHANNELS][2 * TP_TAPS];
+	int tp_pos;
+
+	/*loudness sub blocks*/
+	int block_frames;
+	int block_left;
+	double block_energy[LUFS_SHORT];
+	int block_index;
+	int block_count;
+
+	double rms_ms[AUDIO_METER_MAX_CHANNELS];  /*integrated mean square*/
+
+	audio_meter_levels_t work;    /*levels being computed (writer only)*/
+	audio_meter_levels_t levels;  /*published snapshot*/
+	gv_seqlock_t lock;
+};
+
+/*
+ * create an audio meter
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to meter context
+ */
+audio_meter_t *audio_meter_create()
+{
+	audio_meter_t *meter = calloc(1, sizeof(audio_meter_t));
+	if(meter == NULL)
+	{
+		fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_meter_create): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	return meter;
+}
+
+/*
+ * destroy an audio meter
+ * args:
+ *   meter - pointer to meter context
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_meter_destroy(audio_meter_t *meter)
+{
+	free(meter);
+}
+
+/*
+ * reset the meter for a new stream (writer side)
+ * args:
+ *   meter - pointer to meter context
+ *   channels - number of channels (only the first AUDIO_METER_MAX_CHANNELS are metered)
+ *   samprate - sample rate
+ *
+ * asserts:
+ *   meter is not null
+ *
+ * returns: none
+ */
+void audio_meter_reset(audio_meter_t *meter, int channels, int samprate)
+{
+	/*assertions*/
+	assert(meter != NULL);
+
+	meter->stride = channels > 0 ? channels : 1;
+	meter->channels = MIN(meter->stride, AUDIO_METER_MAX_CHANNELS);
+	meter->samprate = samprate > 0 ? samprate : 44100;
+	meter->groups = (meter->channels + METER_LANES - 1) / METER_LANES;
+
+	double fs = meter->samprate;
+
+	/*pre filter (high shelf, +4 dB above ~1.7 kHz)*/
+	double f0 = 1681.974450955533;
+	double G = 3.999843853973347;
+	double Q = 0.7071752369554196;
+	double K = tan(M_PI * f0 / fs);
+	double Vh = pow(10.0, G / 20.0);
+	double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+	meter->kcoef[0][0] = (Vh + Vb * K / Q + K * K) / a0;
+	meter->kcoef[0][1] = 2.0 * (K * K - Vh) / a0;
+	meter->kcoef[0][2] = (Vh - Vb * K / Q + K * K) / a0;
+	meter->kcoef[0][3] = 2.0 * (K * K - 1.0) / a0;
+	meter->kcoef[0][4] = (1.0 - K / Q + K * K) / a0;
+
+	/*rlb weighting (high pass at ~38 Hz)*/
+	f0 = 38.13547087602444;
+	Q = 0.5003270373238773;
+	K = tan(M_PI * f0 / fs);
+	a0 = 1.0 + K / Q + K * K;
+	meter->kcoef[1][0] = 1.0;
+	meter->kcoef[1][1] = -2.0;
+	meter->kcoef[1][2] = 1.0;
+	meter->kcoef[1][3] = 2.0 * (K * K - 1.0) / a0;
+	meter->kcoef[1][4] = (1.0 - K / Q + K * K) / a0;
+
+	memset(meter->kstate, 0, sizeof(meter->kstate));
+	memset(meter->kenergy, 0, sizeof(meter->kenergy));
+	memset(meter->tp_hist, 0, sizeof(meter->tp_hist));
+	meter->tp_pos = 0;
+
+	meter->block_frames = meter->samprate * LUFS_BLOCK_MS / 1000;
+	meter->block_left = meter->block_frames;
+	memset(meter->block_energy, 0, sizeof(meter->block_energy));
+	meter->block_index = 0;
+	meter->block_count = 0;
+
+	memset(meter->rms_ms, 0, sizeof(meter->rms_ms));
+
+	memset(&meter->work, 0, sizeof(audio_meter_levels_t));
+	meter->work.channels = meter->channels;
+	meter->work.lufs_momentary = LUFS_FLOOR;
+	meter->work.lufs_short = LUFS_FLOOR;
+
+	gv_seqlock_write(&meter->lock, &meter->levels, &meter->work, sizeof(audio_meter_levels_t));
+}
+
+/*
+ * sample peak and sum of squares for each channel
+ * args:
+ *   meter - pointer to meter context
+ *   data - interleaved samples
+ *   frames - number of frames
+ *   peak - per channel peak (output)
+ *   sumsq - per channel sum of squares (output)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void meter_peak_rms(audio_meter_t *meter, const sample_t *data, int frames,
+	float *peak, double *sumsq)
+{
+	int stride = meter->stride;
+	int i = 0;
+	int ch = 0;
+
+	for(ch = 0; ch < meter->channels; ch++)
+	{
+		peak[ch] = 0;
+		sumsq[ch] = 0;
+	}
+
+#if defined(__SSE2__)
+	/*vector lanes map to fixed channels if the stride divides (or is a multiple of) 4*/
+	if((METER_LANES % stride) == 0 || (stride % METER_LANES) == 0)
+	{
+		int nacc = (stride % METER_LANES) == 0 ? stride / METER_LANES : 1;
+		int n = frames * stride;
+		__m128 vmax[AUDIO_METER_MAX_CHANNELS / METER_LANES + 1];
+		__m128 vsq[AUDIO_METER_MAX_CHANNELS / METER_LANES + 1];
+		__m128 sign = _mm_set1_ps(-0.0f);
+		float lane[METER_LANES];
+		int a = 0;
+
+		if(nacc > METER_GROUPS)
+			nacc = 0; /*too many channels: scalar*/
+
+		for(a = 0; a < nacc; a++)
+		{
+			vmax[a] = _mm_setzero_ps();
+			vsq[a] = _mm_setzero_ps();
+		}
+
+		if(nacc > 0)
+		{
+			for(i = 0, a = 0; i + METER_LANES <= n; i += METER_LANES)
+			{
+				__m128 x = _mm_loadu_ps(data + i);
+				vmax[a] = _mm_max_ps(vmax[a], _mm_andnot_ps(sign, x));
+				vsq[a] = _mm_add_ps(vsq[a], _mm_mul_ps(x, x));
+				if(++a >= nacc)
+					a = 0;
+			}
+
+			for(a = 0; a < nacc; a++)
+			{
+				int l = 0;
+				_mm_storeu_ps(lane, vmax[a]);
+				for(l = 0; l < METER_LANES; l++)
+				{
+					ch = (a * METER_LANES + l) % stride;
+					if(lane[l] > peak[ch])
+						peak[ch] = lane[l];
+				}
+				_mm_storeu_ps(lane, vsq[a]);
+				for(l = 0; l < METER_LANES; l++)
+					sumsq[(a * METER_LANES + l) % stride] += lane[l];
+			}
+
+			/*tail*/
+			for(; i < n; i++)
+			{
+				float x = fabsf(data[i]);
+				ch = i % stride;
+				if(x > peak[ch])
+					peak[ch] = x;
+				sumsq[ch] += x * x;
+			}
+			return;
+		}
+	}
+#endif
+
+	for(i = 0; i < frames; i++)
+	{
+		for(ch = 0; ch < meter->channels; ch++)
+		{
+			float x = data[i * stride + ch];
+			float ax = fabsf(x);
+			if(ax > peak[ch])
+				peak[ch] = ax;
+			sumsq[ch] += x * x;
+		}
+	}
+}
+
+/*
+ * true peak (4x oversampled) for each channel
+ * args:
+ *   meter - pointer to meter context
+ *   data - interleaved samples
+ *   frames - number of frames
+ *   true_peak - per channel true peak (output)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void meter_true_peak(audio_meter_t *meter, const sample_t *data, int frames,
+	float *true_peak)
+{
+	int stride = meter->stride;
+	int pos = meter->tp_pos;
+	int ch = 0;
+
+	for(ch = 0; ch < meter->channels; ch++)
+	{
+		float *hist = meter->tp_hist[ch];
+		int i = 0;
+		pos = meter->tp_pos;
+
+#if defined(__SSE2__)
+		__m128 coef[TP_TAPS];
+		__m128 sign = _mm_set1_ps(-0.0f);
+		__m128 vmax = _mm_setzero_ps();
+		float lane[TP_PHASES];
+		int t = 0;
+
+		/*window is oldest first: window[j] is weighted by tap (TP_TAPS - 1 - j)*/
+		for(t = 0; t < TP_TAPS; t++)
+			coef[t] = _mm_loadu_ps(tp_coef[TP_TAPS - 1 - t]);
+
+		for(i = 0; i < frames; i++)
+		{
+			float x = data[i * stride + ch];
+			hist[pos] = x;
+			hist[pos + TP_TAPS] = x;
+
+			const float *win = hist + pos + 1;
+			__m128 acc = _mm_mul_ps(coef[0], _mm_set1_ps(win[0]));
+			for(t = 1; t < TP_TAPS; t++)
+				acc = _mm_add_ps(acc, _mm_mul_ps(coef[t], _mm_set1_ps(win[t])));
+			vmax = _mm_max_ps(vmax, _mm_andnot_ps(sign, acc));
+
+			if(++pos >= TP_TAPS)
+				pos = 0;
+		}
+
+		_mm_storeu_ps(lane, vmax);
+		true_peak[ch] = MAX(MAX(lane[0], lane[1]), MAX(lane[2], lane[3]));
+#else
+		float tp = 0;
+		for(i = 0; i < frames; i++)
+		{
+			float x = data[i * stride + ch];
+			int p = 0;
+			hist[pos] = x;
+			hist[pos + TP_TAPS] = x;
+
+			const float *win = hist + pos + 1;
+			for(p = 0; p < TP_PHASES; p++)
+			{
+				float acc = 0;
+				int t = 0;
+				for(t = 0; t < TP_TAPS; t++)
+					acc += tp_coef[TP_TAPS - 1 - t][p] * win[t];
+				acc = fabsf(acc);
+				if(acc > tp)
+					tp = acc;
+			}
+
+			if(++pos >= TP_TAPS)
+				pos = 0;
+		}
+		true_peak[ch] = tp;
+#endif
+	}
+
+	meter->tp_pos = pos;
+}
+
+/*
+ * close a loudness sub block
+ * args:
+ *   meter - pointer to meter context
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void meter_close_block(audio_meter_t *meter)
+{
+	double energy = 0;
+	int g = 0;
+	int l = 0;
+
+	/*all channel weights are 1.0 (surround weighting is not applied)*/
+	for(g = 0; g < meter->groups; g++)
+		for(l = 0; l < METER_LANES; l++)
+			energy += meter->kenergy[g][l];
+
+	memset(meter->kenergy, 0, sizeof(meter->kenergy));
+
+	meter->block_energy[meter->block_index] = energy / meter->block_frames;
+	if(++(meter->block_index) >= LUFS_SHORT)
+		meter->block_index = 0;
+	if(meter->block_count < LUFS_SHORT)
+		meter->block_count++;
+
+	meter->block_left = meter->block_frames;
+}
+
+/*
+ * loudness of the last n sub blocks
+ * args:
+ *   meter - pointer to meter context
+ *   n - number of sub blocks
+ *
+ * asserts:
+ *   none
+ *
+ * returns: loudness (LUFS)
+ */
+static float meter_loudness(audio_meter_t *meter, int n)
+{
+	double energy = 0;
+	int i = 0;
+
+	if(n > meter->block_count)
+		n = meter->block_count;
+	if(n <= 0)
+		return LUFS_FLOOR;
+
+	int index = meter->block_index;
+	for(i = 0; i < n; i++)
+	{
+		if(--index < 0)
+			index = LUFS_SHORT - 1;
+		energy += meter->block_energy[index];
+	}
+	energy /= n;
+
+	if(energy <= 0)
+		return LUFS_FLOOR;
+
+	float lufs = -0.691 + 10.0 * log10(energy);
+	return lufs < LUFS_FLOOR ? LUFS_FLOOR : lufs;
+}
+
+/*
+ * k-weighted energy (loudness sub blocks)
+ * args:
+ *   meter - pointer to meter context
+ *   data - interleaved samples
+ *   frames - number of frames
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void meter_k_weight(audio_meter_t *meter, const sample_t *data, int frames)
+{
+	int stride = meter->stride;
+	int done = 0;
+
+	while(done < frames)
+	{
+		int run = MIN(meter->block_left, frames - done);
+		int g = 0;
+
+		for(g = 0; g < meter->groups; g++)
+		{
+			int lanes = MIN(METER_LANES, meter->channels - g * METER_LANES);
+			const sample_t *in = data + done * stride + g * METER_LANES;
+			int i = 0;
+
+#if defined(__SSE2__)
+			__m128 c[2][5];
+			__m128 s[2][2];
+			int k = 0;
+			for(k = 0; k < 2; k++)
+			{
+				int j = 0;
+				for(j = 0; j < 5; j++)
+					c[k][j] = _mm_set1_ps(meter->kcoef[k][j]);
+				s[k][0] = _mm_loadu_ps(meter->kstate[g][k][0]);
+				s[k][1] = _mm_loadu_ps(meter->kstate[g][k][1]);
+			}
+			__m128 energy = _mm_loadu_ps(meter->kenergy[g]);
+
+			for(i = 0; i < run; i++)
+			{
+				const sample_t *p = in + i * stride;
+				__m128 x;
+				switch(lanes)
+				{
+					case 1:
+						x = _mm_load_ss(p);
+						break;
+					case 2:
+						x = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *) p);
+						break;
+					case 3:
+						x = _mm_setr_ps(p[0], p[1], p[2], 0);
+						break;
+					default:
+						x = _mm_loadu_ps(p);
+						break;
+				}
+
+				for(k = 0; k < 2; k++)
+				{
+					__m128 y = _mm_add_ps(_mm_mul_ps(c[k][0], x), s[k][0]);
+					s[k][0] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(c[k][1], x), _mm_mul_ps(c[k][3], y)), s[k][1]);
+					s[k][1] = _mm_sub_ps(_mm_mul_ps(c[k][2], x), _mm_mul_ps(c[k][4], y));
+					x = y;
+				}
+				energy = _mm_add_ps(energy, _mm_mul_ps(x, x));
+			}
+
+			for(k = 0; k < 2; k++)
+			{
+				_mm_storeu_ps(meter->kstate[g][k][0], s[k][0]);
+				_mm_storeu_ps(meter->kstate[g][k][1], s[k][1]);
+			}
+			_mm_storeu_ps(meter->kenergy[g], energy);
+#else
+			for(i = 0; i < run; i++)
+			{
+				int l = 0;
+				for(l = 0; l < lanes; l++)
+				{
+					float x = in[i * stride + l];
+					int k = 0;
+					for(k = 0; k < 2; k++)
+					{
+						float *st = &meter->kstate[g][k][0][l];
+						float *c = meter->kcoef[k];
+						float y = c[0] * x + st[0];
+						st[0] = c[1] * x - c[3] * y + st[METER_LANES];
+						st[METER_LANES] = c[2] * x - c[4] * y;
+						x = y;
+					}
+					meter->kenergy[g][l] += x * x;
+				}
+			}
+#endif
+		}
+
+		meter->block_left -= run;
+		done += run;
+
+		if(meter->block_left <= 0)
+			meter_close_block(meter);
+	}
+}
+
+/*
+ * meter a buffer of interleaved samples and publish the levels (writer side)
+ * args:
+ *   meter - pointer to meter context
+ *   data - interleaved samples
+ *   frames - number of frames
+ *   timestamp - buffer timestamp (ns)
+ *
+ * asserts:
+ *   meter is not null
+ *   data is not null
+ *
+ * returns: none
+ */
+void audio_meter_process(audio_meter_t *meter, const sample_t *data, int frames, int64_t timestamp)
+{
+	/*assertions*/
+	assert(meter != NULL);
+	assert(data != NULL);
+
+	if(meter->channels <= 0 || frames <= 0)
+		return;
+
+	audio_meter_levels_t *work = &meter->work;
+	double sumsq[AUDIO_METER_MAX_CHANNELS];
+	int ch = 0;
+
+	meter_peak_rms(meter, data, frames, work->peak, sumsq);
+	meter_true_peak(meter, data, frames, work->true_peak);
+	meter_k_weight(meter, data, frames);
+
+	/*rms - exponential integration*/
+	double alpha = 1.0 - exp(-(double) frames / (RMS_TIME * meter->samprate));
+	for(ch = 0; ch < meter->channels; ch++)
+	{
+		meter->rms_ms[ch] += alpha * (sumsq[ch] / frames - meter->rms_ms[ch]);
+		work->rms[ch] = sqrt(meter->rms_ms[ch]);
+
+		if(work->true_peak[ch] > work->true_peak_max[ch])
+			work->true_peak_max[ch] = work->true_peak[ch];
+	}
+
+	work->lufs_momentary = meter_loudness(meter, LUFS_MOMENTARY);
+	work->lufs_short = meter_loudness(meter, LUFS_SHORT);
+	work->timestamp = timestamp;
+	work->channels = meter->channels;
+
+	gv_seqlock_write(&meter->lock, &meter->levels, work, sizeof(audio_meter_levels_t));
+}
+
+/*
+ * read the last published levels (lock free - any thread)
+ * args:
+ *   meter - pointer to meter context
+ *   levels - pointer to levels snapshot to fill
+ *
+ * asserts:
+ *   meter is not null
+ *   levels is not null
+ *
+ * returns: snapshot sequence (0 if nothing was published yet)
+ */
+uint32_t audio_meter_get_levels(audio_meter_t *meter, audio_meter_levels_t *levels)
+{
+	/*assertions*/
+	assert(meter != NULL);
+	assert(levels != NULL);
+
+	uint32_t seq = gv_seqlock_read(&meter->lock, levels, &meter->levels, sizeof(audio_meter_levels_t));
+	levels->sequence = seq;
+
+	return seq;
+}
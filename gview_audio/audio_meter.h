@@ -0,0 +1,115 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+********************************************************************************/
+
+#ifndef AUDIO_METER_H
+#define AUDIO_METER_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "gviewaudio.h"
+
+/*
+ * audio level metering
+ * sample peak, rms, true peak (BS.1770 4x interpolator) and
+ * momentary/short-term loudness (BS.1770 k-weighting) are computed
+ * by a single writer (the audio consumer) and published as a seqlock
+ * snapshot that any thread can read without locking
+ */
+
+/*audio meter context - opaque structure*/
+typedef struct _audio_meter_t audio_meter_t;
+
+/*
+ * create an audio meter
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to meter context
+ */
+audio_meter_t *audio_meter_create();
+
+/*
+ * destroy an audio meter
+ * args:
+ *   meter - pointer to meter context
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_meter_destroy(audio_meter_t *meter);
+
+/*
+ * reset the meter for a new stream (writer side)
+ * args:
+ *   meter - pointer to meter context
+ *   channels - number of channels (only the first AUDIO_METER_MAX_CHANNELS are metered)
+ *   samprate - sample rate
+ *
+ * asserts:
+ *   meter is not null
+ *
+ * returns: none
+ */
+void audio_meter_reset(audio_meter_t *meter, int channels, int samprate);
+
+/*
+ * meter a buffer of interleaved samples and publish the levels (writer side)
+ * args:
+ *   meter - pointer to meter context
+ *   data - interleaved samples
+ *   frames - number of frames
+ *   timestamp - buffer timestamp (ns)
+ *
+ * asserts:
+ *   meter is not null
+ *   data is not null
+ *
+ * returns: none
+ */
+void audio_meter_process(audio_meter_t *meter, const sample_t *data, int frames, int64_t timestamp);
+
+/*
+ * read the last published levels (lock free - any thread)
+ * args:
+ *   meter - pointer to meter context
+ *   levels - pointer to levels snapshot to fill
+ *
+ * asserts:
+ *   meter is not null
+ *   levels is not null
+ *
+ * returns: snapshot sequence (0 if nothing was published yet)
+ */
+uint32_t audio_meter_get_levels(audio_meter_t *meter, audio_meter_levels_t *levels);
+
+#endif
@@ -59,7 +59,10 @@ static pa_usec_t latency = 0; //real latency in usec (for timestamping)
 static int sink_index = 0;
 static int source_index = 0;
 
-static __THREAD_TYPE my_read_thread;
+static pa_threaded_mainloop *pa_tml = NULL; //capture mainloop (own thread)
+
+#define PA_MIN_FRAGMENT_USEC (5 * PA_USEC_PER_MSEC) /*min fragment duration*/
+#define PA_MIN_MAXLENGTH_USEC (250 * PA_USEC_PER_MSEC) /*min server buffer duration*/
 
 /*
  * clean up and disconnect
@@ -411,7 +414,75 @@ static void get_latency(pa_stream *s)
 }
 
 /*
- * audio record callback
+ * store a captured fragment in the capture buffer
+ *   (filling ring buffers as the capture buffer gets full)
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *   data - pointer to fragment samples (NULL for a hole - silence)
+ *   samples - number of samples in fragment
+ *   ts - timestamp of the fragment first frame (ns)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void store_fragment(audio_context_t *audio_ctx, const sample_t *data,
+	uint32_t samples, int64_t ts)
+{
+	uint64_t frame_length = NSEC_PER_SEC / audio_ctx->samprate; /*in nanosec*/
+	sample_t *capture_buff = (sample_t *) audio_ctx->capture_buff;
+	uint32_t done = 0;
+
+	while(done < samples)
+	{
+		uint32_t n = audio_ctx->capture_buff_size - sample_index;
+		if(n > samples - done)
+			n = samples - done;
+
+		sample_t *dst = capture_buff + sample_index;
+
+		/*bulk copy (or silence for holes)*/
+		if(data)
+			memcpy(dst, data + done, n * sizeof(sample_t));
+		else
+			memset(dst, 0, n * sizeof(sample_t));
+
+		/*store peak value (sample_index is always frame aligned)*/
+		if(data)
+		{
+			uint32_t i = 0;
+			int chan = 0;
+			for(i = 0; i < n; ++i)
+			{
+				if(audio_ctx->capture_buff_level[chan] < dst[i])
+					audio_ctx->capture_buff_level[chan] = dst[i];
+				chan++;
+				if(chan >= audio_ctx->channels)
+					chan = 0;
+			}
+		}
+
+		sample_index += n;
+		done += n;
+
+		if(sample_index >= audio_ctx->capture_buff_size)
+		{
+			/*timestamp of the last stored frame*/
+			int64_t buff_ts = ts + ((done - 1) / audio_ctx->channels) * frame_length;
+
+			audio_fill_buffer(audio_ctx, buff_ts);
+
+			/*reset*/
+			audio_ctx->capture_buff_level[0] = 0;
+			audio_ctx->capture_buff_level[1] = 0;
+			sample_index = 0;
+		}
+	}
+}
+
+/*
+ * audio record callback (runs in the threaded mainloop)
  * args:
  *   s - pointer to pa_stream
  *   length - buffer length
@@ -424,25 +495,26 @@ static void get_latency(pa_stream *s)
  */
 static void stream_request_cb(pa_stream *s, size_t length, void *data)
 {
-
-    audio_context_t *audio_ctx = (audio_context_t *) data;
+	audio_context_t *audio_ctx = (audio_context_t *) data;
 
 	if(audio_ctx->channels == 0)
 	{
 		fprintf(stderr, "AUDIO: (pulseaudio) stream_request_cb failed: channels = 0\n");
 		return;
 	}
-	
+
 	if(audio_ctx->samprate == 0)
 	{
 		fprintf(stderr, "AUDIO: (pulseaudio) stream_request_cb failed: samprate = 0\n");
 		return;
 	}
-	
-	uint64_t frame_length = NSEC_PER_SEC / audio_ctx->samprate; /*in nanosec*/
-	int64_t ts = 0;
-	int64_t buff_ts = 0;
-	uint32_t i = 0;
+
+	/*latency (from the interpolated timing info) is the same for all fragments*/
+	get_latency(s);
+	int64_t ts = ns_time_monotonic() - (latency * 1000);
+
+	if(audio_ctx->last_ts <= 0)
+		audio_ctx->last_ts = ts;
 
 	while (pa_stream_readable_size(s) > 0)
 	{
@@ -457,196 +529,158 @@ static void stream_request_cb(pa_stream *s, size_t length, void *data)
 		}
 
 		if(length == 0)
-		{
-			fprintf(stderr, "AUDIO: (pulseaudio) empty buffer!\n");
-			return; /*buffer is empty*/
-		}
-
-		get_latency(s);
-
-		ts = ns_time_monotonic() - (latency * 1000);
-
-		if(audio_ctx->last_ts <= 0)
-			audio_ctx->last_ts = ts;
-
+			return; /*buffer is empty - nothing to drop*/
 
 		uint32_t numSamples = (uint32_t) length / sizeof(sample_t);
 
-		const sample_t *rptr = (const sample_t*) inputBuffer;
-		sample_t *capture_buff = (sample_t *) audio_ctx->capture_buff;
-
-		int chan = 0;
 		/*store capture samples or silence if inputBuffer == NULL (hole)*/
-		for( i = 0; i < numSamples; ++i )
-		{
-			capture_buff[sample_index] = inputBuffer ? *rptr++ : 0;
-			sample_index++;
-
-			/*store peak value*/
-			if(audio_ctx->capture_buff_level[chan] < capture_buff[sample_index])
-				audio_ctx->capture_buff_level[chan] = capture_buff[sample_index];
-			chan++;
-			if(chan >= audio_ctx->channels)
-				chan = 0;
-
-			if(sample_index >= audio_ctx->capture_buff_size)
-			{
-				buff_ts = ts + ( i / audio_ctx->channels ) * frame_length;
+		store_fragment(audio_ctx, (const sample_t *) inputBuffer, numSamples, ts);
 
-				audio_fill_buffer(audio_ctx, buff_ts);
-
-				/*reset*/
-				audio_ctx->capture_buff_level[0] = 0;
-				audio_ctx->capture_buff_level[1] = 0;
-				sample_index = 0;
-			}
-		}
+		/*next fragment follows this one*/
+		ts += (numSamples / audio_ctx->channels) * (NSEC_PER_SEC / audio_ctx->samprate);
 
 		pa_stream_drop(s); /*clean the samples*/
 	}
-
 }
 
 /*
- * Iterate the main loop while recording is on.
- * This function runs under it's own thread called by audio_pulse_start
+ * context state callback (runs in the threaded mainloop)
  * args:
- *   data - pointer to user data (audio context)
+ *    c - pointer to pulse context
+ *    data - pointer to user data (unused)
  *
  * asserts:
- *   data is not null
+ *    none
  *
- * returns: pointer to error code
+ * returns: none
  */
-static void *pulse_read_audio(void *data)
+static void context_state_cb(pa_context *c, void *data)
 {
-    audio_context_t *audio_ctx = (audio_context_t *) data;
-	/*assertions*/
-	assert(audio_ctx != NULL);
+	switch (pa_context_get_state(c))
+	{
+		case PA_CONTEXT_READY:
+		case PA_CONTEXT_FAILED:
+		case PA_CONTEXT_TERMINATED:
+			pa_threaded_mainloop_signal(pa_tml, 0);
+			break;
+		default:
+			break;
+	}
+}
 
-    if(verbosity > 0)
-		printf("AUDIO: (pulseaudio) read thread started\n");
-    pa_mainloop *pa_ml;
-    pa_mainloop_api *pa_mlapi;
-    pa_buffer_attr bufattr;
-    pa_sample_spec ss;
-    pa_stream_flags_t flags = 0;
-    int r;
-    int pa_ready = 0;
+/*
+ * stream state callback (runs in the threaded mainloop)
+ * args:
+ *    s - pointer to pa_stream
+ *    data - pointer to user data (unused)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void stream_state_cb(pa_stream *s, void *data)
+{
+	switch (pa_stream_get_state(s))
+	{
+		case PA_STREAM_READY:
+		case PA_STREAM_FAILED:
+		case PA_STREAM_TERMINATED:
+			pa_threaded_mainloop_signal(pa_tml, 0);
+			break;
+		default:
+			break;
+	}
+}
 
-    /* Create a mainloop API and connection to the default server */
-    pa_ml = pa_mainloop_new();
-    pa_mlapi = pa_mainloop_get_api(pa_ml);
-    pa_ctx = pa_context_new(pa_mlapi, "guvcview Pulse API");
+/*
+ * set the record buffer attributes from the requested latency
+ * args:
+ *    audio_ctx - pointer to audio context data
+ *    ss - pointer to stream sample spec
+ *    bufattr - pointer to buffer attributes to fill
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void set_buffer_attr(audio_context_t *audio_ctx, const pa_sample_spec *ss,
+	pa_buffer_attr *bufattr)
+{
+	pa_zero(*bufattr);
+	/*playback only*/
+	bufattr->tlength = (uint32_t) -1;
+	bufattr->prebuf = (uint32_t) -1;
+	bufattr->minreq = (uint32_t) -1;
 
-    if(pa_context_connect(pa_ctx, NULL, 0, NULL) < 0)
-    {
-		fprintf(stderr,"AUDIO: PULSE - unable to connect to server: pa_context_connect failed\n");
-		finish(pa_ctx, pa_ml);
-		return ((void *) -1);
+	if(audio_ctx->latency <= 0)
+	{
+		/*let the server decide*/
+		bufattr->maxlength = (uint32_t) -1;
+		bufattr->fragsize = (uint32_t) -1;
+		return;
 	}
 
-    /*
-	 * This function defines a callback so the server will tell us it's state.
-     * Our callback will wait for the state to be ready.  The callback will
-     * modify the variable to 1 so we know when we have a connection and it's
-     * ready.
-     * If there's an error, the callback will set pa_ready to 2
-	 */
-    pa_context_set_state_callback(pa_ctx, pa_state_cb, &pa_ready);
+	/*fragment duration = requested latency*/
+	pa_usec_t frag_usec = (pa_usec_t) (audio_ctx->latency * PA_USEC_PER_SEC);
+	if(frag_usec < PA_MIN_FRAGMENT_USEC)
+		frag_usec = PA_MIN_FRAGMENT_USEC;
 
-    /*
-     * This function defines a time event callback (called every TIME_EVENT_USEC)
-     */
-    //pa_context_rttime_new(pa_ctx, pa_rtclock_now() + TIME_EVENT_USEC, time_event_callback, NULL);
+	/*whole number of frames (pa_usec_to_bytes is frame aligned)*/
+	uint32_t fragsize = (uint32_t) pa_usec_to_bytes(frag_usec, ss);
 
-    /*
-	 * We can't do anything until PA is ready, so just iterate the mainloop
-     * and continue
+	/*
+	 * server side buffer: a few fragments but never less than
+	 * PA_MIN_MAXLENGTH_USEC, so a late wakeup doesn't overflow
 	 */
-    while (pa_ready == 0)
-    {
-        pa_mainloop_iterate(pa_ml, 1, NULL);
-    }
-    if (pa_ready == 2)
-    {
-        finish(pa_ctx, pa_ml);
-        return ((void *) -1);
-    }
-
-	/* set the sample spec (frame rate, channels and format) */
-    ss.rate = audio_ctx->samprate;
-    ss.channels = audio_ctx->channels;
-    ss.format = PA_SAMPLE_FLOAT32LE; /*for PCM -> PA_SAMPLE_S16LE*/
-
-    recordstream = pa_stream_new(pa_ctx, "Record", &ss, NULL);
-    if (!recordstream)
-        fprintf(stderr, "AUDIO: (pulseaudio) pa_stream_new failed (chan:%d rate:%d)\n", 
-			ss.channels, ss.rate);
-
-    /* define the callbacks */
-    pa_stream_set_read_callback(recordstream, stream_request_cb, (void *) audio_ctx);
-
-	// Set properties of the record buffer
-    pa_zero(bufattr);
-    /* optimal value for all is (uint32_t)-1   ~= 2 sec */
-    bufattr.maxlength = (uint32_t) -1;
-    bufattr.prebuf = (uint32_t) -1;
-    bufattr.minreq = (uint32_t) -1;
-
-    if (audio_ctx->latency > 0)
-    {
-      bufattr.fragsize = bufattr.tlength = pa_usec_to_bytes((audio_ctx->latency * 1000) * PA_USEC_PER_MSEC, &ss);
-      flags |= PA_STREAM_ADJUST_LATENCY;
-    }
-    else
-      bufattr.fragsize = bufattr.tlength = (uint32_t) -1;
+	uint32_t maxlength = 4 * fragsize;
+	uint32_t min_maxlength = (uint32_t) pa_usec_to_bytes(PA_MIN_MAXLENGTH_USEC, ss);
+	if(maxlength < min_maxlength)
+		maxlength = min_maxlength;
 
-	flags |= PA_STREAM_INTERPOLATE_TIMING;
-    flags |= PA_STREAM_AUTO_TIMING_UPDATE;
+	bufattr->maxlength = maxlength;
+	bufattr->fragsize = fragsize;
 
-    char * dev = audio_ctx->list_devices[audio_ctx->device].name;
-    if(verbosity > 0)
-		printf("AUDIO: (pulseaudio) connecting to device %s\n\t (channels %d rate %d)\n",
-			dev, ss.channels, ss.rate);
-    r = pa_stream_connect_record(recordstream, dev, &bufattr, flags);
-    if (r < 0)
-    {
-        fprintf(stderr, "AUDIO: (pulseaudio) skip latency adjustment\n");
-        /*
-         * Old pulse audio servers don't like the ADJUST_LATENCY flag,
-		 * so retry without that
-		 */
-        r = pa_stream_connect_record(recordstream, dev, &bufattr,
-                                     PA_STREAM_INTERPOLATE_TIMING|
-                                     PA_STREAM_AUTO_TIMING_UPDATE);
-    }
-    if (r < 0)
-    {
-        fprintf(stderr, "AUDIO: (pulseaudio) pa_stream_connect_record failed\n");
-        finish(pa_ctx, pa_ml);
-        return ((void *) -1);
-    }
+	if(verbosity > 0)
+		printf("AUDIO: (pulseaudio) fragsize %u bytes (%.1f ms) maxlength %u bytes\n",
+			fragsize, (double) frag_usec / PA_USEC_PER_MSEC, maxlength);
+}
 
-    get_latency(recordstream);
+/*
+ * clean up the capture stream, context and threaded mainloop
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void pulse_capture_cleanup()
+{
+	if(pa_tml)
+		pa_threaded_mainloop_stop(pa_tml);
 
-    /*
-     * Iterate the main loop while streaming.  The second argument is whether
-     * or not the iteration should block until something is ready to be
-     * done.  Set it to zero for non-blocking.
-     */
-    while (audio_ctx->stream_flag == AUDIO_STRM_ON)
-    {
-        pa_mainloop_iterate(pa_ml, 1, NULL);
-    }
+	if(recordstream)
+	{
+		pa_stream_disconnect(recordstream);
+		pa_stream_unref(recordstream);
+		recordstream = NULL;
+	}
 
-	if(verbosity > 0)
-		printf("AUDIO: (pulseaudio) stream terminated(%i)\n", audio_ctx->stream_flag);
+	if(pa_ctx)
+	{
+		pa_context_disconnect(pa_ctx);
+		pa_context_unref(pa_ctx);
+		pa_ctx = NULL;
+	}
 
-    pa_stream_disconnect (recordstream);
-    pa_stream_unref (recordstream);
-    finish(pa_ctx, pa_ml);
-    return ((void *) 0);
+	if(pa_tml)
+	{
+		pa_threaded_mainloop_free(pa_tml);
+		pa_tml = NULL;
+	}
 }
 
 /*
@@ -708,7 +742,7 @@ void audio_set_pulseaudio_device(audio_context_t *audio_ctx, int index)
 }
 
 /*
- * Launch the main loop iteration thread
+ * connect the record stream and start the threaded mainloop
  * args:
  *   audio_ctx - pointer to audio context data
  *
@@ -722,21 +756,131 @@ int audio_start_pulseaudio(audio_context_t *audio_ctx)
 	/*assertions*/
 	assert(audio_ctx != NULL);
 
+	pa_buffer_attr bufattr;
+	pa_sample_spec ss;
+	pa_stream_flags_t flags = 0;
+	int r = 0;
+
+	sample_index = 0;
+
+	pa_tml = pa_threaded_mainloop_new();
+	if(!pa_tml)
+	{
+		fprintf(stderr, "AUDIO: (pulseaudio) pa_threaded_mainloop_new failed\n");
+		return -1;
+	}
+
+	pa_ctx = pa_context_new(pa_threaded_mainloop_get_api(pa_tml), "guvcview Pulse API");
+	pa_context_set_state_callback(pa_ctx, context_state_cb, NULL);
+
+	pa_threaded_mainloop_lock(pa_tml);
+
+	if(pa_threaded_mainloop_start(pa_tml) < 0 ||
+		pa_context_connect(pa_ctx, NULL, 0, NULL) < 0)
+	{
+		fprintf(stderr,"AUDIO: PULSE - unable to connect to server: pa_context_connect failed\n");
+		pa_threaded_mainloop_unlock(pa_tml);
+		pulse_capture_cleanup();
+		return -1;
+	}
+
+	/*wait for the context to be ready (signaled by context_state_cb)*/
+	pa_context_state_t state;
+	while((state = pa_context_get_state(pa_ctx)) != PA_CONTEXT_READY)
+	{
+		if(!PA_CONTEXT_IS_GOOD(state))
+		{
+			fprintf(stderr,"AUDIO: PULSE - unable to connect to server: %s\n",
+				pa_strerror(pa_context_errno(pa_ctx)));
+			pa_threaded_mainloop_unlock(pa_tml);
+			pulse_capture_cleanup();
+			return -1;
+		}
+		pa_threaded_mainloop_wait(pa_tml);
+	}
+
+	/* set the sample spec (frame rate, channels and format) */
+	ss.rate = audio_ctx->samprate;
+	ss.channels = audio_ctx->channels;
+	ss.format = PA_SAMPLE_FLOAT32LE; /*for PCM -> PA_SAMPLE_S16LE*/
+
+	recordstream = pa_stream_new(pa_ctx, "Record", &ss, NULL);
+	if (!recordstream)
+	{
+		fprintf(stderr, "AUDIO: (pulseaudio) pa_stream_new failed (chan:%d rate:%d)\n",
+			ss.channels, ss.rate);
+		pa_threaded_mainloop_unlock(pa_tml);
+		pulse_capture_cleanup();
+		return -1;
+	}
+
+	/* define the callbacks */
+	pa_stream_set_state_callback(recordstream, stream_state_cb, NULL);
+	pa_stream_set_read_callback(recordstream, stream_request_cb, (void *) audio_ctx);
+
+	/* set properties of the record buffer (from the requested latency)*/
+	set_buffer_attr(audio_ctx, &ss, &bufattr);
+
+	if(audio_ctx->latency > 0)
+		flags |= PA_STREAM_ADJUST_LATENCY;
+	flags |= PA_STREAM_INTERPOLATE_TIMING;
+	flags |= PA_STREAM_AUTO_TIMING_UPDATE;
+
 	audio_ctx->stream_flag = AUDIO_STRM_ON;
 
-    /* start audio capture thread */
-    if(__THREAD_CREATE(&my_read_thread, pulse_read_audio, (void *) audio_ctx))
-    {
-		fprintf(stderr, "AUDIO: (pulseaudio) read thread creation failed\n");
+	char * dev = audio_ctx->list_devices[audio_ctx->device].name;
+	if(verbosity > 0)
+		printf("AUDIO: (pulseaudio) connecting to device %s\n\t (channels %d rate %d)\n",
+			dev, ss.channels, ss.rate);
+	r = pa_stream_connect_record(recordstream, dev, &bufattr, flags);
+	if (r < 0)
+	{
+		fprintf(stderr, "AUDIO: (pulseaudio) skip latency adjustment\n");
+		/*
+		 * Old pulse audio servers don't like the ADJUST_LATENCY flag,
+		 * so retry without that
+		 */
+		r = pa_stream_connect_record(recordstream, dev, &bufattr,
+			PA_STREAM_INTERPOLATE_TIMING|
+			PA_STREAM_AUTO_TIMING_UPDATE);
+	}
+
+	/*wait for the stream to be ready (signaled by stream_state_cb)*/
+	pa_stream_state_t stream_state;
+	while (r >= 0 && (stream_state = pa_stream_get_state(recordstream)) != PA_STREAM_READY)
+	{
+		if(!PA_STREAM_IS_GOOD(stream_state))
+			r = -1;
+		else
+			pa_threaded_mainloop_wait(pa_tml);
+	}
+
+	if (r < 0)
+	{
+		fprintf(stderr, "AUDIO: (pulseaudio) pa_stream_connect_record failed\n");
 		audio_ctx->stream_flag = AUDIO_STRM_OFF;
-        return (-1);
-    }
+		pa_threaded_mainloop_unlock(pa_tml);
+		pulse_capture_cleanup();
+		return -1;
+	}
 
-    return 0;
+	if(verbosity > 0)
+	{
+		const pa_buffer_attr *attr = pa_stream_get_buffer_attr(recordstream);
+		if(attr)
+			printf("AUDIO: (pulseaudio) server fragsize %u bytes maxlength %u bytes\n",
+				attr->fragsize, attr->maxlength);
+	}
+
+	get_latency(recordstream);
+
+	pa_threaded_mainloop_unlock(pa_tml);
+
+	return 0;
 }
 
 /*
- * stop and join the main loop iteration thread
+ * disconnect the record stream and stop the threaded mainloop
  * args:
  *   audio_ctx - pointer to audio context data
  *
@@ -752,12 +896,26 @@ int audio_stop_pulseaudio(audio_context_t *audio_ctx)
 
 	audio_ctx->stream_flag = AUDIO_STRM_OFF;
 
-	__THREAD_JOIN( my_read_thread );
+	if(!pa_tml)
+		return 0;
+
+	/*no more callbacks after the stream is disconnected*/
+	pa_threaded_mainloop_lock(pa_tml);
+	if(recordstream)
+	{
+		pa_stream_set_read_callback(recordstream, NULL, NULL);
+		pa_stream_disconnect(recordstream);
+		pa_stream_unref(recordstream);
+		recordstream = NULL;
+	}
+	pa_threaded_mainloop_unlock(pa_tml);
+
+	pulse_capture_cleanup();
 
 	if(verbosity > 0)
-		printf("AUDIO: (pulseaudio) read thread joined\n");
+		printf("AUDIO: (pulseaudio) stream terminated\n");
 
-    return 0;
+	return 0;
 }
 
 /*
@@ -0,0 +1,275 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "audio_ring.h"
+
+#define RING_HDR_SIZE (sizeof(audio_ring_block_t))
+/*round payload so that the next header (and payload) stays aligned*/
+#define RING_ALIGN(x) (((x) + RING_HDR_SIZE - 1) & ~((uint64_t) RING_HDR_SIZE - 1))
+
+extern int verbosity;
+
+/*
+ * create a audio ring
+ * args:
+ *   block_size - payload size (bytes) of a typical block
+ *   num_blocks - number of typical blocks the ring must hold
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to new ring (must be freed with audio_ring_destroy)
+ */
+audio_ring_t *audio_ring_create(size_t block_size, int num_blocks)
+{
+	if(block_size == 0 || num_blocks <= 0)
+	{
+		fprintf(stderr, "AUDIO: (ring) invalid ring size (%zu x %i)\n",
+			block_size, num_blocks);
+		return NULL;
+	}
+
+	audio_ring_t *ring = NULL;
+	if(posix_memalign((void **) &ring, AUDIO_RING_CACHE_LINE, sizeof(audio_ring_t)) != 0)
+	{
+		fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_ring_create): %s\n", strerror(errno));
+		exit(-1);
+	}
+	memset(ring, 0, sizeof(audio_ring_t));
+
+	/*
+	 * the extra block leaves room for a padding record
+	 * at the wrap point if the block size changes
+	 */
+	ring->size = (RING_HDR_SIZE + RING_ALIGN(block_size)) * (num_blocks + 1);
+
+	if(posix_memalign((void **) &ring->data, AUDIO_RING_CACHE_LINE, ring->size) != 0)
+	{
+		fprintf(stderr,"AUDIO: FATAL memory allocation failure (audio_ring_create): %s\n", strerror(errno));
+		exit(-1);
+	}
+	/*touch all pages now, not in the realtime callback*/
+	memset(ring->data, 0, ring->size);
+
+	if(verbosity > 1)
+		printf("AUDIO: (ring) allocated %" PRIu64 " bytes for %i blocks of %zu bytes\n",
+			ring->size, num_blocks, block_size);
+
+	return ring;
+}
+
+/*
+ * destroy a audio ring
+ * args:
+ *   ring - pointer to ring
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_ring_destroy(audio_ring_t *ring)
+{
+	if(!ring)
+		return;
+
+	free(ring->data);
+	free(ring);
+}
+
+/*
+ * write a block into the ring (producer side - wait free)
+ * args:
+ *   ring - pointer to ring
+ *   data - pointer to payload data
+ *   size - payload size in bytes
+ *   frames - number of audio frames in payload
+ *   timestamp - block timestamp (ns)
+ *   capture_ts - device timestamp for end of data (ns)
+ *   level_meter - pointer to channels level (2 values)
+ *
+ * asserts:
+ *   ring is not null
+ *
+ * returns: 0 on success, -1 if the ring is full (block is dropped)
+ */
+int audio_ring_write(audio_ring_t *ring, const void *data, uint32_t size,
+	uint32_t frames, int64_t timestamp, int64_t capture_ts,
+	const float *level_meter)
+{
+	/*assertions*/
+	assert(ring != NULL);
+
+	uint64_t write_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_RELAXED);
+	uint64_t read_pos = __atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE);
+
+	uint64_t need = RING_HDR_SIZE + RING_ALIGN(size);
+	uint64_t offset = write_pos % ring->size;
+	uint64_t contig = ring->size - offset;
+	/*blocks never wrap: pad to the end of the ring if needed*/
+	uint64_t pad = (need > contig) ? contig : 0;
+
+	uint64_t fill = write_pos - read_pos;
+
+	if(need + pad > ring->size - fill)
+	{
+		/*ring full - drop the block (never wait for the consumer)*/
+		__atomic_store_n(&ring->overruns, ring->overruns + 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&ring->dropped_frames, ring->dropped_frames + frames, __ATOMIC_RELAXED);
+		return -1;
+	}
+
+	if(pad)
+	{
+		audio_ring_block_t *pad_block = (audio_ring_block_t *) (ring->data + offset);
+		pad_block->size = (uint32_t) (pad - RING_HDR_SIZE);
+		pad_block->flag = AUDIO_RING_BLOCK_PAD;
+		offset = 0;
+	}
+
+	audio_ring_block_t *block = (audio_ring_block_t *) (ring->data + offset);
+	block->size = size;
+	block->flag = AUDIO_RING_BLOCK_DATA;
+	block->timestamp = timestamp;
+	block->capture_ts = capture_ts;
+	block->frames = frames;
+	block->level_meter[0] = level_meter ? level_meter[0] : 0;
+	block->level_meter[1] = level_meter ? level_meter[1] : 0;
+	if(data && size > 0)
+		memcpy(audio_ring_block_data(block), data, size);
+
+	fill += need + pad;
+	if(fill > ring->high_water)
+		__atomic_store_n(&ring->high_water, fill, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->blocks, ring->blocks + 1, __ATOMIC_RELAXED);
+
+	/*publish the block*/
+	__atomic_store_n(&ring->write_pos, write_pos + need + pad, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * get the next block from the ring (consumer side - wait free)
+ *   the block stays owned by the consumer until audio_ring_release
+ * args:
+ *   ring - pointer to ring
+ *
+ * asserts:
+ *   ring is not null
+ *
+ * returns: pointer to block header (payload follows it) or NULL if empty
+ */
+audio_ring_block_t *audio_ring_peek(audio_ring_t *ring)
+{
+	/*assertions*/
+	assert(ring != NULL);
+
+	uint64_t read_pos = __atomic_load_n(&ring->read_pos, __ATOMIC_RELAXED);
+	uint64_t write_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+
+	if(read_pos == write_pos)
+		return NULL; /*empty*/
+
+	audio_ring_block_t *block =
+		(audio_ring_block_t *) (ring->data + (read_pos % ring->size));
+
+	if(block->flag == AUDIO_RING_BLOCK_PAD)
+	{
+		/*skip the padding and hand it back to the producer*/
+		read_pos += RING_HDR_SIZE + block->size;
+		__atomic_store_n(&ring->read_pos, read_pos, __ATOMIC_RELEASE);
+
+		/*padding is always followed by a data block*/
+		block = (audio_ring_block_t *) ring->data;
+	}
+
+	return block;
+}
+
+/*
+ * release the block returned by audio_ring_peek (consumer side)
+ * args:
+ *   ring - pointer to ring
+ *   block - pointer to block header
+ *
+ * asserts:
+ *   ring is not null
+ *   block is not null
+ *
+ * returns: none
+ */
+void audio_ring_release(audio_ring_t *ring, audio_ring_block_t *block)
+{
+	/*assertions*/
+	assert(ring != NULL);
+	assert(block != NULL);
+
+	uint64_t read_pos = __atomic_load_n(&ring->read_pos, __ATOMIC_RELAXED);
+
+	read_pos += RING_HDR_SIZE + RING_ALIGN(block->size);
+
+	__atomic_store_n(&ring->read_pos, read_pos, __ATOMIC_RELEASE);
+}
+
+/*
+ * get the ring statistics (can be called from any thread)
+ * args:
+ *   ring - pointer to ring
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   ring is not null
+ *   stats is not null
+ *
+ * returns: none
+ */
+void audio_ring_get_stats(audio_ring_t *ring, audio_ring_stats_t *stats)
+{
+	/*assertions*/
+	assert(ring != NULL);
+	assert(stats != NULL);
+
+	uint64_t read_pos = __atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE);
+	uint64_t write_pos = __atomic_load_n(&ring->write_pos, __ATOMIC_ACQUIRE);
+
+	stats->blocks = __atomic_load_n(&ring->blocks, __ATOMIC_RELAXED);
+	stats->overruns = __atomic_load_n(&ring->overruns, __ATOMIC_RELAXED);
+	stats->dropped_frames = __atomic_load_n(&ring->dropped_frames, __ATOMIC_RELAXED);
+	stats->size = ring->size;
+	/*positions are read separately - clamp a transient inconsistency*/
+	stats->fill = (write_pos > read_pos) ? write_pos - read_pos : 0;
+	if(stats->fill > ring->size)
+		stats->fill = ring->size;
+	stats->high_water = __atomic_load_n(&ring->high_water, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,182 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Audio library                                                                #
+#                                                                               #
+********************************************************************************/
+
+#ifndef AUDIO_RING_H
+#define AUDIO_RING_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "gviewaudio.h"
+
+/*
+ * single producer / single consumer byte ring
+ * the producer (capture callback) and the consumer (encoder thread)
+ * never share a lock: each side owns one position counter and only
+ * reads the other one (acquire/release ordering)
+ * blocks are stored contiguously (a padding record is used at the wrap
+ * point) so the consumer can process them in place
+ */
+
+#define AUDIO_RING_CACHE_LINE (64)
+
+/*block flags*/
+#define AUDIO_RING_BLOCK_DATA (0)
+#define AUDIO_RING_BLOCK_PAD  (1)
+
+/*ring block header (one cache line) - payload is cache line aligned*/
+typedef struct _audio_ring_block_t
+{
+	uint32_t size;         /*payload size in bytes*/
+	uint32_t flag;         /*block flag (AUDIO_RING_BLOCK_XXX)*/
+	int64_t timestamp;     /*timestamp of the first frame (ns)*/
+	int64_t capture_ts;    /*device (monotonic) timestamp for end of data (ns)*/
+	float level_meter[2];  /*channels level*/
+	uint32_t frames;       /*number of audio frames in payload*/
+	uint32_t reserved[7];
+} audio_ring_block_t;
+
+typedef struct _audio_ring_t
+{
+	/*consumer owned*/
+	uint64_t read_pos __attribute__((aligned(AUDIO_RING_CACHE_LINE)));
+	uint64_t reported_overruns; /*overruns already reported by the consumer*/
+
+	/*producer owned*/
+	uint64_t write_pos __attribute__((aligned(AUDIO_RING_CACHE_LINE)));
+	uint64_t blocks;            /*blocks written*/
+	uint64_t overruns;          /*blocks dropped (ring full)*/
+	uint64_t dropped_frames;    /*audio frames dropped*/
+	uint64_t high_water;        /*max ring fill level (bytes)*/
+
+	/*read only after creation*/
+	uint8_t *data __attribute__((aligned(AUDIO_RING_CACHE_LINE)));
+	uint64_t size;              /*ring size in bytes*/
+} audio_ring_t;
+
+/*
+ * create a audio ring
+ * args:
+ *   block_size - payload size (bytes) of a typical block
+ *   num_blocks - number of typical blocks the ring must hold
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to new ring (must be freed with audio_ring_destroy)
+ */
+audio_ring_t *audio_ring_create(size_t block_size, int num_blocks);
+
+/*
+ * destroy a audio ring
+ * args:
+ *   ring - pointer to ring
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void audio_ring_destroy(audio_ring_t *ring);
+
+/*
+ * write a block into the ring (producer side - wait free)
+ * args:
+ *   ring - pointer to ring
+ *   data - pointer to payload data
+ *   size - payload size in bytes
+ *   frames - number of audio frames in payload
+ *   timestamp - block timestamp (ns)
+ *   capture_ts - device timestamp for end of data (ns)
+ *   level_meter - pointer to channels level (2 values)
+ *
+ * asserts:
+ *   ring is not null
+ *
+ * returns: 0 on success, -1 if the ring is full (block is dropped)
+ */
+int audio_ring_write(audio_ring_t *ring, const void *data, uint32_t size,
+	uint32_t frames, int64_t timestamp, int64_t capture_ts,
+	const float *level_meter);
+
+/*
+ * get the next block from the ring (consumer side - wait free)
+ *   the block stays owned by the consumer until audio_ring_release
+ * args:
+ *   ring - pointer to ring
+ *
+ * asserts:
+ *   ring is not null
+ *
+ * returns: pointer to block header (payload follows it) or NULL if empty
+ */
+audio_ring_block_t *audio_ring_peek(audio_ring_t *ring);
+
+/*
+ * release the block returned by audio_ring_peek (consumer side)
+ * args:
+ *   ring - pointer to ring
+ *   block - pointer to block header
+ *
+ * asserts:
+ *   ring is not null
+ *   block is not null
+ *
+ * returns: none
+ */
+void audio_ring_release(audio_ring_t *ring, audio_ring_block_t *block);
+
+/*
+ * get the ring statistics (can be called from any thread)
+ * args:
+ *   ring - pointer to ring
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   ring is not null
+ *   stats is not null
+ *
+ * returns: none
+ */
+void audio_ring_get_stats(audio_ring_t *ring, audio_ring_stats_t *stats);
+
+/*
+ * get the block payload
+ * args:
+ *   block - pointer to block header
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to block payload
+ */
+static inline void *audio_ring_block_data(audio_ring_block_t *block)
+{
+	return (void *) (block + 1);
+}
+
+#endif
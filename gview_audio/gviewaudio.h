@@ -61,6 +61,8 @@ __BEGIN_DECLS
 #define AUDIO_FX_REVERB (1<<2)
 #define AUDIO_FX_WAHWAH (1<<3)
 #define AUDIO_FX_DUCKY  (1<<4)
+/*number of effects (fx stats are indexed by fx mask bit)*/
+#define AUDIO_FX_COUNT  (5)
 
 /*audio sample format (definition also in gview_encoder)*/
 #ifndef GV_SAMPLE_TYPE_INT16
@@ -81,6 +83,58 @@ typedef struct _audio_buff_t
 	float level_meter[2]; /*average sample level*/
 } audio_buff_t;
 
+/*audio capture ring statistics*/
+typedef struct _audio_ring_stats_t
+{
+	uint64_t blocks;         /*buffers written to the ring*/
+	uint64_t overruns;       /*buffers dropped (ring full)*/
+	uint64_t dropped_frames; /*audio frames dropped*/
+	uint64_t size;           /*ring size (bytes)*/
+	uint64_t fill;           /*current ring fill level (bytes)*/
+	uint64_t high_water;     /*max ring fill level (bytes)*/
+} audio_ring_stats_t;
+
+/*audio clock drift statistics*/
+typedef struct _audio_drift_stats_t
+{
+	int enabled;             /*drift compensation enabled*/
+	double ratio;            /*device sample rate / nominal sample rate*/
+	double ppm;              /*device clock skew (ppm)*/
+	int64_t drift;           /*uncompensated drift against the monotonic clock (ns)*/
+	int64_t sync_error;      /*compensated drift against the monotonic clock (ns)*/
+	int64_t max_sync_error;  /*max absolute compensated drift (ns)*/
+	uint64_t frames_in;      /*captured frames*/
+	uint64_t frames_out;     /*resampled frames*/
+	uint64_t frames_dropped; /*captured frames dropped (resampler fifo full)*/
+	int resets;              /*clock resets (timestamp discontinuities)*/
+} audio_drift_stats_t;
+
+/*audio level meter snapshot*/
+#define AUDIO_METER_MAX_CHANNELS (8)
+typedef struct _audio_meter_levels_t
+{
+	uint32_t sequence;       /*snapshot sequence (0 - no levels yet)*/
+	int channels;            /*metered channels*/
+	int64_t timestamp;       /*timestamp of the last metered buffer (ns)*/
+	float peak[AUDIO_METER_MAX_CHANNELS];      /*sample peak of the last buffer*/
+	float rms[AUDIO_METER_MAX_CHANNELS];       /*rms level (300 ms integration)*/
+	float true_peak[AUDIO_METER_MAX_CHANNELS]; /*true peak (4x oversampled) of the last buffer*/
+	float true_peak_max[AUDIO_METER_MAX_CHANNELS]; /*max true peak since capture start*/
+	float lufs_momentary;    /*loudness over 400 ms (LUFS)*/
+	float lufs_short;        /*loudness over 3 s (LUFS)*/
+} audio_meter_levels_t;
+
+/*audio fx engine statistics (per effect arrays indexed by fx mask bit)*/
+typedef struct _audio_fx_stats_t
+{
+	uint32_t mask;                     /*fx the engine is prepared for*/
+	uint64_t buffers;                  /*processed buffers*/
+	uint64_t frames;                   /*processed audio frames*/
+	uint64_t total_ns[AUDIO_FX_COUNT]; /*total processing time (ns)*/
+	uint64_t max_ns[AUDIO_FX_COUNT];   /*max processing time for a buffer (ns)*/
+	double load[AUDIO_FX_COUNT];       /*processing time / audio time*/
+} audio_fx_stats_t;
+
 typedef struct _audio_device_t
 {
 	int id;                 /*audo device id*/
@@ -323,15 +377,160 @@ int audio_get_next_buffer(audio_context_t *audio_ctx,
 	int type,
 	uint32_t mask);
 
+/*
+ * map the next used buffer from the ring buffer (no copy) and apply fx
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   buff - pointer to a (non allocated) audio buffer
+ *   mask - audio fx mask
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   buff is not null
+ *
+ * returns: error code (buff->data points to interleaved float samples
+ *   owned by the audio ring until audio_release_next_buffer is called)
+ */
+int audio_map_next_buffer(audio_context_t *audio_ctx,
+	audio_buff_t *buff,
+	uint32_t mask);
+
+/*
+ * release a buffer mapped with audio_map_next_buffer
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   buff - pointer to the mapped audio buffer
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   buff is not null
+ *
+ * returns: none
+ */
+void audio_release_next_buffer(audio_context_t *audio_ctx, audio_buff_t *buff);
+
+/*
+ * enable/disable tpdf dither for int16 sample conversions
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *   enable - dither flag (0 - disable)
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: none
+ */
+void audio_set_dither(audio_context_t *audio_ctx, int enable);
+
+/*
+ * get the tpdf dither flag
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: dither flag
+ */
+int audio_get_dither(audio_context_t *audio_ctx);
+
+/*
+ * enable/disable audio clock drift compensation
+ *   (resamples the captured audio to the monotonic clock)
+ *   must be set before audio_start
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *   enable - compensation flag (0 - disable)
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: none
+ */
+void audio_set_drift_compensation(audio_context_t *audio_ctx, int enable);
+
+/*
+ * get the audio clock drift compensation flag
+ * args:
+ *   audio_ctx - pointer to audio context data
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: compensation flag
+ */
+int audio_get_drift_compensation(audio_context_t *audio_ctx);
+
+/*
+ * get the audio clock drift statistics
+ *   safe to call from any thread while capturing
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   stats is not null
+ *
+ * returns: error code (-1 if compensation is not running)
+ */
+int audio_get_drift_stats(audio_context_t *audio_ctx, audio_drift_stats_t *stats);
+
+/*
+ * get the capture ring statistics (overruns, fill level)
+ *   safe to call from any thread while capturing
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   stats is not null
+ *
+ * returns: error code (-1 if capture is not running)
+ */
+int audio_get_ring_stats(audio_context_t *audio_ctx, audio_ring_stats_t *stats);
+
+/*
+ * get the current audio levels (lock free - can be called from any thread)
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   levels - pointer to levels snapshot to fill
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *   levels is not null
+ *
+ * returns: error code (-1 if no audio was metered yet)
+ */
+int audio_get_meter_levels(audio_context_t *audio_ctx, audio_meter_levels_t *levels);
+
+/*
+ * prepare the fx engine for a new fx mask
+ *   allocates all the filter state, so it must be called outside
+ *   the audio path (e.g. when the user changes the fx selection)
+ * args:
+ *   audio_ctx - pointer to audio context
+ *   mask - or'ed fx combination
+ *
+ * asserts:
+ *   audio_ctx is not null
+ *
+ * returns: error code (0 - E_OK)
+ */
+int audio_fx_set_mask(audio_context_t *audio_ctx, uint32_t mask);
+
 /*
  * apply audio fx
+ *   only effects prepared by audio_fx_set_mask are applied
+ *   (no allocation is done here)
  * args:
  *   audio_ctx - pointer to audio context
  *   data - pointer to sample buffer to process
  *   mask - or'ed fx combination
  *
  * asserts:
- *    none
+ *    audio_ctx is not null
  *
  * returns: none
  */
@@ -339,13 +538,25 @@ void audio_fx_apply(audio_context_t *audio_ctx,
 	sample_t *data,
 	uint32_t mask);
 
+/*
+ * get the fx engine statistics (per effect cpu cost)
+ * args:
+ *   stats - pointer to fx stats to fill
+ *
+ * asserts:
+ *   stats is not null
+ *
+ * returns: error code (-1 if no fx engine is prepared)
+ */
+int audio_fx_get_stats(audio_fx_stats_t *stats);
+
 /*
  * clean audio fx data
  * args:
  *   none
  *
  * asserts:
- *   aud_fx is not null
+ *   none
  *
  * returns: none
  */
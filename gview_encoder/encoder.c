@@ -638,6 +638,28 @@ static encoder_audio_context_t *encoder_audio_init(encoder_context_t *encoder_ct
 	enc_audio_ctx->flush_delayed_frames = 0;
 	enc_audio_ctx->flush_done = 0;
 
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	/*
+	 * float pcm is the native capture format: skip libavcodec
+	 * and mux the processed ring buffers directly (no codec context,
+	 * no intermediate frame or packet copy)
+	 */
+	if(audio_defaults->codec_id == AV_CODEC_ID_PCM_F32LE)
+	{
+		enc_audio_ctx->avi_4cc = audio_defaults->avi_4cc;
+		enc_audio_ctx->monotonic_pts = audio_defaults->monotonic_pts;
+		enc_audio_ctx->pcm_passthrough = 1;
+		enc_audio_ctx->frame_size = 1152; /*same as the libav pcm default*/
+		enc_audio_ctx->block_align = encoder_ctx->audio_channels * sizeof(float);
+
+		if(verbosity > 0)
+			printf("ENCODER: Audio pcm passthrough (%d frames of %d bytes)\n",
+				enc_audio_ctx->frame_size, enc_audio_ctx->block_align);
+
+		return (enc_audio_ctx);
+	}
+#endif
+
 	/*
 	 * alloc the audio codec data
 	 */
@@ -866,6 +888,9 @@ int encoder_get_audio_frame_size(encoder_context_t *encoder_ctx)
 	if(encoder_ctx->enc_audio_ctx == NULL)
 		return -1;
 
+	if(encoder_ctx->enc_audio_ctx->pcm_passthrough)
+		return encoder_ctx->enc_audio_ctx->frame_size;
+
 	encoder_codec_data_t *audio_codec_data = (encoder_codec_data_t *) encoder_ctx->enc_audio_ctx->codec_data;
 
 	if(audio_codec_data == NULL)
@@ -896,6 +921,10 @@ int encoder_get_audio_sample_fmt(encoder_context_t *encoder_ctx)
 	if(encoder_ctx->enc_audio_ctx == NULL)
 		return sample_type;
 
+	/*passthrough muxes the native capture samples*/
+	if(encoder_ctx->enc_audio_ctx->pcm_passthrough)
+		return GV_SAMPLE_TYPE_FLOAT;
+
 	encoder_codec_data_t *audio_codec_data = (encoder_codec_data_t *) encoder_ctx->enc_audio_ctx->codec_data;
 
 	if(audio_codec_data == NULL)
@@ -920,6 +949,28 @@ int encoder_get_audio_sample_fmt(encoder_context_t *encoder_ctx)
 	return sample_type;
 }
 
+/*
+ * check if the audio encoder is a pcm passthrough
+ *   (samples are muxed straight from the audio ring)
+ * args:
+ *   encoder_ctx - pointer to encoder context
+ *
+ * asserts:
+ *   encoder_ctx is not null
+ *
+ * returns: 1 if pcm passthrough, 0 otherwise
+ */
+int encoder_get_audio_passthrough(encoder_context_t *encoder_ctx)
+{
+	/*assertions*/
+	assert(encoder_ctx);
+
+	if(encoder_ctx->enc_audio_ctx == NULL)
+		return 0;
+
+	return encoder_ctx->enc_audio_ctx->pcm_passthrough;
+}
+
 /*
  * get audio sample format max value
  * args:
@@ -1293,6 +1344,16 @@ int encoder_flush_audio_buffer(encoder_context_t *encoder_ctx)
 	/*assertions*/
 	assert(encoder_ctx != NULL);
 
+	if(encoder_ctx->enc_audio_ctx == NULL)
+		return -1;
+
+	/*no delayed frames without a codec*/
+	if(encoder_ctx->enc_audio_ctx->pcm_passthrough)
+	{
+		encoder_ctx->enc_audio_ctx->flush_done = 1;
+		return 0;
+	}
+
 	/*flush libav*/
 	int flushed_frame_counter = 0;
 	encoder_ctx->enc_audio_ctx->flush_delayed_frames  = 1;
@@ -1330,6 +1391,28 @@ int encoder_process_audio_buffer(encoder_context_t *encoder_ctx, void *data)
 		encoder_ctx->audio_channels <= 0)
 		return -1;
 
+	encoder_audio_context_t *enc_audio_ctx = encoder_ctx->enc_audio_ctx;
+
+	if(enc_audio_ctx->pcm_passthrough)
+	{
+		/*mux the sample buffer in place (pts is the capture timestamp)*/
+		enc_audio_ctx->outbuf = (uint8_t *) data;
+		enc_audio_ctx->outbuf_coded_size = enc_audio_ctx->frame_size * enc_audio_ctx->block_align;
+		enc_audio_ctx->dts = enc_audio_ctx->pts;
+		enc_audio_ctx->flags = AV_PKT_FLAG_KEY;
+		enc_audio_ctx->duration = enc_audio_ctx->frame_size;
+
+		int ret = encoder_write_audio_data(encoder_ctx);
+
+		/*the buffer belongs to the caller*/
+		enc_audio_ctx->outbuf = NULL;
+		enc_audio_ctx->outbuf_coded_size = 0;
+
+		last_audio_pts = enc_audio_ctx->pts;
+
+		return ret;
+	}
+
 	encoder_encode_audio(encoder_ctx, data);
 
 	int ret = encoder_write_audio_data(encoder_ctx);
@@ -1652,6 +1735,16 @@ int encoder_encode_audio(encoder_context_t *encoder_ctx, void *audio_data)
 
 	encoder_codec_data_t *audio_codec_data = (encoder_codec_data_t *) enc_audio_ctx->codec_data;
 
+	if(audio_codec_data == NULL)
+	{
+		if(verbosity > 1)
+			printf("ENCODER: no audio codec to encode with (pcm passthrough)\n");
+
+		enc_audio_ctx->flush_done = 1;
+		enc_audio_ctx->outbuf_coded_size = 0;
+		return outsize;
+	}
+
 	if(enc_audio_ctx->flush_delayed_frames)
 	{
 		//pkt.size = 0;
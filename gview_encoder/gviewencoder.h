@@ -173,6 +173,11 @@ typedef struct _encoder_audio_context_t
 
 	int monotonic_pts;
 
+	/*pcm passthrough (no codec - capture samples muxed as is)*/
+	int pcm_passthrough;
+	int frame_size;
+	int block_align;
+
 	/*delayed frames handling*/
 	int flush_delayed_frames;
 	int flushed_buffers;
@@ -478,6 +483,19 @@ int encoder_get_audio_frame_size(encoder_context_t *encoder_ctx);
  */
 int encoder_get_audio_sample_fmt(encoder_context_t *encoder_ctx);
 
+/*
+ * check if the audio encoder is a pcm passthrough
+ *   (samples are muxed straight from the audio ring)
+ * args:
+ *   encoder_ctx - pointer to encoder context
+ *
+ * asserts:
+ *   encoder_ctx is not null
+ *
+ * returns: 1 if pcm passthrough, 0 otherwise
+ */
+int encoder_get_audio_passthrough(encoder_context_t *encoder_ctx);
+
 /*
  * get the video codec index for VP9 (webm) codec
  * args:
@@ -160,7 +160,9 @@ int encoder_write_audio_data(encoder_context_t *encoder_ctx)
 
 	encoder_codec_data_t *audio_codec_data = (encoder_codec_data_t *) enc_audio_ctx->codec_data;
 
-	if(audio_codec_data)
+	if(enc_audio_ctx->pcm_passthrough)
+		block_align = enc_audio_ctx->block_align;
+	else if(audio_codec_data)
 		block_align = audio_codec_data->codec_context->block_align;
 
 	__LOCK_MUTEX( __PMUTEX );
@@ -267,7 +269,19 @@ void encoder_muxer_init(encoder_context_t *encoder_ctx, const char *filename)
 				encoder_ctx->audio_channels > 0)
 			{
 				encoder_codec_data_t *audio_codec_data = (encoder_codec_data_t *) encoder_ctx->enc_audio_ctx->codec_data;
-				if(audio_codec_data)
+				if(encoder_ctx->enc_audio_ctx->pcm_passthrough)
+				{
+					/*no codec context: stream parameters from the codec defaults*/
+					audio_stream = avi_add_audio_stream(
+						avi_ctx,
+						encoder_ctx->audio_channels,
+						encoder_ctx->audio_samprate,
+						encoder_get_audio_bits(encoder_ctx->audio_codec_ind),
+						encoder_get_audio_bit_rate(encoder_ctx->audio_codec_ind),
+						AV_CODEC_ID_PCM_F32LE,
+						encoder_ctx->enc_audio_ctx->avi_4cc);
+				}
+				else if(audio_codec_data)
 				{
 					int acodec_ind = get_audio_codec_list_index(audio_codec_data->codec_context->codec_id);
 					/*sample size - only used for PCM*/
@@ -330,9 +344,16 @@ void encoder_muxer_init(encoder_context_t *encoder_ctx, const char *filename)
 				encoder_ctx->audio_channels > 0)
 			{
 				encoder_codec_data_t *audio_codec_data = (encoder_codec_data_t *) encoder_ctx->enc_audio_ctx->codec_data;
-				if(audio_codec_data)
+				if(audio_codec_data || encoder_ctx->enc_audio_ctx->pcm_passthrough)
 				{
-					mkv_ctx->audio_frame_size = audio_codec_data->codec_context->frame_size;
+					int codec_id = AV_CODEC_ID_PCM_F32LE;
+					if(audio_codec_data)
+					{
+						mkv_ctx->audio_frame_size = audio_codec_data->codec_context->frame_size;
+						codec_id = audio_codec_data->codec_context->codec_id;
+					}
+					else
+						mkv_ctx->audio_frame_size = encoder_ctx->enc_audio_ctx->frame_size;
 
 					/*sample size - only used for PCM*/
 					int32_t a_bits = encoder_get_audio_bits(encoder_ctx->audio_codec_ind);
@@ -345,10 +366,12 @@ void encoder_muxer_init(encoder_context_t *encoder_ctx, const char *filename)
 						encoder_ctx->audio_samprate,
 						a_bits,
 						b_rate,
-						audio_codec_data->codec_context->codec_id,
+						codec_id,
 						encoder_ctx->enc_audio_ctx->avi_4cc);
 
-					audio_stream->extra_data_size = encoder_set_audio_mkvCodecPriv(encoder_ctx);
+					/*pcm has no codec private data*/
+					if(audio_codec_data)
+						audio_stream->extra_data_size = encoder_set_audio_mkvCodecPriv(encoder_ctx);
 
 					if(audio_stream->extra_data_size > 0)
 						audio_stream->extra_data = encoder_get_audio_mkvCodecPriv(encoder_ctx->audio_codec_ind);
@@ -0,0 +1,240 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#           Nobuhiro Iwamatsu <iwamatsu@nigauri.org>                            #
+#                             Add UYVY color support(Macbook iSight)            #
+#           Flemming Frandsen <dren.dk@gmail.com>                               #
+#                             Add VU meter OSD                                  #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Render library - shared memory preview reference client                      #
+#                                                                               #
+#  reads yu12 frames published by the RENDER_SHM render and writes them         #
+#  to stdout as raw video, e.g.:                                                #
+#    gview_shmview | ffplay -f rawvideo -pixel_format yuv420p                   #
+#                          -video_size 640x480 -                                #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gviewrender.h"
+
+/*
+ * copy the last published frame from the shm ring
+ * args:
+ *   area - pointer to the mapped shm object
+ *   area_size - size of the mapped shm object
+ *   frame - pointer to frame buffer
+ *   frame_size - frame buffer size
+ *   last_frame - frame number of the last copied frame
+ *
+ * asserts:
+ *   none
+ *
+ * returns: frame number of the copied frame or 0 if no new frame
+ */
+static uint64_t shm_copy_frame(uint8_t *area, size_t area_size,
+	uint8_t *frame, size_t frame_size, uint64_t last_frame)
+{
+	render_shm_header_t *header = (render_shm_header_t *) area;
+
+	/*never trust the producer header: it can change (or be corrupt)*/
+	uint32_t num_slots = header->num_slots;
+	if(num_slots == 0 || num_slots > RENDER_SHM_SLOTS ||
+		header->frame_size != frame_size)
+		return 0;
+
+	int retries = 0;
+	for(retries = 0; retries < 8; ++retries)
+	{
+		uint64_t frame_number = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+		if(frame_number == 0 || frame_number == last_frame)
+			return 0;
+
+		render_shm_slot_t *slot = &header->slot[frame_number % num_slots];
+
+		uint64_t seq1 = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if(seq1 & 1)
+			continue; /*producer is writing this slot*/
+
+		/*the frame must lie inside the mapped area*/
+		uint64_t offset = slot->offset;
+		if(offset < sizeof(render_shm_header_t) ||
+			offset > area_size || frame_size > area_size - offset)
+		{
+			fprintf(stderr, "SHMVIEW: invalid frame offset (%llu)\n", (unsigned long long) offset);
+			return 0;
+		}
+
+		memcpy(frame, area + offset, frame_size);
+		uint64_t slot_frame = slot->frame_number;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		uint64_t seq2 = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+
+		if(seq1 == seq2 && slot_frame == frame_number)
+			return frame_number;
+	}
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n SHM_NAME] [-c FRAMES] [-u UID]\n", prog);
+	fprintf(stderr, "  -n  shm object name (default: %s)\n", RENDER_SHM_NAME);
+	fprintf(stderr, "  -c  number of frames to read (default: 0 - until the producer stops)\n");
+	fprintf(stderr, "  -u  uid of the producer (default: our own - see guvcview --shm_group)\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *name = RENDER_SHM_NAME;
+	long max_frames = 0;
+	uid_t owner = geteuid();
+
+	int opt = 0;
+	while((opt = getopt(argc, argv, "n:c:u:h")) != -1)
+	{
+		switch(opt)
+		{
+			case 'n':
+				name = optarg;
+				break;
+			case 'c':
+				max_frames = strtol(optarg, NULL, 10);
+				break;
+			case 'u':
+				owner = (uid_t) strtoul(optarg, NULL, 10);
+				break;
+			case 'h':
+			default:
+				usage(argv[0]);
+				return (opt == 'h') ? 0 : -1;
+		}
+	}
+
+	int fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0)
+	{
+		fprintf(stderr, "SHMVIEW: couldn't open %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(render_shm_header_t))
+	{
+		fprintf(stderr, "SHMVIEW: invalid shm object %s\n", name);
+		close(fd);
+		return -1;
+	}
+
+	/*
+	 * only trust a ring created by the expected owner (default: ourselves)
+	 * that nobody else can write to
+	 */
+	if(st.st_uid != owner || (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+	{
+		fprintf(stderr, "SHMVIEW: %s is not owned by uid %lu or is writable by others\n",
+			name, (unsigned long) owner);
+		close(fd);
+		return -1;
+	}
+
+	uint8_t *area = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(area == MAP_FAILED)
+	{
+		fprintf(stderr, "SHMVIEW: couldn't map %s: %s\n", name, strerror(errno));
+		return -1;
+	}
+
+	render_shm_header_t *header = (render_shm_header_t *) area;
+
+	if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != RENDER_SHM_MAGIC ||
+		header->version != RENDER_SHM_VERSION ||
+		header->num_slots == 0 ||
+		header->num_slots > RENDER_SHM_SLOTS ||
+		header->frame_size == 0 ||
+		header->frame_size > (uint64_t) st.st_size ||
+		header->shm_size > (uint64_t) st.st_size)
+	{
+		fprintf(stderr, "SHMVIEW: %s is not a compatible guvcview preview ring\n", name);
+		munmap(area, st.st_size);
+		return -1;
+	}
+
+	fprintf(stderr, "SHMVIEW: %s -> %ux%u yu12 (%u bytes per frame)\n",
+		name, header->width, header->height, header->frame_size);
+
+	size_t frame_size = header->frame_size;
+	uint8_t *frame = malloc(frame_size);
+	if(frame == NULL)
+	{
+		fprintf(stderr, "SHMVIEW: couldn't allocate frame buffer: %s\n", strerror(errno));
+		munmap(area, st.st_size);
+		return -1;
+	}
+
+	uint64_t last_frame = 0;
+	long frames = 0;
+
+	while(__atomic_load_n(&header->active, __ATOMIC_ACQUIRE))
+	{
+		uint64_t frame_number = shm_copy_frame(area, st.st_size, frame, frame_size, last_frame);
+
+		if(frame_number == 0)
+		{
+			/*no new frame - sleep a milisec*/
+			struct timespec req = {
+				.tv_sec = 0,
+				.tv_nsec = 1000000};/*nanosec*/
+			nanosleep(&req, NULL);
+			continue;
+		}
+
+		last_frame = frame_number;
+
+		if(fwrite(frame, frame_size, 1, stdout) != 1)
+			break; /*output closed*/
+
+		frames++;
+		if(max_frames > 0 && frames >= max_frames)
+			break;
+	}
+
+	fflush(stdout);
+
+	free(frame);
+	munmap(area, st.st_size);
+
+	return 0;
+}
@@ -43,6 +43,7 @@ __BEGIN_DECLS
 #define RENDER_NONE     (0)
 #define RENDER_SDL      (1)
 #define RENDER_SFML     (2)
+#define RENDER_SHM      (3)
 
 #define EV_QUIT      (0)
 #define EV_KEY_UP    (1)
@@ -75,6 +76,46 @@ __BEGIN_DECLS
 #define REND_OSD_VUMETER_STEREO (1<<1)
 #define REND_OSD_CROSSHAIR      (1<<2)
 
+/*
+ * shared memory preview ring (RENDER_SHM)
+ *
+ * the capture process publishes yu12 frames in a posix shared memory
+ * object with RENDER_SHM_SLOTS frame slots; external viewers map it
+ * read only and copy the last published frame.
+ * each slot is guarded by a sequence counter (seqlock):
+ *   odd - the producer is writing the slot
+ *   even - slot is stable
+ * a reader must check that the slot sequence is even and unchanged
+ * after copying the frame data, otherwise it should retry.
+ */
+#define RENDER_SHM_NAME    "/guvcview_preview"
+#define RENDER_SHM_MAGIC   (0x48535647) /*'GVSH'*/
+#define RENDER_SHM_VERSION (1)
+#define RENDER_SHM_SLOTS   (4)
+
+typedef struct _render_shm_slot_t
+{
+	uint64_t sequence;     /*seqlock counter (odd while writing)*/
+	uint64_t frame_number; /*frame number stored in slot (starts at 1)*/
+	uint64_t timestamp;    /*publish time - monotonic clock in ns*/
+	uint64_t offset;       /*frame data offset from the start of the shm object*/
+} render_shm_slot_t;
+
+typedef struct _render_shm_header_t
+{
+	uint32_t magic;        /*RENDER_SHM_MAGIC*/
+	uint32_t version;      /*RENDER_SHM_VERSION*/
+	uint32_t width;        /*frame width*/
+	uint32_t height;       /*frame height*/
+	uint32_t pixelformat;  /*v4l2 fourcc (always V4L2_PIX_FMT_YUV420)*/
+	uint32_t frame_size;   /*frame data size in bytes*/
+	uint32_t num_slots;    /*number of frame slots*/
+	uint32_t active;       /*1 while the producer is running*/
+	uint64_t sequence;     /*frame number of the last published frame (0 - none)*/
+	uint64_t shm_size;     /*total size of the shm object*/
+	render_shm_slot_t slot[RENDER_SHM_SLOTS];
+} render_shm_header_t;
+
 typedef int (*render_event_callback)(void *data);
 
 typedef struct _render_events_t
@@ -144,6 +185,70 @@ void render_set_crosshair_color(uint32_t rgb_color);
  */
 uint32_t render_get_crosshair_color();
 
+/*
+ * set the shared memory object name used by RENDER_SHM
+ * args:
+ *   name - shm object name (e.g. "/guvcview_video0")
+ *          if NULL or empty use RENDER_SHM_NAME
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void render_set_shm_name(const char *name);
+
+/*
+ * allow members of our group to read the RENDER_SHM preview ring
+ *  (must be set before render_init)
+ * args:
+ *   enable - if set the ring is created 0640 (default 0600 - owner only)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void render_set_shm_group_access(int enable);
+
+/*
+ * set the preview policy (must be set before render_init)
+ * args:
+ *   max_fps - maximum preview frame rate (0 - render every frame)
+ *   width - maximum preview width (0 - frame width)
+ *   height - maximum preview height (0 - frame height)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void render_set_preview_policy(double max_fps, int width, int height);
+
+/*
+ * get preview width (after applying the preview policy)
+ * args:
+ *   none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: preview width
+ */
+int render_get_preview_width();
+
+/*
+ * get preview height (after applying the preview policy)
+ * args:
+ *   none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: preview height
+ */
+int render_get_preview_height();
+
 /*
  * get render width
  * args:
@@ -171,7 +276,7 @@ int render_get_height();
 /*
  * render initialization
  * args:
- *   render - render API to use (RENDER_NONE, RENDER_SDL1, ...)
+ *   render - render API to use (RENDER_NONE, RENDER_SDL, RENDER_SFML, RENDER_SHM)
  *   width - render width
  *   height - render height
  *   flags - window flags:
@@ -200,10 +305,35 @@ int render_init(int render, int width, int height, int flags, int win_w, int win
  */
 void render_set_caption(const char* caption);
 
+/*
+ * check if a frame is due for preview (preview fps policy)
+ * args:
+ *    timestamp - frame timestamp (ns)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: 1 if the frame should be rendered, 0 otherwise
+ */
+int render_preview_is_due(uint64_t timestamp);
+
+/*
+ * get the preview frame for frame (downscaled if needed)
+ * args:
+ *    frame - pointer to frame buffer (yu12 format - render width x height)
+ *
+ * asserts:
+ *    frame is not null
+ *
+ * returns: pointer to preview frame (yu12 format - preview width x height)
+ *          this is either frame or an internal buffer
+ */
+uint8_t *render_get_preview_frame(uint8_t *frame);
+
 /*
  * render a frame
  * args:
- *   frame - pointer to frame data (yuyv format)
+ *   frame - pointer to preview frame data (yu12 format)
  *
  * asserts:
  *   frame is not null
@@ -212,6 +342,18 @@ void render_set_caption(const char* caption);
  */
 int render_frame(uint8_t *frame);
 
+/*
+ * dispatch render events (for frames that are not rendered)
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_dispatch_events();
+
 /*
  * get event index on render_events_list
  * args:
@@ -266,7 +408,7 @@ void render_frame_fx(uint8_t *frame, uint32_t mask);
 /*
  * Apply OSD mask
  * args:
- *    frame - pointer to frame buffer (yuyv format)
+ *    frame - pointer to preview frame buffer (yu12 format)
  *
  * asserts:
  *    frame is not null
@@ -37,12 +37,15 @@
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
+#include <limits.h>
 /* support for internationalization - i18n */
 #include <locale.h>
 #include <libintl.h>
 
+#include "gview.h"
 #include "gviewrender.h"
 #include "render.h"
+#include "render_shm.h"
 #include "../config.h"
 
 #if ENABLE_SDL2
@@ -61,11 +64,26 @@ static int render_api = RENDER_SDL;
 static int my_width = 0;
 static int my_height = 0;
 
+/*preview policy*/
+static double my_preview_max_fps = 0; /*0 - render every frame*/
+static int my_preview_req_width = 0; /*0 - use frame width*/
+static int my_preview_req_height = 0; /*0 - use frame height*/
+
+static int my_preview_width = 0;
+static int my_preview_height = 0;
+static int my_preview_scaled = 0; /*preview is a downscaled copy of the frame*/
+static uint64_t my_last_preview_ts = 0;
+
 static uint32_t my_osd_mask = REND_OSD_NONE;
 static uint32_t my_crosshair_color_rgb = 0x0000FF00;
 
+/*vu levels (written by the audio thread, read by the render loop)*/
+static gv_seqlock_t osd_vu_lock = {0};
 static float osd_vu_level[2] = {0, 0};
 
+static char my_shm_name[NAME_MAX] = RENDER_SHM_NAME;
+static int my_shm_group_access = 0;
+
 static render_events_t render_events_list[] =
 {
 	{
@@ -203,8 +221,7 @@ uint32_t render_get_crosshair_color()
  */
 void render_set_vu_level(float vu_level[2])
 {
-	osd_vu_level[0] = vu_level[0];
-	osd_vu_level[1] = vu_level[1];
+	gv_seqlock_write(&osd_vu_lock, osd_vu_level, vu_level, sizeof(osd_vu_level));
 }
 
 /*
@@ -219,8 +236,94 @@ void render_set_vu_level(float vu_level[2])
  */
 void render_get_vu_level(float vu_level[2])
 {
-	vu_level[0] = osd_vu_level[0];
-	vu_level[1] = osd_vu_level[1];
+	gv_seqlock_read(&osd_vu_lock, vu_level, osd_vu_level, sizeof(osd_vu_level));
+}
+
+/*
+ * set the shared memory object name used by RENDER_SHM
+ * args:
+ *   name - shm object name (e.g. "/guvcview_video0")
+ *          if NULL or empty use RENDER_SHM_NAME
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void render_set_shm_name(const char *name)
+{
+	if(name == NULL || strlen(name) < 1)
+		name = RENDER_SHM_NAME;
+
+	/*posix shm names must start with a slash*/
+	if(name[0] != '/')
+		snprintf(my_shm_name, NAME_MAX, "/%s", name);
+	else
+		snprintf(my_shm_name, NAME_MAX, "%s", name);
+}
+
+/*
+ * allow members of our group to read the RENDER_SHM preview ring
+ * args:
+ *   enable - if set the ring is created 0640 (default 0600 - owner only)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void render_set_shm_group_access(int enable)
+{
+	my_shm_group_access = enable ? 1 : 0;
+}
+
+/*
+ * set the preview policy (must be set before render_init)
+ * args:
+ *   max_fps - maximum preview frame rate (0 - render every frame)
+ *   width - maximum preview width (0 - frame width)
+ *   height - maximum preview height (0 - frame height)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void render_set_preview_policy(double max_fps, int width, int height)
+{
+	my_preview_max_fps = (max_fps > 0) ? max_fps : 0;
+	my_preview_req_width = (width > 0) ? width : 0;
+	my_preview_req_height = (height > 0) ? height : 0;
+}
+
+/*
+ * get preview width (after applying the preview policy)
+ * args:
+ *   none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: preview width
+ */
+int render_get_preview_width()
+{
+	return my_preview_width;
+}
+
+/*
+ * get preview height (after applying the preview policy)
+ * args:
+ *   none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: preview height
+ */
+int render_get_preview_height()
+{
+	return my_preview_height;
 }
 
 /*
@@ -256,7 +359,7 @@ int render_get_height()
 /*
  * render initialization
  * args:
- *   render - render API to use (RENDER_NONE, RENDER_SDL1, ...)
+ *   render - render API to use (RENDER_NONE, RENDER_SDL, RENDER_SFML, RENDER_SHM)
  *   width - render width
  *   height - render height
  *   flags - window flags:
@@ -280,20 +383,56 @@ int render_init(int render, int width, int height, int flags, int win_w, int win
 	my_width = width;
 	my_height = height;
 
+	/*preview size: fit the frame in the requested size (keep aspect)*/
+	my_preview_width = width;
+	my_preview_height = height;
+	my_preview_scaled = 0;
+	my_last_preview_ts = 0;
+
+	if(render_api != RENDER_NONE &&
+		((my_preview_req_width > 0 && my_preview_req_width < width) ||
+		 (my_preview_req_height > 0 && my_preview_req_height < height)))
+	{
+		double scale_w = (my_preview_req_width > 0) ?
+			(double) my_preview_req_width / width : 1.0;
+		double scale_h = (my_preview_req_height > 0) ?
+			(double) my_preview_req_height / height : 1.0;
+		double scale = MIN(scale_w, scale_h);
+
+		/*yu12 needs even dimensions*/
+		int preview_w = ((int) (width * scale)) & ~1;
+		int preview_h = ((int) (height * scale)) & ~1;
+
+		if(preview_w >= 16 && preview_h >= 16 &&
+			render_scale_init(width, height, preview_w, preview_h) == 0)
+		{
+			my_preview_width = preview_w;
+			my_preview_height = preview_h;
+			my_preview_scaled = 1;
+		}
+		else
+			fprintf(stderr, "RENDER: couldn't set preview size %ix%i - using %ix%i\n",
+				my_preview_req_width, my_preview_req_height, width, height);
+	}
+
 	switch(render_api)
 	{
 		case RENDER_NONE:
 			break;
 
+		case RENDER_SHM:
+			ret = init_render_shm(my_preview_width, my_preview_height, my_shm_name, my_shm_group_access);
+			break;
+
 		#if ENABLE_SFML
 		case RENDER_SFML:
-			ret = init_render_sfml(my_width, my_height, flags, win_w, win_h);
+			ret = init_render_sfml(my_preview_width, my_preview_height, flags, win_w, win_h);
 			break;
 		#endif
 
 		#if ENABLE_SDL2
 		case RENDER_SDL:
-			ret = init_render_sdl2(my_width, my_height, flags, win_w, win_h);
+			ret = init_render_sdl2(my_preview_width, my_preview_height, flags, win_w, win_h);
 			break;
 		#endif
 
@@ -327,10 +466,66 @@ void render_frame_fx(uint8_t *frame, uint32_t mask)
 	render_fx_apply(frame, my_width, my_height, mask);
 }
 
+/*
+ * check if a frame is due for preview (preview fps policy)
+ * args:
+ *    timestamp - frame timestamp (ns)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: 1 if the frame should be rendered, 0 otherwise
+ */
+int render_preview_is_due(uint64_t timestamp)
+{
+	if(my_preview_max_fps <= 0)
+		return 1;
+
+	uint64_t interval = (uint64_t) (NSEC_PER_SEC / my_preview_max_fps);
+
+	/*
+	 * allow 1/8 of the interval of jitter, otherwise a preview rate
+	 * equal to the capture rate would drop frames at random
+	 */
+	if(my_last_preview_ts == 0 ||
+		timestamp < my_last_preview_ts ||
+		timestamp - my_last_preview_ts >= interval - interval / 8)
+	{
+		my_last_preview_ts = timestamp;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * get the preview frame for frame (downscaled if needed)
+ * args:
+ *    frame - pointer to frame buffer (yu12 format - render width x height)
+ *
+ * asserts:
+ *    frame is not null
+ *
+ * returns: pointer to preview frame (yu12 format - preview width x height)
+ *          this is either frame or an internal buffer
+ */
+uint8_t *render_get_preview_frame(uint8_t *frame)
+{
+	/*asserts*/
+	assert(frame != NULL);
+
+	if(!my_preview_scaled)
+		return frame;
+
+	uint8_t *preview = render_scale_yu12(frame);
+
+	return (preview != NULL) ? preview : frame;
+}
+
 /*
  * Apply OSD mask
  * args:
- *    frame - pointer to frame buffer (yu12 format)
+ *    frame - pointer to preview frame buffer (yu12 format)
  *
  * asserts:
  *    frame is not null
@@ -345,16 +540,16 @@ void render_frame_osd(uint8_t *frame)
 	/*osd vu meter*/
 	if(((render_get_osd_mask() &
 		(REND_OSD_VUMETER_MONO | REND_OSD_VUMETER_STEREO))) != 0)
-		render_osd_vu_meter(frame, my_width, my_height, vu_level);
+		render_osd_vu_meter(frame, my_preview_width, my_preview_height, vu_level);
 	/*osd crosshair*/
 	if(((render_get_osd_mask() & REND_OSD_CROSSHAIR)) != 0)
-		render_osd_crosshair(frame, my_width, my_height);
+		render_osd_crosshair(frame, my_preview_width, my_preview_height);
 }
 
 /*
  * render a frame
  * args:
- *   frame - pointer to frame data (yu12 format)
+ *   frame - pointer to preview frame data (yu12 format)
  *
  * asserts:
  *   frame is not null
@@ -372,16 +567,20 @@ int render_frame(uint8_t *frame)
 		case RENDER_NONE:
 			break;
 
+		case RENDER_SHM:
+			ret = render_shm_frame(frame, my_preview_width, my_preview_height);
+			break;
+
 		#if ENABLE_SFML
 		case RENDER_SFML:
-			ret = render_sfml_frame(frame, my_width, my_height);
+			ret = render_sfml_frame(frame, my_preview_width, my_preview_height);
 			render_sfml_dispatch_events();
 			break;
 		#endif
 
 		#if ENABLE_SDL2
 		case RENDER_SDL:
-			ret = render_sdl2_frame(frame, my_width, my_height);
+			ret = render_sdl2_frame(frame, my_preview_width, my_preview_height);
 			render_sdl2_dispatch_events();
 			break;
 		#endif
@@ -393,6 +592,37 @@ int render_frame(uint8_t *frame)
 	return ret;
 }
 
+/*
+ * dispatch render events (for frames that are not rendered)
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_dispatch_events()
+{
+	switch(render_api)
+	{
+		#if ENABLE_SFML
+		case RENDER_SFML:
+			render_sfml_dispatch_events();
+			break;
+		#endif
+
+		#if ENABLE_SDL2
+		case RENDER_SDL:
+			render_sdl2_dispatch_events();
+			break;
+		#endif
+
+		default:
+			break;
+	}
+}
+
 /*
  * set caption
  * args:
@@ -444,6 +674,10 @@ void render_close()
 		case RENDER_NONE:
 			break;
 
+		case RENDER_SHM:
+			render_shm_clean();
+			break;
+
 		#if ENABLE_SFML
 		case RENDER_SFML:
 			render_sfml_clean();
@@ -463,8 +697,18 @@ void render_close()
 	/*clean fx data*/
 	render_clean_fx();
 
+	/*clean osd sprites*/
+	render_osd_vu_meter_clean();
+	render_osd_crosshair_clean();
+
+	/*clean preview scaler*/
+	render_scale_clean();
+	my_preview_scaled = 0;
+
 	my_width = 0;
 	my_height = 0;
+	my_preview_width = 0;
+	my_preview_height = 0;
 }
 
 /*
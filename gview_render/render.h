@@ -26,6 +26,31 @@
 
 #ifndef RENDER_H
 #define RENDER_H
+
+typedef struct _yuv_color_t
+{
+	uint8_t y;
+	uint8_t u;
+	uint8_t v;
+} yuv_color_t;
+
+/*
+ * OSD sprite: yu12 planes plus luma and chroma alpha planes
+ * for a rectangle of the frame (even coordinates and size)
+ */
+typedef struct _render_osd_sprite_t
+{
+	int x;      /*top left x coordinate in frame*/
+	int y;      /*top left y coordinate in frame*/
+	int width;  /*sprite width*/
+	int height; /*sprite height*/
+	uint8_t *data; /*sprite buffer (all planes)*/
+	uint8_t *py;
+	uint8_t *pu;
+	uint8_t *pv;
+	uint8_t *alpha;    /*luma alpha (width x height)*/
+	uint8_t *alpha_uv; /*chroma alpha (width/2 x height/2)*/
+} render_osd_sprite_t;
 /*
  * render a vu meter
  * args:
@@ -41,6 +66,18 @@
  */
 void render_osd_vu_meter(uint8_t *frame, int width, int height, float vu_level[2]);
 
+/*
+ * clean vu meter osd data
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_osd_vu_meter_clean();
+
 /*
  * render a crosshair
  * args:
@@ -55,6 +92,123 @@ void render_osd_vu_meter(uint8_t *frame, int width, int height, float vu_level[2
  */
 void render_osd_crosshair(uint8_t *frame, int width, int height);
 
+/*
+ * clean crosshair osd data
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_osd_crosshair_clean();
+
+/*
+ * (re)allocate a sprite for a given frame rectangle
+ * args:
+ *   sprite - pointer to sprite
+ *   x - sprite top left x coordinate in frame (rounded down to even)
+ *   y - sprite top left y coordinate in frame (rounded down to even)
+ *   width - sprite width (rounded up to even)
+ *   height - sprite height (rounded up to even)
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: error code (0 - ok)
+ */
+int render_osd_sprite_alloc(render_osd_sprite_t *sprite, int x, int y, int width, int height);
+
+/*
+ * free sprite data
+ * args:
+ *   sprite - pointer to sprite
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_free(render_osd_sprite_t *sprite);
+
+/*
+ * clear a sprite (fully transparent)
+ * args:
+ *   sprite - pointer to sprite
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_clear(render_osd_sprite_t *sprite);
+
+/*
+ * set a sprite luma pixel (opaque)
+ * args:
+ *   sprite - pointer to sprite
+ *   x - x coordinate in frame
+ *   y - y coordinate in frame
+ *   color - pixel color
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_set_y(render_osd_sprite_t *sprite, int x, int y, yuv_color_t *color);
+
+/*
+ * set a sprite chroma pixel (opaque)
+ * args:
+ *   sprite - pointer to sprite
+ *   cx - x coordinate in frame chroma plane
+ *   cy - y coordinate in frame chroma plane
+ *   color - pixel color
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_set_uv(render_osd_sprite_t *sprite, int cx, int cy, yuv_color_t *color);
+
+/*
+ * fill a rectangle in a sprite (opaque)
+ *  chroma covers height/2 lines (at least one)
+ * args:
+ *   sprite - pointer to sprite
+ *   x - rectangle top left x coordinate in frame
+ *   y - rectangle top left y coordinate in frame
+ *   width - rectangle width
+ *   height - rectangle height
+ *   color - fill color
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_fill_rect(render_osd_sprite_t *sprite,
+	int x, int y, int width, int height, yuv_color_t *color);
+
+/*
+ * alpha blend a sprite into a yu12 frame
+ * args:
+ *   sprite - pointer to sprite
+ *   frame - pointer to yu12 frame data
+ *   width - frame width
+ *   height - frame height
+ *
+ * asserts:
+ *   sprite is not null
+ *   frame is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_blend(render_osd_sprite_t *sprite, uint8_t *frame, int width, int height);
+
 /*
  * Apply fx filters
  * args:
@@ -70,4 +224,43 @@ void render_osd_crosshair(uint8_t *frame, int width, int height);
  */
 void render_fx_apply(uint8_t *frame, int width, int height, uint32_t mask);
 
+/*
+ * init the yu12 preview scaler
+ * args:
+ *   src_width - frame width
+ *   src_height - frame height
+ *   dst_width - preview width
+ *   dst_height - preview height
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code (0 - ok)
+ */
+int render_scale_init(int src_width, int src_height, int dst_width, int dst_height);
+
+/*
+ * scale a yu12 frame to the preview size
+ * args:
+ *   frame - pointer to yu12 frame data (src_width x src_height)
+ *
+ * asserts:
+ *   frame is not null
+ *
+ * returns: pointer to scaled yu12 frame (internal buffer) or NULL on error
+ */
+uint8_t *render_scale_yu12(uint8_t *frame);
+
+/*
+ * clean the yu12 preview scaler
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_scale_clean();
+
 #endif
\ No newline at end of file
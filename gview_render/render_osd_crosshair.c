@@ -29,23 +29,24 @@
 
 #include "gview.h"
 #include "gviewrender.h"
+#include "render.h"
 
 extern int verbosity;
 
-typedef struct _yuv_color_t
-{
-	uint8_t y;
-	uint8_t u;
-	uint8_t v;
-} yuv_color_t;
+#define CROSSHAIR_SIZE (24)
+
+/*crosshair sprite and the state it was rasterized for*/
+static render_osd_sprite_t crosshair_sprite;
+static uint32_t crosshair_sprite_color = 0;
+static int crosshair_sprite_width = 0;
+static int crosshair_sprite_height = 0;
 
 /*
- * plot a crosshair in a yu12 frame (planar)
+ * rasterize a crosshair sprite for a yu12 frame (planar)
  * args:
- *   frame - pointer to yu12 frame data
- *   size  - frame line size in pixels (width)
- *   width - width
- *   height - height 
+ *   size  - crosshair size
+ *   width - frame width
+ *   height - frame height
  *   color - line color
  *
  * asserts:
@@ -53,78 +54,50 @@ typedef struct _yuv_color_t
  *
  * returns: none
  */
-static void plot_crosshair_yu12(uint8_t *frame, int size, int width, int height, yuv_color_t *color)
+static void rasterize_crosshair_yu12(int size, int width, int height, yuv_color_t *color)
 {
-	uint8_t *py = frame;
-	uint8_t *pu = frame + (width * height);
-	uint8_t *pv = pu + ((width * height) / 4);
+	if(render_osd_sprite_alloc(&crosshair_sprite,
+		(width - size)/2 - 2,
+		(height - size)/2 - 2,
+		size + 6,
+		size + 6) != 0)
+		return;
+
+	render_osd_sprite_clear(&crosshair_sprite);
 
 	/*y - 1st vertical line*/
 	int h = (height-size)/2;
 	for(h = (height-size)/2; h < height/2 - 2; h++)
-	{
-		py = frame + (h * width) + width/2;
-		*py = color->y;
-	}
+		render_osd_sprite_set_y(&crosshair_sprite, width/2, h, color);
 	/*y - 1st horizontal line*/
 	int w = (width-size)/2;
 	for(w = (width-size)/2; w < width/2 - 2; w++)
-	{
-		py = frame + ((height/2) * width) + w;
-		*py = color->y;
-	}
+		render_osd_sprite_set_y(&crosshair_sprite, w, height/2, color);
 	/*y - 2nd horizontal line*/
 	for(w = width/2 + 2; w < (width+size)/2; w++)
-	{
-		py = frame + ((height/2) * width) + w;
-		*py = color->y;
-	}
+		render_osd_sprite_set_y(&crosshair_sprite, w, height/2, color);
 	/*y - 2nd vertical line*/
 	for(h = height/2 + 2; h < (height+size)/2; h++)
-	{
-		py = frame + (h * width) + width/2;
-		*py = color->y;
-	}
+		render_osd_sprite_set_y(&crosshair_sprite, width/2, h, color);
 
-				
 	/*u v - 1st vertical line*/
 	for(h = (height-size)/4; h < height/4 - 1; h++) /*every two rows*/
-	{
-		pu = frame + (width * height) + (h * width/2) + width/4;
-		*pu = color->u;
-		pv = pu + (width * height)/4;
-		*pv = color->v;
-	}
+		render_osd_sprite_set_uv(&crosshair_sprite, width/4, h, color);
 	/*u v - 1st horizontal line*/
 	for(w = (width-size)/4; w < width/4 - 1; w++) /*every two rows*/
-	{
-		pu = frame + (width * height) + ((height/4) * width/2) + w;
-		*pu = color->u;
-		pv = pu + (width * height)/4;
-		*pv = color->v;
-	}
+		render_osd_sprite_set_uv(&crosshair_sprite, w, height/4, color);
 	/*u v - 2nd horizontal line*/
 	for(w = width/4 + 1; w < (width+size)/4; w++) /*every two rows*/
-	{
-		pu = frame + (width * height) + ((height/4) * width/2) + w;
-		*pu = color->u;
-		pv = pu + (width * height)/4;
-		*pv = color->v;
-	}
+		render_osd_sprite_set_uv(&crosshair_sprite, w, height/4, color);
 	/*u v - 2nd vertical line*/
 	for(h = height/4 + 1; h < (height+size)/4; h++) /*every two rows*/
-	{
-		pu = frame + (width * height) + (h * width/2) + width/4;
-		*pu = color->u;
-		pv = pu + (width * height)/4;
-		*pv = color->v;
-	}
+		render_osd_sprite_set_uv(&crosshair_sprite, width/4, h, color);
 }
 
 /*
  * render a crosshair
  * args:
- *   frame - pointer to yuyv frame data
+ *   frame - pointer to yu12 frame data
  *   width - frame width
  *   height - frame height
  *
@@ -135,20 +108,48 @@ static void plot_crosshair_yu12(uint8_t *frame, int size, int width, int height,
  */
 void render_osd_crosshair(uint8_t *frame, int width, int height)
 {
-	yuv_color_t color;
-	color.y = 0;
-	color.u = 0;
-	color.v = 0;
-
 	uint32_t rgb_color = render_get_crosshair_color();
 
-	uint8_t r = (uint8_t) ((rgb_color & 0x00FF0000) >> 16);
-	uint8_t g = (uint8_t) ((rgb_color & 0x0000FF00) >> 8);
-	uint8_t b = (uint8_t) (rgb_color & 0x000000FF);
+	/*only rasterize the sprite if color or frame size changed*/
+	if(crosshair_sprite.data == NULL ||
+		rgb_color != crosshair_sprite_color ||
+		width != crosshair_sprite_width ||
+		height != crosshair_sprite_height)
+	{
+		yuv_color_t color;
+
+		uint8_t r = (uint8_t) ((rgb_color & 0x00FF0000) >> 16);
+		uint8_t g = (uint8_t) ((rgb_color & 0x0000FF00) >> 8);
+		uint8_t b = (uint8_t) (rgb_color & 0x000000FF);
+
+		color.y = CLIP(0.299*(r-128) + 0.587*(g-128) + 0.114*(b-128) + 128) ;
+		color.u = CLIP(-0.147*(r-128) - 0.289*(g-128) + 0.436*(b-128) + 128);
+		color.v = CLIP(0.615*(r-128) - 0.515*(g-128) - 0.100*(b-128) + 128);
+
+		rasterize_crosshair_yu12(CROSSHAIR_SIZE, width, height, &color);
+
+		crosshair_sprite_color = rgb_color;
+		crosshair_sprite_width = width;
+		crosshair_sprite_height = height;
+	}
+
+	render_osd_sprite_blend(&crosshair_sprite, frame, width, height);
+}
 
-	color.y = CLIP(0.299*(r-128) + 0.587*(g-128) + 0.114*(b-128) + 128) ;
-	color.u = CLIP(-0.147*(r-128) - 0.289*(g-128) + 0.436*(b-128) + 128);
-	color.v = CLIP(0.615*(r-128) - 0.515*(g-128) - 0.100*(b-128) + 128);
+/*
+ * clean crosshair osd data
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_osd_crosshair_clean()
+{
+	render_osd_sprite_free(&crosshair_sprite);
 
-	plot_crosshair_yu12(frame, 24, width, height, &color);
+	crosshair_sprite_width = 0;
+	crosshair_sprite_height = 0;
 }
@@ -0,0 +1,358 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#           Nobuhiro Iwamatsu <iwamatsu@nigauri.org>                            #
+#                             Add UYVY color support(Macbook iSight)            #
+#           Flemming Frandsen <dren.dk@gmail.com>                               #
+#                             Add VU meter OSD                                  #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Render library - OSD sprites                                                 #
+#                                                                               #
+#  OSD elements are rasterized into yu12 + alpha sprites only when their state  #
+#  changes and then alpha blended into the preview frame                        #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gview.h"
+#include "gviewrender.h"
+#include "render.h"
+#include "../config.h"
+
+extern int verbosity;
+
+/*
+ * free sprite data
+ * args:
+ *   sprite - pointer to sprite
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_free(render_osd_sprite_t *sprite)
+{
+	/*asserts*/
+	assert(sprite != NULL);
+
+	if(sprite->data)
+		free(sprite->data);
+
+	memset(sprite, 0, sizeof(render_osd_sprite_t));
+}
+
+/*
+ * (re)allocate a sprite for a given frame rectangle
+ * args:
+ *   sprite - pointer to sprite
+ *   x - sprite top left x coordinate in frame (rounded down to even)
+ *   y - sprite top left y coordinate in frame (rounded down to even)
+ *   width - sprite width (rounded up to even)
+ *   height - sprite height (rounded up to even)
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: error code (0 - ok)
+ */
+int render_osd_sprite_alloc(render_osd_sprite_t *sprite, int x, int y, int width, int height)
+{
+	/*asserts*/
+	assert(sprite != NULL);
+
+	x &= ~1;
+	y &= ~1;
+	width = (width + 1) & ~1;
+	height = (height + 1) & ~1;
+
+	if(sprite->data &&
+		sprite->x == x && sprite->y == y &&
+		sprite->width == width && sprite->height == height)
+		return 0;
+
+	render_osd_sprite_free(sprite);
+
+	if(width <= 0 || height <= 0)
+		return -1;
+
+	size_t luma_size = width * height;
+	size_t chroma_size = luma_size / 4;
+
+	/*y + u + v + alpha + chroma alpha*/
+	sprite->data = calloc(2 * luma_size + 3 * chroma_size, sizeof(uint8_t));
+	if(sprite->data == NULL)
+	{
+		fprintf(stderr, "RENDER: couldn't allocate osd sprite: %s\n", strerror(errno));
+		return -1;
+	}
+
+	sprite->x = x;
+	sprite->y = y;
+	sprite->width = width;
+	sprite->height = height;
+
+	sprite->py = sprite->data;
+	sprite->pu = sprite->py + luma_size;
+	sprite->pv = sprite->pu + chroma_size;
+	sprite->alpha = sprite->pv + chroma_size;
+	sprite->alpha_uv = sprite->alpha + luma_size;
+
+	return 0;
+}
+
+/*
+ * clear a sprite (fully transparent)
+ * args:
+ *   sprite - pointer to sprite
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_clear(render_osd_sprite_t *sprite)
+{
+	/*asserts*/
+	assert(sprite != NULL);
+
+	if(sprite->data == NULL)
+		return;
+
+	memset(sprite->alpha, 0, sprite->width * sprite->height);
+	memset(sprite->alpha_uv, 0, (sprite->width * sprite->height) / 4);
+}
+
+/*
+ * set a sprite luma pixel (opaque)
+ * args:
+ *   sprite - pointer to sprite
+ *   x - x coordinate in frame
+ *   y - y coordinate in frame
+ *   color - pixel color
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_set_y(render_osd_sprite_t *sprite, int x, int y, yuv_color_t *color)
+{
+	x -= sprite->x;
+	y -= sprite->y;
+
+	if(x < 0 || y < 0 || x >= sprite->width || y >= sprite->height)
+		return;
+
+	sprite->py[y * sprite->width + x] = color->y;
+	sprite->alpha[y * sprite->width + x] = 255;
+}
+
+/*
+ * set a sprite chroma pixel (opaque)
+ * args:
+ *   sprite - pointer to sprite
+ *   cx - x coordinate in frame chroma plane
+ *   cy - y coordinate in frame chroma plane
+ *   color - pixel color
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_set_uv(render_osd_sprite_t *sprite, int cx, int cy, yuv_color_t *color)
+{
+	cx -= sprite->x / 2;
+	cy -= sprite->y / 2;
+
+	int cwidth = sprite->width / 2;
+
+	if(cx < 0 || cy < 0 || cx >= cwidth || cy >= sprite->height / 2)
+		return;
+
+	sprite->pu[cy * cwidth + cx] = color->u;
+	sprite->pv[cy * cwidth + cx] = color->v;
+	sprite->alpha_uv[cy * cwidth + cx] = 255;
+}
+
+/*
+ * fill a rectangle in a sprite (opaque)
+ *  chroma covers height/2 lines (at least one)
+ * args:
+ *   sprite - pointer to sprite
+ *   x - rectangle top left x coordinate in frame
+ *   y - rectangle top left y coordinate in frame
+ *   width - rectangle width
+ *   height - rectangle height
+ *   color - fill color
+ *
+ * asserts:
+ *   sprite is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_fill_rect(render_osd_sprite_t *sprite,
+	int x, int y, int width, int height, yuv_color_t *color)
+{
+	/*asserts*/
+	assert(sprite != NULL);
+
+	int i = 0;
+	int j = 0;
+
+	for(j = 0; j < height; ++j)
+		for(i = 0; i < width; ++i)
+			render_osd_sprite_set_y(sprite, x + i, y + j, color);
+
+	int cheight = (height > 1) ? height / 2 : 1;
+	for(j = 0; j < cheight; ++j)
+		for(i = 0; i < width / 2; ++i)
+			render_osd_sprite_set_uv(sprite, x / 2 + i, y / 2 + j, color);
+}
+
+/*
+ * alpha blend a line: dst = (src * a + dst * (255 - a)) / 255
+ * args:
+ *   dst - pointer to destination line
+ *   src - pointer to source line
+ *   alpha - pointer to alpha line
+ *   width - line width
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void blend_line(uint8_t *dst, const uint8_t *src, const uint8_t *alpha, int width)
+{
+	int x = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi16(255);
+	const __m128i rnd = _mm_set1_epi16(128);
+	for(; x + 16 <= width; x += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *) (alpha + x));
+
+		/*skip fully transparent blocks*/
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(a, zero)) == 0xFFFF)
+			continue;
+
+		__m128i s = _mm_loadu_si128((const __m128i *) (src + x));
+		__m128i d = _mm_loadu_si128((const __m128i *) (dst + x));
+
+		__m128i a_lo = _mm_unpacklo_epi8(a, zero);
+		__m128i a_hi = _mm_unpackhi_epi8(a, zero);
+
+		__m128i lo = _mm_add_epi16(
+			_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), a_lo),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(max, a_lo))),
+			rnd);
+		__m128i hi = _mm_add_epi16(
+			_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), a_hi),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(max, a_hi))),
+			rnd);
+
+		/*exact division by 255: (v + (v >> 8)) >> 8*/
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+		_mm_storeu_si128((__m128i *) (dst + x), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for(; x < width; ++x)
+	{
+		if(alpha[x] == 0)
+			continue;
+
+		int v = src[x] * alpha[x] + dst[x] * (255 - alpha[x]) + 128;
+		dst[x] = (uint8_t) ((v + (v >> 8)) >> 8);
+	}
+}
+
+/*
+ * alpha blend a sprite into a yu12 frame
+ * args:
+ *   sprite - pointer to sprite
+ *   frame - pointer to yu12 frame data
+ *   width - frame width
+ *   height - frame height
+ *
+ * asserts:
+ *   sprite is not null
+ *   frame is not null
+ *
+ * returns: none
+ */
+void render_osd_sprite_blend(render_osd_sprite_t *sprite, uint8_t *frame, int width, int height)
+{
+	/*asserts*/
+	assert(sprite != NULL);
+	assert(frame != NULL);
+
+	if(sprite->data == NULL)
+		return;
+
+	/*clip to frame*/
+	int sw = MIN(sprite->width, width - sprite->x);
+	int sh = MIN(sprite->height, height - sprite->y);
+
+	if(sw <= 0 || sh <= 0 || sprite->x < 0 || sprite->y < 0)
+		return;
+
+	int line = 0;
+	for(line = 0; line < sh; ++line)
+	{
+		int offset = line * sprite->width;
+		blend_line(
+			frame + (sprite->y + line) * width + sprite->x,
+			sprite->py + offset,
+			sprite->alpha + offset,
+			sw);
+	}
+
+	uint8_t *pu = frame + width * height;
+	uint8_t *pv = pu + (width * height) / 4;
+
+	int cwidth = width / 2;
+	int sprite_cwidth = sprite->width / 2;
+	for(line = 0; line < sh / 2; ++line)
+	{
+		int offset = line * sprite_cwidth;
+		int frame_offset = (sprite->y / 2 + line) * cwidth + sprite->x / 2;
+
+		blend_line(pu + frame_offset, sprite->pu + offset, sprite->alpha_uv + offset, sw / 2);
+		blend_line(pv + frame_offset, sprite->pv + offset, sprite->alpha_uv + offset, sw / 2);
+	}
+}
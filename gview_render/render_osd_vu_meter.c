@@ -25,120 +25,120 @@
 
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #include "gview.h"
 #include "gviewrender.h"
+#include "render.h"
 
 extern int verbosity;
 
-typedef struct _yuv_color_t
-{
-	uint8_t y;
-	uint8_t u;
-	uint8_t v;
-} yuv_color_t;
-
 #define REFERENCE_LEVEL 0.8
 #define VU_BARS         20
 
 static float vu_peak[2] = {0.0, 0.0};
 static float vu_peak_freeze[2]= {0.0 ,0.0};
 
+/*vu meter sprite and the state it was rasterized for*/
+static render_osd_sprite_t vu_sprite;
+static uint8_t vu_sprite_lit[2][VU_BARS];
+static int vu_sprite_channels = 0;
+static int vu_sprite_frame_width = 0;
+static int vu_sprite_frame_height = 0;
+
 /*
- * plot a rectangular box in a yu12 frame (planar)
+ * get the color for a vu meter bar
  * args:
- *   frame - pointer to yu12 frame data
- *   lines - number of lines in frame (height)
- *   linesize - frame line size in pixels (width)
- *   x - box top left x coordinate
- *   y - box top left y coordinate
- *   width - box width
- *   height - box height
- *   color - box color
+ *   box - bar index
+ *   color - pointer to color
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void plot_box_yu12(uint8_t *frame, int lines, int linesize, int x, int y, int width, int height, yuv_color_t *color)
+static void vu_bar_color(int box, yuv_color_t *color)
 {
-	uint8_t *py = frame;
-	uint8_t *pu = frame + (linesize * lines);
-	uint8_t *pv = pu + ((linesize * lines) / 4);
+	/* The dB it takes to light the current box */
+	float db = 2 * (box - (VU_BARS - 1));
 
-	/*y*/
-	int h = 0;
-	for(h = 0; h < height; ++h)
+	if (db < -10) /*green bar*/
 	{
-		py = frame + x + ((y + h) * linesize);
-		int w = 0;
-		for(w = 0; w < width; ++w)
-		{
-			*py++ = color->y;
-		}
+		color->y = 154;
+		color->u = 72;
+		color->v = 57;
 	}
-
-	/*u v*/
-	for(h = 0; h < height/2; h++) /*every two lines*/
+	else if (db < -2) /*yellow bar*/
 	{
-		pu = frame + (linesize * lines) + (int) floor(x/2) + (( (int) floor(y/2) + h) * (int) floor(linesize/2));
-		pv = pu + (int) floor((linesize * lines) / 4);
-
-		int w = 0;
-		for(w = 0; w < width/2; w++) /*every two rows*/
-		{
-			*pu++ = color->u;
-			*pv++ = color->v;
-		}
+		color->y = 203;
+		color->u = 44;
+		color->v = 142;
+	}
+	else /*red bar*/
+	{
+		color->y = 107;
+		color->u = 100;
+		color->v = 212;
 	}
 }
 
 /*
- * plot a line in a yu12 frame (planar)
+ * rasterize the vu meter sprite
  * args:
- *   frame - pointer to yu12 frame data
- *   lines - number of lines in frame (height)
- *   linesize - frame line size in pixels (width)
- *   x - box top left x coordinate
- *   y - box top left y coordinate
- *   width - line width
- *   color - line color
+ *   width - frame width
+ *   height - frame height
+ *   channels - number of channels to render
+ *   lit - bar light state for each channel
  *
  * asserts:
  *   none
  *
  * returns: none
  */
-static void plot_line_yu12(uint8_t *frame, int lines, int linesize, int x, int y, int width, yuv_color_t *color)
+static void vu_meter_rasterize(int width, int height, int channels, uint8_t lit[2][VU_BARS])
 {
-	uint8_t *py = frame;
-	uint8_t *pu = frame + (linesize * lines);
-	uint8_t *pv = pu + ((linesize * lines) / 4);
+	int bw = 2 * (width  / (VU_BARS * 8)); /*make it at least two pixels*/
+	int bh = height / 24;
 
-	int w = 0;
+	if(render_osd_sprite_alloc(&vu_sprite,
+		16, bh,
+		VU_BARS * (bw + 4),
+		2 * (bh + 4) + 2) != 0)
+		return;
 
-	/*y*/
-	py = frame + x + (y * linesize);
-	for(w = 0; w < width; ++w)
-	{
-		*py++ = color->y;
-	}
+	render_osd_sprite_clear(&vu_sprite);
 
-	/*u v*/
-	pu = frame + (linesize * lines) + (int) floor(x/2) + ((int) floor(y/2) * (int) floor(linesize/2));
-	pv = pu + (int) floor((linesize * lines) / 4);
-	for(w = 0; w < width/2; w ++) /*every two rows*/
+	int channel = 0;
+	for (channel = 0; channel < channels; ++channel)
 	{
-		*pu++ = color->u;
-		*pv++ = color->v;
+		int box = 0;
+		for (box = 0; box <= (VU_BARS - 1); ++box)
+		{
+			/* start x coordinate for box */
+			int bx = box * (bw + 4) + (16);
+			/* Start y coordinate for box (box top)*/
+			int by = channel * (bh + 4) + bh;
+
+			yuv_color_t color;
+			vu_bar_color(box, &color);
+
+			if (lit[channel][box])
+				render_osd_sprite_fill_rect(&vu_sprite, bx, by, bw, bh, &color);
+			else if (bw > 0) /*draw single line*/
+				render_osd_sprite_fill_rect(&vu_sprite, bx, by + (bh /2), bw, 1, &color);
+		}
 	}
+
+	memcpy(vu_sprite_lit, lit, sizeof(vu_sprite_lit));
+	vu_sprite_channels = channels;
+	vu_sprite_frame_width = width;
+	vu_sprite_frame_height = height;
 }
 
 /*
  * render a vu meter
  * args:
- *   frame - pointer to yuyv frame data
+ *   frame - pointer to yu12 frame data
  *   width - frame width
  *   height - frame height
  *   vu_level - vu level values (array with 2 channels)
@@ -150,15 +150,15 @@ static void plot_line_yu12(uint8_t *frame, int lines, int linesize, int x, int y
  */
 void render_osd_vu_meter(uint8_t *frame, int width, int height, float vu_level[2])
 {
-	int bw = 2 * (width  / (VU_BARS * 8)); /*make it at least two pixels*/
-	int bh = height / 24;
+	uint8_t lit[2][VU_BARS];
+	memset(lit, 0, sizeof(lit));
+
+	/*if mono mode only render first channel*/
+	int channels = ((render_get_osd_mask() & REND_OSD_VUMETER_MONO) != 0) ? 1 : 2;
 
 	int channel;
-	for (channel = 0; channel < 2; ++channel)
+	for (channel = 0; channel < channels; ++channel)
 	{
-		if((render_get_osd_mask() & REND_OSD_VUMETER_MONO) != 0 && channel > 0)
-			continue; /*if mono mode only render first channel*/
-
 		/*make sure we have a positive value (required by log10)*/
 		if(vu_level[channel] < 0)
 			vu_level[channel] = -vu_level[channel];
@@ -172,11 +172,11 @@ void render_osd_vu_meter(uint8_t *frame, int width, int height, float vu_level[2
 		else if (vu_peak_freeze[channel] > 0)
 		{
 			vu_peak_freeze[channel]--;
-  		}
-  		else if (vu_peak[channel] > vu_level[channel])
-  		{
+		}
+		else if (vu_peak[channel] > vu_level[channel])
+		{
 			vu_peak[channel] -= (vu_peak[channel] - vu_level[channel]) / 10;
-  		}
+		}
 
 		/*by default no bar is light */
 		float dBuLevel = - 4 * (VU_BARS - 1);
@@ -188,58 +188,54 @@ void render_osd_vu_meter(uint8_t *frame, int width, int height, float vu_level[2
 		if(vu_peak[channel] > 0)
 			dBuPeak  = 10 * log10(vu_peak[channel]  / REFERENCE_LEVEL);
 
-  		/* draw the bars */
-  		int peaked = 0;
-  		int box = 0;
-  		for (box = 0; box <= (VU_BARS - 1); ++box)
-  		{
+		/* light the bars */
+		int peaked = 0;
+		int box = 0;
+		for (box = 0; box <= (VU_BARS - 1); ++box)
+		{
 			/*
 			 * The dB it takes to light the current box
 			 * step of 2 db between boxes
 			 */
 			float db = 2 * (box - (VU_BARS - 1));
 
-			/* start x coordinate for box */
-			int bx = box * (bw + 4) + (16);
-			/* Start y coordinate for box (box top)*/
-			int by = channel * (bh + 4) + bh;
-
-			yuv_color_t color;
-			color.y = 127;
-			color.u = 127;
-			color.v = 127;
-
-			/*green bar*/
-			if (db < -10)
-			{
-					color.y = 154;
-  				color.u = 72;
-  				color.v = 57;
-			}
-			else if (db < -2) /*yellow bar*/
-			{
-					color.y = 203;
-  				color.u = 44;
-  				color.v = 142;
-			}
-			else /*red bar*/
-			{
-				color.y = 107;
-				color.u = 100;
-				color.v = 212;
-			}
-
 			int light = dBuLevel > db;
 			if (dBuPeak < db+1 && !peaked)
 			{
-  				peaked = 1;
-  				light = 1;
+				peaked = 1;
+				light = 1;
 			}
 
-			if (light)
-				plot_box_yu12(frame, height, width, bx, by, bw, bh, &color);
-			else if (bw > 0) /*draw single line*/
-				plot_line_yu12(frame, height, width, bx, by + (bh /2), bw, &color);
+			lit[channel][box] = light ? 1 : 0;
 		}
-  	}
+	}
+
+	/*only rasterize the sprite if the bars changed*/
+	if(vu_sprite.data == NULL ||
+		channels != vu_sprite_channels ||
+		width != vu_sprite_frame_width ||
+		height != vu_sprite_frame_height ||
+		memcmp(lit, vu_sprite_lit, sizeof(lit)) != 0)
+		vu_meter_rasterize(width, height, channels, lit);
+
+	render_osd_sprite_blend(&vu_sprite, frame, width, height);
+}
+
+/*
+ * clean vu meter osd data
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_osd_vu_meter_clean()
+{
+	render_osd_sprite_free(&vu_sprite);
+
+	vu_sprite_channels = 0;
+	vu_sprite_frame_width = 0;
+	vu_sprite_frame_height = 0;
 }
@@ -0,0 +1,460 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#           Nobuhiro Iwamatsu <iwamatsu@nigauri.org>                            #
+#                             Add UYVY color support(Macbook iSight)            #
+#           Flemming Frandsen <dren.dk@gmail.com>                               #
+#                             Add VU meter OSD                                  #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Render library - yu12 preview downscaler                                     #
+#                                                                               #
+#  each plane is first reduced by successive 2x2 box filters while it's at      #
+#  least twice the target size and then bilinear interpolated to the final     #
+#  size (so big reduction factors don't alias)                                  #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gview.h"
+#include "gviewrender.h"
+#include "render.h"
+#include "../config.h"
+
+extern int verbosity;
+
+typedef struct _scale_plane_t
+{
+	int src_width;     /*plane source width*/
+	int src_height;    /*plane source height*/
+	int dst_width;     /*plane target width*/
+	int dst_height;    /*plane target height*/
+	int halvings;      /*number of 2x2 box reductions*/
+	int bl_width;      /*plane width after box reductions*/
+	int bl_height;     /*plane height after box reductions*/
+	int *x_ofs;        /*bilinear source column for each target column*/
+	uint16_t *x_frac;  /*bilinear column weight (0-256)*/
+	int *y_ofs;        /*bilinear source line for each target line*/
+	uint16_t *y_frac;  /*bilinear line weight (0-256)*/
+} scale_plane_t;
+
+static scale_plane_t plane_y;
+static scale_plane_t plane_uv;
+
+static uint8_t *scale_tmp[2] = {NULL, NULL}; /*box reduction ping pong buffers*/
+static uint8_t *scale_row = NULL; /*vertical interpolated line*/
+static uint8_t *scale_frame = NULL; /*scaled yu12 frame*/
+
+/*
+ * reduce a plane by half in both directions (2x2 box filter)
+ * args:
+ *   src - pointer to source plane
+ *   src_width - source plane width
+ *   dst - pointer to destination plane
+ *   dst_width - destination plane width (src_width/2)
+ *   dst_height - destination plane height (src_height/2)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void box_halve_plane(const uint8_t *src, int src_width,
+	uint8_t *dst, int dst_width, int dst_height)
+{
+	int y = 0;
+	for(y = 0; y < dst_height; ++y)
+	{
+		const uint8_t *r0 = src + (2 * y) * src_width;
+		const uint8_t *r1 = r0 + src_width;
+		uint8_t *d = dst + y * dst_width;
+
+		int x = 0;
+#if defined(__SSE2__)
+		/*
+		 * average the two lines and then the pixel pairs
+		 * (pavg rounds up, so the result may differ by one
+		 *  from the exact 4 pixel average - fine for preview)
+		 */
+		const __m128i mask = _mm_set1_epi16(0x00FF);
+		for(; x + 16 <= dst_width; x += 16)
+		{
+			__m128i a0 = _mm_loadu_si128((const __m128i *) (r0 + 2 * x));
+			__m128i a1 = _mm_loadu_si128((const __m128i *) (r0 + 2 * x + 16));
+			__m128i b0 = _mm_loadu_si128((const __m128i *) (r1 + 2 * x));
+			__m128i b1 = _mm_loadu_si128((const __m128i *) (r1 + 2 * x + 16));
+
+			__m128i v0 = _mm_avg_epu8(a0, b0);
+			__m128i v1 = _mm_avg_epu8(a1, b1);
+
+			__m128i h0 = _mm_avg_epu16(_mm_and_si128(v0, mask), _mm_srli_epi16(v0, 8));
+			__m128i h1 = _mm_avg_epu16(_mm_and_si128(v1, mask), _mm_srli_epi16(v1, 8));
+
+			_mm_storeu_si128((__m128i *) (d + x), _mm_packus_epi16(h0, h1));
+		}
+#endif
+		for(; x < dst_width; ++x)
+			d[x] = (uint8_t) ((r0[2*x] + r0[2*x+1] + r1[2*x] + r1[2*x+1] + 2) >> 2);
+	}
+}
+
+/*
+ * interpolate two lines (vertical bilinear step)
+ * args:
+ *   r0 - pointer to top line
+ *   r1 - pointer to bottom line
+ *   width - line width
+ *   frac - bottom line weight (0-256)
+ *   out - pointer to output line
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void lerp_lines(const uint8_t *r0, const uint8_t *r1, int width, int frac, uint8_t *out)
+{
+	if(frac == 0)
+	{
+		memcpy(out, r0, width);
+		return;
+	}
+
+	int x = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w1 = _mm_set1_epi16(frac);
+	const __m128i w0 = _mm_set1_epi16(256 - frac);
+	const __m128i rnd = _mm_set1_epi16(128);
+	for(; x + 16 <= width; x += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *) (r0 + x));
+		__m128i b = _mm_loadu_si128((const __m128i *) (r1 + x));
+
+		/*a*(256-f) + b*f + 128 fits in an unsigned 16 bit lane*/
+		__m128i lo = _mm_add_epi16(
+			_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1)),
+			rnd);
+		__m128i hi = _mm_add_epi16(
+			_mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1)),
+			rnd);
+
+		_mm_storeu_si128((__m128i *) (out + x),
+			_mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+	}
+#endif
+	for(; x < width; ++x)
+		out[x] = (uint8_t) ((r0[x] * (256 - frac) + r1[x] * frac + 128) >> 8);
+}
+
+/*
+ * build the bilinear sampling table for one dimension
+ *  (pixel centers are aligned)
+ * args:
+ *   src_size - source size
+ *   dst_size - target size
+ *   ofs - pointer to offset table (dst_size elements)
+ *   frac - pointer to weight table (dst_size elements)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void build_sample_table(int src_size, int dst_size, int *ofs, uint16_t *frac)
+{
+	int i = 0;
+	for(i = 0; i < dst_size; ++i)
+	{
+		/*source position in 1/256 pixel units*/
+		int64_t pos = (((int64_t) (2 * i + 1) * src_size * 256) / (2 * dst_size)) - 128;
+		if(pos < 0)
+			pos = 0;
+
+		int o = (int) (pos >> 8);
+		int f = (int) (pos & 0xFF);
+
+		if(o >= src_size - 1)
+		{
+			/*last pixel: sample it with full weight*/
+			o = (src_size > 1) ? src_size - 2 : 0;
+			f = (src_size > 1) ? 256 : 0;
+		}
+
+		ofs[i] = o;
+		frac[i] = (uint16_t) f;
+	}
+}
+
+/*
+ * clean a plane scale plan
+ * args:
+ *   plane - pointer to plane plan
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void scale_plane_clean(scale_plane_t *plane)
+{
+	if(plane->x_ofs)
+		free(plane->x_ofs);
+	if(plane->x_frac)
+		free(plane->x_frac);
+	if(plane->y_ofs)
+		free(plane->y_ofs);
+	if(plane->y_frac)
+		free(plane->y_frac);
+
+	memset(plane, 0, sizeof(scale_plane_t));
+}
+
+/*
+ * set up a plane scale plan
+ * args:
+ *   plane - pointer to plane plan
+ *   src_width - plane source width
+ *   src_height - plane source height
+ *   dst_width - plane target width
+ *   dst_height - plane target height
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code (0 - ok)
+ */
+static int scale_plane_init(scale_plane_t *plane,
+	int src_width, int src_height, int dst_width, int dst_height)
+{
+	memset(plane, 0, sizeof(scale_plane_t));
+
+	plane->src_width = src_width;
+	plane->src_height = src_height;
+	plane->dst_width = dst_width;
+	plane->dst_height = dst_height;
+
+	plane->bl_width = src_width;
+	plane->bl_height = src_height;
+
+	while(plane->bl_width / 2 >= dst_width && plane->bl_height / 2 >= dst_height)
+	{
+		plane->bl_width /= 2;
+		plane->bl_height /= 2;
+		plane->halvings++;
+	}
+
+	plane->x_ofs = calloc(dst_width, sizeof(int));
+	plane->x_frac = calloc(dst_width, sizeof(uint16_t));
+	plane->y_ofs = calloc(dst_height, sizeof(int));
+	plane->y_frac = calloc(dst_height, sizeof(uint16_t));
+
+	if(!plane->x_ofs || !plane->x_frac || !plane->y_ofs || !plane->y_frac)
+	{
+		fprintf(stderr, "RENDER: couldn't allocate scaler tables: %s\n", strerror(errno));
+		scale_plane_clean(plane);
+		return -1;
+	}
+
+	build_sample_table(plane->bl_width, dst_width, plane->x_ofs, plane->x_frac);
+	build_sample_table(plane->bl_height, dst_height, plane->y_ofs, plane->y_frac);
+
+	return 0;
+}
+
+/*
+ * scale a single plane
+ * args:
+ *   plane - pointer to plane plan
+ *   src - pointer to source plane
+ *   dst - pointer to destination plane
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void scale_plane(scale_plane_t *plane, const uint8_t *src, uint8_t *dst)
+{
+	const uint8_t *in = src;
+	int w = plane->src_width;
+	int h = plane->src_height;
+
+	int i = 0;
+	for(i = 0; i < plane->halvings; ++i)
+	{
+		uint8_t *out = scale_tmp[i % 2];
+		/*last reduction already gives the target size: write it in place*/
+		if(w / 2 == plane->dst_width && h / 2 == plane->dst_height)
+			out = dst;
+
+		box_halve_plane(in, w, out, w / 2, h / 2);
+		in = out;
+		w /= 2;
+		h /= 2;
+	}
+
+	if(in == dst)
+		return;
+
+	if(w == plane->dst_width && h == plane->dst_height)
+	{
+		memcpy(dst, in, w * h);
+		return;
+	}
+
+	int y = 0;
+	for(y = 0; y < plane->dst_height; ++y)
+	{
+		const uint8_t *r0 = in + plane->y_ofs[y] * w;
+		const uint8_t *r1 = (h > 1) ? r0 + w : r0;
+
+		lerp_lines(r0, r1, w, plane->y_frac[y], scale_row);
+
+		uint8_t *d = dst + y * plane->dst_width;
+		int x = 0;
+		for(x = 0; x < plane->dst_width; ++x)
+		{
+			int o = plane->x_ofs[x];
+			int f = plane->x_frac[x];
+			d[x] = (uint8_t) ((scale_row[o] * (256 - f) + scale_row[o + 1] * f + 128) >> 8);
+		}
+	}
+}
+
+/*
+ * init the yu12 preview scaler
+ * args:
+ *   src_width - frame width
+ *   src_height - frame height
+ *   dst_width - preview width
+ *   dst_height - preview height
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code (0 - ok)
+ */
+int render_scale_init(int src_width, int src_height, int dst_width, int dst_height)
+{
+	render_scale_clean();
+
+	if(scale_plane_init(&plane_y, src_width, src_height, dst_width, dst_height) ||
+		scale_plane_init(&plane_uv, src_width/2, src_height/2, dst_width/2, dst_height/2))
+	{
+		render_scale_clean();
+		return -1;
+	}
+
+	size_t tmp_size = (src_width / 2) * (src_height / 2);
+
+	scale_tmp[0] = calloc(tmp_size, sizeof(uint8_t));
+	scale_tmp[1] = calloc(tmp_size, sizeof(uint8_t));
+	/*extra bytes: the horizontal step may read one pixel past a 1 pixel line*/
+	scale_row = calloc(src_width + 16, sizeof(uint8_t));
+	scale_frame = calloc((dst_width * dst_height * 3) / 2, sizeof(uint8_t));
+
+	if(!scale_tmp[0] || !scale_tmp[1] || !scale_row || !scale_frame)
+	{
+		fprintf(stderr, "RENDER: couldn't allocate scaler buffers: %s\n", strerror(errno));
+		render_scale_clean();
+		return -1;
+	}
+
+	if(verbosity > 0)
+		printf("RENDER: preview scaler %ix%i -> %ix%i (%i box reductions)\n",
+			src_width, src_height, dst_width, dst_height, plane_y.halvings);
+
+	return 0;
+}
+
+/*
+ * scale a yu12 frame to the preview size
+ * args:
+ *   frame - pointer to yu12 frame data (src_width x src_height)
+ *
+ * asserts:
+ *   frame is not null
+ *
+ * returns: pointer to scaled yu12 frame (internal buffer) or NULL on error
+ */
+uint8_t *render_scale_yu12(uint8_t *frame)
+{
+	/*asserts*/
+	assert(frame != NULL);
+
+	if(scale_frame == NULL)
+		return NULL;
+
+	uint8_t *src_u = frame + plane_y.src_width * plane_y.src_height;
+	uint8_t *src_v = src_u + plane_uv.src_width * plane_uv.src_height;
+
+	uint8_t *dst_u = scale_frame + plane_y.dst_width * plane_y.dst_height;
+	uint8_t *dst_v = dst_u + plane_uv.dst_width * plane_uv.dst_height;
+
+	scale_plane(&plane_y, frame, scale_frame);
+	scale_plane(&plane_uv, src_u, dst_u);
+	scale_plane(&plane_uv, src_v, dst_v);
+
+	return scale_frame;
+}
+
+/*
+ * clean the yu12 preview scaler
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_scale_clean()
+{
+	scale_plane_clean(&plane_y);
+	scale_plane_clean(&plane_uv);
+
+	if(scale_tmp[0])
+		free(scale_tmp[0]);
+	scale_tmp[0] = NULL;
+	if(scale_tmp[1])
+		free(scale_tmp[1]);
+	scale_tmp[1] = NULL;
+	if(scale_row)
+		free(scale_row);
+	scale_row = NULL;
+	if(scale_frame)
+		free(scale_frame);
+	scale_frame = NULL;
+}
@@ -29,6 +29,7 @@
 
 extern "C" {
 #include "gview.h"
+#include "gviewv4l2core.h"
 #include "gviewrender.h"
 #include "render.h"
 #include "render_sfml.h"
@@ -37,84 +38,6 @@ extern "C" {
 
 extern int verbosity;
 
-/*
- * yu12 to rgba (rgb32)
- * args:
- *    out - pointer to output rgba data buffer
- *    in - pointer to input yu12 data buffer
- *    width - buffer width (in pixels)
- *    height - buffer height (in pixels)
- *
- * asserts:
- *    none
- *
- * returns: none
- */
-static void yu12_to_rgba (uint8_t *out, uint8_t *in, int width, int height)
-{
-	uint8_t *py1 = in; //line 1
-	uint8_t *py2 = py1 + width; //line 2
-	uint8_t *pu = in + (width * height);
-	uint8_t *pv = pu + ((width * height) / 4);
-
-	uint8_t *pout1 = out; //first line
-	uint8_t *pout2 = out + (width * 4); //second line
-
-	int h=0, w=0;
-
-	for(h=0; h < height; h+=2) //every two lines
-	{
-		py1 = in + (h * width);
-		py2 = py1 + width;
-
-		pout1 = out + (h * width * 4);
-		pout2 = pout1 + (width * 4);
-
-		for(w=0; w<width; w+=2) //every 2 pixels
-		{
-			/* standart: r = y0 + 1.402 (v-128) */
-			/* logitech: r = y0 + 1.370705 (v-128) */
-			*pout1++=CLIP(*py1 + 1.402 * (*pv-128));
-			*pout2++=CLIP(*py2 + 1.402 * (*pv-128));
-			/* standart: g = y0 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g = y0 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*pout1++=CLIP(*py1 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			*pout2++=CLIP(*py2 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			/* standart: b = y0 + 1.772 (u-128) */
-			/* logitech: b = y0 + 1.732446 (u-128) */
-			*pout1++=CLIP(*py1 + 1.772 *( *pu-128));
-			*pout2++=CLIP(*py2 + 1.772 *( *pu-128));
-			/* alpha set to 255*/
-			*pout1++=255;
-			*pout2++=255;
-
-			py1++;
-			py2++;
-
-			/* standart: r1 =y1 + 1.402 (v-128) */
-			/* logitech: r1 = y1 + 1.370705 (v-128) */
-			*pout1++=CLIP(*py1 + 1.402 * (*pv-128));
-			*pout2++=CLIP(*py2 + 1.402 * (*pv-128));
-			/* standart: g1 = y1 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g1 = y1 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*pout1++=CLIP(*py1 - 0.34414 * (*pu-128) -0.71414 * (*pv-128));
-			*pout2++=CLIP(*py2 - 0.34414 * (*pu-128) -0.71414 * (*pv-128));
-			/* standart: b1 = y1 + 1.772 (u-128) */
-			/* logitech: b1 = y1 + 1.732446 (u-128) */
-			*pout1++=CLIP(*py1 + 1.772 * (*pu-128));
-			*pout2++=CLIP(*py2 + 1.772 * (*pu-128));
-			/* alpha set to 255*/
-			*pout1++=255;
-			*pout2++=255;
-
-			py1++;
-			py2++;
-			pu++;
-			pv++;
-		}
-	}
-}
-
 SFMLRender::SFMLRender(int width, int height, int flags, int win_w, int win_h)
 {
 	int w = width;
@@ -293,7 +216,7 @@ int SFMLRender::render_frame(uint8_t *frame, int width, int height)
 	}
 	else
 	{
-		yu12_to_rgba ((uint8_t *) pix, frame, width, height);
+		v4l2core_yu12_to_rgb((uint8_t *) pix, width * 4, frame, width, height, RGB_FMT_RGBA);
 		//update texture
 		texture.update(pix);
 		//draw frame
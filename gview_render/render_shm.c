@@ -0,0 +1,299 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#           Nobuhiro Iwamatsu <iwamatsu@nigauri.org>                            #
+#                             Add UYVY color support(Macbook iSight)            #
+#           Flemming Frandsen <dren.dk@gmail.com>                               #
+#                             Add VU meter OSD                                  #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  Render library - shared memory preview ring                                  #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/videodev2.h>
+
+#include "gview.h"
+#include "gviewrender.h"
+#include "render.h"
+#include "render_shm.h"
+#include "../config.h"
+
+extern int verbosity;
+
+static char shm_name[NAME_MAX] = RENDER_SHM_NAME;
+static int shm_fd = -1;
+static uint8_t *shm_area = NULL;
+static render_shm_header_t *shm_header = NULL;
+static size_t shm_size = 0;
+static uint64_t shm_frame_number = 0;
+
+/*
+ * align size to the system page size
+ * args:
+ *   size - size in bytes
+ *
+ * asserts:
+ *   none
+ *
+ * returns: aligned size
+ */
+static size_t page_align(size_t size)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	if(page_size <= 0)
+		page_size = 4096;
+
+	return (size + page_size - 1) & ~((size_t) page_size - 1);
+}
+
+/*
+ * get the monotonic time in nanoseconds
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: monotonic time in ns
+ */
+static uint64_t monotonic_ns()
+{
+	struct timespec now;
+
+	if(clock_gettime(CLOCK_MONOTONIC, &now) != 0)
+		return 0;
+
+	return ((uint64_t) now.tv_sec * NSEC_PER_SEC + (uint64_t) now.tv_nsec);
+}
+
+/*
+ * init shared memory render
+ * args:
+ *    width - frame width
+ *    height - frame height
+ *    name - shm object name
+ *    group_access - if set, members of our group may also read the ring
+ *                   (default is owner only)
+ *
+ * asserts:
+ *    name is not null
+ *
+ * returns: error code (0 ok)
+ */
+int init_render_shm(int width, int height, const char *name, int group_access)
+{
+	/*asserts*/
+	assert(name != NULL);
+
+	if(shm_area != NULL)
+		render_shm_clean();
+
+	strncpy(shm_name, name, NAME_MAX - 1);
+	shm_name[NAME_MAX - 1] = '\0';
+
+	size_t frame_size = (width * height * 3) / 2;
+	size_t header_size = page_align(sizeof(render_shm_header_t));
+	size_t slot_size = page_align(frame_size);
+
+	shm_size = header_size + RENDER_SHM_SLOTS * slot_size;
+
+	if(verbosity > 0)
+		printf("RENDER: Initializing shm render (%s - %zu bytes)\n",
+			shm_name, shm_size);
+
+	mode_t mode = S_IRUSR | S_IWUSR;
+	if(group_access)
+		mode |= S_IRGRP;
+
+	/*
+	 * drop any stale object left behind by a previous run and create
+	 * a fresh one exclusively: an object pre-created by someone else
+	 * (e.g. world writable, or truncated under us) is never reused
+	 */
+	shm_unlink(shm_name);
+
+	shm_fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, mode);
+	if(shm_fd < 0)
+	{
+		if(errno == EEXIST)
+			fprintf(stderr, "RENDER: (shm) %s already exists and is not ours - refusing to use it\n", shm_name);
+		else
+			fprintf(stderr, "RENDER: (shm) couldn't open %s: %s\n", shm_name, strerror(errno));
+		return -1;
+	}
+
+	/*shm_open mode is filtered by the umask - set it explicitly*/
+	struct stat st;
+	if(fchmod(shm_fd, mode) != 0 ||
+		fstat(shm_fd, &st) != 0 ||
+		st.st_uid != geteuid())
+	{
+		fprintf(stderr, "RENDER: (shm) %s is not owned by this user\n", shm_name);
+		close(shm_fd);
+		shm_fd = -1;
+		return -1;
+	}
+
+	if(ftruncate(shm_fd, shm_size) != 0)
+	{
+		fprintf(stderr, "RENDER: (shm) couldn't resize %s: %s\n", shm_name, strerror(errno));
+		render_shm_clean();
+		return -2;
+	}
+
+	shm_area = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd, 0);
+	if(shm_area == MAP_FAILED)
+	{
+		fprintf(stderr, "RENDER: (shm) couldn't map %s: %s\n", shm_name, strerror(errno));
+		shm_area = NULL;
+		render_shm_clean();
+		return -3;
+	}
+
+	shm_header = (render_shm_header_t *) shm_area;
+
+	/*
+	 * mark the header invalid while it's being set up
+	 * (readers check the magic before anything else)
+	 */
+	__atomic_store_n(&shm_header->magic, 0, __ATOMIC_RELEASE);
+
+	shm_header->version = RENDER_SHM_VERSION;
+	shm_header->width = width;
+	shm_header->height = height;
+	shm_header->pixelformat = V4L2_PIX_FMT_YUV420;
+	shm_header->frame_size = frame_size;
+	shm_header->num_slots = RENDER_SHM_SLOTS;
+	shm_header->shm_size = shm_size;
+	shm_header->sequence = 0;
+
+	int i = 0;
+	for(i = 0; i < RENDER_SHM_SLOTS; ++i)
+	{
+		shm_header->slot[i].sequence = 0;
+		shm_header->slot[i].frame_number = 0;
+		shm_header->slot[i].timestamp = 0;
+		shm_header->slot[i].offset = header_size + i * slot_size;
+	}
+
+	shm_frame_number = 0;
+
+	__atomic_store_n(&shm_header->active, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&shm_header->magic, RENDER_SHM_MAGIC, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * publish a frame in the shared memory ring
+ * args:
+ *   frame - pointer to frame data (yu12 format)
+ *   width - frame width
+ *   height - frame height
+ *
+ * asserts:
+ *   frame is not null
+ *
+ * returns: error code
+ */
+int render_shm_frame(uint8_t *frame, int width, int height)
+{
+	/*asserts*/
+	assert(frame != NULL);
+
+	if(shm_header == NULL)
+		return -1;
+
+	if(width != (int) shm_header->width || height != (int) shm_header->height)
+	{
+		fprintf(stderr, "RENDER: (shm) frame size (%ix%i) doesn't match shm format (%ix%i)\n",
+			width, height, shm_header->width, shm_header->height);
+		return -2;
+	}
+
+	shm_frame_number++;
+
+	render_shm_slot_t *slot = &shm_header->slot[shm_frame_number % RENDER_SHM_SLOTS];
+
+	/*odd sequence: slot is being written*/
+	uint64_t seq = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+	__atomic_store_n(&slot->sequence, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	memcpy(shm_area + slot->offset, frame, shm_header->frame_size);
+	slot->frame_number = shm_frame_number;
+	slot->timestamp = monotonic_ns();
+
+	/*even sequence: slot is stable*/
+	__atomic_store_n(&slot->sequence, seq + 2, __ATOMIC_RELEASE);
+
+	/*make the slot the current one*/
+	__atomic_store_n(&shm_header->sequence, shm_frame_number, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/*
+ * clean shared memory render data
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void render_shm_clean()
+{
+	if(shm_header)
+		__atomic_store_n(&shm_header->active, 0, __ATOMIC_RELEASE);
+
+	if(shm_area)
+		munmap(shm_area, shm_size);
+
+	shm_area = NULL;
+	shm_header = NULL;
+	shm_size = 0;
+
+	if(shm_fd >= 0)
+	{
+		close(shm_fd);
+		/*
+		 * readers that still have the object mapped keep it alive,
+		 * new readers will only find it after the next init
+		 */
+		shm_unlink(shm_name);
+	}
+
+	shm_fd = -1;
+}
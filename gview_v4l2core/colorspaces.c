@@ -26,6 +26,8 @@
 #include <errno.h>
 #include <assert.h>
 
+#include "gviewv4l2core.h"
+#include "yu12_rgb.h"
 #include "gview.h"
 #include "../config.h"
 
@@ -2725,69 +2727,12 @@ void ba24_to_yu12(uint8_t *out, uint8_t *in, int width, int height)
  */
 void yu12_to_rgb24 (uint8_t *out, uint8_t *in, int width, int height)
 {
-	/*assertions*/
-	assert(out);
-	assert(in);
-	
-	uint8_t *py1 = in; //line 1
-	uint8_t *py2 = py1 + width; //line 2
-	uint8_t *pu = in + (width * height);
-	uint8_t *pv = pu + ((width * height) / 4);
-	
-	uint8_t *pout1 = out; //first line
-	uint8_t *pout2 = out + (width * 3); //second line
-	
-	int h=0, w=0;
-	
-	for(h=0; h < height; h+=2) //every two lines
-	{
-		py1 = in + (h * width);
-		py2 = py1 + width;
-		
-		pout1 = out + (h * width * 3);
-		pout2 = pout1 + (width * 3);
-		
-		for(w=0; w<width; w+=2) //every 2 pixels
-		{
-			/* standart: r = y0 + 1.402 (v-128) */
-			/* logitech: r = y0 + 1.370705 (v-128) */
-			*pout1++=CLIP(*py1 + 1.402 * (*pv-128));
-			*pout2++=CLIP(*py2 + 1.402 * (*pv-128));	
-			/* standart: g = y0 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g = y0 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*pout1++=CLIP(*py1 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			*pout2++=CLIP(*py2 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			/* standart: b = y0 + 1.772 (u-128) */
-			/* logitech: b = y0 + 1.732446 (u-128) */
-			*pout1++=CLIP(*py1 + 1.772 *( *pu-128));
-			*pout2++=CLIP(*py2 + 1.772 *( *pu-128));
-			
-			py1++;
-			py2++;
-			
-			/* standart: r1 =y1 + 1.402 (v-128) */
-			/* logitech: r1 = y1 + 1.370705 (v-128) */
-			*pout1++=CLIP(*py1 + 1.402 * (*pv-128));
-			*pout2++=CLIP(*py2 + 1.402 * (*pv-128));
-			/* standart: g1 = y1 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g1 = y1 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*pout1++=CLIP(*py1 - 0.34414 * (*pu-128) -0.71414 * (*pv-128));
-			*pout2++=CLIP(*py2 - 0.34414 * (*pu-128) -0.71414 * (*pv-128));
-			/* standart: b1 = y1 + 1.772 (u-128) */
-			/* logitech: b1 = y1 + 1.732446 (u-128) */
-			*pout1++=CLIP(*py1 + 1.772 * (*pu-128));
-			*pout2++=CLIP(*py2 + 1.772 * (*pu-128));
-			
-			py1++;
-			py2++;
-			pu++;
-			pv++;
-		}
-	}
+	yu12_to_rgb(out, width * 3, in, width, height, RGB_FMT_RGB24,
+		yu12_rgb_get_matrix(), yu12_rgb_get_range());
 }
 
 /*
- * FIXME:  yu12 to bgr24 with lines upsidedown
+ * yu12 to bgr24 with lines upsidedown
  *   used for bitmap files (DIB24)
  * args:
  *    out - pointer to output bgr data buffer
@@ -2802,76 +2747,14 @@ void yu12_to_rgb24 (uint8_t *out, uint8_t *in, int width, int height)
  */
 void yu12_to_dib24 (uint8_t *out, uint8_t *in, int width, int height)
 {
-	/*assertions*/
-	assert(out);
-	assert(in);
-	
-	uint8_t *py1 = in + (height * width) - width; //begin of last line
-	uint8_t *py2 = py1 - width; //last line -1
-	
-	uint8_t *pu = in + ((width * height * 5) / 4) - (width/2); //begin of last line
-	uint8_t *pv = pu + ((width * height) / 4); //begin of last line
-	
-	uint8_t *pout1 = out; //first line
-	uint8_t *pout2 = pout1 + (width * 3); //second line
-	
-	int h=0, w=0;
-	int uvline = height/2;
-	
-	for(h=height; h >0 ; h-=2) //every two lines
-	{
-		uvline--; //begin of uv line
-		
-		py1 = in + ((h-1) * width);
-		py2 = py1 - width;
-		
-		pu = in + (width * height) + ((uvline * width)/2);
-		pv = pu + ((width * height) / 4);
-		
-		pout1 = out + ((height-h) * width * 3);
-		pout2 = pout1 + (width * 3);
-		
-		for(w=0; w<width; w+=2) //every 2 pixels
-		{
-			/* standart: b = y0 + 1.772 (u-128) */
-			/* logitech: b = y0 + 1.732446 (u-128) */
-			*pout1++=CLIP(*py1 + 1.772 *( *pu-128));
-			*pout2++=CLIP(*py2 + 1.772 *( *pu-128));	
-			/* standart: g = y0 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g = y0 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*pout1++=CLIP(*py1 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			*pout2++=CLIP(*py2 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			/* standart: r = y0 + 1.402 (v-128) */
-			/* logitech: r = y0 + 1.370705 (v-128) */
-			*pout1++=CLIP(*py1 + 1.402 * (*pv-128));
-			*pout2++=CLIP(*py2 + 1.402 * (*pv-128));
-			
-			py1++;
-			py2++;
-			
-			/* standart: b = y0 + 1.772 (u-128) */
-			/* logitech: b = y0 + 1.732446 (u-128) */
-			*pout1++=CLIP(*py1 + 1.772 *( *pu-128));
-			*pout2++=CLIP(*py2 + 1.772 *( *pu-128));	
-			/* standart: g = y0 - 0.34414 (u-128) - 0.71414 (v-128)*/
-			/* logitech: g = y0 - 0.337633 (u-128)- 0.698001 (v-128)*/
-			*pout1++=CLIP(*py1 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			*pout2++=CLIP(*py2 - 0.34414 * (*pu-128) -0.71414*(*pv-128));
-			/* standart: r = y0 + 1.402 (v-128) */
-			/* logitech: r = y0 + 1.370705 (v-128) */
-			*pout1++=CLIP(*py1 + 1.402 * (*pv-128));
-			*pout2++=CLIP(*py2 + 1.402 * (*pv-128));
-
-			py1++;
-			py2++;
-			pu++;
-			pv++;
-		}
-	}
+	/*start at the last output line and go backwards*/
+	yu12_to_rgb(out + ((height - 1) * width * 3), - (width * 3), in,
+		width, height, RGB_FMT_BGR24,
+		yu12_rgb_get_matrix(), yu12_rgb_get_range());
 }
 
 /*
- * convert yuv 420 planar (yu12) to yuv 422 (save_image_jpeg)
+ * convert yuv 420 planar (yu12) to yuv 422
  * args:
  *    out- pointer to output buffer (yuyv)
  *    in- pointer to input buffer (yuv420 planar data frame (yu12))
@@ -622,7 +622,7 @@ void ba24_to_yu12(uint8_t *out, uint8_t *in, int width, int height);
 void yu12_to_rgb24 (uint8_t *out, uint8_t *in, int width, int height);
 
 /*
- * FIXME:  yu12 to bgr24 with lines upsidedown
+ * yu12 to bgr24 with lines upsidedown
  *   used for bitmap files (DIB24)
  * args:
  *    out - pointer to output bgr data buffer
@@ -638,7 +638,7 @@ void yu12_to_rgb24 (uint8_t *out, uint8_t *in, int width, int height);
 void yu12_to_dib24 (uint8_t *out, uint8_t *in, int width, int height);
 
 /*
- * convert yuv 420 planar (yu12) to yuv 422 (save_image_jpeg)
+ * convert yuv 420 planar (yu12) to yuv 422
  * args:
  *    out- pointer to output buffer (yuyv)
  *    in- pointer to input buffer (yuv420 planar data frame (yu12))
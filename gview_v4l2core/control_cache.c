@@ -0,0 +1,427 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <linux/videodev2.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "gviewv4l2core.h"
+#include "v4l2_controls.h"
+#include "v4l2_devices.h"
+#include "control_cache.h"
+#include "../config.h"
+
+extern int verbosity;
+extern uint8_t disable_libv4l2;
+
+#define CONTROL_CACHE_MAGIC   "V4L2CTLC"
+#define CONTROL_CACHE_VERSION (1)
+#define CONTROL_CACHE_MAX_CTRLS (1024) /*sanity limit*/
+
+/*
+ * control cache file header
+ *  (followed by num_controls v4l2_queryctrl entries, each one followed
+ *   by a uint32_t menu item count and the v4l2_querymenu items)
+ */
+typedef struct _v4l2_ctrl_cache_header_t
+{
+	char magic[8];           //CONTROL_CACHE_MAGIC
+	uint32_t version;        //CONTROL_CACHE_VERSION
+	uint32_t vendor;         //usb vendor id
+	uint32_t product;        //usb product id
+	uint32_t firmware;       //usb bcdDevice
+	uint8_t driver[16];      //driver name
+	uint32_t driver_version; //driver (kernel) version
+	uint32_t libv4l2;        //1 if the controls include libv4l2 emulated controls
+	uint32_t queryctrl_size; //sizeof(struct v4l2_queryctrl)
+	uint32_t querymenu_size; //sizeof(struct v4l2_querymenu)
+	uint32_t num_controls;   //number of control descriptors
+} __attribute__ ((packed)) v4l2_ctrl_cache_header_t;
+
+static char *control_cache_dir = NULL;
+
+/*
+ * set the control descriptor cache directory
+ * args:
+ *   dir - cache directory (NULL disables the cache)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: void
+ */
+void set_control_cache_dir(const char *dir)
+{
+	if(control_cache_dir)
+		free(control_cache_dir);
+	control_cache_dir = NULL;
+
+	if(dir)
+		control_cache_dir = strdup(dir);
+}
+
+/*
+ * get the usb system data of the device
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: pointer to device system data (NULL if not a usb device)
+ */
+static v4l2_dev_sys_data_t *get_usb_sys_data(v4l2_dev_t *vd)
+{
+	/*assertions*/
+	assert(vd != NULL);
+
+	v4l2_device_list_t *device_list = get_device_list();
+
+	if(!device_list || !device_list->list_devices ||
+		vd->this_device < 0 || vd->this_device >= device_list->num_devices)
+		return NULL;
+
+	v4l2_dev_sys_data_t *sys_data = &(device_list->list_devices[vd->this_device]);
+
+	/*this_device defaults to the first device if the device wasn't found*/
+	if(!sys_data->device || !vd->videodevice ||
+		strcmp(sys_data->device, vd->videodevice) != 0)
+		return NULL;
+
+	if(sys_data->vendor == 0 && sys_data->product == 0)
+		return NULL;
+
+	return sys_data;
+}
+
+/*
+ * fill the cache header with the device key
+ * args:
+ *   vd - pointer to video device data
+ *   sys_data - pointer to device system data
+ *   header - pointer to cache header
+ *
+ * asserts:
+ *   vd is not null
+ *   sys_data is not null
+ *   header is not null
+ *
+ * returns: void
+ */
+static void fill_cache_header(v4l2_dev_t *vd, v4l2_dev_sys_data_t *sys_data, v4l2_ctrl_cache_header_t *header)
+{
+	/*assertions*/
+	assert(vd != NULL);
+	assert(sys_data != NULL);
+	assert(header != NULL);
+
+	memset(header, 0, sizeof(v4l2_ctrl_cache_header_t));
+	memcpy(header->magic, CONTROL_CACHE_MAGIC, sizeof(header->magic));
+	header->version = CONTROL_CACHE_VERSION;
+	header->vendor = sys_data->vendor;
+	header->product = sys_data->product;
+	header->firmware = sys_data->firmware;
+	memcpy(header->driver, vd->cap.driver, sizeof(header->driver));
+	header->driver_version = vd->cap.version;
+	header->libv4l2 = disable_libv4l2 ? 0 : 1;
+	header->queryctrl_size = sizeof(struct v4l2_queryctrl);
+	header->querymenu_size = sizeof(struct v4l2_querymenu);
+}
+
+/*
+ * get the control descriptor cache file name for the device
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: pointer to cache file name (must be freed)
+ *   or NULL if the cache is disabled or the device is not usb
+ */
+char *get_control_cache_filename(v4l2_dev_t *vd)
+{
+	/*assertions*/
+	assert(vd != NULL);
+
+	if(control_cache_dir == NULL)
+		return NULL;
+
+	v4l2_dev_sys_data_t *sys_data = get_usb_sys_data(vd);
+	if(sys_data == NULL)
+		return NULL;
+
+	int size = strlen(control_cache_dir) + 32;
+	char *filename = calloc(size, sizeof(char));
+	if(filename == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (get_control_cache_filename): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	snprintf(filename, size, "%s/%04x_%04x_%04x.ctrls",
+		control_cache_dir,
+		sys_data->vendor & 0xffff,
+		sys_data->product & 0xffff,
+		sys_data->firmware & 0xffff);
+
+	return filename;
+}
+
+/*
+ * add the control descriptors from the cache file to the control list
+ * args:
+ *   vd - pointer to video device data
+ *   filename - cache file name
+ *   current - pointer to pointer of current control from control list
+ *
+ * asserts:
+ *   vd is not null
+ *   filename is not null
+ *
+ * returns: number of controls added (-1 if the cache is missing or stale)
+ */
+int load_control_cache(v4l2_dev_t *vd, const char *filename, v4l2_ctrl_t **current)
+{
+	/*assertions*/
+	assert(vd != NULL);
+	assert(filename != NULL);
+
+	v4l2_dev_sys_data_t *sys_data = get_usb_sys_data(vd);
+	if(sys_data == NULL)
+		return -1;
+
+	FILE *fp = fopen(filename, "rb");
+	if(fp == NULL)
+	{
+		if(verbosity > 0)
+			printf("V4L2_CORE: (control cache) no cache file %s\n", filename);
+		return -1;
+	}
+
+	v4l2_ctrl_cache_header_t key;
+	v4l2_ctrl_cache_header_t header;
+	fill_cache_header(vd, sys_data, &key);
+
+	if(fread(&header, sizeof(v4l2_ctrl_cache_header_t), 1, fp) < 1 ||
+		memcmp(&header, &key, offsetof(v4l2_ctrl_cache_header_t, num_controls)) != 0 ||
+		header.num_controls == 0 ||
+		header.num_controls > CONTROL_CACHE_MAX_CTRLS)
+	{
+		fprintf(stderr, "V4L2_CORE: (control cache) stale or invalid cache file %s\n", filename);
+		fclose(fp);
+		return -1;
+	}
+
+	int n = header.num_controls;
+	int i = 0;
+
+	/*read everything before adding any control (a bad file must not leave a partial list)*/
+	struct v4l2_queryctrl *queryctrl = calloc(n, sizeof(struct v4l2_queryctrl));
+	struct v4l2_querymenu **menu = calloc(n, sizeof(struct v4l2_querymenu *));
+	uint32_t *menu_entries = calloc(n, sizeof(uint32_t));
+	if(queryctrl == NULL || menu == NULL || menu_entries == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (load_control_cache): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	int ok = 1;
+	for(i = 0; i < n && ok; i++)
+	{
+		if(fread(&queryctrl[i], sizeof(struct v4l2_queryctrl), 1, fp) < 1 ||
+			fread(&menu_entries[i], sizeof(uint32_t), 1, fp) < 1 ||
+			menu_entries[i] > (uint32_t) CONTROL_CACHE_MAX_CTRLS)
+		{
+			ok = 0;
+			break;
+		}
+
+		/*names are used as C strings*/
+		queryctrl[i].name[sizeof(queryctrl[i].name) - 1] = '\0';
+
+		if(queryctrl[i].type != V4L2_CTRL_TYPE_MENU &&
+			queryctrl[i].type != V4L2_CTRL_TYPE_INTEGER_MENU)
+		{
+			/*only menus store items*/
+			if(menu_entries[i] > 0)
+			{
+				ok = 0;
+				break;
+			}
+			continue;
+		}
+
+		if(queryctrl[i].minimum < 0 || queryctrl[i].minimum > queryctrl[i].maximum)
+		{
+			ok = 0;
+			break;
+		}
+
+		/*menu items plus the last entry*/
+		menu[i] = calloc(menu_entries[i] + 1, sizeof(struct v4l2_querymenu));
+		if(menu[i] == NULL)
+		{
+			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (load_control_cache): %s\n", strerror(errno));
+			exit(-1);
+		}
+
+		if(menu_entries[i] > 0 &&
+			fread(menu[i], sizeof(struct v4l2_querymenu), menu_entries[i], fp) < menu_entries[i])
+		{
+			ok = 0;
+			break;
+		}
+
+		/*
+		 * item indexes must be strictly increasing and in [minimum, maximum]
+		 * (the menu ends with index maximum + 1, see save_control_cache)
+		 */
+		uint32_t k = 0;
+		for(k = 0; k < menu_entries[i]; k++)
+		{
+			menu[i][k].name[sizeof(menu[i][k].name) - 1] = '\0';
+
+			if(menu[i][k].index < (uint32_t) queryctrl[i].minimum ||
+				menu[i][k].index > (uint32_t) queryctrl[i].maximum ||
+				(k > 0 && menu[i][k].index <= menu[i][k - 1].index))
+			{
+				ok = 0;
+				break;
+			}
+		}
+		if(!ok)
+			break;
+
+		menu[i][menu_entries[i]].id = queryctrl[i].id;
+		menu[i][menu_entries[i]].index = queryctrl[i].maximum + 1;
+	}
+
+	fclose(fp);
+
+	if(!ok)
+	{
+		fprintf(stderr, "V4L2_CORE: (control cache) truncated or invalid cache file %s\n", filename);
+		for(i = 0; i < n; i++)
+			free(menu[i]);
+		n = -1;
+	}
+	else
+	{
+		for(i = 0; i < n; i++)
+			add_control_descriptor(vd, &queryctrl[i], menu[i], menu_entries[i], current);
+
+		if(verbosity > 0)
+			printf("V4L2_CORE: (control cache) loaded %i control descriptors from %s\n", n, filename);
+	}
+
+	free(queryctrl);
+	free(menu);
+	free(menu_entries);
+
+	return n;
+}
+
+/*
+ * save the control descriptors of the control list into the cache file
+ * args:
+ *   vd - pointer to video device data
+ *   filename - cache file name
+ *
+ * asserts:
+ *   vd is not null
+ *   filename is not null
+ *
+ * returns: error code (0 -E_OK)
+ */
+int save_control_cache(v4l2_dev_t *vd, const char *filename)
+{
+	/*assertions*/
+	assert(vd != NULL);
+	assert(filename != NULL);
+
+	v4l2_dev_sys_data_t *sys_data = get_usb_sys_data(vd);
+	if(sys_data == NULL || vd->list_device_controls == NULL)
+		return E_NO_DATA;
+
+	v4l2_ctrl_cache_header_t header;
+	fill_cache_header(vd, sys_data, &header);
+	header.num_controls = vd->num_controls;
+
+	/*write to a temporary file and rename it (other instances may be reading)*/
+	int size = strlen(filename) + 16;
+	char tmp_filename[size];
+	snprintf(tmp_filename, size, "%s.%i", filename, (int) getpid());
+
+	FILE *fp = fopen(tmp_filename, "wb");
+	if(fp == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: (save_control_cache) Could not open %s for write: %s\n",
+			tmp_filename, strerror(errno));
+		return E_FILE_IO_ERR;
+	}
+
+	int ok = (fwrite(&header, sizeof(v4l2_ctrl_cache_header_t), 1, fp) == 1);
+
+	v4l2_ctrl_t *current = vd->list_device_controls;
+	for( ; current != NULL && ok; current = current->next)
+	{
+		struct v4l2_queryctrl queryctrl;
+		memcpy(&queryctrl, &current->control, sizeof(struct v4l2_queryctrl));
+		/*grabbed and inactive are state (not descriptor) flags*/
+		queryctrl.flags &= ~(V4L2_CTRL_FLAG_GRABBED | V4L2_CTRL_FLAG_INACTIVE);
+
+		/*count the menu items (the list ends with index maximum + 1)*/
+		uint32_t menu_entries = 0;
+		if(current->menu)
+			while(current->menu[menu_entries].index <= (uint32_t) current->control.maximum)
+				menu_entries++;
+
+		ok = (fwrite(&queryctrl, sizeof(struct v4l2_queryctrl), 1, fp) == 1) &&
+			(fwrite(&menu_entries, sizeof(uint32_t), 1, fp) == 1) &&
+			(menu_entries == 0 ||
+			 fwrite(current->menu, sizeof(struct v4l2_querymenu), menu_entries, fp) == menu_entries);
+	}
+
+	if(fclose(fp) != 0)
+		ok = 0;
+
+	if(!ok || rename(tmp_filename, filename) != 0)
+	{
+		fprintf(stderr, "V4L2_CORE: (save_control_cache) Could not write %s: %s\n",
+			filename, strerror(errno));
+		remove(tmp_filename);
+		return E_FILE_IO_ERR;
+	}
+
+	if(verbosity > 0)
+		printf("V4L2_CORE: (control cache) saved %i control descriptors to %s\n",
+			vd->num_controls, filename);
+
+	return E_OK;
+}
@@ -0,0 +1,81 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+#ifndef CONTROL_CACHE_H
+#define CONTROL_CACHE_H
+
+#include "v4l2_core.h"
+
+/*
+ * set the control descriptor cache directory
+ * args:
+ *   dir - cache directory (NULL disables the cache)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: void
+ */
+void set_control_cache_dir(const char *dir);
+
+/*
+ * get the control descriptor cache file name for the device
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: pointer to cache file name (must be freed)
+ *   or NULL if the cache is disabled or the device is not usb
+ */
+char *get_control_cache_filename(v4l2_dev_t *vd);
+
+/*
+ * add the control descriptors from the cache file to the control list
+ * args:
+ *   vd - pointer to video device data
+ *   filename - cache file name
+ *   current - pointer to pointer of current control from control list
+ *
+ * asserts:
+ *   vd is not null
+ *   filename is not null
+ *
+ * returns: number of controls added (-1 if the cache is missing or stale)
+ */
+int load_control_cache(v4l2_dev_t *vd, const char *filename, v4l2_ctrl_t **current);
+
+/*
+ * save the control descriptors of the control list into the cache file
+ * args:
+ *   vd - pointer to video device data
+ *   filename - cache file name
+ *
+ * asserts:
+ *   vd is not null
+ *   filename is not null
+ *
+ * returns: error code (0 -E_OK)
+ */
+int save_control_cache(v4l2_dev_t *vd, const char *filename);
+
+#endif
@@ -141,6 +141,8 @@ int load_control_profile(v4l2_dev_t *vd, const char *filename)
 
 	FILE *fp;
 	int major=0, minor=0, rev=0;
+	/*only controls changed by the profile are written to the device*/
+	uint32_t generation = __atomic_load_n(&vd->ctrl_generation, __ATOMIC_SEQ_CST);
 
 	if((fp = fopen(filename,"r"))!=NULL)
 	{
@@ -185,9 +187,11 @@ int load_control_profile(v4l2_dev_t *vd, const char *filename)
 						if(current->control.minimum == min &&
 						   current->control.maximum == max &&
 						   current->control.step == step &&
-						   current->control.default_value == def)
+						   current->control.default_value == def &&
+						   current->value != val)
 						{
 							current->value = val;
+							mark_control_changed(vd, current);
 						}
 					}
 				}
@@ -196,9 +200,10 @@ int load_control_profile(v4l2_dev_t *vd, const char *filename)
 				{
 					v4l2_ctrl_t *current = v4l2core_get_control_by_id(vd, id);
 
-					if(current)
+					if(current && current->value64 != val64)
 					{
 						current->value64 = val64;
+						mark_control_changed(vd, current);
 					}
 				}
 				else if(sscanf(line,"ID{0x%08x};CHK{%5i:%5i:%5i:0}=STR{\"%*s\"}",
@@ -226,12 +231,14 @@ int load_control_profile(v4l2_dev_t *vd, const char *filename)
 								if(current->string)
 									free(current->string);
 								current->string = strndup(str, max); /*FIXME: does max includes '\0' ?*/
+								mark_control_changed(vd, current);
 							}
-							else
+							else if(current->string == NULL || strcmp(current->string, str) != 0)
                             {
 								if(current->string)
 									free(current->string);
 								current->string = strndup(str, strlen(str)+1);
+								mark_control_changed(vd, current);
 							}
 						}
 					}
@@ -239,8 +246,8 @@ int load_control_profile(v4l2_dev_t *vd, const char *filename)
 			}
 		}
 
-		set_v4l2_control_values(vd);
-		get_v4l2_control_values(vd);
+		set_v4l2_changed_control_values(vd, generation);
+		sync_v4l2_control_values(vd);
 	}
     else
     {
@@ -34,6 +34,10 @@
 #include <math.h>
 #include <assert.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "gviewv4l2core.h"
 #include "dct.h"
 #include "gview.h"
@@ -53,10 +57,179 @@ void levelshift (int16_t * const data)
 {
 	int16_t i;
 
+#if defined(__SSE2__)
+	const __m128i c128 = _mm_set1_epi16(128);
+
+	for (i = 0; i < 64; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((__m128i *) (data + i));
+		_mm_storeu_si128((__m128i *) (data + i), _mm_sub_epi16(v, c128));
+	}
+#else
 	for (i = 63; i >= 0; --i)
 		data [i] -= 128;
+#endif
 }
 
+/*  All values are shifted left by 10   */
+/*  and rounded off to nearest integer  */
+
+/* scale[0] = 1
+ * scale[k] = cos(k*PI/16)*root(2)
+ */
+#define DCT_C1 1420  /* cos PI/16 * root(2)  */
+#define DCT_C2 1338  /* cos PI/8 * root(2)   */
+#define DCT_C3 1204  /* cos 3PI/16 * root(2) */
+#define DCT_C5 805   /* cos 5PI/16 * root(2) */
+#define DCT_C6 554   /* cos 3PI/8 * root(2)  */
+#define DCT_C7 283   /* cos 7PI/16 * root(2) */
+
+#if defined(__SSE2__)
+/*coefficient pair (a,b) for _mm_madd_epi16 on interleaved (x,y) lanes*/
+#define DCT_K(a,b) _mm_set_epi16(b, a, b, a, b, a, b, a)
+
+/*
+ * transpose a 8x8 block of int16 (one vector per line)
+ * args:
+ *    v - pointer to 8 vectors
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static inline void transpose_8x8_sse2(__m128i *v)
+{
+	__m128i a0 = _mm_unpacklo_epi16(v[0], v[1]);
+	__m128i a1 = _mm_unpackhi_epi16(v[0], v[1]);
+	__m128i a2 = _mm_unpacklo_epi16(v[2], v[3]);
+	__m128i a3 = _mm_unpackhi_epi16(v[2], v[3]);
+	__m128i a4 = _mm_unpacklo_epi16(v[4], v[5]);
+	__m128i a5 = _mm_unpackhi_epi16(v[4], v[5]);
+	__m128i a6 = _mm_unpacklo_epi16(v[6], v[7]);
+	__m128i a7 = _mm_unpackhi_epi16(v[6], v[7]);
+
+	__m128i b0 = _mm_unpacklo_epi32(a0, a2);
+	__m128i b1 = _mm_unpackhi_epi32(a0, a2);
+	__m128i b2 = _mm_unpacklo_epi32(a1, a3);
+	__m128i b3 = _mm_unpackhi_epi32(a1, a3);
+	__m128i b4 = _mm_unpacklo_epi32(a4, a6);
+	__m128i b5 = _mm_unpackhi_epi32(a4, a6);
+	__m128i b6 = _mm_unpacklo_epi32(a5, a7);
+	__m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+	v[0] = _mm_unpacklo_epi64(b0, b4);
+	v[1] = _mm_unpackhi_epi64(b0, b4);
+	v[2] = _mm_unpacklo_epi64(b1, b5);
+	v[3] = _mm_unpackhi_epi64(b1, b5);
+	v[4] = _mm_unpacklo_epi64(b2, b6);
+	v[5] = _mm_unpackhi_epi64(b2, b6);
+	v[6] = _mm_unpacklo_epi64(b3, b7);
+	v[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+/*
+ * (x*ka + y*kb) >> shift (32 bit products, 16 bit result)
+ * args:
+ *    x - first operand
+ *    y - second operand
+ *    k - coefficient pair (DCT_K(ka,kb))
+ *    shift - right shift
+ *
+ * asserts:
+ *    none
+ *
+ * returns: 8 int16 results
+ */
+static inline __m128i dct_mul2_sse2(__m128i x, __m128i y, __m128i k, __m128i shift)
+{
+	__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(x, y), k);
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(x, y), k);
+
+	return _mm_packs_epi32(_mm_sra_epi32(lo, shift), _mm_sra_epi32(hi, shift));
+}
+
+/*
+ * (x0*k0a + x1*k0b + x2*k1a + x3*k1b) >> shift (32 bit products, 16 bit result)
+ * args:
+ *    x0, x1 - first operand pair
+ *    k0 - coefficient pair for x0, x1
+ *    x2, x3 - second operand pair
+ *    k1 - coefficient pair for x2, x3
+ *    shift - right shift
+ *
+ * asserts:
+ *    none
+ *
+ * returns: 8 int16 results
+ */
+static inline __m128i dct_mul4_sse2(__m128i x0, __m128i x1, __m128i k0,
+	__m128i x2, __m128i x3, __m128i k1, __m128i shift)
+{
+	__m128i lo = _mm_add_epi32(
+		_mm_madd_epi16(_mm_unpacklo_epi16(x0, x1), k0),
+		_mm_madd_epi16(_mm_unpacklo_epi16(x2, x3), k1));
+	__m128i hi = _mm_add_epi32(
+		_mm_madd_epi16(_mm_unpackhi_epi16(x0, x1), k0),
+		_mm_madd_epi16(_mm_unpackhi_epi16(x2, x3), k1));
+
+	return _mm_packs_epi32(_mm_sra_epi32(lo, shift), _mm_sra_epi32(hi, shift));
+}
+
+/*
+ * one dimensional 8 point DCT on 8 lines at once
+ *   (v[k] holds sample k of each line - lines are the vector lanes)
+ *   intermediates fit in 16 bits for level shifted 8 bit input
+ * args:
+ *    v - pointer to 8 vectors (in place)
+ *    s_dc - shift for the even (add/sub only) terms
+ *    s_ac - shift for the multiplied terms
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static inline void dct_pass_sse2(__m128i *v, int s_dc, int s_ac)
+{
+	const __m128i sdc = _mm_cvtsi32_si128(s_dc);
+	const __m128i sac = _mm_cvtsi32_si128(s_ac);
+
+	__m128i x8 = _mm_add_epi16(v[0], v[7]);
+	__m128i x0 = _mm_sub_epi16(v[0], v[7]);
+
+	__m128i x7 = _mm_add_epi16(v[1], v[6]);
+	__m128i x1 = _mm_sub_epi16(v[1], v[6]);
+
+	__m128i x6 = _mm_add_epi16(v[2], v[5]);
+	__m128i x2 = _mm_sub_epi16(v[2], v[5]);
+
+	__m128i x5 = _mm_add_epi16(v[3], v[4]);
+	__m128i x3 = _mm_sub_epi16(v[3], v[4]);
+
+	__m128i x4 = _mm_add_epi16(x8, x5);
+	x8 = _mm_sub_epi16(x8, x5);
+
+	x5 = _mm_add_epi16(x7, x6);
+	x7 = _mm_sub_epi16(x7, x6);
+
+	v[0] = _mm_sra_epi16(_mm_add_epi16(x4, x5), sdc);
+	v[4] = _mm_sra_epi16(_mm_sub_epi16(x4, x5), sdc);
+
+	v[2] = dct_mul2_sse2(x8, x7, DCT_K(DCT_C2, DCT_C6), sac);
+	v[6] = dct_mul2_sse2(x8, x7, DCT_K(DCT_C6, -DCT_C2), sac);
+
+	v[7] = dct_mul4_sse2(x0, x1, DCT_K(DCT_C7, -DCT_C5),
+		x2, x3, DCT_K(DCT_C3, -DCT_C1), sac);
+	v[5] = dct_mul4_sse2(x0, x1, DCT_K(DCT_C5, -DCT_C1),
+		x2, x3, DCT_K(DCT_C7, DCT_C3), sac);
+	v[3] = dct_mul4_sse2(x0, x1, DCT_K(DCT_C3, -DCT_C7),
+		x2, x3, DCT_K(-DCT_C1, -DCT_C5), sac);
+	v[1] = dct_mul4_sse2(x0, x1, DCT_K(DCT_C1, DCT_C3),
+		x2, x3, DCT_K(DCT_C5, DCT_C7), sac);
+}
+#endif
+
 /*
  * DCT for One block(8x8)
  * args:
@@ -69,22 +242,36 @@ void levelshift (int16_t * const data)
  */
 void DCT (int16_t *data)
 {
+#if defined(__SSE2__)
+	/*same fixed point arithmetic as the scalar version (bit exact)*/
+	__m128i v[8];
+	int i;
+
+	for (i = 0; i < 8; i++)
+		v[i] = _mm_loadu_si128((__m128i *) (data + 8 * i));
+
+	/* row pass (lanes are the block rows) */
+	transpose_8x8_sse2(v);
+	dct_pass_sse2(v, 0, 10);
+
+	/* column pass (lanes are the block columns) */
+	transpose_8x8_sse2(v);
+	dct_pass_sse2(v, 3, 13);
+
+	for (i = 0; i < 8; i++)
+		_mm_storeu_si128((__m128i *) (data + 8 * i), v[i]);
+#else
 	uint16_t i;
 	int32_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
 	int16_t *tmp_ptr;
 	tmp_ptr=data;
-	/*  All values are shifted left by 10   */
-	/*  and rounded off to nearest integer  */
-
-	/* scale[0] = 1
-	 * scale[k] = cos(k*PI/16)*root(2)
-	 */
-	static const uint16_t c1=1420;    /* cos PI/16 * root(2)  */
-	static const uint16_t c2=1338;    /* cos PI/8 * root(2)   */
-	static const uint16_t c3=1204;    /* cos 3PI/16 * root(2) */
-	static const uint16_t c5=805;     /* cos 5PI/16 * root(2) */
-	static const uint16_t c6=554;     /* cos 3PI/8 * root(2)  */
-	static const uint16_t c7=283;     /* cos 7PI/16 * root(2) */
+
+	static const uint16_t c1=DCT_C1;
+	static const uint16_t c2=DCT_C2;
+	static const uint16_t c3=DCT_C3;
+	static const uint16_t c5=DCT_C5;
+	static const uint16_t c6=DCT_C6;
+	static const uint16_t c7=DCT_C7;
 
 	static const uint16_t s1=3;
 	static const uint16_t s2=10;
@@ -162,4 +349,5 @@ void DCT (int16_t *data)
 
 		data++;
 	}
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,368 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#           Dr. Alexander K. Seewald <alex@seewald.at>                          #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  focus metrics - sharpness measures for the software autofocus                #
+#                                                                               #
+#                                                                               #
+********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "focus_metric.h"
+#include "dct.h"
+#include "gview.h"
+
+#define FOCUS_DCT_ORDER   (5)    /*highest order dct coef used by the dct metric*/
+#define FOCUS_SIMD_CHUNK  (2048) /*pixels accumulated in 32 bit lanes before widening*/
+
+static int ACweight[64] = {
+	0,1,2,3,4,5,6,7,
+	1,1,2,3,4,5,6,7,
+	2,2,2,3,4,5,6,7,
+	3,3,3,3,4,5,6,7,
+	4,4,4,4,4,5,6,7,
+	5,5,5,5,5,5,6,7,
+	7,7,7,7,7,7,7,7
+};
+
+/*
+ * dct sharpness (weighted ac energy of 8x8 blocks)
+ * args:
+ *    y - pointer to the first luma line of the frame
+ *    stride - luma line stride (in bytes)
+ *    x - roi left column (in pixels)
+ *    y0 - roi top line (in pixels)
+ *    width - roi width (in pixels)
+ *    height - roi height (in pixels)
+ *    step - block line step (1 - evaluate every block line)
+ *
+ * asserts:
+ *    y is not null
+ *
+ * returns: sharpness value
+ */
+double focus_metric_dct(uint8_t *y, int stride,
+	int x, int y0, int width, int height, int step)
+{
+	/*asserts*/
+	assert(y != NULL);
+
+	double sumAC[64];
+	int16_t data[64];
+	int numMCUx = width / 8;
+	int numMCUy = height / 8;
+	int cnt = 0;
+	int i = 0;
+	int j = 0;
+	int xp = 0;
+	int yp = 0;
+	double res = 0;
+
+	if(numMCUx <= 0 || numMCUy <= 0)
+		return 0;
+	if(step < 1)
+		step = 1;
+
+	/*center the block grid in the roi*/
+	x += (width - numMCUx * 8) >> 1;
+	y0 += (height - numMCUy * 8) >> 1;
+
+	/*gaussian weight around the roi center*/
+	int ctx = numMCUx >> 1;
+	int cty = numMCUy >> 1;
+	double rad = ctx/2;
+	if (cty < ctx) { rad = cty/2; }
+	if (rad < 1) { rad = 1; }
+	rad = rad * rad;
+
+	memset(sumAC, 0, 64 * sizeof(double));
+
+	for (yp = 0; yp < numMCUy; yp += step)
+	{
+		double yp_ = yp - cty;
+		double weight_y = exp(-(yp_ * yp_)/rad);
+		uint8_t *line = y + (y0 + yp * 8) * stride + x;
+
+		for (xp = 0; xp < numMCUx; xp++)
+		{
+			double xp_ = xp - ctx;
+			double weight = weight_y * exp(-(xp_ * xp_)/rad);
+			uint8_t *mcu = line + xp * 8;
+
+			for (i = 0; i < 8; i++)
+				for (j = 0; j < 8; j++)
+					data[i * 8 + j] = (int16_t) mcu[i * stride + j];
+
+			levelshift (data);
+			DCT (data);
+
+			for (i = 0; i < 64; i++)
+				sumAC[i] += data[i] * data[i] * weight;
+
+			cnt++;
+		}
+	}
+
+	for (i = 0; i <= FOCUS_DCT_ORDER; i++)
+	{
+		for(j = 0; j < FOCUS_DCT_ORDER; j++)
+		{
+			/*average = mean*/
+			res += (sumAC[i * 8 + j] / (double) cnt) * ACweight[i * 8 + j];
+		}
+	}
+
+	return res;
+}
+
+/*
+ * accumulate the laplacian of a luma line
+ * args:
+ *    p - pointer to the first pixel in line
+ *    stride - luma line stride (in bytes)
+ *    width - number of pixels in line
+ *    sum - pointer to laplacian sum accumulator
+ *    sum2 - pointer to squared laplacian sum accumulator
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void laplacian_line(uint8_t *p, int stride, int width,
+	int64_t *sum, int64_t *sum2)
+{
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	int32_t acc[4];
+
+	while(i + 8 <= width)
+	{
+		/*
+		 * |laplacian| <= 1020 so the squared sum of one 8 pixel
+		 * group is at most 2.1M per lane: widen every chunk
+		 */
+		int end = i + FOCUS_SIMD_CHUNK;
+		if(end > width)
+			end = width;
+
+		__m128i vsum = zero;
+		__m128i vsum2 = zero;
+
+		for(; i + 8 <= end; i += 8)
+		{
+			__m128i c = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + i)), zero);
+			__m128i l = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + i - 1)), zero);
+			__m128i r = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + i + 1)), zero);
+			__m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + i - stride)), zero);
+			__m128i d = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + i + stride)), zero);
+
+			__m128i lap = _mm_sub_epi16(_mm_slli_epi16(c, 2),
+				_mm_add_epi16(_mm_add_epi16(l, r), _mm_add_epi16(u, d)));
+
+			vsum = _mm_add_epi32(vsum, _mm_madd_epi16(lap, one));
+			vsum2 = _mm_add_epi32(vsum2, _mm_madd_epi16(lap, lap));
+		}
+
+		_mm_storeu_si128((__m128i *) acc, vsum);
+		*sum += (int64_t) acc[0] + acc[1] + acc[2] + acc[3];
+		_mm_storeu_si128((__m128i *) acc, vsum2);
+		*sum2 += (int64_t) acc[0] + acc[1] + acc[2] + acc[3];
+	}
+#endif
+
+	for(; i < width; i++)
+	{
+		int lap = 4 * p[i] - p[i - 1] - p[i + 1] - p[i - stride] - p[i + stride];
+		*sum += lap;
+		*sum2 += lap * lap;
+	}
+}
+
+/*
+ * variance of the laplacian
+ * args:
+ *    y - pointer to the first luma line of the frame
+ *    stride - luma line stride (in bytes)
+ *    x - roi left column (in pixels) - must be > 0
+ *    y0 - roi top line (in pixels) - must be > 0
+ *    width - roi width (in pixels) - roi must end before the last column
+ *    height - roi height (in pixels) - roi must end before the last line
+ *    step - line step (1 - evaluate every line)
+ *
+ * asserts:
+ *    y is not null
+ *
+ * returns: sharpness value
+ */
+double focus_metric_laplacian(uint8_t *y, int stride,
+	int x, int y0, int width, int height, int step)
+{
+	/*asserts*/
+	assert(y != NULL);
+
+	int64_t sum = 0;
+	int64_t sum2 = 0;
+	int64_t n = 0;
+	int line = 0;
+
+	if(width <= 0 || height <= 0)
+		return 0;
+	if(step < 1)
+		step = 1;
+
+	for(line = y0; line < y0 + height; line += step)
+	{
+		laplacian_line(y + line * stride + x, stride, width, &sum, &sum2);
+		n += width;
+	}
+
+	double mean = (double) sum / (double) n;
+	return ((double) sum2 / (double) n) - (mean * mean);
+}
+
+/*
+ * accumulate the squared sobel gradient of a luma line
+ * args:
+ *    p - pointer to the first pixel in line
+ *    stride - luma line stride (in bytes)
+ *    width - number of pixels in line
+ *    sum2 - pointer to squared gradient sum accumulator
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void tenengrad_line(uint8_t *p, int stride, int width, int64_t *sum2)
+{
+	uint8_t *a = p - stride; /*line above*/
+	uint8_t *b = p + stride; /*line below*/
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	int32_t acc[4];
+
+	while(i + 8 <= width)
+	{
+		/*
+		 * |gx|,|gy| <= 1020 so the squared sum of one 8 pixel
+		 * group is at most 4.2M per lane: widen every chunk
+		 */
+		int end = i + FOCUS_SIMD_CHUNK;
+		if(end > width)
+			end = width;
+
+		__m128i vsum2 = zero;
+
+		for(; i + 8 <= end; i += 8)
+		{
+			__m128i al = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (a + i - 1)), zero);
+			__m128i ac = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (a + i)), zero);
+			__m128i ar = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (a + i + 1)), zero);
+			__m128i cl = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + i - 1)), zero);
+			__m128i cr = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (p + i + 1)), zero);
+			__m128i bl = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (b + i - 1)), zero);
+			__m128i bc = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (b + i)), zero);
+			__m128i br = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) (b + i + 1)), zero);
+
+			/*gx = (ar + 2cr + br) - (al + 2cl + bl)*/
+			__m128i gx = _mm_sub_epi16(
+				_mm_add_epi16(_mm_add_epi16(ar, br), _mm_slli_epi16(cr, 1)),
+				_mm_add_epi16(_mm_add_epi16(al, bl), _mm_slli_epi16(cl, 1)));
+			/*gy = (bl + 2bc + br) - (al + 2ac + ar)*/
+			__m128i gy = _mm_sub_epi16(
+				_mm_add_epi16(_mm_add_epi16(bl, br), _mm_slli_epi16(bc, 1)),
+				_mm_add_epi16(_mm_add_epi16(al, ar), _mm_slli_epi16(ac, 1)));
+
+			vsum2 = _mm_add_epi32(vsum2, _mm_madd_epi16(gx, gx));
+			vsum2 = _mm_add_epi32(vsum2, _mm_madd_epi16(gy, gy));
+		}
+
+		_mm_storeu_si128((__m128i *) acc, vsum2);
+		*sum2 += (int64_t) acc[0] + acc[1] + acc[2] + acc[3];
+	}
+#endif
+
+	for(; i < width; i++)
+	{
+		int gx = (a[i + 1] + 2 * p[i + 1] + b[i + 1]) - (a[i - 1] + 2 * p[i - 1] + b[i - 1]);
+		int gy = (b[i - 1] + 2 * b[i] + b[i + 1]) - (a[i - 1] + 2 * a[i] + a[i + 1]);
+		*sum2 += gx * gx + gy * gy;
+	}
+}
+
+/*
+ * tenengrad (mean squared sobel gradient magnitude)
+ * args:
+ *    y - pointer to the first luma line of the frame
+ *    stride - luma line stride (in bytes)
+ *    x - roi left column (in pixels) - must be > 0
+ *    y0 - roi top line (in pixels) - must be > 0
+ *    width - roi width (in pixels) - roi must end before the last column
+ *    height - roi height (in pixels) - roi must end before the last line
+ *    step - line step (1 - evaluate every line)
+ *
+ * asserts:
+ *    y is not null
+ *
+ * returns: sharpness value
+ */
+double focus_metric_tenengrad(uint8_t *y, int stride,
+	int x, int y0, int width, int height, int step)
+{
+	/*asserts*/
+	assert(y != NULL);
+
+	int64_t sum2 = 0;
+	int64_t n = 0;
+	int line = 0;
+
+	if(width <= 0 || height <= 0)
+		return 0;
+	if(step < 1)
+		step = 1;
+
+	for(line = y0; line < y0 + height; line += step)
+	{
+		tenengrad_line(y + line * stride + x, stride, width, &sum2);
+		n += width;
+	}
+
+	return (double) sum2 / (double) n;
+}
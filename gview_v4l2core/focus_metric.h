@@ -0,0 +1,112 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#           Dr. Alexander K. Seewald <alex@seewald.at>                          #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  focus metrics - sharpness measures for the software autofocus                #
+#                                                                               #
+#                                                                               #
+********************************************************************************/
+
+#ifndef FOCUS_METRIC_H
+#define FOCUS_METRIC_H
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+/*
+ * focus metric callback
+ * args:
+ *    y - pointer to the first luma line of the frame
+ *    stride - luma line stride (in bytes)
+ *    x - roi left column (in pixels)
+ *    y0 - roi top line (in pixels)
+ *    width - roi width (in pixels)
+ *    height - roi height (in pixels)
+ *    step - line step (1 - evaluate every line)
+ *
+ * asserts:
+ *    y is not null
+ *
+ * returns: sharpness value (higher is sharper)
+ */
+typedef double (*focus_metric_t)(uint8_t *y, int stride,
+	int x, int y0, int width, int height, int step);
+
+/*
+ * dct sharpness (weighted ac energy of 8x8 blocks)
+ * args:
+ *    y - pointer to the first luma line of the frame
+ *    stride - luma line stride (in bytes)
+ *    x - roi left column (in pixels)
+ *    y0 - roi top line (in pixels)
+ *    width - roi width (in pixels)
+ *    height - roi height (in pixels)
+ *    step - block line step (1 - evaluate every block line)
+ *
+ * asserts:
+ *    y is not null
+ *
+ * returns: sharpness value
+ */
+double focus_metric_dct(uint8_t *y, int stride,
+	int x, int y0, int width, int height, int step);
+
+/*
+ * variance of the laplacian
+ * args:
+ *    y - pointer to the first luma line of the frame
+ *    stride - luma line stride (in bytes)
+ *    x - roi left column (in pixels) - must be > 0
+ *    y0 - roi top line (in pixels) - must be > 0
+ *    width - roi width (in pixels) - roi must end before the last column
+ *    height - roi height (in pixels) - roi must end before the last line
+ *    step - line step (1 - evaluate every line)
+ *
+ * asserts:
+ *    y is not null
+ *
+ * returns: sharpness value
+ */
+double focus_metric_laplacian(uint8_t *y, int stride,
+	int x, int y0, int width, int height, int step);
+
+/*
+ * tenengrad (mean squared sobel gradient magnitude)
+ * args:
+ *    y - pointer to the first luma line of the frame
+ *    stride - luma line stride (in bytes)
+ *    x - roi left column (in pixels) - must be > 0
+ *    y0 - roi top line (in pixels) - must be > 0
+ *    width - roi width (in pixels) - roi must end before the last column
+ *    height - roi height (in pixels) - roi must end before the last line
+ *    step - line step (1 - evaluate every line)
+ *
+ * asserts:
+ *    y is not null
+ *
+ * returns: sharpness value
+ */
+double focus_metric_tenengrad(uint8_t *y, int stride,
+	int x, int y0, int width, int height, int step);
+
+#endif
@@ -88,6 +88,8 @@ __BEGIN_DECLS
 #define E_WRONG_MARKER_ERR        (-29)
 #define E_NO_EOI_ERR              (-30)
 #define E_FILE_IO_ERR             (-31)
+#define E_QUEUE_FULL_ERR          (-32)
+#define E_BUFFER_SIZE_ERR         (-33)
 #define E_UNKNOWN_ERR    		  (-40)
 
 /*
@@ -103,6 +105,16 @@ __BEGIN_DECLS
 #define IO_MMAP 1
 #define IO_READ 2
 
+/*
+ * minimum interval between control write queue flushes (ms)
+ */
+#define CTRL_QUEUE_FLUSH_INTERVAL (50)
+
+/*
+ * control events check interval (ms)
+ */
+#define CTRL_EVENTS_CHECK_INTERVAL (250)
+
 /*
  * Frame status
  */
@@ -112,6 +124,7 @@ __BEGIN_DECLS
 
 /*
  * software autofocus sort method
+ * (ignored - kept for API compatibility)
  * quick sort
  * shell sort
  * insert sort
@@ -122,6 +135,24 @@ __BEGIN_DECLS
 #define AUTOF_SORT_INSERT 3
 #define AUTOF_SORT_BUBBLE 4
 
+/*
+ * software autofocus sharpness measure
+ * dct ac energy (8x8 blocks)
+ * variance of the laplacian
+ * tenengrad (squared sobel gradient)
+ */
+#define AUTOF_METRIC_DCT       0
+#define AUTOF_METRIC_LAPLACIAN 1
+#define AUTOF_METRIC_TENENGRAD 2
+
+/*
+ * software autofocus tracking mode
+ * continuous - refocus on a sustained sharpness drop
+ * quiet - recording: larger hysteresis, bounded local refocus, no rescan
+ */
+#define AUTOF_TRACK_CONTINUOUS 0
+#define AUTOF_TRACK_QUIET      1
+
 /*
  * Image Formats
  */
@@ -129,6 +160,38 @@ __BEGIN_DECLS
 #define IMG_FMT_JPG     (1)
 #define IMG_FMT_PNG     (2)
 #define IMG_FMT_BMP     (3)
+#define IMG_FMT_JPG_RAW (4) /*mjpeg bitstream passthrough (raw_frame)*/
+
+/*
+ * png compression presets
+ */
+#define PNG_PRESET_FAST    (0) /*zlib level 1, up filter*/
+#define PNG_PRESET_DEFAULT (1) /*zlib level 6, adaptive filters*/
+#define PNG_PRESET_SMALL   (2) /*zlib level 9, adaptive filters*/
+
+/*
+ * snapshot service backpressure policy (queue full)
+ */
+#define SNAPSHOT_POLICY_BLOCK    (0) /*wait for a free queue slot*/
+#define SNAPSHOT_POLICY_DROP_NEW (1) /*discard the new snapshot*/
+#define SNAPSHOT_POLICY_DROP_OLD (2) /*discard the oldest pending snapshot*/
+
+/*
+ * yu12 to rgb conversion: output pixel layouts
+ */
+#define RGB_FMT_RGB24   (0)
+#define RGB_FMT_BGR24   (1)
+#define RGB_FMT_RGBA    (2)
+#define RGB_FMT_BGRA    (3)
+
+/*
+ * yu12 to rgb conversion: matrix coefficients and quantization range
+ */
+#define YUV_MATRIX_BT601  (0)
+#define YUV_MATRIX_BT709  (1)
+
+#define YUV_RANGE_FULL    (0)
+#define YUV_RANGE_LIMITED (1)
 
 
 /*
@@ -233,6 +296,8 @@ typedef struct _v4l2_ctrl_t
     int menu_entries;
     char **menu_entry; /*gettext translated menu entry name*/
 
+    uint32_t generation; /*registry generation of the last value or flags change*/
+
     //next control in the list
     struct _v4l2_ctrl_t *next;
 } v4l2_ctrl_t;
@@ -265,6 +330,52 @@ typedef struct _v4l2_frame_buff_t
 
 } v4l2_frame_buff_t;
 
+/*
+ * snapshot service completion callback
+ *   (called from a writer thread - status is E_OK on success)
+ */
+typedef void (*v4l2core_snapshot_cb_t)(const char *filename, int format, int status, void *data);
+
+/*
+ * snapshot service stats
+ */
+typedef struct _v4l2_snapshot_stats_t
+{
+	uint64_t submitted; //snapshots submitted
+	uint64_t saved;     //snapshots written to disk
+	uint64_t failed;    //encoding or io errors
+	uint64_t dropped;   //dropped by the backpressure policy
+	uint64_t blocked;   //producer waits for a free slot
+	int pending;        //snapshots currently queued
+	int max_pending;    //queue high water mark
+	int busy;           //snapshots being encoded
+	uint64_t encode_ns;      //total encode and write time
+	uint64_t max_latency_ns; //max submit to completion time
+} v4l2_snapshot_stats_t;
+
+/*
+ * raw frame dump: frame index entry
+ *   (stored in front of each frame and in the file index)
+ */
+#define RAW_FRAME_KEYFRAME (1 << 0) //frame is a keyframe (h264 IDR)
+
+typedef struct _v4l2_raw_index_t
+{
+	uint32_t magic;       //record magic
+	uint32_t pixelformat; //frame pixel format (v4l2 fourcc)
+	uint32_t width;       //frame width (in pixels)
+	uint32_t height;      //frame height (in pixels)
+	uint64_t timestamp;   //capture timestamp (ns)
+	uint64_t offset;      //frame data offset in file (page aligned)
+	uint64_t size;        //frame data size (bytes)
+	uint64_t frame;       //frame number
+	uint32_t flags;       //frame flags (RAW_FRAME_XXX)
+	uint32_t reserved[3];
+} __attribute__ ((packed)) v4l2_raw_index_t;
+
+typedef struct _v4l2_raw_writer_t v4l2_raw_writer_t;
+typedef struct _v4l2_raw_reader_t v4l2_raw_reader_t;
+
 /*
  * v4l2 device system data
  */
@@ -276,6 +387,7 @@ typedef struct _v4l2_dev_sys_data_t
 	char *location;
 	uint32_t vendor;
 	uint32_t product;
+	uint32_t firmware; /*usb bcdDevice*/
 	int valid;
 	int current;
 	uint64_t busnum;
@@ -447,6 +559,20 @@ void v4l2core_disable_libv4l2();
  */
 void v4l2core_enable_libv4l2();
 
+/*
+ * set the control descriptor cache directory (set before opening the device)
+ *  usb devices will load their control descriptors from a cache file
+ *  (keyed by vendor, product and firmware) instead of querying them
+ * args:
+ *   dir - cache directory (NULL disables the cache - default)
+ *
+ * asserts:
+ *   none
+ *
+ * returns void
+ */
+void v4l2core_set_control_cache_dir(const char *dir);
+
 /*
  * get pixelformat from fourcc
  * args:
@@ -496,6 +622,38 @@ void v4l2core_set_capture_method(v4l2_dev_t *vd, int method);
  */
 v4l2_dev_t* v4l2core_init_dev(const char *device);
 
+/*
+ * Initiate a video device handler without a device (offline decoding)
+ *   raw frames are fed with v4l2core_decode_raw_frame
+ * args:
+ *   pixelformat - raw frame v4l2 pixel format
+ *   width - frame width
+ *   height - frame height
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to v4l2 device handler (or NULL on error)
+ */
+v4l2_dev_t* v4l2core_init_offline_dev(uint32_t pixelformat, int width, int height);
+
+/*
+ * decode a raw frame on an offline device handler
+ * args:
+ *   vd - pointer to v4l2 device handler (from v4l2core_init_offline_dev)
+ *   raw_frame - pointer to raw frame data (in the device pixel format)
+ *   raw_size - raw frame size in bytes
+ *   timestamp - frame timestamp (ns)
+ *
+ * asserts:
+ *   vd is not null
+ *   raw_frame is not null
+ *
+ * returns: pointer to decoded frame buffer (or NULL on error)
+ */
+v4l2_frame_buff_t *v4l2core_decode_raw_frame(v4l2_dev_t *vd,
+	uint8_t *raw_frame, size_t raw_size, uint64_t timestamp);
+
 /*
  * get device control list
  * args:
@@ -508,6 +666,20 @@ v4l2_dev_t* v4l2core_init_dev(const char *device);
  */
 v4l2_ctrl_t *v4l2core_get_control_list(v4l2_dev_t *vd);
 
+/*
+ * get device control registry generation
+ *  (controls with control->generation greater than a previously
+ *   returned generation changed since then)
+ * args:
+ *    vd - pointer to v4l2 device handler
+ *
+ * asserts:
+ *    vd is not null
+ *
+ * return: current control generation
+ */
+uint32_t v4l2core_get_control_generation(v4l2_dev_t *vd);
+
 /*
  * get stream frame format list for device
  * args:
@@ -633,6 +805,7 @@ int v4l2core_check_device_list_events();
 
 /*
  * check for control events
+ *  (updates the control cache with value, flags and range changes)
  * args:
  *   vd - pointer to v4l2 device handler
  *
@@ -703,6 +876,18 @@ int v4l2core_get_frame_width(v4l2_dev_t *vd);
  */
 int v4l2core_get_frame_height(v4l2_dev_t *vd);
 
+/*
+ * get the maximum raw frame size for the current format
+ * args:
+ *   vd - pointer to v4l2 device handler
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: negotiated frame size (sizeimage) in bytes
+ */
+size_t v4l2core_get_frame_max_size(v4l2_dev_t *vd);
+
 /* get frame format index from format list
  * args:
  *   vd - pointer to v4l2 device handler
@@ -950,6 +1135,7 @@ int v4l2core_set_control_value_by_id(v4l2_dev_t *vd, int id);
 /*
  * updates the value for control id from the device
  * also updates control flags
+ * (no device read if the control cache is kept current by control events)
  * args:
  *   vd - pointer to v4l2 device handler
  *   id - control id
@@ -961,6 +1147,36 @@ int v4l2core_set_control_value_by_id(v4l2_dev_t *vd, int id);
  */
 int v4l2core_get_control_value_by_id(v4l2_dev_t *vd, int id);
 
+/*
+ * queue the current value of control id for a deferred write
+ *  (repeated writes to the same control are coalesced and only
+ *   the last value is sent on the next queue flush)
+ * args:
+ *   vd - pointer to v4l2 device handler
+ *   id - control id
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: error code (controls that can't be coalesced,
+ *   like buttons or relative controls, are written immediately)
+ */
+int v4l2core_queue_control_value_by_id(v4l2_dev_t *vd, int id);
+
+/*
+ * flush the control write queue: writes the queued controls of each
+ *  class in a single VIDIOC_S_EXT_CTRLS, at most once every
+ *  CTRL_QUEUE_FLUSH_INTERVAL ms
+ * args:
+ *   vd - pointer to v4l2 device handler
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: number of controls written to the device
+ */
+int v4l2core_flush_control_queue(v4l2_dev_t *vd);
+
 /*
  * goes trough the control list and sets values in device to default
  * args:
@@ -975,6 +1191,7 @@ void v4l2core_set_control_defaults(v4l2_dev_t *vd);
 
 /*
  * set autofocus sort method
+ *   (ignored - the focus search doesn't sort samples)
  * args:
  *    method - sort method
  *
@@ -985,6 +1202,58 @@ void v4l2core_set_control_defaults(v4l2_dev_t *vd);
  */
 void v4l2core_soft_autofocus_set_sort(int method);
 
+/*
+ * set autofocus tracking mode
+ * args:
+ *    mode - tracking mode (AUTOF_TRACK_XXX)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_tracking(int mode);
+
+/*
+ * set autofocus sharpness measure
+ * args:
+ *    metric - sharpness measure (AUTOF_METRIC_XXX)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_metric(int metric);
+
+/*
+ * set autofocus region of interest
+ * args:
+ *    x - roi left column (% of frame width)
+ *    y - roi top line (% of frame height)
+ *    width - roi width (% of frame width)
+ *    height - roi height (% of frame height)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_roi(int x, int y, int width, int height);
+
+/*
+ * set autofocus line subsampling
+ * args:
+ *    step - evaluate one in every step lines of the roi
+ *           (0 - auto: bound the evaluated pixels per frame)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_subsample(int step);
+
 /*
  * initiate software autofocus
  * args:
@@ -1395,7 +1664,7 @@ int v4l2core_save_data_to_file(const char *filename, uint8_t *data, int size);
  *    frame - pointer to frame buffer
  *    filename - output file name
  *    format - image type
- *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP)
+ *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP, IMG_FMT_JPG_RAW)
  *
  * asserts:
  *    none
@@ -1407,6 +1676,246 @@ int v4l2core_save_image(
 	const char *filename,
 	int format);
 
+/*
+ * encode a yu12 frame to a baseline jpeg (4:2:0)
+ *   MCU rows are restart intervals, encoded in parallel
+ * args:
+ *    in - pointer to yu12 frame data
+ *    width - frame width
+ *    height - frame height
+ *    out - pointer to output buffer
+ *    out_size - output buffer size in bytes
+ *    huff - huffman tables flag (1 - JFIF with DHT; 0 - AVI1 without DHT)
+ *
+ * asserts:
+ *    in is not null
+ *    out is not null
+ *
+ * returns: jpeg size in bytes or error code (< 0)
+ */
+int v4l2core_encode_jpeg(uint8_t *in, int width, int height,
+	uint8_t *out, int out_size, int huff);
+
+/*
+ * set the png compression preset and number of deflate threads
+ * args:
+ *    preset - compression preset (PNG_PRESET_[FAST|DEFAULT|SMALL])
+ *    threads - number of deflate threads (1 to 8)
+ *      (1 - single threaded libpng writer; > 1 - parallel deflate)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_set_png_compression(int preset, int threads);
+
+/*
+ * start the snapshot service
+ * args:
+ *   workers - number of writer threads (1 to 8)
+ *   queue_size - maximum number of pending snapshots (1 to 64)
+ *   policy - backpressure policy when the queue is full
+ *            (SNAPSHOT_POLICY_[BLOCK|DROP_NEW|DROP_OLD])
+ *   callback - completion callback (called from a writer thread) or NULL
+ *   data - callback user data
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code
+ */
+int v4l2core_snapshot_start(int workers, int queue_size, int policy,
+	v4l2core_snapshot_cb_t callback, void *data);
+
+/*
+ * queue a frame snapshot for encoding and writing
+ *   (the frame data is copied - the frame can be released on return)
+ * args:
+ *   frame - pointer to frame buffer
+ *   filename - output file name
+ *   format - image type
+ *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP, IMG_FMT_JPG_RAW)
+ *
+ * asserts:
+ *   frame is not null
+ *   filename is not null
+ *
+ * returns: error code (E_QUEUE_FULL_ERR if the snapshot was dropped)
+ */
+int v4l2core_snapshot_submit(v4l2_frame_buff_t *frame, const char *filename, int format);
+
+/*
+ * preallocate a burst arena: the queue grows to hold frames pending
+ *   snapshots, each with a prefaulted buffer of frame_size bytes, so
+ *   a burst is queued without blocking or allocating
+ *   (waits for the pending snapshots to complete)
+ * args:
+ *   frames - number of arena frames (0 releases the arena)
+ *   frame_size - arena frame size in bytes
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code
+ */
+int v4l2core_snapshot_reserve(int frames, size_t frame_size);
+
+/*
+ * get the snapshot service stats
+ * args:
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   stats is not null
+ *
+ * returns: none
+ */
+void v4l2core_snapshot_get_stats(v4l2_snapshot_stats_t *stats);
+
+/*
+ * stop the snapshot service
+ *   (blocks until all pending snapshots are written)
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void v4l2core_snapshot_stop();
+
+/*
+ * open a raw dump file for writing
+ *   (lossless container: frames are stored as captured - raw_frame -
+ *    with an index entry holding timestamp, pixel format and size)
+ * args:
+ *   filename - file name
+ *
+ * asserts:
+ *   filename is not null
+ *
+ * returns: pointer to writer or NULL on error
+ */
+v4l2_raw_writer_t *v4l2core_raw_writer_open(const char *filename);
+
+/*
+ * queue a frame (raw_frame data) for writing
+ *   blocks if all the write slots are busy
+ *   (must always be called from the same thread)
+ * args:
+ *   writer - pointer to writer
+ *   frame - pointer to frame buffer
+ *   pixelformat - frame pixel format (v4l2 fourcc)
+ *
+ * asserts:
+ *   writer is not null
+ *   frame is not null
+ *
+ * returns: error code
+ */
+int v4l2core_raw_writer_add_frame(v4l2_raw_writer_t *writer,
+	v4l2_frame_buff_t *frame, uint32_t pixelformat);
+
+/*
+ * close a raw dump file
+ *   (writes the pending frames, the index and the final header)
+ * args:
+ *   writer - pointer to writer
+ *
+ * asserts:
+ *   writer is not null
+ *
+ * returns: error code
+ */
+int v4l2core_raw_writer_close(v4l2_raw_writer_t *writer);
+
+/*
+ * open a raw dump file for reading (memory mapped)
+ *   the index is rebuilt from the frame records if the file wasn't closed
+ * args:
+ *   filename - file name
+ *
+ * asserts:
+ *   filename is not null
+ *
+ * returns: pointer to reader or NULL on error
+ */
+v4l2_raw_reader_t *v4l2core_raw_reader_open(const char *filename);
+
+/*
+ * get the number of frames in a raw dump file
+ * args:
+ *   reader - pointer to reader
+ *
+ * asserts:
+ *   reader is not null
+ *
+ * returns: number of frames
+ */
+uint64_t v4l2core_raw_reader_get_frames(v4l2_raw_reader_t *reader);
+
+/*
+ * get a frame from a raw dump file
+ * args:
+ *   reader - pointer to reader
+ *   n - frame number (0 to frames - 1)
+ *   entry - pointer to index entry to fill (can be NULL)
+ *
+ * asserts:
+ *   reader is not null
+ *
+ * returns: pointer to frame data (in the file mapping) or NULL on error
+ */
+uint8_t *v4l2core_raw_reader_get_frame(v4l2_raw_reader_t *reader,
+	uint64_t n, v4l2_raw_index_t *entry);
+
+/*
+ * close a raw dump file (unmaps the file)
+ * args:
+ *   reader - pointer to reader
+ *
+ * asserts:
+ *   reader is not null
+ *
+ * returns: none
+ */
+void v4l2core_raw_reader_close(v4l2_raw_reader_t *reader);
+
+/*
+ * set the yuv colorspace used for rgb conversions (snapshots and cpu render)
+ * args:
+ *    matrix - yuv matrix coefficients (YUV_MATRIX_BT601 or YUV_MATRIX_BT709)
+ *    range - yuv quantization range (YUV_RANGE_FULL or YUV_RANGE_LIMITED)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_set_yuv_colorspace(int matrix, int range);
+
+/*
+ * convert a yu12 frame to packed rgb using the current yuv colorspace
+ * args:
+ *    out - pointer to first line of the output buffer
+ *    out_stride - output line stride in bytes
+ *                 (negative values write lines bottom-up)
+ *    in - pointer to input yu12 data buffer
+ *    width - frame width (in pixels)
+ *    height - frame height (in pixels)
+ *    rgb_fmt - output pixel layout (RGB_FMT_XXX)
+ *
+ * asserts:
+ *    out is not null
+ *    in is not null
+ *
+ * returns: none
+ */
+void v4l2core_yu12_to_rgb(uint8_t *out, int out_stride, uint8_t *in,
+	int width, int height, int rgb_fmt);
+
 /*
  * ############### TIME DATA ##############
  */
@@ -0,0 +1,718 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  raw frame dump - lossless container for uncompressed capture                 #
+#                                                                               #
+#  file layout (little endian, every block is RAW_DUMP_ALIGN aligned):          #
+#    header block                                                               #
+#    for each frame: record block (index entry) + payload (padded)              #
+#    index (all the entries - written on close)                                 #
+#                                                                               #
+#  records are written by a writer thread, the reader maps the file and        #
+#  rebuilds the index from the records if the file was not closed              #
+#                                                                               #
+********************************************************************************/
+
+#define _GNU_SOURCE /*O_DIRECT and sync_file_range*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "gviewv4l2core.h"
+#include "gview.h"
+
+extern int verbosity;
+
+#define RAW_DUMP_MAGIC   "GVRAWDMP"
+#define RAW_DUMP_VERSION (1)
+#define RAW_DUMP_ENDIAN  (0x01020304)
+#define RAW_DUMP_ALIGN   (4096) /*block alignment (O_DIRECT safe)*/
+#define RAW_DUMP_SLOTS   (8)    /*write queue slots*/
+#define RAW_RECORD_MAGIC (0x46525647) /*'GVRF'*/
+
+typedef struct _raw_dump_header_t
+{
+	char magic[8];         /*RAW_DUMP_MAGIC*/
+	uint32_t version;      /*RAW_DUMP_VERSION*/
+	uint32_t endian;       /*RAW_DUMP_ENDIAN*/
+	uint32_t align;        /*block alignment*/
+	uint32_t entry_size;   /*index entry size*/
+	uint64_t frames;       /*number of frames (0 if not closed)*/
+	uint64_t index_offset; /*index offset (0 if not closed)*/
+	uint64_t data_end;     /*end of the last record*/
+} __attribute__ ((packed)) raw_dump_header_t;
+
+typedef struct _raw_slot_t
+{
+	uint8_t *buffer;    /*record block + payload (aligned)*/
+	size_t buffer_size;
+	size_t size;        /*bytes to write*/
+	uint64_t offset;    /*record offset in file*/
+} raw_slot_t;
+
+struct _v4l2_raw_writer_t
+{
+	int fd;
+	int direct;            /*file opened with O_DIRECT*/
+	uint64_t offset;       /*next record offset*/
+
+	v4l2_raw_index_t *index;
+	uint64_t frames;
+	uint64_t index_size;   /*index capacity (entries)*/
+
+	raw_slot_t slot[RAW_DUMP_SLOTS];
+	int head;              /*next slot to write*/
+	int count;             /*queued slots*/
+
+	int stop;
+	int error;
+	uint64_t blocked;      /*frames that waited for a free slot*/
+
+	__THREAD_TYPE thread;
+	__MUTEX_TYPE mutex;
+	__COND_TYPE cond;
+};
+
+struct _v4l2_raw_reader_t
+{
+	uint8_t *map;
+	size_t map_size;
+
+	v4l2_raw_index_t *index;
+	int index_alloc;       /*index was rebuilt (must be freed)*/
+	uint64_t frames;
+};
+
+/*
+ * round size up to the block alignment
+ * args:
+ *   size - size in bytes
+ *
+ * asserts:
+ *   none
+ *
+ * returns: aligned size
+ */
+static uint64_t raw_align(uint64_t size)
+{
+	return (size + RAW_DUMP_ALIGN - 1) & ~((uint64_t) RAW_DUMP_ALIGN - 1);
+}
+
+/*
+ * allocate an aligned and zeroed block buffer
+ * args:
+ *   size - buffer size (multiple of RAW_DUMP_ALIGN)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to buffer
+ */
+static uint8_t *raw_alloc(size_t size)
+{
+	uint8_t *buffer = NULL;
+
+	if(posix_memalign((void **) &buffer, RAW_DUMP_ALIGN, size) != 0)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (raw_alloc): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	memset(buffer, 0, size);
+	return buffer;
+}
+
+/*
+ * write a buffer at a given file offset
+ * args:
+ *   fd - file descriptor
+ *   buffer - pointer to data
+ *   size - data size
+ *   offset - file offset
+ *
+ * asserts:
+ *   buffer is not null
+ *
+ * returns: error code
+ */
+static int raw_write(int fd, uint8_t *buffer, size_t size, uint64_t offset)
+{
+	/*assertions*/
+	assert(buffer != NULL);
+
+	while(size > 0)
+	{
+		ssize_t ret = pwrite(fd, buffer, size, (off_t) offset);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			fprintf(stderr, "V4L2_CORE: (raw dump) write error: %s\n", strerror(errno));
+			return E_FILE_IO_ERR;
+		}
+
+		buffer += ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return E_OK;
+}
+
+/*
+ * raw dump writer thread
+ *   writes the queued records in order; for buffered files the
+ *   writeback is started right away and the previous record is
+ *   dropped from the page cache, so the cache doesn't fill up
+ * args:
+ *   data - pointer to writer
+ *
+ * asserts:
+ *   data is not null
+ *
+ * returns: NULL
+ */
+static void *raw_writer_thread(void *data)
+{
+	/*assertions*/
+	assert(data != NULL);
+
+	v4l2_raw_writer_t *writer = (v4l2_raw_writer_t *) data;
+
+	uint64_t last_offset = 0;
+	size_t last_size = 0;
+
+	while(1)
+	{
+		__LOCK_MUTEX(&writer->mutex);
+		while(writer->count == 0 && !writer->stop)
+			__COND_WAIT(&writer->cond, &writer->mutex);
+
+		if(writer->count == 0)
+		{
+			__UNLOCK_MUTEX(&writer->mutex);
+			break;
+		}
+
+		raw_slot_t *slot = &writer->slot[writer->head];
+		__UNLOCK_MUTEX(&writer->mutex);
+
+		int ret = raw_write(writer->fd, slot->buffer, slot->size, slot->offset);
+
+		if(ret == E_OK && !writer->direct)
+		{
+			sync_file_range(writer->fd, slot->offset, slot->size,
+				SYNC_FILE_RANGE_WRITE);
+			if(last_size > 0)
+			{
+				sync_file_range(writer->fd, last_offset, last_size,
+					SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+				posix_fadvise(writer->fd, last_offset, last_size, POSIX_FADV_DONTNEED);
+			}
+			last_offset = slot->offset;
+			last_size = slot->size;
+		}
+
+		__LOCK_MUTEX(&writer->mutex);
+		if(ret != E_OK)
+			writer->error = ret;
+		writer->head = (writer->head + 1) % RAW_DUMP_SLOTS;
+		writer->count--;
+		__COND_BCAST(&writer->cond);
+		__UNLOCK_MUTEX(&writer->mutex);
+	}
+
+	return NULL;
+}
+
+/*
+ * open a raw dump file for writing
+ * args:
+ *   filename - file name
+ *
+ * asserts:
+ *   filename is not null
+ *
+ * returns: pointer to writer or NULL on error
+ */
+v4l2_raw_writer_t *v4l2core_raw_writer_open(const char *filename)
+{
+	/*assertions*/
+	assert(filename != NULL);
+
+	int direct = 1;
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+	if(fd < 0 && errno == EINVAL)
+	{
+		/*file system doesn't support direct io*/
+		direct = 0;
+		fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	}
+
+	if(fd < 0)
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) couldn't open %s: %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	v4l2_raw_writer_t *writer = calloc(1, sizeof(v4l2_raw_writer_t));
+	if(writer == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_raw_writer_open): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	writer->fd = fd;
+	writer->direct = direct;
+
+	/*header block (updated on close)*/
+	uint8_t *block = raw_alloc(RAW_DUMP_ALIGN);
+	raw_dump_header_t *header = (raw_dump_header_t *) block;
+	memcpy(header->magic, RAW_DUMP_MAGIC, 8);
+	header->version = RAW_DUMP_VERSION;
+	header->endian = RAW_DUMP_ENDIAN;
+	header->align = RAW_DUMP_ALIGN;
+	header->entry_size = sizeof(v4l2_raw_index_t);
+
+	int ret = raw_write(fd, block, RAW_DUMP_ALIGN, 0);
+	free(block);
+
+	if(ret != E_OK)
+	{
+		close(fd);
+		free(writer);
+		return NULL;
+	}
+
+	writer->offset = RAW_DUMP_ALIGN;
+
+	__INIT_MUTEX(&writer->mutex);
+	__INIT_COND(&writer->cond);
+
+	if(__THREAD_CREATE(&writer->thread, raw_writer_thread, writer))
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) couldn't start the writer thread\n");
+		__CLOSE_COND(&writer->cond);
+		__CLOSE_MUTEX(&writer->mutex);
+		close(fd);
+		free(writer);
+		return NULL;
+	}
+
+	if(verbosity > 0)
+		printf("V4L2_CORE: (raw dump) writing frames to %s (direct io: %i)\n",
+			filename, direct);
+
+	return writer;
+}
+
+/*
+ * queue a frame (raw_frame data) for writing
+ *   blocks if all the write slots are busy
+ *   (must always be called from the same thread)
+ * args:
+ *   writer - pointer to writer
+ *   frame - pointer to frame buffer
+ *   pixelformat - frame pixel format (v4l2 fourcc)
+ *
+ * asserts:
+ *   writer is not null
+ *   frame is not null
+ *
+ * returns: error code
+ */
+int v4l2core_raw_writer_add_frame(v4l2_raw_writer_t *writer,
+	v4l2_frame_buff_t *frame, uint32_t pixelformat)
+{
+	/*assertions*/
+	assert(writer != NULL);
+	assert(frame != NULL);
+
+	if(frame->raw_frame == NULL || frame->raw_frame_size == 0)
+		return E_NO_DATA;
+
+	__LOCK_MUTEX(&writer->mutex);
+	if(writer->count == RAW_DUMP_SLOTS && !writer->error)
+	{
+		writer->blocked++;
+		while(writer->count == RAW_DUMP_SLOTS && !writer->error)
+			__COND_WAIT(&writer->cond, &writer->mutex);
+	}
+	int ret = writer->error;
+	int slot_index = (writer->head + writer->count) % RAW_DUMP_SLOTS;
+	__UNLOCK_MUTEX(&writer->mutex);
+
+	if(ret != E_OK)
+		return ret;
+
+	/*the slot is owned by the producer until it's queued*/
+	raw_slot_t *slot = &writer->slot[slot_index];
+
+	size_t payload_size = raw_align(frame->raw_frame_size);
+	slot->size = RAW_DUMP_ALIGN + payload_size;
+	slot->offset = writer->offset;
+
+	if(slot->buffer_size < slot->size)
+	{
+		free(slot->buffer);
+		slot->buffer = raw_alloc(slot->size);
+		slot->buffer_size = slot->size;
+	}
+
+	/*record block: index entry*/
+	v4l2_raw_index_t *entry = (v4l2_raw_index_t *) slot->buffer;
+	memset(slot->buffer, 0, RAW_DUMP_ALIGN);
+	entry->magic = RAW_RECORD_MAGIC;
+	entry->pixelformat = pixelformat;
+	entry->width = frame->width;
+	entry->height = frame->height;
+	entry->timestamp = frame->timestamp;
+	entry->offset = slot->offset + RAW_DUMP_ALIGN;
+	entry->size = frame->raw_frame_size;
+	entry->frame = writer->frames;
+	entry->flags = frame->isKeyframe ? RAW_FRAME_KEYFRAME : 0;
+
+	/*payload*/
+	uint8_t *payload = slot->buffer + RAW_DUMP_ALIGN;
+	memcpy(payload, frame->raw_frame, frame->raw_frame_size);
+	memset(payload + frame->raw_frame_size, 0, payload_size - frame->raw_frame_size);
+
+	/*index*/
+	if(writer->frames >= writer->index_size)
+	{
+		writer->index_size = (writer->index_size > 0) ? writer->index_size * 2 : 1024;
+		writer->index = realloc(writer->index, writer->index_size * sizeof(v4l2_raw_index_t));
+		if(writer->index == NULL)
+		{
+			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_raw_writer_add_frame): %s\n", strerror(errno));
+			exit(-1);
+		}
+	}
+	writer->index[writer->frames] = *entry;
+	writer->frames++;
+	writer->offset += slot->size;
+
+	__LOCK_MUTEX(&writer->mutex);
+	writer->count++;
+	__COND_BCAST(&writer->cond);
+	__UNLOCK_MUTEX(&writer->mutex);
+
+	return E_OK;
+}
+
+/*
+ * close a raw dump file
+ *   (writes the pending frames, the index and the final header)
+ * args:
+ *   writer - pointer to writer
+ *
+ * asserts:
+ *   writer is not null
+ *
+ * returns: error code
+ */
+int v4l2core_raw_writer_close(v4l2_raw_writer_t *writer)
+{
+	/*assertions*/
+	assert(writer != NULL);
+
+	int i = 0;
+
+	__LOCK_MUTEX(&writer->mutex);
+	writer->stop = 1;
+	__COND_BCAST(&writer->cond);
+	__UNLOCK_MUTEX(&writer->mutex);
+
+	__THREAD_JOIN(writer->thread);
+
+	int ret = writer->error;
+
+	if(ret == E_OK)
+	{
+		/*index*/
+		size_t index_size = raw_align(writer->frames * sizeof(v4l2_raw_index_t));
+		if(index_size > 0)
+		{
+			uint8_t *block = raw_alloc(index_size);
+			memcpy(block, writer->index, writer->frames * sizeof(v4l2_raw_index_t));
+			ret = raw_write(writer->fd, block, index_size, writer->offset);
+			free(block);
+		}
+	}
+
+	if(ret == E_OK)
+	{
+		/*final header*/
+		uint8_t *block = raw_alloc(RAW_DUMP_ALIGN);
+		raw_dump_header_t *header = (raw_dump_header_t *) block;
+		memcpy(header->magic, RAW_DUMP_MAGIC, 8);
+		header->version = RAW_DUMP_VERSION;
+		header->endian = RAW_DUMP_ENDIAN;
+		header->align = RAW_DUMP_ALIGN;
+		header->entry_size = sizeof(v4l2_raw_index_t);
+		header->frames = writer->frames;
+		header->index_offset = writer->offset;
+		header->data_end = writer->offset;
+
+		ret = raw_write(writer->fd, block, RAW_DUMP_ALIGN, 0);
+		free(block);
+	}
+
+	if(fsync(writer->fd) || close(writer->fd))
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) couldn't write to file: %s\n", strerror(errno));
+		ret = E_FILE_IO_ERR;
+	}
+
+	if(verbosity > 0)
+		printf("V4L2_CORE: (raw dump) %" PRIu64 " frames written (%" PRIu64 " blocked)\n",
+			writer->frames, writer->blocked);
+
+	for(i = 0; i < RAW_DUMP_SLOTS; i++)
+		free(writer->slot[i].buffer);
+
+	__CLOSE_COND(&writer->cond);
+	__CLOSE_MUTEX(&writer->mutex);
+
+	free(writer->index);
+	free(writer);
+
+	return ret;
+}
+
+/*
+ * rebuild the index from the record blocks
+ *   (file was not closed - the last incomplete frame is skipped)
+ * args:
+ *   reader - pointer to reader
+ *
+ * asserts:
+ *   reader is not null
+ *
+ * returns: none
+ */
+static void raw_reader_rebuild_index(v4l2_raw_reader_t *reader)
+{
+	/*assertions*/
+	assert(reader != NULL);
+
+	uint64_t offset = RAW_DUMP_ALIGN;
+	uint64_t index_size = 0;
+
+	reader->index = NULL;
+	reader->index_alloc = 1;
+	reader->frames = 0;
+
+	while(offset + RAW_DUMP_ALIGN <= reader->map_size)
+	{
+		v4l2_raw_index_t *entry = (v4l2_raw_index_t *) (reader->map + offset);
+
+		if(entry->magic != RAW_RECORD_MAGIC ||
+			entry->offset != offset + RAW_DUMP_ALIGN ||
+			entry->size > reader->map_size - entry->offset)
+			break;
+
+		if(reader->frames >= index_size)
+		{
+			index_size = (index_size > 0) ? index_size * 2 : 1024;
+			reader->index = realloc(reader->index, index_size * sizeof(v4l2_raw_index_t));
+			if(reader->index == NULL)
+			{
+				fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (raw_reader_rebuild_index): %s\n", strerror(errno));
+				exit(-1);
+			}
+		}
+
+		reader->index[reader->frames] = *entry;
+		reader->frames++;
+
+		offset = entry->offset + raw_align(entry->size);
+	}
+
+	if(verbosity > 0)
+		printf("V4L2_CORE: (raw dump) rebuilt index - %" PRIu64 " frames\n", reader->frames);
+}
+
+/*
+ * open a raw dump file for reading (memory mapped)
+ * args:
+ *   filename - file name
+ *
+ * asserts:
+ *   filename is not null
+ *
+ * returns: pointer to reader or NULL on error
+ */
+v4l2_raw_reader_t *v4l2core_raw_reader_open(const char *filename)
+{
+	/*assertions*/
+	assert(filename != NULL);
+
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) couldn't open %s: %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size < RAW_DUMP_ALIGN)
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) %s is not a raw dump file\n", filename);
+		close(fd);
+		return NULL;
+	}
+
+	uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd); /*the mapping keeps the file open*/
+
+	if(map == MAP_FAILED)
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) couldn't map %s: %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	raw_dump_header_t *header = (raw_dump_header_t *) map;
+	if(memcmp(header->magic, RAW_DUMP_MAGIC, 8) != 0 ||
+		header->version != RAW_DUMP_VERSION ||
+		header->endian != RAW_DUMP_ENDIAN ||
+		header->align != RAW_DUMP_ALIGN ||
+		header->entry_size != sizeof(v4l2_raw_index_t))
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) %s is not a compatible raw dump file\n", filename);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	v4l2_raw_reader_t *reader = calloc(1, sizeof(v4l2_raw_reader_t));
+	if(reader == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_raw_reader_open): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	reader->map = map;
+	reader->map_size = st.st_size;
+
+	/*check the index bounds without overflowing (offset and frames come from the file)*/
+	if(header->index_offset > 0 &&
+		header->index_offset <= reader->map_size &&
+		(header->index_offset % sizeof(uint64_t)) == 0 &&
+		header->frames <= (reader->map_size - header->index_offset) / sizeof(v4l2_raw_index_t))
+	{
+		reader->index = (v4l2_raw_index_t *) (map + header->index_offset);
+		reader->frames = header->frames;
+	}
+	else
+		raw_reader_rebuild_index(reader);
+
+	/*frames are read in any order*/
+	madvise(map, reader->map_size, MADV_RANDOM);
+
+	return reader;
+}
+
+/*
+ * get the number of frames in a raw dump file
+ * args:
+ *   reader - pointer to reader
+ *
+ * asserts:
+ *   reader is not null
+ *
+ * returns: number of frames
+ */
+uint64_t v4l2core_raw_reader_get_frames(v4l2_raw_reader_t *reader)
+{
+	/*assertions*/
+	assert(reader != NULL);
+
+	return reader->frames;
+}
+
+/*
+ * get a frame from a raw dump file
+ * args:
+ *   reader - pointer to reader
+ *   n - frame number (0 to frames - 1)
+ *   entry - pointer to index entry to fill (can be NULL)
+ *
+ * asserts:
+ *   reader is not null
+ *
+ * returns: pointer to frame data (in the file mapping) or NULL on error
+ */
+uint8_t *v4l2core_raw_reader_get_frame(v4l2_raw_reader_t *reader,
+	uint64_t n, v4l2_raw_index_t *entry)
+{
+	/*assertions*/
+	assert(reader != NULL);
+
+	if(n >= reader->frames)
+		return NULL;
+
+	v4l2_raw_index_t *index = &reader->index[n];
+
+	if(index->offset > reader->map_size ||
+		index->size > reader->map_size - index->offset)
+	{
+		fprintf(stderr, "V4L2_CORE: (raw dump) frame %" PRIu64 " is out of the file bounds\n", n);
+		return NULL;
+	}
+
+	if(entry != NULL)
+		*entry = *index;
+
+	return reader->map + index->offset;
+}
+
+/*
+ * close a raw dump file (unmaps the file)
+ * args:
+ *   reader - pointer to reader
+ *
+ * asserts:
+ *   reader is not null
+ *
+ * returns: none
+ */
+void v4l2core_raw_reader_close(v4l2_raw_reader_t *reader)
+{
+	/*assertions*/
+	assert(reader != NULL);
+
+	if(reader->index_alloc)
+		free(reader->index);
+
+	munmap(reader->map, reader->map_size);
+	free(reader);
+}
@@ -75,7 +75,7 @@ int v4l2core_save_data_to_file(const char *filename, uint8_t *data, int size)
  *    frame - pointer to frame buffer
  *    filename - output file name
  *    format - image type
- *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP)
+ *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP, IMG_FMT_JPG_RAW)
  *
  * asserts:
  *    none
@@ -100,6 +100,12 @@ int save_frame_image(v4l2_frame_buff_t *frame, const char *filename, int format)
 		    ret = save_image_jpeg(frame, filename);
 		    break;
 
+		case IMG_FMT_JPG_RAW:
+			if(verbosity > 0)
+				printf("V4L2_CORE: saving mjpeg frame (passthrough) to %s\n", filename);
+			ret = save_image_jpeg_passthrough(frame, filename);
+			break;
+
 		case IMG_FMT_BMP:
 			if(verbosity > 0)
 				printf("V4L2_CORE: saving bmp frame to %s\n", filename);
@@ -33,7 +33,7 @@
  *    frame - pointer to frame buffer
  *    filename - output file name
  *    format - image type
- *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP)
+ *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP, IMG_FMT_JPG_RAW)
  *
  * asserts:
  *    vd is not null
@@ -55,6 +55,21 @@ int save_frame_image(v4l2_frame_buff_t *frame, const char *filename, int format)
  */
 int save_image_jpeg(v4l2_frame_buff_t *frame, const char *filename);
 
+/*
+ * save a mjpeg frame bitstream to a jpeg file (no re-encoding)
+ *   mjpeg frames usually omit the huffman tables (fixed by the spec),
+ *   so the default DHT segment is spliced in before the scan
+ * args:
+ *    frame - pointer to frame buffer (raw_frame holds the mjpeg frame)
+ *    filename - filename string
+ *
+ * asserts:
+ *    frame is not null
+ *
+ * returns: error code (E_FORMAT_ERR if raw_frame is not a jpeg)
+ */
+int save_image_jpeg_passthrough(v4l2_frame_buff_t *frame, const char *filename);
+
 /*
  * save frame data to a bmp file
  * args:
@@ -29,16 +29,29 @@
 #include <errno.h>
 #include <assert.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "gviewv4l2core.h"
 #include "save_image.h"
-#include "colorspaces.h"
 #include "dct.h"
+#include "gview.h"
 #include "../config.h"
 
 /*huffman table from jpeg decoder*/
 #define JPG_HUFFMAN_TABLE_LENGTH 0x01A0
 extern const uint8_t jpeg_huffman_table[JPG_HUFFMAN_TABLE_LENGTH];
 
+/*header markers size (SOI, APP0, DQT, DHT, DRI, SOF and SOS)*/
+#define JPEG_HEADER_MAX_SIZE (1024)
+/*worst case size of an encoded 4:2:0 MCU (6 blocks with byte stuffing)*/
+#define JPEG_MCU_MAX_SIZE (2560)
+/*maximum number of encoder threads*/
+#define JPEG_MAX_THREADS (8)
+/*minimum number of MCU rows (restart intervals) per encoder thread*/
+#define JPEG_MIN_BAND_ROWS (4)
+
 typedef struct _jpeg_file_header_t
 {
 	uint8_t SOI[2];/*SOI Marker 0xFFD8*/
@@ -68,15 +81,6 @@ typedef struct _jpeg_encoder_ctx_t
 	uint16_t	horizontal_mcus;
 	uint16_t	vertical_mcus;
 
-	uint16_t	rows;
-	uint16_t	cols;
-
-	uint16_t	length_minus_mcu_width;
-	uint16_t	length_minus_width;
-	uint16_t	incr;
-	uint16_t	mcu_width_size;
-	uint16_t	offset;
-
 	int16_t		ldc1;
 	int16_t		ldc2;
 	int16_t		ldc3;
@@ -87,6 +91,8 @@ typedef struct _jpeg_encoder_ctx_t
 	/* MCUs */
 	int16_t		Y1 [64];
 	int16_t		Y2 [64];
+	int16_t		Y3 [64];
+	int16_t		Y4 [64];
 	int16_t		Temp [64];
 	int16_t		CB [64];
 	int16_t		CR [64];
@@ -99,6 +105,22 @@ typedef struct _jpeg_encoder_ctx_t
 
 } jpeg_encoder_ctx_t;
 
+/*
+ * a band of MCU rows encoded by a single thread
+ *  (each MCU row is a restart interval)
+ */
+typedef struct _jpeg_band_t
+{
+	jpeg_encoder_ctx_t jpeg_ctx; /*band encoder context (bit writer and dc predictors)*/
+	uint8_t *input;              /*yu12 frame*/
+	int first_row;               /*first MCU row*/
+	int last_row;                /*last MCU row (not included)*/
+
+	uint8_t *buffer;             /*band bitstream*/
+	size_t buffer_size;          /*band bitstream buffer size*/
+	size_t size;                 /*band bitstream size*/
+} jpeg_band_t;
+
 #define PUTBITS	\
 {	\
 	bits_in_next_word = (int16_t) (jpeg_ctx->bitindex + numbits - 32);	\
@@ -348,11 +370,14 @@ static uint16_t DSP_Division (uint32_t numer, uint32_t denom)
 }
 
 /*
- * split yuyv data into YCBr planes
+ * split yu12 data into the Y, Cb and Cr blocks of a 4:2:0 MCU (16x16)
  *   and fill matching encoder context fields
+ *   (edge MCUs replicate the last column and line of the frame)
  * args:
  *    jpeg_ctx - pointer to jpeg encoder context
- *    input - pointer to input data
+ *    input - pointer to input data (yu12)
+ *    mcu_x - MCU column
+ *    mcu_y - MCU row
  *
  * asserts:
  *    jpeg_ctx is not null
@@ -360,43 +385,84 @@ static uint16_t DSP_Division (uint32_t numer, uint32_t denom)
  *
  * returns: none
  */
-static void read_422_format (jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *input)
+static void read_420_format (jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *input, int mcu_x, int mcu_y)
 {
 	/*assertions*/
 	assert(jpeg_ctx != NULL);
 	assert(input != NULL);
 
-	int32_t i, j;
+	int i, j;
 
-	int16_t *Y1 = jpeg_ctx->Y1; /*64 int16 block*/
-	int16_t *Y2 = jpeg_ctx->Y2;
-	int16_t *CB = jpeg_ctx->CB;
-	int16_t *CR = jpeg_ctx->CR;
+	int width = jpeg_ctx->image_width;
+	int height = jpeg_ctx->image_height;
+	int c_width = width >> 1;
+	int c_height = height >> 1;
 
-	uint16_t incr = jpeg_ctx->incr;
+	uint8_t *py = input;
+	uint8_t *pu = py + (width * height);
+	uint8_t *pv = pu + (c_width * c_height);
 
-	uint8_t *tmp = NULL;
-	tmp = input;
+	int x0 = mcu_x << 4;
+	int y0 = mcu_y << 4;
 
-	for (i=8; i>0; i--) /*8 rows*/
+	if(x0 + 16 <= width && y0 + 16 <= height)
 	{
-		for (j=4; j>0; j--) /* 8 cols*/
+		uint8_t *y_line = py + (y0 * width) + x0;
+		uint8_t *u_line = pu + ((y0 >> 1) * c_width) + (x0 >> 1);
+		uint8_t *v_line = pv + ((y0 >> 1) * c_width) + (x0 >> 1);
+
+		for (i = 0; i < 64; i += 8) /*8 rows*/
 		{
-			*Y1++ = *tmp++;
-			*CB++ = *tmp++;
-			*Y1++ = *tmp++;
-			*CR++ = *tmp++;
+			uint8_t *y_line1 = y_line + (8 * width);
+
+			for (j = 0; j < 8; j++) /* 8 cols*/
+			{
+				jpeg_ctx->Y1[i + j] = y_line[j];
+				jpeg_ctx->Y2[i + j] = y_line[j + 8];
+				jpeg_ctx->Y3[i + j] = y_line1[j];
+				jpeg_ctx->Y4[i + j] = y_line1[j + 8];
+				jpeg_ctx->CB[i + j] = u_line[j];
+				jpeg_ctx->CR[i + j] = v_line[j];
+			}
+
+			y_line += width;
+			u_line += c_width;
+			v_line += c_width;
 		}
+		return;
+	}
 
-		for (j=4; j>0; j--) /* 8 cols*/
+	/*edge MCU*/
+	for (i = 0; i < 16; i++)
+	{
+		int y = (y0 + i < height) ? y0 + i : height - 1;
+		int16_t *top = (i < 8) ? jpeg_ctx->Y1 : jpeg_ctx->Y3;
+		int16_t *bottom = (i < 8) ? jpeg_ctx->Y2 : jpeg_ctx->Y4;
+
+		for (j = 0; j < 16; j++)
 		{
-			*Y2++ = *tmp++;
-			*CB++ = *tmp++;
-			*Y2++ = *tmp++;
-			*CR++ = *tmp++;
+			int x = (x0 + j < width) ? x0 + j : width - 1;
+			int16_t *block = (j < 8) ? top : bottom;
+
+			block[((i & 7) << 3) + (j & 7)] = py[(y * width) + x];
 		}
+	}
+
+	for (i = 0; i < 8; i++)
+	{
+		int y = (y0 >> 1) + i;
+		if(y >= c_height)
+			y = c_height - 1;
+
+		for (j = 0; j < 8; j++)
+		{
+			int x = (x0 >> 1) + j;
+			if(x >= c_width)
+				x = c_width - 1;
 
-		tmp += incr; /* next row (width - mcu_width)*/
+			jpeg_ctx->CB[(i << 3) + j] = pu[(y * c_width) + x];
+			jpeg_ctx->CR[(i << 3) + j] = pv[(y * c_width) + x];
+		}
 	}
 }
 
@@ -458,6 +524,31 @@ static void quantization (jpeg_encoder_ctx_t *jpeg_ctx, int16_t * const data, ui
 	assert(quant_table_ptr != NULL);
 
 	int16_t i;
+
+#if defined(__SSE2__)
+	/*
+	 * quantization table entries are >= 2 so the Q.15 reciprocals
+	 * are below 0x8000 and fit signed 16 bit multiplies
+	 */
+	int16_t value[64] __attribute__((aligned(16)));
+	const __m128i round = _mm_set1_epi32(0x4000);
+
+	for (i = 0; i < 64; i += 8)
+	{
+		__m128i d = _mm_loadu_si128((__m128i *) (data + i));
+		__m128i q = _mm_loadu_si128((__m128i *) (quant_table_ptr + i));
+		__m128i lo = _mm_mullo_epi16(d, q);
+		__m128i hi = _mm_mulhi_epi16(d, q);
+
+		__m128i v0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 15);
+		__m128i v1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 15);
+
+		_mm_store_si128((__m128i *) (value + i), _mm_packs_epi32(v0, v1));
+	}
+
+	for (i = 0; i < 64; i++)
+		jpeg_ctx->Temp [zigzag_table [i]] = value [i];
+#else
 	int32_t value;
 
 	for (i=63; i>=0; i--)
@@ -467,6 +558,7 @@ static void quantization (jpeg_encoder_ctx_t *jpeg_ctx, int16_t * const data, ui
 
 		jpeg_ctx->Temp [zigzag_table [i]] = (int16_t) value;
 	}
+#endif
 }
 
 /*
@@ -599,7 +691,8 @@ static uint8_t *huffman (jpeg_encoder_ctx_t *jpeg_ctx, uint16_t component, uint8
 }
 
 /*
- * For bit Stuffing and EOI marker
+ * flush the bit writer at the end of a restart interval
+ *   (pads the last byte with 1 bits and does byte stuffing)
  * args:
  *     jpeg_ctx - pointer to jpeg encoder context
  *     output - pointer to output buffer
@@ -610,7 +703,7 @@ static uint8_t *huffman (jpeg_encoder_ctx_t *jpeg_ctx, uint16_t component, uint8
  *
  * returns: pointer to output buffer
  */
-static uint8_t *close_bitstream (jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output)
+static uint8_t *flush_bitstream (jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output)
 {
 	/*assertions*/
 	assert(jpeg_ctx != NULL);
@@ -618,22 +711,21 @@ static uint8_t *close_bitstream (jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output)
 
 	if (jpeg_ctx->bitindex > 0)
 	{
-		jpeg_ctx->lcode <<= (32 - jpeg_ctx->bitindex);
+		uint16_t pad = 32 - jpeg_ctx->bitindex;
+		uint32_t lcode = (jpeg_ctx->lcode << pad) | ((1U << pad) - 1);
 		uint16_t count = (jpeg_ctx->bitindex + 7) >> 3;
 		uint16_t i = 0;
 
-		uint8_t *ptr = (uint8_t *) &jpeg_ctx->lcode + 3;
-
-		for (i=count; i>0; i--)
+		for (i=0; i<count; i++)
 		{
-			if ((*output++ = *ptr--) == 0xff)
+			if ((*output++ = (uint8_t) (lcode >> (24 - (i << 3)))) == 0xff)
 				*output++ = 0;
 		}
 	}
 
-	/* End of image marker (EOI) */
-	*output++ = 0xFF;
-	*output++ = 0xD9;
+	jpeg_ctx->lcode = 0;
+	jpeg_ctx->bitindex = 0;
+
 	return output;
 }
 
@@ -654,28 +746,15 @@ static void initialization (jpeg_encoder_ctx_t *jpeg_ctx, int image_width, int i
 	/*assertions*/
 	assert(jpeg_ctx != NULL);
 
-	uint16_t mcu_width, mcu_height, bytes_per_pixel;
-
 	jpeg_ctx->image_width = image_width;
 	jpeg_ctx->image_height = image_height;
 
-	jpeg_ctx->mcu_width = mcu_width = 16;
-	jpeg_ctx->horizontal_mcus = (uint16_t) (image_width >> 4);/* width/16 */
-
-	jpeg_ctx->mcu_height = mcu_height = 8;
-	jpeg_ctx->vertical_mcus = (uint16_t) (image_height >> 3); /* height/8 */
-
-	bytes_per_pixel = 2;
-
-	jpeg_ctx->length_minus_mcu_width = (uint16_t) ((image_width - mcu_width) * bytes_per_pixel);
-	jpeg_ctx->length_minus_width = (uint16_t) (image_width * bytes_per_pixel);
+	/* 4:2:0 - partial MCUs at the right and bottom edges are padded */
+	jpeg_ctx->mcu_width = 16;
+	jpeg_ctx->horizontal_mcus = (uint16_t) ((image_width + 15) >> 4);/* width/16 */
 
-	jpeg_ctx->mcu_width_size = (uint16_t) (mcu_width * bytes_per_pixel);
-
-	jpeg_ctx->rows = jpeg_ctx->mcu_height;
-	jpeg_ctx->cols = jpeg_ctx->mcu_width;
-	jpeg_ctx->incr = jpeg_ctx->length_minus_mcu_width;
-	jpeg_ctx->offset = (uint16_t) ((image_width * mcu_height) * bytes_per_pixel);
+	jpeg_ctx->mcu_height = 16;
+	jpeg_ctx->vertical_mcus = (uint16_t) ((image_height + 15) >> 4); /* height/16 */
 
 	jpeg_ctx->ldc1 = 0;
 	jpeg_ctx->ldc2 = 0;
@@ -726,20 +805,18 @@ static uint8_t* encode_MCU (jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output)
 	assert(jpeg_ctx != NULL);
 	assert(output != NULL);
 
-	levelshift (jpeg_ctx->Y1);
-	DCT (jpeg_ctx->Y1);
-
-	quantization (jpeg_ctx, jpeg_ctx->Y1, jpeg_ctx->ILqt);
-
-	output = huffman (jpeg_ctx, 1, output);
+	int16_t *luma[4] = {jpeg_ctx->Y1, jpeg_ctx->Y2, jpeg_ctx->Y3, jpeg_ctx->Y4};
+	int i = 0;
 
-	levelshift (jpeg_ctx->Y2);
-	DCT (jpeg_ctx->Y2);
+	for (i = 0; i < 4; i++)
+	{
+		levelshift (luma[i]);
+		DCT (luma[i]);
 
-	quantization (jpeg_ctx, jpeg_ctx->Y2,
-		jpeg_ctx->ILqt);
+		quantization (jpeg_ctx, luma[i], jpeg_ctx->ILqt);
 
-	output = huffman (jpeg_ctx, 1, output);
+		output = huffman (jpeg_ctx, 1, output);
+	}
 
 	levelshift (jpeg_ctx->CB);
 	DCT (jpeg_ctx->CB);
@@ -869,6 +946,14 @@ static uint8_t *write_markers(jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output, int
 
 	}
 
+	// Restart interval (DRI) - one MCU row per interval
+	*output++ = 0xFF;
+	*output++ = 0xDD;
+	*output++ = 0x00;
+	*output++ = 0x04;
+	*output++ = (uint8_t) (jpeg_ctx->horizontal_mcus >> 8);
+	*output++ = (uint8_t) jpeg_ctx->horizontal_mcus;
+
 	number_of_components = 3;
 
 	// Frame header(SOF)
@@ -897,9 +982,9 @@ static uint8_t *write_markers(jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output, int
 	// Nf
 	*output++ = number_of_components;
 
-	/* type 422 */
+	/* type 420 */
 	*output++ = 0x01; /*id (y)*/
-	*output++ = 0x21; /*horiz|vertical */
+	*output++ = 0x22; /*horiz|vertical */
 	*output++ = 0x00; /*quantization table used*/
 
 	*output++ = 0x02; /*id (u)*/
@@ -926,7 +1011,7 @@ static uint8_t *write_markers(jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output, int
 	// Ns = number of scans
 	*output++ = number_of_components;
 
-	/* type 422*/
+	/* type 420*/
 	*output++ = 0x01; /*component id (y)*/
 	*output++ = 0x00; /*dc|ac tables*/
 
@@ -943,11 +1028,123 @@ static uint8_t *write_markers(jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output, int
 	return output;
 }
 
+/*
+ * get the number of jpeg encoder threads
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: number of threads (1 to JPEG_MAX_THREADS)
+ */
+static int jpeg_get_threads()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(n < 1)
+		n = 1;
+	if(n > JPEG_MAX_THREADS)
+		n = JPEG_MAX_THREADS;
+
+	return (int) n;
+}
+
+/*
+ * make sure the band bitstream buffer has room for size more bytes
+ * args:
+ *    band - pointer to band
+ *    size - needed size in bytes
+ *
+ * asserts:
+ *    band is not null
+ *
+ * returns: none
+ */
+static void jpeg_band_reserve(jpeg_band_t *band, size_t size)
+{
+	/*assertions*/
+	assert(band != NULL);
+
+	if(band->size + size <= band->buffer_size)
+		return;
+
+	size_t buffer_size = band->buffer_size * 2;
+	while(buffer_size < band->size + size)
+		buffer_size *= 2;
+
+	band->buffer = realloc(band->buffer, buffer_size);
+	if(band->buffer == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (jpeg_band_reserve): %s\n", strerror(errno));
+		exit(-1);
+	}
+	band->buffer_size = buffer_size;
+}
+
+/*
+ * encode a band of MCU rows (thread function)
+ *   each row is a restart interval: the dc predictors are reset
+ *   at the start of the row and the bitstream is flushed and
+ *   terminated with a RSTn marker at the end (except for the last row)
+ * args:
+ *    data - pointer to band (jpeg_band_t)
+ *
+ * asserts:
+ *    data is not null
+ *
+ * returns: NULL
+ */
+static void *jpeg_encode_band(void *data)
+{
+	/*assertions*/
+	assert(data != NULL);
+
+	jpeg_band_t *band = (jpeg_band_t *) data;
+	jpeg_encoder_ctx_t *jpeg_ctx = &band->jpeg_ctx;
+
+	int row = 0;
+	int col = 0;
+
+	for (row = band->first_row; row < band->last_row; row++)
+	{
+		jpeg_restart(jpeg_ctx);
+
+		for (col = 0; col < jpeg_ctx->horizontal_mcus; col++)
+		{
+			jpeg_band_reserve(band, JPEG_MCU_MAX_SIZE);
+
+			/*reads a MCU*/
+			read_420_format (jpeg_ctx, band->input, col, row);
+
+			/* Encode the data in MCU */
+			band->size = encode_MCU (jpeg_ctx, band->buffer + band->size) - band->buffer;
+		}
+
+		/*flush bits (8 bytes max with stuffing) and RSTn marker*/
+		jpeg_band_reserve(band, 10);
+
+		uint8_t *output = flush_bitstream (jpeg_ctx, band->buffer + band->size);
+
+		if(row < jpeg_ctx->vertical_mcus - 1)
+		{
+			*output++ = 0xFF;
+			*output++ = (uint8_t) (0xD0 + (row & 0x07));
+		}
+
+		band->size = output - band->buffer;
+	}
+
+	return NULL;
+}
+
 /*
  * encode jpeg
+ *   MCU rows are split in bands that are encoded in parallel
  * args:
- *    input - pointer to input buffer (yuyv format)
+ *    input - pointer to input buffer (yu12 format)
  *    output - pointer to output buffer (jpeg format)
+ *    output_size - output buffer size in bytes
  *    jpeg_ctx - pointer to jpeg encoder context
  *    huff - huffman flag
  *
@@ -957,9 +1154,9 @@ static uint8_t *write_markers(jpeg_encoder_ctx_t *jpeg_ctx, uint8_t *output, int
  *    ouput is not null
  *    jpeg_ctx is not null
  *
- * returns: ouput size
+ * returns: ouput size or error code (< 0)
  */
-static int encode_jpeg (uint8_t *input, uint8_t *output,
+static int encode_jpeg (uint8_t *input, uint8_t *output, int output_size,
 	jpeg_encoder_ctx_t *jpeg_ctx, int huff)
 {
 	/*assertions*/
@@ -967,62 +1164,150 @@ static int encode_jpeg (uint8_t *input, uint8_t *output,
 	assert(output != NULL);
 	assert(jpeg_ctx != NULL);
 
-	int size;
-	uint16_t i, j;
-	uint8_t *tmp_ptr=NULL;
-	uint8_t *tmp_iptr = input;
+	int size = 0;
+	int i = 0;
 	uint8_t *tmp_optr = output;
 
+	if(output_size < JPEG_HEADER_MAX_SIZE)
+	{
+		fprintf(stderr, "V4L2_CORE: (jpeg encoder) output buffer too small (%i bytes)\n", output_size);
+		return E_BUFFER_SIZE_ERR;
+	}
+
 	/* clean jpeg parameters*/
 	jpeg_restart(jpeg_ctx);
 
 	/* Writing Marker Data */
 	tmp_optr = write_markers (jpeg_ctx, tmp_optr, huff);
+	size = tmp_optr - output;
+
+	/* split the MCU rows between the encoder threads */
+	int n_bands = jpeg_ctx->vertical_mcus / JPEG_MIN_BAND_ROWS;
+	if(n_bands > jpeg_get_threads())
+		n_bands = jpeg_get_threads();
+	if(n_bands < 1)
+		n_bands = 1;
 
-	uint8_t *yuv422 = calloc(jpeg_ctx->image_width * jpeg_ctx->image_height * 2, sizeof(uint8_t));
-	if(yuv422 == NULL)
+	jpeg_band_t *band = calloc(n_bands, sizeof(jpeg_band_t));
+	if(band == NULL)
 	{
-		fprintf(stderr, "V4L2_CORE: couldn't allocate memory for jpeg encoder (fatal)\n");
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (encode_jpeg): %s\n", strerror(errno));
 		exit(-1);
 	}
-	yu12_to_yuyv(yuv422, input, jpeg_ctx->image_width, jpeg_ctx->image_height);
-	tmp_iptr = yuv422;
 
-	for (i=0; i < jpeg_ctx->vertical_mcus; i++) /* height /8 */
+	for (i = 0; i < n_bands; i++)
 	{
-		tmp_ptr = tmp_iptr;
-		for (j=0; j< jpeg_ctx->horizontal_mcus; j++) /* width /16 */
+		band[i].jpeg_ctx = *jpeg_ctx;
+		band[i].input = input;
+		band[i].first_row = (jpeg_ctx->vertical_mcus * i) / n_bands;
+		band[i].last_row = (jpeg_ctx->vertical_mcus * (i + 1)) / n_bands;
+
+		/*start with 1.5 bytes per pixel - grows if needed*/
+		band[i].buffer_size = ((band[i].last_row - band[i].first_row) *
+			jpeg_ctx->horizontal_mcus * 384) + JPEG_MCU_MAX_SIZE;
+		band[i].buffer = malloc(band[i].buffer_size);
+		if(band[i].buffer == NULL)
 		{
-			/*reads a block*/
-			read_422_format (jpeg_ctx, tmp_iptr); /*YUYV*/
+			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (encode_jpeg): %s\n", strerror(errno));
+			exit(-1);
+		}
+	}
 
-			/* Encode the data in MCU */
-			tmp_optr = encode_MCU (jpeg_ctx, tmp_optr);
+	/* band 0 is encoded in the calling thread */
+	__THREAD_TYPE band_thread[JPEG_MAX_THREADS];
+	int band_thread_ok[JPEG_MAX_THREADS];
 
-			if(j < (jpeg_ctx->horizontal_mcus -1))
-			{
-				tmp_iptr += jpeg_ctx->mcu_width_size;
-			}
-			else
-			{
-				tmp_iptr=tmp_ptr;
-			}
+	for (i = 1; i < n_bands; i++)
+		band_thread_ok[i] = (__THREAD_CREATE(&band_thread[i], jpeg_encode_band, &band[i]) == 0);
+
+	jpeg_encode_band(&band[0]);
+
+	for (i = 1; i < n_bands; i++)
+	{
+		if(band_thread_ok[i])
+			__THREAD_JOIN(band_thread[i]);
+		else
+			jpeg_encode_band(&band[i]); /*couldn't create the thread*/
+	}
+
+	/* concatenate the band bitstreams */
+	for (i = 0; i < n_bands; i++)
+	{
+		if(size >= 0 && size + band[i].size + 2 <= (size_t) output_size)
+		{
+			memcpy(output + size, band[i].buffer, band[i].size);
+			size += band[i].size;
 		}
-		tmp_iptr += jpeg_ctx->offset;
+		else
+			size = E_BUFFER_SIZE_ERR;
 
+		free(band[i].buffer);
 	}
 
-	/* Close Routine */
-	free(yuv422);
+	free(band);
 
-	tmp_optr = close_bitstream (jpeg_ctx, tmp_optr);
-	size = tmp_optr - output;
-	tmp_iptr = NULL;
-	tmp_optr = NULL;
+	if(size < 0)
+	{
+		fprintf(stderr, "V4L2_CORE: (jpeg encoder) output buffer too small (%i bytes)\n", output_size);
+		return size;
+	}
+
+	/* End of image marker (EOI) */
+	output[size++] = 0xFF;
+	output[size++] = 0xD9;
 
 	return (size);
 }
 
+/*
+ * encode a yu12 frame to jpeg
+ * args:
+ *    in - pointer to yu12 frame data
+ *    width - frame width
+ *    height - frame height
+ *    out - pointer to output buffer
+ *    out_size - output buffer size in bytes
+ *    huff - huffman tables flag (1 - JFIF with DHT; 0 - AVI1 without DHT)
+ *
+ * asserts:
+ *    in is not null
+ *    out is not null
+ *
+ * returns: jpeg size in bytes or error code (< 0)
+ */
+int v4l2core_encode_jpeg(uint8_t *in, int width, int height,
+	uint8_t *out, int out_size, int huff)
+{
+	/*assertions*/
+	assert(in != NULL);
+	assert(out != NULL);
+
+	if(width < 2 || height < 2 || width > 0xFFFF || height > 0xFFFF)
+	{
+		fprintf(stderr, "V4L2_CORE: (jpeg encoder) bad frame size %ix%i\n", width, height);
+		return E_BAD_WIDTH_OR_HEIGHT_ERR;
+	}
+
+	jpeg_encoder_ctx_t *jpeg_ctx = calloc(1, sizeof(jpeg_encoder_ctx_t));
+	if(jpeg_ctx == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_encode_jpeg): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	/* Initialization of JPEG control structure */
+	initialization (jpeg_ctx, width, height);
+
+	/* Initialization of Quantization Tables  */
+	initialize_quantization_tables (jpeg_ctx);
+
+	int size = encode_jpeg(in, out, out_size, jpeg_ctx, huff);
+
+	free(jpeg_ctx);
+
+	return size;
+}
+
 /*
  * save frame data to a jpeg file
  * args:
@@ -1038,38 +1323,161 @@ int save_image_jpeg(v4l2_frame_buff_t *frame, const char *filename)
 {
 	int ret = E_OK;
 
-	jpeg_encoder_ctx_t *jpeg_ctx = calloc(1, sizeof(jpeg_encoder_ctx_t));
-	if(jpeg_ctx == NULL)
+	/*same size as the yu12 frame*/
+	int jpeg_size = ((frame->width * frame->height * 3) >> 1) + JPEG_HEADER_MAX_SIZE;
+
+	uint8_t *jpeg = malloc(jpeg_size);
+	if(jpeg == NULL)
 	{
 		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (save_image_jpeg): %s\n", strerror(errno));
 		exit(-1);
 	}
 
-	uint8_t *jpeg = calloc((frame->width * frame->height) >> 1, sizeof(uint8_t));
-	if(jpeg == NULL)
+	jpeg_size = v4l2core_encode_jpeg(frame->yuv_frame, frame->width, frame->height,
+		jpeg, jpeg_size, 1);
+
+	if(jpeg_size < 0)
+		ret = jpeg_size;
+	else if(v4l2core_save_data_to_file(filename, jpeg, jpeg_size))
 	{
-		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (save_image_jpeg): %s\n", strerror(errno));
-		exit(-1);
+		fprintf (stderr, "V4L2_CORE: (save_image_jpeg) couldn't capture Image to %s \n",
+					filename);
+		ret = E_FILE_IO_ERR;
 	}
 
-	/* Initialization of JPEG control structure */
-	initialization (jpeg_ctx, frame->width, frame->height);
+	/*clean up*/
+	free(jpeg);
 
-	/* Initialization of Quantization Tables  */
-	initialize_quantization_tables (jpeg_ctx);
+	return ret;
+}
 
-	int jpeg_size = encode_jpeg(frame->yuv_frame, jpeg, jpeg_ctx, 1);
+/*
+ * find the jpeg scan start and check for huffman tables
+ * args:
+ *    data - pointer to jpeg bitstream
+ *    size - bitstream size in bytes
+ *    has_dht - pointer to flag set if a DHT segment is present
+ *
+ * asserts:
+ *    data is not null
+ *    has_dht is not null
+ *
+ * returns: offset of the SOS marker (or -1 if not a valid jpeg)
+ */
+static int jpeg_find_scan(const uint8_t *data, size_t size, int *has_dht)
+{
+	assert(data != NULL);
+	assert(has_dht != NULL);
+
+	*has_dht = 0;
 
-	if(v4l2core_save_data_to_file(filename, jpeg, jpeg_size))
+	if(size < 4 || data[0] != 0xFF || data[1] != 0xD8) /*SOI*/
+		return -1;
+
+	size_t pos = 2;
+
+	while(pos + 4 <= size)
+	{
+		if(data[pos] != 0xFF)
+			return -1;
+
+		uint8_t marker = data[pos + 1];
+
+		if(marker == 0xFF) /*fill byte*/
+		{
+			pos++;
+			continue;
+		}
+
+		if(marker == 0xDA) /*SOS*/
+			return (int) pos;
+
+		/*standalone markers (TEM, RSTn, SOI)*/
+		if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+		{
+			pos += 2;
+			continue;
+		}
+
+		if(marker == 0xD9) /*EOI before any scan*/
+			return -1;
+
+		if(marker == 0xC4) /*DHT*/
+			*has_dht = 1;
+
+		size_t length = (data[pos + 2] << 8) | data[pos + 3];
+		if(length < 2)
+			return -1;
+
+		pos += 2 + length;
+	}
+
+	return -1;
+}
+
+/*
+ * save a mjpeg frame bitstream to a jpeg file (no re-encoding)
+ *   mjpeg frames usually omit the huffman tables (fixed by the spec),
+ *   so the default DHT segment is spliced in before the scan
+ * args:
+ *    frame - pointer to frame buffer (raw_frame holds the mjpeg frame)
+ *    filename - filename string
+ *
+ * asserts:
+ *    frame is not null
+ *
+ * returns: error code (E_FORMAT_ERR if raw_frame is not a jpeg)
+ */
+int save_image_jpeg_passthrough(v4l2_frame_buff_t *frame, const char *filename)
+{
+	assert(frame != NULL);
+
+	if(frame->raw_frame == NULL)
+		return E_NO_DATA;
+
+	int has_dht = 0;
+	int sos = jpeg_find_scan(frame->raw_frame, frame->raw_frame_size, &has_dht);
+
+	if(sos < 0)
+	{
+		fprintf(stderr, "V4L2_CORE: (save_image_jpeg) raw frame is not a valid jpeg bitstream\n");
+		return E_FORMAT_ERR;
+	}
+
+	FILE *fp = fopen(filename, "wb");
+	if(fp == NULL)
 	{
 		fprintf (stderr, "V4L2_CORE: (save_image_jpeg) couldn't capture Image to %s \n",
 					filename);
+		return E_FILE_IO_ERR;
+	}
+
+	int ret = E_OK;
+
+	/*headers up to the scan*/
+	if(fwrite(frame->raw_frame, sos, 1, fp) < 1)
 		ret = E_FILE_IO_ERR;
+
+	if(ret == E_OK && !has_dht)
+	{
+		/*DHT marker and length (0x01A2 = table + 2)*/
+		uint8_t dht[4] = {0xFF, 0xC4, 0x01, 0xA2};
+
+		if(fwrite(dht, 4, 1, fp) < 1 ||
+			fwrite(jpeg_huffman_table, JPG_HUFFMAN_TABLE_LENGTH, 1, fp) < 1)
+			ret = E_FILE_IO_ERR;
 	}
 
-	/*clean up*/
-	free(jpeg);
-	free(jpeg_ctx);
+	/*scan data (byte exact)*/
+	if(ret == E_OK && fwrite(frame->raw_frame + sos, frame->raw_frame_size - sos, 1, fp) < 1)
+		ret = E_FILE_IO_ERR;
+
+	fflush(fp); /*flush data stream to file system*/
+	if(fsync(fileno(fp)) || fclose(fp))
+		ret = E_FILE_IO_ERR;
+
+	if(ret != E_OK)
+		fprintf(stderr, "V4L2_CORE: (save_image_jpeg) error - couldn't write buffer to file: %s\n", strerror(errno));
 
 	return ret;
 }
@@ -29,10 +29,429 @@
 #include <errno.h>
 #include <assert.h>
 #include <png.h>
+#include <zlib.h>
 
 #include "gviewv4l2core.h"
 #include "save_image.h"
 #include "colorspaces.h"
+#include "gview.h"
+
+/*maximum number of deflate threads*/
+#define PNG_MAX_THREADS (8)
+/*minimum number of rows per deflate thread*/
+#define PNG_MIN_BAND_ROWS (16)
+/*deflate window size (dictionary for the next band)*/
+#define PNG_WINDOW_SIZE (32768)
+/*maximum IDAT chunk size*/
+#define PNG_IDAT_SIZE (1 << 20)
+
+typedef struct _png_preset_t
+{
+	int level;    /*zlib compression level*/
+	int strategy; /*zlib compression strategy*/
+	int filters;  /*png row filters (PNG_FILTER_XXX mask)*/
+} png_preset_t;
+
+static const png_preset_t png_presets[] =
+{
+	/*PNG_PRESET_FAST*/
+	{ .level = 1, .strategy = Z_DEFAULT_STRATEGY, .filters = PNG_FILTER_UP },
+	/*PNG_PRESET_DEFAULT (libpng defaults)*/
+	{ .level = 6, .strategy = Z_FILTERED, .filters = PNG_ALL_FILTERS },
+	/*PNG_PRESET_SMALL*/
+	{ .level = 9, .strategy = Z_FILTERED, .filters = PNG_ALL_FILTERS }
+};
+
+static int png_preset = PNG_PRESET_DEFAULT;
+static int png_threads = 1;
+
+/*
+ * a band of rows filtered and deflated by a single thread
+ */
+typedef struct _png_band_t
+{
+	uint8_t *data;      /*rgb image*/
+	int width;          /*image width*/
+	int first_row;      /*first row*/
+	int last_row;       /*last row (not included)*/
+	int dict_rows;      /*rows before first_row used as deflate dictionary*/
+	int last;           /*last band flag (ends the deflate stream)*/
+
+	uint8_t *out;       /*raw deflate data*/
+	size_t out_size;    /*raw deflate data size*/
+	size_t in_size;     /*filtered data size*/
+	uLong adler;        /*adler32 of the filtered data*/
+	int ret;            /*error code*/
+} png_band_t;
+
+/*
+ * set the png compression preset and number of deflate threads
+ * args:
+ *    preset - compression preset (PNG_PRESET_[FAST|DEFAULT|SMALL])
+ *    threads - number of deflate threads (1 to 8)
+ *      (1 - single threaded libpng writer; > 1 - parallel deflate)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_set_png_compression(int preset, int threads)
+{
+	if(preset < PNG_PRESET_FAST || preset > PNG_PRESET_SMALL)
+	{
+		fprintf(stderr, "V4L2_CORE: (save png) invalid compression preset %i - using default\n", preset);
+		preset = PNG_PRESET_DEFAULT;
+	}
+
+	if(threads < 1)
+		threads = 1;
+	if(threads > PNG_MAX_THREADS)
+		threads = PNG_MAX_THREADS;
+
+	png_preset = preset;
+	png_threads = threads;
+}
+
+/*
+ * paeth predictor
+ * args:
+ *    a - left byte
+ *    b - up byte
+ *    c - up left byte
+ *
+ * asserts:
+ *    none
+ *
+ * returns: predicted byte
+ */
+static inline int png_paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if(pa <= pb && pa <= pc)
+		return a;
+	if(pb <= pc)
+		return b;
+	return c;
+}
+
+/*
+ * filter a byte of a rgb row
+ * args:
+ *    type - filter type (PNG_FILTER_VALUE_XXX)
+ *    row - pointer to row
+ *    prev - pointer to previous row
+ *    i - byte index
+ *
+ * asserts:
+ *    none
+ *
+ * returns: filtered byte
+ */
+static inline uint8_t png_filter_byte(int type, uint8_t *row, uint8_t *prev, int i)
+{
+	int a = (i >= 3) ? row[i - 3] : 0;
+	int b = prev[i];
+	int c = (i >= 3) ? prev[i - 3] : 0;
+
+	switch(type)
+	{
+		case PNG_FILTER_VALUE_SUB:
+			return (uint8_t) (row[i] - a);
+		case PNG_FILTER_VALUE_UP:
+			return (uint8_t) (row[i] - b);
+		case PNG_FILTER_VALUE_AVG:
+			return (uint8_t) (row[i] - ((a + b) >> 1));
+		case PNG_FILTER_VALUE_PAETH:
+			return (uint8_t) (row[i] - png_paeth(a, b, c));
+		default:
+			return row[i];
+	}
+}
+
+/*
+ * filter a rgb row
+ *   with more than one filter in the mask, the one with the lowest
+ *   sum of absolute (signed) differences is used (same as libpng)
+ * args:
+ *    out - pointer to output (filter type byte + filtered row)
+ *    row - pointer to row
+ *    prev - pointer to previous row (zeros for the first row)
+ *    row_size - row size in bytes
+ *    filters - png row filters mask (PNG_FILTER_XXX)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void png_filter_row(uint8_t *out, uint8_t *row, uint8_t *prev,
+	int row_size, int filters)
+{
+	int type = PNG_FILTER_VALUE_NONE;
+	int i = 0;
+
+	if(filters & (filters - 1))
+	{
+		unsigned long best = ~0UL;
+		int t = 0;
+
+		for(t = PNG_FILTER_VALUE_NONE; t < PNG_FILTER_VALUE_LAST; t++)
+		{
+			if(!(filters & (PNG_FILTER_NONE << t)))
+				continue;
+
+			unsigned long sum = 0;
+			for(i = 0; i < row_size && sum < best; i++)
+				sum += abs((int8_t) png_filter_byte(t, row, prev, i));
+
+			if(sum < best)
+			{
+				best = sum;
+				type = t;
+			}
+		}
+	}
+	else
+	{
+		for(type = PNG_FILTER_VALUE_NONE; type < PNG_FILTER_VALUE_LAST; type++)
+			if(filters & (PNG_FILTER_NONE << type))
+				break;
+	}
+
+	*out++ = (uint8_t) type;
+
+	if(type == PNG_FILTER_VALUE_UP)
+	{
+		for(i = 0; i < row_size; i++)
+			out[i] = row[i] - prev[i];
+	}
+	else
+	{
+		for(i = 0; i < row_size; i++)
+			out[i] = png_filter_byte(type, row, prev, i);
+	}
+}
+
+/*
+ * filter and deflate a band of rows (thread function)
+ *   the stream is left open (sync flush) for all but the last band,
+ *   so the bands can be concatenated in a single deflate stream
+ * args:
+ *    data - pointer to band (png_band_t)
+ *
+ * asserts:
+ *    data is not null
+ *
+ * returns: NULL
+ */
+static void *png_deflate_band(void *data)
+{
+	/*assertions*/
+	assert(data != NULL);
+
+	png_band_t *band = (png_band_t *) data;
+	const png_preset_t *preset = &png_presets[png_preset];
+
+	int row_size = band->width * 3;
+	size_t filtered_row_size = row_size + 1;
+	int first = band->first_row - band->dict_rows;
+	int row = 0;
+
+	uint8_t *zeros = calloc(row_size, sizeof(uint8_t));
+	uint8_t *filtered = malloc((band->last_row - first) * filtered_row_size);
+	if(zeros == NULL || filtered == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (png_deflate_band): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	for(row = first; row < band->last_row; row++)
+		png_filter_row(filtered + (row - first) * filtered_row_size,
+			band->data + row * row_size,
+			(row > 0) ? band->data + (row - 1) * row_size : zeros,
+			row_size, preset->filters);
+
+	free(zeros);
+
+	uint8_t *in = filtered + band->dict_rows * filtered_row_size;
+	band->in_size = (band->last_row - band->first_row) * filtered_row_size;
+	band->adler = adler32(adler32(0L, Z_NULL, 0), in, band->in_size);
+
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+
+	/*raw deflate (no zlib header or trailer)*/
+	if(deflateInit2(&strm, preset->level, Z_DEFLATED, -15, 8, preset->strategy) != Z_OK)
+	{
+		fprintf(stderr, "V4L2_CORE: (save png) couldn't init deflate stream\n");
+		band->ret = E_ALLOC_ERR;
+		free(filtered);
+		return NULL;
+	}
+
+	/*prime the window with the end of the previous band*/
+	if(band->dict_rows > 0)
+	{
+		size_t dict_size = band->dict_rows * filtered_row_size;
+		if(dict_size > PNG_WINDOW_SIZE)
+			dict_size = PNG_WINDOW_SIZE;
+		deflateSetDictionary(&strm, in - dict_size, dict_size);
+	}
+
+	/*deflate bound plus the sync flush empty block*/
+	size_t out_size = deflateBound(&strm, band->in_size) + 16;
+	band->out = malloc(out_size);
+	if(band->out == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (png_deflate_band): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	strm.next_in = in;
+	strm.avail_in = band->in_size;
+	strm.next_out = band->out;
+	strm.avail_out = out_size;
+
+	int ret = deflate(&strm, band->last ? Z_FINISH : Z_SYNC_FLUSH);
+	if((band->last && ret != Z_STREAM_END) ||
+		(!band->last && (ret != Z_OK || strm.avail_in != 0)))
+	{
+		fprintf(stderr, "V4L2_CORE: (save png) deflate error (%i)\n", ret);
+		band->ret = E_UNKNOWN_ERR;
+	}
+
+	band->out_size = strm.total_out;
+
+	deflateEnd(&strm);
+	free(filtered);
+
+	return NULL;
+}
+
+/*
+ * compress the image data (zlib datastream for the IDAT chunks)
+ *   row bands are filtered and deflated in parallel and concatenated
+ * args:
+ *    width - image width (in pixels)
+ *    height - image height (in pixels)
+ *    data - pointer to rgb data
+ *    size - pointer to datastream size
+ *
+ * asserts:
+ *    data is not null
+ *    size is not null
+ *
+ * returns: pointer to zlib datastream (must be freed) or NULL on error
+ */
+static uint8_t *png_deflate_parallel(int width, int height, uint8_t *data, size_t *size)
+{
+	/*assertions*/
+	assert(data != NULL);
+	assert(size != NULL);
+
+	int i = 0;
+	int ret = E_OK;
+	size_t filtered_row_size = width * 3 + 1;
+
+	int n_bands = height / PNG_MIN_BAND_ROWS;
+	if(n_bands > png_threads)
+		n_bands = png_threads;
+	if(n_bands < 1)
+		n_bands = 1;
+
+	png_band_t *band = calloc(n_bands, sizeof(png_band_t));
+	if(band == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (png_deflate_parallel): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	for(i = 0; i < n_bands; i++)
+	{
+		band[i].data = data;
+		band[i].width = width;
+		band[i].first_row = (height * i) / n_bands;
+		band[i].last_row = (height * (i + 1)) / n_bands;
+		band[i].dict_rows = (PNG_WINDOW_SIZE + filtered_row_size - 1) / filtered_row_size;
+		if(band[i].dict_rows > band[i].first_row)
+			band[i].dict_rows = band[i].first_row;
+		band[i].last = (i == n_bands - 1);
+	}
+
+	/* band 0 is deflated in the calling thread */
+	__THREAD_TYPE band_thread[PNG_MAX_THREADS];
+	int band_thread_ok[PNG_MAX_THREADS];
+
+	for(i = 1; i < n_bands; i++)
+		band_thread_ok[i] = (__THREAD_CREATE(&band_thread[i], png_deflate_band, &band[i]) == 0);
+
+	png_deflate_band(&band[0]);
+
+	for(i = 1; i < n_bands; i++)
+	{
+		if(band_thread_ok[i])
+			__THREAD_JOIN(band_thread[i]);
+		else
+			png_deflate_band(&band[i]); /*couldn't create the thread*/
+	}
+
+	/* zlib header + deflate bands + adler32 */
+	size_t stream_size = 6;
+	for(i = 0; i < n_bands; i++)
+	{
+		stream_size += band[i].out_size;
+		if(band[i].ret != E_OK)
+			ret = band[i].ret;
+	}
+
+	uint8_t *stream = NULL;
+
+	if(ret == E_OK)
+	{
+		stream = malloc(stream_size);
+		if(stream == NULL)
+		{
+			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (png_deflate_parallel): %s\n", strerror(errno));
+			exit(-1);
+		}
+
+		const png_preset_t *preset = &png_presets[png_preset];
+		/*CMF (deflate, 32K window) and FLG (compression level, check bits)*/
+		int flevel = (preset->level < 2) ? 0 : (preset->level < 6) ? 1 : (preset->level == 6) ? 2 : 3;
+		uint8_t *ptr = stream;
+		*ptr++ = 0x78;
+		*ptr = (uint8_t) (flevel << 6);
+		*ptr += 31 - ((0x78 << 8) + *ptr) % 31;
+		ptr++;
+
+		uLong adler = band[0].adler;
+		for(i = 0; i < n_bands; i++)
+		{
+			memcpy(ptr, band[i].out, band[i].out_size);
+			ptr += band[i].out_size;
+			if(i > 0)
+				adler = adler32_combine(adler, band[i].adler, band[i].in_size);
+		}
+
+		*ptr++ = (uint8_t) (adler >> 24);
+		*ptr++ = (uint8_t) (adler >> 16);
+		*ptr++ = (uint8_t) (adler >> 8);
+		*ptr++ = (uint8_t) adler;
+
+		*size = stream_size;
+	}
+
+	for(i = 0; i < n_bands; i++)
+		free(band[i].out);
+	free(band);
+
+	return stream;
+}
 
 /*
  * save rgb data into png format file
@@ -57,6 +476,11 @@ static int save_png(const char *filename, int width, int height, uint8_t *data)
 	png_structp png_ptr;
 	png_infop info_ptr;
 	png_text text_ptr[3];
+	const png_preset_t *preset = &png_presets[png_preset];
+
+	/*zlib datastream (parallel deflate)*/
+	uint8_t * volatile idat = NULL;
+	size_t idat_size = 0;
 
 	png_bytep row_pointers[height];
 	/* open the file */
@@ -94,6 +518,8 @@ static int save_png(const char *filename, int width, int height, uint8_t *data)
 	*/
 	if (setjmp(png_jmpbuf(png_ptr)))
 	{
+		if(idat != NULL)
+			free(idat);
 		fclose(fp);
 		png_destroy_write_struct(&png_ptr, &info_ptr);
 		return (E_ALLOC_ERR);
@@ -108,22 +534,14 @@ static int save_png(const char *filename, int width, int height, uint8_t *data)
 	 * PNG_FILTER_VALUE_NAME or the bitwise OR of one
 	 * or more PNG_FILTER_NAME masks.
 	 */
-	//png_set_filter(png_ptr, 0,
-	//	PNG_FILTER_NONE  | PNG_FILTER_VALUE_NONE |
-	//	PNG_FILTER_SUB   | PNG_FILTER_VALUE_SUB  |
-	//	PNG_FILTER_UP    | PNG_FILTER_VALUE_UP   |
-	//	PNG_FILTER_AVE   | PNG_FILTER_VALUE_AVE  |
-	//	PNG_FILTER_PAETH | PNG_FILTER_VALUE_PAETH|
-	//	PNG_ALL_FILTERS);
+	png_set_filter(png_ptr, 0, preset->filters);
 
 	/* set the zlib compression level */
-	//png_set_compression_level(png_ptr,
-	//	Z_BEST_COMPRESSION);
+	png_set_compression_level(png_ptr, preset->level);
 
 	/* set other zlib parameters */
 	//png_set_compression_mem_level(png_ptr, 8);
-	//png_set_compression_strategy(png_ptr,
-	//	Z_DEFAULT_STRATEGY);
+	png_set_compression_strategy(png_ptr, preset->strategy);
 	//png_set_compression_window_bits(png_ptr, 15);
 	//png_set_compression_method(png_ptr, 8);
 	//png_set_compression_buffer_size(png_ptr, 8192);
@@ -161,21 +579,44 @@ static int save_png(const char *filename, int width, int height, uint8_t *data)
 	/* flip BGR pixels to RGB */
 	//png_set_bgr(png_ptr); /*?no longuer required?*/
 
-	/* Write the image data.*/
-	for (l = 0; l < height; l++)
-		row_pointers[l] = data + l * width * 3;
+	if(png_threads > 1 && height >= 2 * PNG_MIN_BAND_ROWS)
+		idat = png_deflate_parallel(width, height, data, &idat_size);
 
-	png_write_image(png_ptr, row_pointers);
+	if(idat != NULL)
+	{
+		/* Write the compressed image data (parallel deflate) */
+		size_t offset = 0;
+		for(offset = 0; offset < idat_size; offset += PNG_IDAT_SIZE)
+		{
+			size_t chunk_size = idat_size - offset;
+			if(chunk_size > PNG_IDAT_SIZE)
+				chunk_size = PNG_IDAT_SIZE;
+			png_write_chunk(png_ptr, (png_const_bytep) "IDAT", idat + offset, chunk_size);
+		}
+
+		free(idat);
+		idat = NULL;
+
+		png_write_chunk(png_ptr, (png_const_bytep) "IEND", NULL, 0);
+	}
+	else
+	{
+		/* Write the image data.*/
+		for (l = 0; l < height; l++)
+			row_pointers[l] = data + l * width * 3;
 
-	/*
-	 * You can write optional chunks like tEXt, zTXt, and tIME at the end
-	 * as well.  Shouldn't be necessary in 1.1.0 and up as all the public
-	 * chunks are supported and you can use png_set_unknown_chunks() to
-	 * register unknown chunks into the info structure to be written out.
-	 */
+		png_write_image(png_ptr, row_pointers);
 
-	/* It is REQUIRED to call this to finish writing the rest of the file */
-	png_write_end(png_ptr, info_ptr);
+		/*
+		 * You can write optional chunks like tEXt, zTXt, and tIME at the end
+		 * as well.  Shouldn't be necessary in 1.1.0 and up as all the public
+		 * chunks are supported and you can use png_set_unknown_chunks() to
+		 * register unknown chunks into the info structure to be written out.
+		 */
+
+		/* It is REQUIRED to call this to finish writing the rest of the file */
+		png_write_end(png_ptr, info_ptr);
+	}
 
 	/*
 	 * If you png_malloced a palette, free it here
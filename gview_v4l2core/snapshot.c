@@ -0,0 +1,627 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  snapshot service - asynchronous image encoding and writing                   #
+#                                                                               #
+#  frames are copied once into a queue slot on the capture thread and           #
+#  encoded/written to disk by a pool of writer threads                          #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "gviewv4l2core.h"
+#include "save_image.h"
+#include "core_time.h"
+#include "gview.h"
+
+extern int verbosity;
+
+#define SNAPSHOT_MAX_WORKERS (8)
+#define SNAPSHOT_MAX_QUEUE   (64)
+#define SNAPSHOT_MAX_ARENA   (1024) /*max frames in a burst arena*/
+
+/*slot states*/
+#define SLOT_FREE     (0)
+#define SLOT_RESERVED (1) /*frame being copied by the producer*/
+#define SLOT_QUEUED   (2)
+#define SLOT_BUSY     (3) /*being encoded by a worker*/
+
+typedef struct _snapshot_job_t
+{
+	int state;
+	int format;
+	char *filename;
+
+	v4l2_frame_buff_t frame; /*private frame (points to data)*/
+
+	uint8_t *data;           /*snapshot buffer (reused between jobs)*/
+	size_t data_size;
+	int in_arena;            /*data is a slice of the burst arena*/
+
+	uint64_t submit_ts;
+} snapshot_job_t;
+
+typedef struct _snapshot_service_t
+{
+	int running;
+	int stop;
+	int policy;
+
+	v4l2core_snapshot_cb_t callback;
+	void *callback_data;
+
+	int num_workers;
+	__THREAD_TYPE workers[SNAPSHOT_MAX_WORKERS];
+
+	/*job slots: queue_size + num_workers (queued + in flight)*/
+	int num_slots;
+	snapshot_job_t *slots;
+
+	/*pending fifo (slot indexes)*/
+	int base_queue_size;    /*queue size without a burst arena*/
+	int queue_size;
+	int *queue;
+	int queue_head;
+	int queue_count;
+
+	/*preallocated burst arena (sliced into slot buffers)*/
+	uint8_t *arena;
+	size_t arena_size;
+
+	__MUTEX_TYPE mutex;
+	__COND_TYPE job_cond;   /*signaled on new jobs and stop*/
+	__COND_TYPE space_cond; /*signaled when a slot is freed*/
+
+	v4l2_snapshot_stats_t stats;
+} snapshot_service_t;
+
+static snapshot_service_t snap;
+
+/*
+ * call the completion callback (if any)
+ * args:
+ *   filename - image file name
+ *   format - image format
+ *   status - error code (E_OK on success)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static void snapshot_notify(const char *filename, int format, int status)
+{
+	if(snap.callback)
+		snap.callback(filename, format, status, snap.callback_data);
+}
+
+/*
+ * release a job slot (mutex must be held)
+ * args:
+ *   job - pointer to job slot
+ *
+ * asserts:
+ *   job is not null
+ *
+ * returns: none
+ */
+static void snapshot_release_slot(snapshot_job_t *job)
+{
+	assert(job != NULL);
+
+	free(job->filename);
+	job->filename = NULL;
+	job->state = SLOT_FREE;
+
+	__COND_SIGNAL(&snap.space_cond);
+}
+
+/*
+ * writer thread: encode and write queued snapshots until stopped
+ *   (pending jobs are drained before exiting)
+ * args:
+ *   data - unused
+ *
+ * asserts:
+ *   none
+ *
+ * returns: NULL
+ */
+static void *snapshot_worker(void *data)
+{
+	(void) data;
+
+	__LOCK_MUTEX(&snap.mutex);
+
+	while(1)
+	{
+		while(snap.queue_count == 0 && !snap.stop)
+			__COND_WAIT(&snap.job_cond, &snap.mutex);
+
+		if(snap.queue_count == 0) /*stop and nothing left*/
+			break;
+
+		snapshot_job_t *job = &snap.slots[snap.queue[snap.queue_head]];
+		snap.queue_head = (snap.queue_head + 1) % snap.queue_size;
+		snap.queue_count--;
+
+		job->state = SLOT_BUSY;
+		snap.stats.busy++;
+
+		__UNLOCK_MUTEX(&snap.mutex);
+
+		uint64_t t0 = ns_time_monotonic();
+
+		int ret = save_frame_image(&job->frame, job->filename, job->format);
+
+		uint64_t t1 = ns_time_monotonic();
+
+		if(ret != E_OK)
+			fprintf(stderr, "V4L2_CORE: (snapshot) failed to save %s (error %i)\n",
+				job->filename, ret);
+
+		snapshot_notify(job->filename, job->format, ret);
+
+		__LOCK_MUTEX(&snap.mutex);
+
+		if(ret == E_OK)
+			snap.stats.saved++;
+		else
+			snap.stats.failed++;
+
+		snap.stats.encode_ns += t1 - t0;
+		if(t1 - job->submit_ts > snap.stats.max_latency_ns)
+			snap.stats.max_latency_ns = t1 - job->submit_ts;
+
+		snap.stats.busy--;
+		snapshot_release_slot(job);
+	}
+
+	__UNLOCK_MUTEX(&snap.mutex);
+
+	return NULL;
+}
+
+/*
+ * start the snapshot service
+ * args:
+ *   workers - number of writer threads (1 to 8)
+ *   queue_size - maximum number of pending snapshots (1 to 64)
+ *   policy - backpressure policy when the queue is full
+ *            (SNAPSHOT_POLICY_[BLOCK|DROP_NEW|DROP_OLD])
+ *   callback - completion callback (called from a writer thread) or NULL
+ *   data - callback user data
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code
+ */
+int v4l2core_snapshot_start(int workers, int queue_size, int policy,
+	v4l2core_snapshot_cb_t callback, void *data)
+{
+	if(snap.running)
+	{
+		fprintf(stderr, "V4L2_CORE: (snapshot) service already running\n");
+		return E_OK;
+	}
+
+	if(workers < 1)
+		workers = 1;
+	if(workers > SNAPSHOT_MAX_WORKERS)
+		workers = SNAPSHOT_MAX_WORKERS;
+	if(queue_size < 1)
+		queue_size = 1;
+	if(queue_size > SNAPSHOT_MAX_QUEUE)
+		queue_size = SNAPSHOT_MAX_QUEUE;
+
+	memset(&snap, 0, sizeof(snapshot_service_t));
+
+	snap.policy = policy;
+	snap.callback = callback;
+	snap.callback_data = data;
+	snap.base_queue_size = queue_size;
+	snap.queue_size = queue_size;
+	snap.num_slots = queue_size + workers;
+
+	snap.slots = calloc(snap.num_slots, sizeof(snapshot_job_t));
+	snap.queue = calloc(queue_size, sizeof(int));
+	if(snap.slots == NULL || snap.queue == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_snapshot_start): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	__INIT_MUTEX(&snap.mutex);
+	__INIT_COND(&snap.job_cond);
+	__INIT_COND(&snap.space_cond);
+
+	int i = 0;
+	for(i = 0; i < workers; i++)
+	{
+		if(__THREAD_CREATE(&snap.workers[i], snapshot_worker, NULL) != 0)
+		{
+			fprintf(stderr, "V4L2_CORE: (snapshot) couldn't create writer thread %i\n", i);
+			break;
+		}
+	}
+
+	snap.num_workers = i;
+	snap.running = 1;
+
+	if(snap.num_workers == 0)
+	{
+		v4l2core_snapshot_stop();
+		return E_UNKNOWN_ERR;
+	}
+
+	if(verbosity > 0)
+		printf("V4L2_CORE: (snapshot) service started: %i writer(s), queue of %i (policy %i)\n",
+			snap.num_workers, snap.queue_size, snap.policy);
+
+	return E_OK;
+}
+
+/*
+ * queue a frame snapshot for encoding and writing
+ *   (the frame data is copied - the frame can be released on return)
+ * args:
+ *   frame - pointer to frame buffer
+ *   filename - output file name
+ *   format - image type
+ *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP, IMG_FMT_JPG_RAW)
+ *
+ * asserts:
+ *   frame is not null
+ *   filename is not null
+ *
+ * returns: error code (E_QUEUE_FULL_ERR if the snapshot was dropped)
+ */
+int v4l2core_snapshot_submit(v4l2_frame_buff_t *frame, const char *filename, int format)
+{
+	/*assertions*/
+	assert(frame != NULL);
+	assert(filename != NULL);
+
+	/*no service: save it inline*/
+	if(!snap.running)
+		return save_frame_image(frame, filename, format);
+
+	uint8_t *src = NULL;
+	size_t size = 0;
+
+	/*passthrough needs a jpeg bitstream - re-encode otherwise*/
+	if(format == IMG_FMT_JPG_RAW &&
+		(frame->raw_frame == NULL || frame->raw_frame_size < 4 ||
+		 frame->raw_frame[0] != 0xFF || frame->raw_frame[1] != 0xD8))
+		format = IMG_FMT_JPG;
+
+	if(format == IMG_FMT_RAW || format == IMG_FMT_JPG_RAW)
+	{
+		src = frame->raw_frame;
+		size = frame->raw_frame_size;
+	}
+	else
+	{
+		src = frame->yuv_frame;
+		size = (size_t) frame->width * frame->height * 3 / 2; /*yu12*/
+	}
+
+	if(src == NULL || size == 0)
+		return E_NO_DATA;
+
+	char *dropped_filename = NULL;
+	int dropped_format = 0;
+
+	__LOCK_MUTEX(&snap.mutex);
+
+	snap.stats.submitted++;
+
+	while(snap.queue_count >= snap.queue_size && !snap.stop)
+	{
+		if(snap.policy == SNAPSHOT_POLICY_DROP_NEW)
+		{
+			snap.stats.dropped++;
+			__UNLOCK_MUTEX(&snap.mutex);
+
+			fprintf(stderr, "V4L2_CORE: (snapshot) queue full - dropping %s\n", filename);
+			snapshot_notify(filename, format, E_QUEUE_FULL_ERR);
+			return E_QUEUE_FULL_ERR;
+		}
+		else if(snap.policy == SNAPSHOT_POLICY_DROP_OLD)
+		{
+			/*discard the oldest pending job (not yet started)*/
+			snapshot_job_t *old = &snap.slots[snap.queue[snap.queue_head]];
+			snap.queue_head = (snap.queue_head + 1) % snap.queue_size;
+			snap.queue_count--;
+			snap.stats.dropped++;
+
+			free(dropped_filename); /*only the last one is reported*/
+			dropped_filename = old->filename;
+			dropped_format = old->format;
+			old->filename = NULL;
+			snapshot_release_slot(old);
+		}
+		else
+		{
+			/*SNAPSHOT_POLICY_BLOCK*/
+			snap.stats.blocked++;
+			__COND_WAIT(&snap.space_cond, &snap.mutex);
+		}
+	}
+
+	/*
+	 * a free slot always exists here: at most queue_size
+	 * jobs are pending and num_workers in flight
+	 */
+	snapshot_job_t *job = NULL;
+	int i = 0;
+	for(i = 0; i < snap.num_slots; i++)
+	{
+		if(snap.slots[i].state == SLOT_FREE)
+		{
+			job = &snap.slots[i];
+			break;
+		}
+	}
+
+	if(job == NULL || snap.stop)
+	{
+		__UNLOCK_MUTEX(&snap.mutex);
+		fprintf(stderr, "V4L2_CORE: (snapshot) no free slot for %s\n", filename);
+		free(dropped_filename);
+		return E_UNKNOWN_ERR;
+	}
+
+	job->state = SLOT_RESERVED;
+
+	__UNLOCK_MUTEX(&snap.mutex);
+
+	if(dropped_filename)
+	{
+		fprintf(stderr, "V4L2_CORE: (snapshot) queue full - dropping %s\n", dropped_filename);
+		snapshot_notify(dropped_filename, dropped_format, E_QUEUE_FULL_ERR);
+		free(dropped_filename);
+	}
+
+	/*copy the frame once (outside the lock - the slot is reserved)*/
+	if(job->data_size < size)
+	{
+		if(!job->in_arena)
+			free(job->data);
+		job->in_arena = 0;
+		job->data = malloc(size);
+		if(job->data == NULL)
+		{
+			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_snapshot_submit): %s\n", strerror(errno));
+			exit(-1);
+		}
+		job->data_size = size;
+	}
+
+	memcpy(job->data, src, size);
+
+	memset(&job->frame, 0, sizeof(v4l2_frame_buff_t));
+	job->frame.width = frame->width;
+	job->frame.height = frame->height;
+	job->frame.timestamp = frame->timestamp;
+	if(format == IMG_FMT_RAW || format == IMG_FMT_JPG_RAW)
+	{
+		job->frame.raw_frame = job->data;
+		job->frame.raw_frame_size = size;
+	}
+	else
+		job->frame.yuv_frame = job->data;
+
+	job->format = format;
+	job->filename = strdup(filename);
+	job->submit_ts = ns_time_monotonic();
+
+	__LOCK_MUTEX(&snap.mutex);
+
+	job->state = SLOT_QUEUED;
+	snap.queue[(snap.queue_head + snap.queue_count) % snap.queue_size] = job - snap.slots;
+	snap.queue_count++;
+	if(snap.queue_count > snap.stats.max_pending)
+		snap.stats.max_pending = snap.queue_count;
+
+	__COND_SIGNAL(&snap.job_cond);
+	__UNLOCK_MUTEX(&snap.mutex);
+
+	return E_OK;
+}
+
+/*
+ * preallocate a burst arena: the queue grows to hold frames pending
+ *   snapshots, each with a prefaulted buffer of frame_size bytes, so
+ *   a burst is queued without blocking or allocating
+ *   (waits for the pending snapshots to complete)
+ * args:
+ *   frames - number of arena frames (0 releases the arena)
+ *   frame_size - arena frame size in bytes
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code
+ */
+int v4l2core_snapshot_reserve(int frames, size_t frame_size)
+{
+	if(!snap.running)
+	{
+		fprintf(stderr, "V4L2_CORE: (snapshot) can't reserve an arena: service not running\n");
+		return E_UNKNOWN_ERR;
+	}
+
+	if(frames < 0 || frame_size == 0)
+		frames = 0;
+	if(frames > SNAPSHOT_MAX_ARENA)
+	{
+		fprintf(stderr, "V4L2_CORE: (snapshot) arena limited to %i frames\n", SNAPSHOT_MAX_ARENA);
+		frames = SNAPSHOT_MAX_ARENA;
+	}
+
+	__LOCK_MUTEX(&snap.mutex);
+
+	/*slots can only be rebuilt when idle*/
+	while(snap.queue_count > 0 || snap.stats.busy > 0)
+		__COND_WAIT(&snap.space_cond, &snap.mutex);
+
+	int i = 0;
+	for(i = 0; i < snap.num_slots; i++)
+	{
+		if(!snap.slots[i].in_arena)
+			free(snap.slots[i].data);
+	}
+	free(snap.arena);
+	snap.arena = NULL;
+	snap.arena_size = 0;
+
+	snap.queue_size = MAX(snap.base_queue_size, frames);
+	snap.num_slots = snap.queue_size + snap.num_workers;
+	snap.queue_head = 0;
+
+	free(snap.slots);
+	free(snap.queue);
+	snap.slots = calloc(snap.num_slots, sizeof(snapshot_job_t));
+	snap.queue = calloc(snap.queue_size, sizeof(int));
+	if(snap.slots == NULL || snap.queue == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_snapshot_reserve): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	if(frames > 0)
+	{
+		snap.arena_size = (size_t) frames * frame_size;
+		snap.arena = malloc(snap.arena_size);
+		if(snap.arena == NULL)
+		{
+			__UNLOCK_MUTEX(&snap.mutex);
+			fprintf(stderr, "V4L2_CORE: (snapshot) couldn't allocate a %zu byte arena: %s\n",
+				snap.arena_size, strerror(errno));
+			snap.arena_size = 0;
+			return E_ALLOC_ERR;
+		}
+
+		/*prefault the pages now instead of during the burst*/
+		memset(snap.arena, 0, snap.arena_size);
+
+		for(i = 0; i < frames; i++)
+		{
+			snap.slots[i].data = snap.arena + (size_t) i * frame_size;
+			snap.slots[i].data_size = frame_size;
+			snap.slots[i].in_arena = 1;
+		}
+	}
+
+	__UNLOCK_MUTEX(&snap.mutex);
+
+	if(verbosity > 0)
+		printf("V4L2_CORE: (snapshot) arena of %i frames (%zu bytes), queue of %i\n",
+			frames, snap.arena_size, snap.queue_size);
+
+	return E_OK;
+}
+
+/*
+ * get the snapshot service stats
+ * args:
+ *   stats - pointer to stats struct to fill
+ *
+ * asserts:
+ *   stats is not null
+ *
+ * returns: none
+ */
+void v4l2core_snapshot_get_stats(v4l2_snapshot_stats_t *stats)
+{
+	/*assertions*/
+	assert(stats != NULL);
+
+	if(!snap.running)
+	{
+		memset(stats, 0, sizeof(v4l2_snapshot_stats_t));
+		return;
+	}
+
+	__LOCK_MUTEX(&snap.mutex);
+	*stats = snap.stats;
+	stats->pending = snap.queue_count;
+	__UNLOCK_MUTEX(&snap.mutex);
+}
+
+/*
+ * stop the snapshot service
+ *   (blocks until all pending snapshots are written)
+ * args:
+ *   none
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+void v4l2core_snapshot_stop()
+{
+	if(!snap.running)
+		return;
+
+	__LOCK_MUTEX(&snap.mutex);
+	snap.stop = 1;
+	__COND_BCAST(&snap.job_cond);
+	__COND_BCAST(&snap.space_cond);
+	__UNLOCK_MUTEX(&snap.mutex);
+
+	int i = 0;
+	for(i = 0; i < snap.num_workers; i++)
+		__THREAD_JOIN(snap.workers[i]);
+
+	if(verbosity > 0)
+		printf("V4L2_CORE: (snapshot) %" PRIu64 " submitted, %" PRIu64 " saved, %" PRIu64 " failed, %" PRIu64 " dropped (max pending %i, max latency %.1f ms)\n",
+			snap.stats.submitted, snap.stats.saved, snap.stats.failed, snap.stats.dropped,
+			snap.stats.max_pending, snap.stats.max_latency_ns / 1E6);
+
+	for(i = 0; i < snap.num_slots; i++)
+	{
+		free(snap.slots[i].filename);
+		if(!snap.slots[i].in_arena)
+			free(snap.slots[i].data);
+	}
+
+	free(snap.slots);
+	free(snap.queue);
+	free(snap.arena);
+
+	__CLOSE_COND(&snap.job_cond);
+	__CLOSE_COND(&snap.space_cond);
+	__CLOSE_MUTEX(&snap.mutex);
+
+	memset(&snap, 0, sizeof(snapshot_service_t));
+}
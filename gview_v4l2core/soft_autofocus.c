@@ -22,7 +22,7 @@
 
 /*******************************************************************************#
 #                                                                               #
-#  autofocus - using dct                                                        #
+#  autofocus - model based search on a pluggable sharpness measure              #
 #                                                                               #
 #                                                                               #
 ********************************************************************************/
@@ -34,68 +34,112 @@
 #include <errno.h>
 #include <math.h>
 #include <assert.h>
+#include <limits.h>
 
 #include "gviewv4l2core.h"
 #include "soft_autofocus.h"
-#include "dct.h"
+#include "focus_metric.h"
 #include "gview.h"
 #include "core_time.h"
 #include "../config.h"
 
-#define _TH_		(80) /* default treshold = 1/80 of focus sharpness value*/
-
-#define FLAT 		(0)
-#define LOCAL_MAX	(1)
-#define LEFT		(2)
-#define RIGHT		(3)
-#define INCSTEP		(4)
-
-#define MAX_ARR_S 20
-
-#define SWAP(x, y) temp = (x); (x) = (y); (y) = temp
+#define FOCUS_MAX_SAMPLES (1 << 18) /*max roi pixels evaluated per frame (auto step)*/
+
+/*search states*/
+#define FOCUS_STATE_SCAN    (0) /*coarse scan of the full focus range*/
+#define FOCUS_STATE_BRACKET (1) /*bracket the peak around the current focus*/
+#define FOCUS_STATE_REFINE  (2) /*parabolic fit / golden section refine*/
+#define FOCUS_STATE_TRACK   (3) /*focused - monitor sharpness*/
+
+/*bracket probes*/
+#define BRACKET_RIGHT        (0)
+#define BRACKET_LEFT         (1)
+#define BRACKET_EXPAND_RIGHT (2)
+#define BRACKET_EXPAND_LEFT  (3)
+
+#define FOCUS_SCAN_POINTS  (9)   /*coarse scan samples over the focus range*/
+#define FOCUS_SCAN_FALL    (70)  /*end the scan if sharpness fell under 70% of the peak*/
+#define FOCUS_REFINE_ITER  (6)   /*max refine probes*/
+#define FOCUS_GOLDEN       (0.381966) /*golden section (2 - phi)*/
+#define FOCUS_EXPAND       (1.618034) /*bracket expansion (phi)*/
+#define FOCUS_EXPAND_MAX   (4)   /*max bracket expansions before a full scan*/
+
+#define FOCUS_SETTLE_TOL   (4)   /*max sharpness change (%) between frames of a settled lens*/
+#define FOCUS_SETTLE_STABLE (2)  /*stable frame pairs for a settled lens*/
+#define FOCUS_SETTLE_MAX   (12)  /*max frames waiting for the lens to settle*/
+#define FOCUS_SETTLE_CALIB (4)   /*measured moves before relying on the settle model*/
+
+#define FOCUS_TRACK_DROP   (20)  /*sharpness drop (%) that triggers a refocus*/
+#define FOCUS_TRACK_HOLD   (3)   /*frames the drop must last*/
+
+/*quiet tracking (recording)*/
+#define FOCUS_QUIET_DROP    (35)   /*sharpness drop (%) that triggers a refocus*/
+#define FOCUS_QUIET_HOLD    (1000) /*time (ms) the drop must last*/
+#define FOCUS_QUIET_COOL    (3000) /*time (ms) between refocus*/
+#define FOCUS_QUIET_EXPAND  (5)    /*max bracket expansions (no full scan)*/
 
 extern int verbosity;
 
 typedef struct _focus_ctx_t
 {
-	int focus;
-	int step;
-	int right;
-	int left;
-	int sharpness;
-	int focus_sharpness;
-	int sharpLeft;
-	int sharpRight;
-    v4l2_ctrl_t* focus_control;
+	v4l2_ctrl_t* focus_control;
 	int f_max;
 	int f_min;
 	int f_step;
-	int i_step;
-	int focusDir;
-	int arr_sharp[MAX_ARR_S];
-	int arr_foc[MAX_ARR_S];
-	int ind;
-	int flag;
-	int setFocus;
-	int focus_wait;
-	int last_focus;
+	int tol;              /*search resolution (focus units)*/
+	int state;            /*FOCUS_STATE_XXX*/
+	int focus;            /*focus target (-1 - start a new search)*/
+	int last_focus;       /*focus value set in the device*/
+	int sharpness;        /*last sharpness sample*/
+	int setFocus;         /*a requested search is running*/
+	/*lens settle*/
+	double frame_ms;      /*frame time (ms)*/
+	double ms_per_step;   /*lens settle time per focus unit (ms)*/
+	int focus_wait;       /*frames to skip before the next sample*/
+	int settle_measure;   /*flag - measure the settle time of this move*/
+	int settle_calib;     /*number of measured moves*/
+	int settle_frames;    /*frames since the measured move*/
+	int settle_dist;      /*measured move distance*/
+	int settle_sharpness; /*previous sample of the measured move*/
+	int settle_start;     /*sharpness before the measured move*/
+	int settle_stable;    /*consecutive stable samples*/
+	/*coarse scan*/
+	int scan_dir;         /*1 - from f_min; -1 - from f_max*/
+	int scan_ind;
+	int scan_best;
+	int scan_sharp[FOCUS_SCAN_POINTS];
+	/*bracket: a <= b <= c*/
+	int a;
+	int b;
+	int c;
+	int fa;
+	int fb;
+	int fc;
+	int phase;            /*BRACKET_XXX*/
+	int expand;           /*bracket expansions*/
+	int delta;            /*bracket step*/
+	int iter;             /*refine iterations*/
+	/*tracking*/
+	int ref_sharpness;    /*focused sharpness (-1 - not set)*/
+	int low_count;        /*frames under the drop threshold*/
+	int cooldown;         /*frames until a refocus is allowed*/
 } focus_ctx_t;
 
 static focus_ctx_t *focus_ctx = NULL;
 
-static double sumAC[64];
-static int ACweight[64] = {
-	0,1,2,3,4,5,6,7,
-	1,1,2,3,4,5,6,7,
-	2,2,2,3,4,5,6,7,
-	3,3,3,3,4,5,6,7,
-	4,4,4,4,4,5,6,7,
-	5,5,5,5,5,5,6,7,
-	7,7,7,7,7,7,7,7
+/*sharpness measures - indexed by AUTOF_METRIC_XXX*/
+static focus_metric_t focus_metrics[] =
+{
+	focus_metric_dct,       /*AUTOF_METRIC_DCT*/
+	focus_metric_laplacian, /*AUTOF_METRIC_LAPLACIAN*/
+	focus_metric_tenengrad  /*AUTOF_METRIC_TENENGRAD*/
 };
 
-/*use insert sort by default - it's the fastest for small and almost sorted arrays (our case)*/
-static int sort_method = AUTOF_SORT_INSERT; /* 1 - Quick sort   2 - Shell sort  3- insert sort  other - bubble sort*/
+static int focus_metric = AUTOF_METRIC_LAPLACIAN;
+static int focus_roi[4] = {25, 25, 50, 50}; /*x, y, width, height (% of frame) - central half*/
+static int focus_line_step = 0; /*0 - auto (at most FOCUS_MAX_SAMPLES pixels)*/
+
+static int track_mode = AUTOF_TRACK_CONTINUOUS;
 
 /*
  * sets a focus loop while autofocus is on
@@ -113,12 +157,7 @@ void v4l2core_soft_autofocus_set_focus()
 	assert(focus_ctx != NULL);
 
 	focus_ctx->setFocus = 1;
-
-	focus_ctx->ind = 0;
-	focus_ctx->flag = 0;
-	focus_ctx->right = 255;
-	focus_ctx->left = 8;
-	focus_ctx->focus = -1; /*reset focus*/
+	focus_ctx->focus = -1; /*reset focus - start a new search*/
 }
 
 /*
@@ -133,7 +172,89 @@ void v4l2core_soft_autofocus_set_focus()
  */
 void v4l2core_soft_autofocus_set_sort(int method)
 {
-	sort_method = method;
+	/*the model based search doesn't sort samples*/
+	(void) method;
+}
+
+/*
+ * set autofocus tracking mode
+ * args:
+ *    mode - tracking mode (AUTOF_TRACK_XXX)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_tracking(int mode)
+{
+	track_mode = (mode == AUTOF_TRACK_QUIET) ? AUTOF_TRACK_QUIET : AUTOF_TRACK_CONTINUOUS;
+}
+
+/*
+ * set autofocus sharpness measure
+ * args:
+ *    metric - sharpness measure (AUTOF_METRIC_XXX)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_metric(int metric)
+{
+	if(metric < 0 || metric >= (int) (sizeof(focus_metrics)/sizeof(focus_metrics[0])))
+	{
+		fprintf(stderr, "V4L2_CORE: (soft_autofocus) unknown sharpness metric %i\n", metric);
+		return;
+	}
+
+	focus_metric = metric;
+}
+
+/*
+ * set autofocus region of interest
+ * args:
+ *    x - roi left column (% of frame width)
+ *    y - roi top line (% of frame height)
+ *    width - roi width (% of frame width)
+ *    height - roi height (% of frame height)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_roi(int x, int y, int width, int height)
+{
+	if(x < 0 || y < 0 || width <= 0 || height <= 0 ||
+		x + width > 100 || y + height > 100)
+	{
+		fprintf(stderr, "V4L2_CORE: (soft_autofocus) invalid roi %i,%i,%i,%i (%% of frame)\n",
+			x, y, width, height);
+		return;
+	}
+
+	focus_roi[0] = x;
+	focus_roi[1] = y;
+	focus_roi[2] = width;
+	focus_roi[3] = height;
+}
+
+/*
+ * set autofocus line subsampling
+ * args:
+ *    step - evaluate one in every step lines of the roi
+ *           (0 - auto: bound the evaluated pixels per frame)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_soft_autofocus_set_subsample(int step)
+{
+	focus_line_step = (step < 0) ? 0 : step;
 }
 
 /*
@@ -167,9 +288,9 @@ int soft_autofocus_init (v4l2_dev_t *vd)
 		exit(-1);
 	}
 
-    focus_ctx->focus_control = v4l2core_get_control_by_id(vd, vd->has_focus_control_id);
+	focus_ctx->focus_control = v4l2core_get_control_by_id(vd, vd->has_focus_control_id);
 
-    if(focus_ctx->focus_control == NULL)
+	if(focus_ctx->focus_control == NULL)
 	{
 		fprintf(stderr, "V4L2_CORE: couldn't load focus control for id %x\n", vd->has_focus_control_id);
 		free(focus_ctx);
@@ -180,578 +301,639 @@ int soft_autofocus_init (v4l2_dev_t *vd)
 	focus_ctx->f_max = focus_ctx->focus_control->control.maximum;
 	focus_ctx->f_min = focus_ctx->focus_control->control.minimum;
 	focus_ctx->f_step = focus_ctx->focus_control->control.step;
+	if(focus_ctx->f_step <= 0)
+		focus_ctx->f_step = 1;
 
-	focus_ctx->i_step = (focus_ctx->f_max + 1 - focus_ctx->f_min)/32;
-	if(focus_ctx->i_step <= focus_ctx->f_step)
-		focus_ctx->i_step = focus_ctx->f_step * 2;
-	//printf("V4L2_CORE: (soft_autofocus) focus step:%i\n", focus_ctx->i_step);
-	focus_ctx->right = focus_ctx->f_max;
-	focus_ctx->left = focus_ctx->f_min + focus_ctx->i_step; /*start with focus at 8*/
+	/*search resolution: 1/64 of the focus range*/
+	focus_ctx->tol = (focus_ctx->f_max - focus_ctx->f_min)/64;
+	if(focus_ctx->tol < focus_ctx->f_step)
+		focus_ctx->tol = focus_ctx->f_step;
+
+	focus_ctx->state = FOCUS_STATE_SCAN;
 	focus_ctx->focus = -1;
 	focus_ctx->focus_wait = 0;
+	focus_ctx->ref_sharpness = -1;
+
+	/*start with the old 1.4 ms per step estimate - refined by measured moves*/
+	focus_ctx->ms_per_step = 1.4;
+	focus_ctx->frame_ms = 1000 / 30.0;
+	if(vd->fps_num > 0 && vd->fps_denom > 0)
+		focus_ctx->frame_ms = (1000.0 * vd->fps_num) / vd->fps_denom;
 
 	focus_ctx->last_focus = focus_ctx->focus_control->value;
 	/*make sure we wait for focus to settle on first check*/
 	if (focus_ctx->last_focus < 0)
 		focus_ctx->last_focus = focus_ctx->f_max;
 
-	memset(sumAC, 0, 64*sizeof(*sumAC)); /*reset array to 0*/
-
 	return (E_OK);
 }
 
 /*
- * quick sort
- * (the fastest and more complex - recursive, doesn't do well on almost sorted data)
+ * clip and align a focus value to the control range and step
  * args:
- *   left -
- *   right -
+ *    focus - focus value
  *
  * asserts:
- *   focus_ctx is not null
+ *    focus_ctx is not null
  *
- * returns: none
+ * returns: focus value
  */
-static void q_sort(int left, int right)
+static int focus_snap(int focus)
 {
-	/*asserts*/
-	assert(focus_ctx != NULL);
+	int step = focus_ctx->f_step;
 
-	int l_hold = left;
-	int r_hold = right;
-	int pivot = focus_ctx->arr_sharp[left];
-	int temp = focus_ctx->arr_foc[left];
+	if(focus < focus_ctx->f_min)
+		focus = focus_ctx->f_min;
+	if(focus > focus_ctx->f_max)
+		focus = focus_ctx->f_max;
 
-	while(left < right)
-	{
-		while((focus_ctx->arr_sharp[right] >= pivot) && (left < right))
-			right--;
-		if (left != right)
-		{
-			focus_ctx->arr_sharp[left] = focus_ctx->arr_sharp[right];
-			focus_ctx->arr_foc[left] = focus_ctx->arr_foc[right];
-			left++;
-		}
-		while((left < right) && (focus_ctx->arr_sharp[left] <= pivot))
-			left++;
-		if (left != right)
-		{
-			focus_ctx->arr_sharp[right] = focus_ctx->arr_sharp[left];
-			focus_ctx->arr_foc[right] = focus_ctx->arr_foc[left];
-			right--;
-		}
-	}
-	focus_ctx->arr_sharp[left] = pivot;
-	focus_ctx->arr_foc[left] = temp;
-	pivot = left;
+	focus = focus_ctx->f_min + ((focus - focus_ctx->f_min + step/2)/step) * step;
+	if(focus > focus_ctx->f_max)
+		focus -= step;
 
-	if (l_hold < pivot) q_sort(l_hold, pivot-1);
-	if (r_hold > pivot) q_sort(pivot+1, r_hold);
+	return focus;
 }
 
 /*
- * shell sort
- * (based on insert sort, but with some optimization)
- * for small arrays insert sort is still faster
+ * get focus value for a coarse scan point
  * args:
- *    size -
+ *    ind - scan point index
  *
  * asserts:
  *    focus_ctx is not null
  *
- * returns: none
+ * returns: focus value
  */
-static void s_sort(int size)
+static int focus_scan_pos(int ind)
 {
-	/*asserts*/
-	assert(focus_ctx != NULL);
+	int offset = ((focus_ctx->f_max - focus_ctx->f_min) * ind)/(FOCUS_SCAN_POINTS - 1);
 
-	int i, j, temp, gap;
+	if(focus_ctx->scan_dir < 0)
+		return focus_snap(focus_ctx->f_max - offset);
 
-	for (gap = size / 2; gap > 0; gap /= 2)
-	{
-		for (i = gap; i <= size; i++)
-		{
-			for (j = i-gap; j >= 0 && (focus_ctx->arr_sharp[j] > focus_ctx->arr_sharp[j + gap]); j -= gap)
-			{
-				SWAP(focus_ctx->arr_sharp[j], focus_ctx->arr_sharp[j + gap]);
-				SWAP(focus_ctx->arr_foc[j], focus_ctx->arr_foc[j + gap]);
-			}
-		}
-	}
+	return focus_snap(focus_ctx->f_min + offset);
 }
 
 /*
- * insert sort
- * (fastest for small arrays, around 15 elements)
+ * move the lens
  * args:
- *    size -
+ *    vd - pointer to device data
+ *    focus - new focus value
+ *    measure - flag: measure the lens settle time for this move
  *
  * asserts:
+ *    vd is not null
  *    focus_ctx is not null
  *
  * returns: none
  */
-static void i_sort (int size)
+static void focus_move(v4l2_dev_t *vd, int focus, int measure)
 {
-	/*asserts*/
-	assert(focus_ctx != NULL);
+	int dist = abs(focus - focus_ctx->last_focus);
 
-	int i,j,temp;
+	focus_ctx->focus = focus;
+	focus_ctx->focus_control->value = focus;
+	if (v4l2core_set_control_value_by_id(vd, focus_ctx->focus_control->control.id) != 0)
+		fprintf(stderr, "V4L2_CORE: (soft_autofocus) couldn't set focus to %d\n", focus);
 
-	for (i = 1; i <= size; i++)
+	/*calibrate the settle model on long moves*/
+	if(focus_ctx->settle_calib < FOCUS_SETTLE_CALIB &&
+		dist >= (focus_ctx->f_max - focus_ctx->f_min)/16)
+		measure = 1;
+
+	if(measure)
 	{
-		for(j = i; j > 0 && (focus_ctx->arr_sharp[j-1] > focus_ctx->arr_sharp[j]); j--)
-		{
-			SWAP(focus_ctx->arr_sharp[j],focus_ctx->arr_sharp[j-1]);
-			SWAP(focus_ctx->arr_foc[j],focus_ctx->arr_foc[j-1]);
-		}
+		/*sample every frame until sharpness is stable*/
+		focus_ctx->settle_measure = 1;
+		focus_ctx->settle_frames = 0;
+		focus_ctx->settle_dist = dist;
+		focus_ctx->settle_sharpness = -1;
+		focus_ctx->settle_start = focus_ctx->sharpness;
+		focus_ctx->settle_stable = 0;
+		focus_ctx->focus_wait = 0;
+	}
+	else
+	{
+		/*one frame latency plus the predicted lens travel*/
+		focus_ctx->settle_measure = 0;
+		focus_ctx->focus_wait = (int) ceil(dist * focus_ctx->ms_per_step / focus_ctx->frame_ms) + 1;
 	}
+
+	focus_ctx->last_focus = focus;
 }
 
 /*
- * bubble sort
- * (the simplest and most inefficient - in real test with focus data
- * it did better than shell or quick sort since focus data is almost
- * sorted)
+ * check if the lens settled after a measured move
+ *   (updates the settle model)
  * args:
- *    size -
+ *    sharpness - sharpness of the current frame
  *
  * asserts:
  *    focus_ctx is not null
  *
- * returns: none
+ * returns: 1 - settled; 0 - still moving
  */
-static void b_sort (int size)
+static int focus_settled(int sharpness)
 {
-	int i, temp, swapped;
+	int prev = focus_ctx->settle_sharpness;
 
-	do
-	{
-		swapped = 0;
-		size--;
-		for (i = 0 ; i <= size; ++i)
-		{
-			if (focus_ctx->arr_sharp[i+1] < focus_ctx->arr_sharp[i])
-			{
-				SWAP(focus_ctx->arr_sharp[i],focus_ctx->arr_sharp[i+1]);
-				SWAP(focus_ctx->arr_foc[i],focus_ctx->arr_foc[i+1]);
-				swapped = 1;
-			}
-		}
-	} while (swapped);
+	focus_ctx->settle_frames++;
+	focus_ctx->settle_sharpness = sharpness;
+
+	if(prev < 0)
+		return 0;
+
+	if(fabs((double) sharpness - prev) * 100 >
+		(double) ((sharpness > prev) ? sharpness : prev) * FOCUS_SETTLE_TOL)
+		focus_ctx->settle_stable = 0;
+	else
+		focus_ctx->settle_stable++;
+
+	if(focus_ctx->settle_stable < FOCUS_SETTLE_STABLE &&
+		focus_ctx->settle_frames < FOCUS_SETTLE_MAX)
+		return 0;
+
+	focus_ctx->settle_measure = 0;
+
+	/*
+	 * the lens was already stable on the first frame of the stable
+	 * run: one skipped frame is latency, the others lens travel
+	 */
+	int skipped = focus_ctx->settle_frames - focus_ctx->settle_stable - 1;
+
+	/*
+	 * only trust moves that changed the image
+	 * (a move over a flat part of the sharpness curve looks settled at once)
+	 */
+	if(focus_ctx->settle_dist <= 0 ||
+		fabs((double) sharpness - focus_ctx->settle_start) * 100 <=
+		(double) ((sharpness > focus_ctx->settle_start) ? sharpness : focus_ctx->settle_start) * FOCUS_SETTLE_TOL)
+		return 1;
+
+	double ms_per_step = ((skipped > 1) ? (skipped - 1) * focus_ctx->frame_ms : 0) /
+		focus_ctx->settle_dist;
+	/*fast attack, slow decay: waiting too little gives bad samples*/
+	if(ms_per_step > focus_ctx->ms_per_step)
+		focus_ctx->ms_per_step = ms_per_step;
+	else
+		focus_ctx->ms_per_step = (focus_ctx->ms_per_step + ms_per_step) / 2;
+	focus_ctx->settle_calib++;
+
+	if(verbosity > 1)
+		printf("V4L2_CORE: (soft_autofocus) lens settled in %d frames (move %d): %.2f ms/step\n",
+			skipped, focus_ctx->settle_dist, focus_ctx->ms_per_step);
+
+	return 1;
+}
+
+/*
+ * lock focus on the best sample and start tracking
+ * args:
+ *    none
+ *
+ * asserts:
+ *    focus_ctx is not null
+ *
+ * returns: next focus value
+ */
+static int focus_lock()
+{
+	focus_ctx->state = FOCUS_STATE_TRACK;
+	focus_ctx->ref_sharpness = -1; /*set from the first settled frame*/
+	focus_ctx->low_count = 0;
+	focus_ctx->cooldown = 0;
+	if(track_mode == AUTOF_TRACK_QUIET)
+		focus_ctx->cooldown = (int) (FOCUS_QUIET_COOL / focus_ctx->frame_ms);
+	focus_ctx->setFocus = 0;
+
+	return focus_ctx->b;
 }
 
 /*
- * sort focus values
+ * get the next refine probe
+ *   parabola vertex through (a, b, c) or a golden section
+ *   step into the larger side of the bracket
  * args:
- *    size - focus array size
+ *    none
+ *
+ * asserts:
+ *    focus_ctx is not null
  *
- * returns: best focus value
+ * returns: next focus value
  */
-static int focus_sort(int size)
+static int focus_refine_next()
 {
-	if (size>=20)
+	focus_ctx_t *f = focus_ctx;
+
+	if(f->c - f->a <= 2 * f->tol || f->iter >= FOCUS_REFINE_ITER)
+		return focus_lock();
+
+	f->iter++;
+
+	if(f->a < f->b && f->b < f->c)
 	{
-		fprintf(stderr, "V4L2_CORE: (soft_autofocus) focus array size=%d exceeds 20\n", size);
-		size = 10;
+		/*
+		 * fit the log of sharpness: the peak is closer to a
+		 * gaussian than to a parabola
+		 */
+		double la = log(f->fa + 1.0);
+		double lb = log(f->fb + 1.0);
+		double lc = log(f->fc + 1.0);
+		double d1 = f->b - f->a;
+		double d2 = f->b - f->c;
+		double num = d1 * d1 * (lb - lc) - d2 * d2 * (lb - la);
+		double den = d1 * (lb - lc) - d2 * (lb - la);
+
+		if(den != 0)
+		{
+			double u = f->b - 0.5 * num / den;
+			if(u > f->a && u < f->c)
+			{
+				int x = focus_snap((int) lround(u));
+				if(fabs(u - f->b) >= f->tol &&
+					x != f->a && x != f->b && x != f->c)
+					return x;
+
+				/*vertex at b within resolution of a narrow bracket: b is the peak*/
+				if(f->c - f->a <= 8 * f->tol)
+					return focus_lock();
+			}
+		}
 	}
 
-	switch(sort_method)
-	{
-		case AUTOF_SORT_QUICK:
-			q_sort(0, size);
-			break;
+	/*golden section*/
+	double u = (f->c - f->b > f->b - f->a) ?
+		f->b + FOCUS_GOLDEN * (f->c - f->b) :
+		f->b - FOCUS_GOLDEN * (f->b - f->a);
 
-		case AUTOF_SORT_SHELL:
-			s_sort(size);
-			break;
+	int x = focus_snap((int) lround(u));
+	if(x == f->a || x == f->b || x == f->c)
+		return focus_lock();
 
-		case AUTOF_SORT_BUBBLE:
-			b_sort(size);
-			break;
+	return x;
+}
 
-		default:
-		case AUTOF_SORT_INSERT:
-			i_sort(size);
-			break;
-	}
+/*
+ * start refining a bracketed peak (a <= b <= c)
+ * args:
+ *    none
+ *
+ * asserts:
+ *    focus_ctx is not null
+ *
+ * returns: next focus value
+ */
+static int focus_refine_start()
+{
+	focus_ctx->state = FOCUS_STATE_REFINE;
+	focus_ctx->iter = 0;
 
-	/*better focus value*/
-	return(focus_ctx->arr_foc[size]);
+	return focus_refine_next();
 }
 
 /*
- * extract lum (y) data from image
+ * refine sample
  * args:
- *    frame - image frame data pointer
- *    dataY - pointer for lum (y) data
- *    width - width of image frame (in pixels)
- *    height - height of image frame (in pixels)
+ *    focus - sampled focus value
+ *    sharpness - sampled sharpness
  *
  * asserts:
+ *    focus_ctx is not null
  *
- * returns: pointer to lum data buffer
+ * returns: next focus value
  */
-static int16_t *focus_extract_Y (uint8_t *frame, int16_t *dataY, int width, int height)
+static int focus_refine(int focus, int sharpness)
 {
-	int i = 0;
-	uint8_t *pimg;
-	pimg = frame;
+	focus_ctx_t *f = focus_ctx;
 
-	for (i = 0; i < (height * width); ++i)
+	if(sharpness > f->fb)
+	{
+		if(focus > f->b) { f->a = f->b; f->fa = f->fb; }
+		else { f->c = f->b; f->fc = f->fb; }
+		f->b = focus;
+		f->fb = sharpness;
+	}
+	else
 	{
-		dataY[i]=(int16_t) *pimg++; // luma
+		if(focus > f->b) { f->c = focus; f->fc = sharpness; }
+		else { f->a = focus; f->fa = sharpness; }
 	}
 
-	return (dataY);
+	return focus_refine_next();
 }
 
 /*
- * check focus
+ * start a coarse scan of the full focus range
+ *   (from the range end nearest to the current focus)
  * args:
  *    none
  *
  * asserts:
  *    focus_ctx is not null
  *
- * returns: focus code
+ * returns: next focus value
  */
-static int checkFocus()
+static int focus_scan_start()
 {
-	/*asserts*/
-	assert(focus_ctx != NULL);
+	focus_ctx->state = FOCUS_STATE_SCAN;
+	focus_ctx->scan_dir = (focus_ctx->last_focus - focus_ctx->f_min >
+		focus_ctx->f_max - focus_ctx->last_focus) ? -1 : 1;
+	focus_ctx->scan_ind = 0;
+	focus_ctx->scan_best = 0;
+
+	return focus_scan_pos(0);
+}
+
+/*
+ * coarse scan sample
+ * args:
+ *    sharpness - sampled sharpness
+ *
+ * asserts:
+ *    focus_ctx is not null
+ *
+ * returns: next focus value
+ */
+static int focus_scan(int sharpness)
+{
+	focus_ctx_t *f = focus_ctx;
+	int ind = f->scan_ind;
 
-	/*change treshold according to sharpness*/
-	int TH = _TH_;
-	//if(focus_ctx->focus_sharpness < (5 * _TH_)) TH = _TH_ * 4 ;
+	f->scan_sharp[ind] = sharpness;
+	if(sharpness > f->scan_sharp[f->scan_best])
+		f->scan_best = ind;
 
-	if (focus_ctx->step <= focus_ctx->i_step)
+	int best = f->scan_best;
+	double peak = f->scan_sharp[best];
+
+	/*continue until the end of range or past the peak (its neighbours bracket it)*/
+	if(ind + 1 < FOCUS_SCAN_POINTS &&
+		!(ind > best && (double) sharpness * 100 < peak * FOCUS_SCAN_FALL))
 	{
-		if (abs((focus_ctx->sharpLeft-focus_ctx->focus_sharpness)<(focus_ctx->focus_sharpness/TH)) &&
-			(abs(focus_ctx->sharpRight-focus_ctx->focus_sharpness)<(focus_ctx->focus_sharpness/TH)))
-		{
-			return (FLAT);
-		}
-		else if (((focus_ctx->focus_sharpness-focus_ctx->sharpRight))>=(focus_ctx->focus_sharpness/TH) &&
-			((focus_ctx->focus_sharpness-focus_ctx->sharpLeft))>=(focus_ctx->focus_sharpness/TH))
-		{
-			/*
-			 *  significantly down in both directions -> check another step
-			 *  outside for local maximum
-			 */
-			focus_ctx->step=16;
-			return (INCSTEP);
-		}
-		else
-		{
-			// one is significant, the other is not...
-			int left=0; int right=0;
-			if (abs((focus_ctx->sharpLeft-focus_ctx->focus_sharpness))>=(focus_ctx->focus_sharpness/TH))
-			{
-				if (focus_ctx->sharpLeft>focus_ctx->focus_sharpness) left++;
-				else right++;
-			}
-			if (abs((focus_ctx->sharpRight-focus_ctx->focus_sharpness))>=(focus_ctx->focus_sharpness/TH))
-			{
-				if (focus_ctx->sharpRight>focus_ctx->focus_sharpness) right++;
-				else left++;
-			}
-			if (left==right) return (FLAT);
-			else if (left>right) return (LEFT);
-			else return (RIGHT);
-		}
+		f->scan_ind++;
+		return focus_scan_pos(f->scan_ind);
+	}
+
+	/*bracket the peak with its neighbours*/
+	int n1 = (best > 0) ? best - 1 : best;
+	int n2 = (best < ind) ? best + 1 : best;
+	int p1 = focus_scan_pos(n1);
+	int p2 = focus_scan_pos(n2);
+
+	f->b = focus_scan_pos(best);
+	f->fb = f->scan_sharp[best];
+	if(p1 <= p2)
+	{
+		f->a = p1; f->fa = f->scan_sharp[n1];
+		f->c = p2; f->fc = f->scan_sharp[n2];
 	}
 	else
 	{
-		if (((focus_ctx->focus_sharpness-focus_ctx->sharpRight))>=(focus_ctx->focus_sharpness/TH) &&
-			((focus_ctx->focus_sharpness-focus_ctx->sharpLeft))>=(focus_ctx->focus_sharpness/TH))
-		{
-			return (LOCAL_MAX);
-		}
-		else
-		{
-			return (FLAT);
-		}
+		f->a = p2; f->fa = f->scan_sharp[n2];
+		f->c = p1; f->fc = f->scan_sharp[n1];
 	}
+
+	return focus_refine_start();
 }
 
 /*
- * measure sharpness in MCU
+ * start a local search around the current focus
  * args:
- *    data - MCU data [8x8]
- *    weight - MCU weight for sharpness measure.
+ *    focus - current focus value
+ *    sharpness - current sharpness
  *
  * asserts:
- *    none
+ *    focus_ctx is not null
  *
- * returns: none
+ * returns: next focus value
  */
-static void getSharpnessMCU (int16_t *data, double weight)
+static int focus_bracket_start(int focus, int sharpness)
 {
-
-	int i=0;
-	int j=0;
-
-	levelshift (data);
-	DCT (data);
-
-	for (i=0;i<8;i++)
-	{
-		for(j=0;j<8;j++)
-		{
-			sumAC[i*8+j]+=data[i*8+j]*data[i*8+j]*weight;
-		}
-	}
+	focus_ctx_t *f = focus_ctx;
+	int range = f->f_max - f->f_min;
+
+	f->state = FOCUS_STATE_BRACKET;
+	f->b = focus;
+	f->fb = sharpness;
+	f->expand = 0;
+	/*smaller probes while recording*/
+	f->delta = (track_mode == AUTOF_TRACK_QUIET) ? range/32 : range/16;
+	if(f->delta < f->tol)
+		f->delta = f->tol;
+
+	f->phase = BRACKET_RIGHT;
+	f->c = focus_snap(f->b + f->delta);
+	return f->c;
 }
 
 /*
- * sharpness in focus window
+ * local search sample
+ *   probes both sides of the current focus and expands the
+ *   bracket (golden ratio) towards the rising side
  * args:
- *    frame - pointer to image frame
- *    width - frame width
- *    height - frame height
- *    t - highest order coef
+ *    focus - sampled focus value
+ *    sharpness - sampled sharpness
  *
  * asserts:
- *    none
+ *    focus_ctx is not null
  *
- * returns: sharpness value
+ * returns: next focus value
  */
-int soft_autofocus_get_sharpness (uint8_t *frame, int width, int height, int t)
+static int focus_bracket(int focus, int sharpness)
 {
-	float res=0;
-	int numMCUx = width/(8*2); /*covers 1/2 of width - width should be even*/
-	int numMCUy = height/(8*2); /*covers 1/2 of height- height should be even*/
-	int16_t dataMCU[64];
-	int16_t* data;
-	int16_t *Y = calloc(width * height, sizeof(int16_t));
-
-	if(Y == NULL)
+	focus_ctx_t *f = focus_ctx;
+	int quiet = (track_mode == AUTOF_TRACK_QUIET);
+
+	switch(f->phase)
 	{
-		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (soft_autofocus_get_sharpness): %s\n", strerror(errno));
-		exit(-1);
+		case BRACKET_RIGHT:
+			f->c = focus;
+			f->fc = sharpness;
+			f->phase = BRACKET_LEFT;
+			f->a = focus_snap(f->b - f->delta);
+			return f->a;
+
+		case BRACKET_LEFT:
+		case BRACKET_EXPAND_LEFT:
+			f->a = focus;
+			f->fa = sharpness;
+			break;
+
+		case BRACKET_EXPAND_RIGHT:
+			f->c = focus;
+			f->fc = sharpness;
+			break;
 	}
 
-	double weight;
-	double xp_;
-	int ctx = numMCUx >> 1; /*center*/
-	int cty = numMCUy >> 1;
-	double rad=ctx/2;
-	if (cty<ctx) { rad=cty/2; }
-	rad=rad*rad;
-	int cnt2 =0;
-
-	data=dataMCU;
-
-	focus_extract_Y (frame, Y, width, height);
-
-	int i=0;
-	int j=0;
-	int xp=0;
-	int yp=0;
-	/*calculate MCU sharpness*/
-	for (yp=0;yp<numMCUy;yp++)
+	/*sides significantly sharper than b (above the frame noise)*/
+	double margin = (double) f->fb * (100 + FOCUS_SETTLE_TOL) / 100;
+	int rise_left = (f->fa > margin);
+	int rise_right = (f->fc > margin);
+
+	if(!rise_left && !rise_right)
 	{
-		double yp_=yp-cty;
-		for (xp=0;xp<numMCUx;xp++)
-		{
-			xp_=xp-ctx;
-			weight = exp(-(xp_*xp_)/rad-(yp_*yp_)/rad);
-			for (i=0;i<8;i++)
-			{
-				for(j=0;j<8;j++)
-				{
-					/*center*/
-					dataMCU[i*8+j]=Y[(((height-(numMCUy-(yp*2))*8)>>1)+i)*width
-						+(((width-(numMCUx-(xp*2))*8)>>1)+j)];
-				}
-			}
-			getSharpnessMCU(data,weight);
-			cnt2++;
-		}
+		/*flat: lost focus (defocused tail) - rescan*/
+		if((double) (f->fb - ((f->fa < f->fc) ? f->fa : f->fc)) * 100 <=
+			(double) f->fb * FOCUS_SETTLE_TOL)
+			return focus_scan_start();
+
+		/*peak bracketed (or at a range limit)*/
+		return focus_refine_start();
+	}
+
+	if(f->expand >= (quiet ? FOCUS_QUIET_EXPAND : FOCUS_EXPAND_MAX))
+	{
+		/*lost track: rescan (never while recording)*/
+		if(!quiet)
+			return focus_scan_start();
+
+		if(f->fa > f->fb) { f->b = f->a; f->fb = f->fa; }
+		if(f->fc > f->fb) { f->b = f->c; f->fb = f->fc; }
+		return focus_lock();
 	}
 
-	free(Y);
+	f->expand++;
+	f->delta = (int) (f->delta * FOCUS_EXPAND);
 
-	for (i=0;i<=t;i++)
+	if(rise_right && f->fc >= f->fa)
 	{
-		for(j=0;j<t;j++)
-		{
-			sumAC[i*8+j]/=(double) (cnt2); /*average = mean*/
-			res+=sumAC[i*8+j]*ACweight[i*8+j];
-		}
+		/*rising to the right*/
+		f->a = f->b; f->fa = f->fb;
+		f->b = f->c; f->fb = f->fc;
+		f->phase = BRACKET_EXPAND_RIGHT;
+		f->c = focus_snap(f->b + f->delta);
+		return f->c;
 	}
-	return (roundf(res*10)); /*round to int (4 digit precision)*/
+
+	/*rising to the left*/
+	f->c = f->b; f->fc = f->fb;
+	f->b = f->a; f->fb = f->fa;
+	f->phase = BRACKET_EXPAND_LEFT;
+	f->a = focus_snap(f->b - f->delta);
+	return f->a;
 }
 
 /*
- * get focus value
+ * tracking sample
+ *   refocus only if sharpness stays under the reference
+ *   (minus a hysteresis band) for a number of frames
  * args:
- *    none
+ *    focus - current focus value
+ *    sharpness - sampled sharpness
  *
  * asserts:
  *    focus_ctx is not null
  *
- * returns: focus code
+ * returns: next focus value
  */
-int soft_autofocus_get_focus_value()
+static int focus_track(int focus, int sharpness)
 {
-	int step = focus_ctx->i_step * 2;
-	int step2 = focus_ctx->i_step / 2;
-	if (step2 <= 0 ) step2 = 1;
-	int focus=0;
+	focus_ctx_t *f = focus_ctx;
+	int quiet = (track_mode == AUTOF_TRACK_QUIET);
+	int drop = quiet ? FOCUS_QUIET_DROP : FOCUS_TRACK_DROP;
+	int hold = quiet ? (int) (FOCUS_QUIET_HOLD / f->frame_ms) : FOCUS_TRACK_HOLD;
 
-	switch (focus_ctx->flag)
+	if(f->ref_sharpness < 0)
 	{
-		/*--------- first time - run sharpness algorithm -----------------*/
-		if(focus_ctx->ind >= 20)
-		{
-			fprintf (stderr, "V4L2_CORE: (soft_autofocus) ind=%d exceeds 20\n", focus_ctx->ind);
-			focus_ctx->ind = 10;
-		}
+		f->ref_sharpness = sharpness;
+		f->low_count = 0;
+		return focus;
+	}
 
-		case 0: /*sample left to right at higher step*/
-			focus_ctx->arr_sharp[focus_ctx->ind] = focus_ctx->sharpness;
-			focus_ctx->arr_foc[focus_ctx->ind] = focus_ctx->focus;
-			/*reached max focus value*/
-			if (focus_ctx->focus >= focus_ctx->right )
-			{	/*get left and right from arr_sharp*/
-				focus = focus_sort(focus_ctx->ind);
-				/*get a window around the best value*/
-				focus_ctx->left = (focus- step/2);
-				focus_ctx->right = (focus + step/2);
-				if (focus_ctx->left < focus_ctx->f_min) focus_ctx->left = focus_ctx->f_min;
-				if (focus_ctx->right > focus_ctx->f_max) focus_ctx->right = focus_ctx->f_max;
-				focus_ctx->focus = focus_ctx->left;
-				focus_ctx->ind = 0;
-				focus_ctx->flag = 1;
-			}
-			else /*increment focus*/
-			{
-				focus_ctx->focus=focus_ctx->arr_foc[focus_ctx->ind] + step; /*next focus*/
-				focus_ctx->ind++;
-				focus_ctx->flag = 0;
-			}
-			break;
+	if(f->cooldown > 0)
+		f->cooldown--;
 
-		case 1: /*sample left to right at lower step - fine tune*/
-			focus_ctx->arr_sharp[focus_ctx->ind] = focus_ctx->sharpness;
-			focus_ctx->arr_foc[focus_ctx->ind] = focus_ctx->focus;
-			/*reached window max focus*/
-			if (focus_ctx->focus >= focus_ctx->right )
-			{	/*get left and right from arr_sharp*/
-				focus = focus_sort(focus_ctx->ind);
-				/*get the best value*/
-				focus_ctx->focus = focus;
-				focus_ctx->focus_sharpness = focus_ctx->arr_sharp[focus_ctx->ind];
-				focus_ctx->step = focus_ctx->i_step; /*first step for focus tracking*/
-				focus_ctx->focusDir = FLAT; /*no direction for focus*/
-				focus_ctx->flag = 2;
-			}
-			else /*increment focus*/
-			{
-				focus_ctx->focus=focus_ctx->arr_foc[focus_ctx->ind] + step2; /*next focus*/
-				focus_ctx->ind++;
-				focus_ctx->flag = 1;
-			}
-			break;
+	if((double) sharpness * 100 < (double) f->ref_sharpness * (100 - drop))
+	{
+		f->low_count++;
+		if(f->low_count >= hold && f->cooldown <= 0)
+			return focus_bracket_start(focus, sharpness);
+	}
+	else
+	{
+		/*inside the band: follow slow scene changes*/
+		f->low_count = 0;
+		f->ref_sharpness += (int) (((double) sharpness - f->ref_sharpness) / 8);
+	}
 
-		case 2: /* set treshold in order to sharpness*/
-			if (focus_ctx->setFocus)
-			{
-				/*reset*/
-				focus_ctx->setFocus = 0;
-				focus_ctx->flag= 0;
-				focus_ctx->right = focus_ctx->f_max;
-				focus_ctx->left = focus_ctx->f_min + focus_ctx->i_step;
-				focus_ctx->ind = 0;
-			}
-			else
-			{
-				/*track focus*/
-				focus_ctx->focus_sharpness = focus_ctx->sharpness;
-				focus_ctx->flag = 3;
-				focus_ctx->sharpLeft = 0;
-				focus_ctx->sharpRight = 0;
-				focus_ctx->focus += focus_ctx->step; /*check right*/
-			}
-			break;
+	return focus;
+}
 
-		case 3:
-			/*track focus*/
-			focus_ctx->flag = 4;
-			focus_ctx->sharpRight = focus_ctx->sharpness;
-			focus_ctx->focus -= (2*focus_ctx->step); /*check left*/
-			break;
+/*
+ * process a sharpness sample at the current focus
+ * args:
+ *    sharpness - sampled sharpness
+ *
+ * asserts:
+ *    focus_ctx is not null
+ *
+ * returns: next focus value
+ */
+static int focus_search(int sharpness)
+{
+	int focus = focus_ctx->last_focus;
 
-		case 4:
-			/*track focus*/
-			focus_ctx->sharpLeft=focus_ctx->sharpness;
-			int ret=0;
-			ret = checkFocus();
+	switch(focus_ctx->state)
+	{
+		case FOCUS_STATE_SCAN:
+			return focus_scan(sharpness);
 
-			switch (ret)
-			{
-				case LOCAL_MAX:
-					focus_ctx->focus += focus_ctx->step; /*return to orig. focus*/
-					focus_ctx->step = focus_ctx->i_step;
-					focus_ctx->flag = 2;
-					break;
-
-				case FLAT:
-					if(focus_ctx->focusDir == FLAT)
-					{
-						focus_ctx->step = focus_ctx->i_step;
-						if(focus_ctx->focus_sharpness < 4 * _TH_)
-						{
-							/* 99% chance we lost focus     */
-							/* move focus to half the range */
-							focus_ctx->focus = focus_ctx->f_max / 2;
-						}
-						else
-						{
-							focus_ctx->focus += focus_ctx->step; /*return to orig. focus*/
-						}
-						focus_ctx->flag = 2;
-					}
-					else if (focus_ctx->focusDir == RIGHT)
-					{
-						focus_ctx->focus += 2*focus_ctx->step; /*go right*/
-						focus_ctx->step = focus_ctx->i_step;
-						focus_ctx->flag = 2;
-					}
-					else
-					{	/*go left*/
-						focus_ctx->step = focus_ctx->i_step;
-						focus_ctx->flag = 2;
-					}
-					break;
-
-				case RIGHT:
-					focus_ctx->focus += 2*focus_ctx->step; /*go right*/
-					focus_ctx->flag = 2;
-					break;
-
-				case LEFT:
-					/*keep focus on left*/
-					focus_ctx->flag = 2;
-					break;
-
-				case INCSTEP:
-					focus_ctx->focus += focus_ctx->step; /*return to orig. focus*/
-					focus_ctx->step = 2 * focus_ctx->i_step;
-					focus_ctx->flag = 2;
-					break;
-			}
-			break;
+		case FOCUS_STATE_BRACKET:
+			return focus_bracket(focus, sharpness);
+
+		case FOCUS_STATE_REFINE:
+			return focus_refine(focus, sharpness);
+
+		default:
+			return focus_track(focus, sharpness);
 	}
-	/*clip focus, right and left*/
-	focus_ctx->focus=(focus_ctx->focus > focus_ctx->f_max) ? focus_ctx->f_max : ((focus_ctx->focus < focus_ctx->f_min) ? focus_ctx->f_min : focus_ctx->focus);
-	focus_ctx->right=(focus_ctx->right > focus_ctx->f_max) ? focus_ctx->f_max : ((focus_ctx->right < focus_ctx->f_min) ? focus_ctx->f_min : focus_ctx->right);
-	focus_ctx->left =(focus_ctx->left > focus_ctx->f_max) ? focus_ctx->f_max : ((focus_ctx->left < focus_ctx->f_min) ? focus_ctx->f_min : focus_ctx->left);
+}
 
-	return focus_ctx->focus;
+/*
+ * sharpness in focus window
+ * args:
+ *    frame - pointer to image frame (yu12)
+ *    width - frame width
+ *    height - frame height
+ *
+ * asserts:
+ *    frame is not null
+ *
+ * returns: sharpness value
+ */
+int soft_autofocus_get_sharpness (uint8_t *frame, int width, int height)
+{
+	/*asserts*/
+	assert(frame != NULL);
+
+	int x = (width * focus_roi[0]) / 100;
+	int y = (height * focus_roi[1]) / 100;
+	int w = (width * focus_roi[2]) / 100;
+	int h = (height * focus_roi[3]) / 100;
+
+	/*keep one pixel border for the 3x3 kernels*/
+	if(x < 1)
+		x = 1;
+	if(y < 1)
+		y = 1;
+	if(x + w > width - 1)
+		w = width - 1 - x;
+	if(y + h > height - 1)
+		h = height - 1 - y;
+
+	if(w < 8 || h < 8)
+		return 0;
+
+	int step = focus_line_step;
+	if(step <= 0)
+		step = (w * h + FOCUS_MAX_SAMPLES - 1) / FOCUS_MAX_SAMPLES;
+
+	double res = focus_metrics[focus_metric](frame, width, x, y, w, h, step);
+
+	res *= 10; /*round to int (4 digit precision)*/
+	if(res > INT_MAX)
+		return INT_MAX;
+	return (int) lround(res);
 }
 
 /*
@@ -774,61 +956,51 @@ int soft_autofocus_run(v4l2_dev_t *vd, v4l2_frame_buff_t *frame)
 	if (focus_ctx->focus < 0)
 	{
 		/*starting autofocus*/
-		focus_ctx->focus = focus_ctx->left; /*start left*/
-
-		focus_ctx->focus_control->value = focus_ctx->focus;
-		if (v4l2core_set_control_value_by_id(vd, focus_ctx->focus_control->control.id) != 0)
-			fprintf(stderr, "V4L2_CORE: (sof_autofocus) couldn't set focus to %d\n", focus_ctx->focus);
-
-		/*number of frames until focus is stable*/
-		/*1.4 ms focus time - every 1 step*/
-		focus_ctx->focus_wait = (int) abs(focus_ctx->focus - focus_ctx->last_focus)*1.4/((1000*vd->fps_num)/vd->fps_denom)+1;
-        focus_ctx->last_focus = focus_ctx->focus;
+		focus_move(vd, focus_scan_start(), 1);
+		return (focus_ctx->setFocus);
 	}
-	else
+
+	if (focus_ctx->focus_wait > 0)
 	{
-		if (focus_ctx->focus_wait == 0)
-		{
-			focus_ctx->sharpness = soft_autofocus_get_sharpness (
-				frame->yuv_frame,
-				vd->format.fmt.pix.width,
-				vd->format.fmt.pix.height,
-				5);
-
-			if (verbosity > 1)
-				printf("V4L2_CORE: (sof_autofocus) sharp=%d focus_sharp=%d foc=%d right=%d left=%d ind=%d flag=%d\n",
-					focus_ctx->sharpness,
-					focus_ctx->focus_sharpness,
-					focus_ctx->focus,
-					focus_ctx->right,
-					focus_ctx->left,
-					focus_ctx->ind,
-					focus_ctx->flag);
-
-			focus_ctx->focus = soft_autofocus_get_focus_value();
-
-			if ((focus_ctx->focus != focus_ctx->last_focus))
-			{
-				focus_ctx->focus_control->value = focus_ctx->focus;
-				if (v4l2core_set_control_value_by_id(vd, focus_ctx->focus_control->control.id) != 0)
-					fprintf(stderr, "V4L2_CORE: (sof_autofocus) couldn't set focus to %d\n",
-						focus_ctx->focus);
-
-				/*number of frames until focus is stable*/
-				/*1.4 ms focus time - every 1 step*/
-				focus_ctx->focus_wait = (int) abs(focus_ctx->focus - focus_ctx->last_focus)*1.4/((1000*vd->fps_num)/vd->fps_denom)+1;
-			}
-			focus_ctx->last_focus = focus_ctx->focus;
-		}
-		else
-		{
-			focus_ctx->focus_wait--;
-			if (verbosity > 1)
-				printf("V4L2_CORE: (soft_autofocus) Wait Frame: %d\n",
-					focus_ctx->focus_wait);
-		}
+		focus_ctx->focus_wait--;
+		if (verbosity > 1)
+			printf("V4L2_CORE: (soft_autofocus) Wait Frame: %d\n",
+				focus_ctx->focus_wait);
+		return (focus_ctx->setFocus);
 	}
 
+	focus_ctx->sharpness = soft_autofocus_get_sharpness (
+		frame->yuv_frame,
+		vd->format.fmt.pix.width,
+		vd->format.fmt.pix.height);
+
+	if (focus_ctx->settle_measure && !focus_settled(focus_ctx->sharpness))
+		return (focus_ctx->setFocus);
+
+	int state = focus_ctx->state;
+	int focus = focus_search(focus_ctx->sharpness);
+
+	/*probes at the current focus reuse this sample*/
+	int i = 0;
+	while (focus == focus_ctx->last_focus &&
+		focus_ctx->state != FOCUS_STATE_TRACK && i++ < 8)
+		focus = focus_search(focus_ctx->sharpness);
+
+	if (verbosity > 1 && (state != FOCUS_STATE_TRACK || focus != focus_ctx->last_focus))
+		printf("V4L2_CORE: (soft_autofocus) sharp=%d foc=%d next=%d a=%d b=%d c=%d state=%d->%d\n",
+			focus_ctx->sharpness,
+			focus_ctx->last_focus,
+			focus,
+			focus_ctx->a,
+			focus_ctx->b,
+			focus_ctx->c,
+			state,
+			focus_ctx->state);
+
+	if (focus != focus_ctx->last_focus)
+		/*measure the lens settle on lock - the first tracking sample is the reference*/
+		focus_move(vd, focus, focus_ctx->state == FOCUS_STATE_TRACK);
+
 	return (focus_ctx->setFocus);
 }
 
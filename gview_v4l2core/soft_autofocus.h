@@ -22,7 +22,7 @@
 
 /*******************************************************************************#
 #                                                                               #
-#  autofocus - using dct for sharpness measure                                  #
+#  autofocus - model based search on a pluggable sharpness measure              #
 #                                                                               #
 #                                                                               #
 ********************************************************************************/
@@ -63,28 +63,15 @@ int soft_autofocus_run(v4l2_dev_t *vd, v4l2_frame_buff_t *frame);
 /*
  * sharpness in focus window
  * args:
- *    frame - pointer to image frame
+ *    frame - pointer to image frame (yu12)
  *    width - frame width
  *    height - frame height
- *    t - highest order coef
  *
  * asserts:
- *    none
+ *    frame is not null
  *
  * returns: sharpness value
  */
-int soft_autofocus_get_sharpness (uint8_t *frame, int width, int height, int t);
-
-/*
- * get focus value
- * args:
- *    none
- *
- * asserts:
- *    focus_ctx is not null
- *
- * returns: focus code
- */
-int soft_autofocus_get_focus_value ();
+int soft_autofocus_get_sharpness (uint8_t *frame, int width, int height);
 
 #endif
\ No newline at end of file
@@ -91,6 +91,21 @@ int h264_get_support()
 	return h264_support;
 }
 
+/*
+ * set h264 support type (offline decoding - no device to probe)
+ * args:
+ *    type - support type (H264_NONE; H264_MUXED; H264_FRAME)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void h264_set_support(int type)
+{
+	h264_support = type;
+}
+
 /*
  * print probe/commit data
  * args:
@@ -255,6 +255,18 @@ typedef struct _uvcx_qp_steps_layers_t
  */
 int h264_get_support();
 
+/*
+ * set h264 support type (offline decoding - no device to probe)
+ * args:
+ *    type - support type (H264_NONE; H264_MUXED; H264_FRAME)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void h264_set_support(int type);
+
 /*
  * gets the uvc h264 xu control unit id, if any
  * args:
@@ -36,6 +36,8 @@
 #include "v4l2_devices.h"
 #include "v4l2_controls.h"
 #include "v4l2_xu_ctrls.h"
+#include "control_cache.h"
+#include "core_time.h"
 #include "../config.h"
 
 #ifndef V4L2_CTRL_ID2CLASS
@@ -43,6 +45,7 @@
 #endif
 
 extern int verbosity;
+extern uint8_t disable_libv4l2;
 
 // GUID for logitech peripheral (pan/tilt) V3 extension unit: {FFE52D21-8030-4E2C-82d9-f587d00540bd}
 #define GUID_LOGITECH_PERIPHERAL_XU {0x21, 0x2D, 0xE5, 0xFF, 0x30, 0x80, 0x2C, 0x4E, 0x82, 0xD9, 0xF5, 0x87, 0xD0, 0x05, 0x40, 0xBD}
@@ -151,6 +154,92 @@ static int query_ioctl(v4l2_dev_t *vd, int current_ctrl, struct v4l2_queryctrl*
     return(ret);
 }
 
+#ifdef VIDIOC_QUERY_EXT_CTRL
+/*
+ * extended control query (walks basic and compound controls)
+ * args:
+ *   vd - pointer to video device data
+ *   current_ctrl - current control id
+ *   ctrl - pointer to v4l2_query_ext_ctrl data
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid ( > 0 )
+ *   ctrl is not null
+ *
+ * returns: error code
+ */
+static int query_ext_ioctl(v4l2_dev_t *vd, int current_ctrl, struct v4l2_query_ext_ctrl* ctrl)
+{
+	/*assertions*/
+	assert(vd != NULL);
+	assert(vd->fd > 0);
+	assert(ctrl != NULL);
+
+	int ret = 0;
+	int tries = 4;
+	do
+	{
+		if(ret)
+			ctrl->id = current_ctrl | V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+		ret = ioctl(vd->fd, VIDIOC_QUERY_EXT_CTRL, ctrl);
+	}
+	while (ret && tries-- &&
+		((errno == EIO || errno == EPIPE || errno == ETIMEDOUT)));
+
+	return(ret);
+}
+
+/*
+ * convert extended control query data to v4l2_queryctrl
+ *  (same conversion as VIDIOC_QUERYCTRL in the kernel)
+ * args:
+ *   query_ext - pointer to v4l2_query_ext_ctrl data
+ *   queryctrl - pointer to v4l2_queryctrl data
+ *
+ * asserts:
+ *   query_ext is not null
+ *   queryctrl is not null
+ *
+ * returns: error code (-1 for compound and array controls)
+ */
+static int query_ext_to_queryctrl(struct v4l2_query_ext_ctrl* query_ext, struct v4l2_queryctrl* queryctrl)
+{
+	/*assertions*/
+	assert(query_ext != NULL);
+	assert(queryctrl != NULL);
+
+	if(query_ext->type >= V4L2_CTRL_COMPOUND_TYPES || query_ext->nr_of_dims > 0)
+		return -1;
+
+	memset(queryctrl, 0, sizeof(struct v4l2_queryctrl));
+	queryctrl->id = query_ext->id;
+	queryctrl->type = query_ext->type;
+	queryctrl->flags = query_ext->flags;
+	strncpy((char *) queryctrl->name, query_ext->name, sizeof(queryctrl->name) - 1);
+
+	switch(queryctrl->type)
+	{
+		case V4L2_CTRL_TYPE_INTEGER:
+		case V4L2_CTRL_TYPE_BOOLEAN:
+		case V4L2_CTRL_TYPE_MENU:
+		case V4L2_CTRL_TYPE_INTEGER_MENU:
+		case V4L2_CTRL_TYPE_STRING:
+		case V4L2_CTRL_TYPE_BITMASK:
+			queryctrl->minimum = query_ext->minimum;
+			queryctrl->maximum = query_ext->maximum;
+			queryctrl->step = query_ext->step;
+			queryctrl->default_value = query_ext->default_value;
+			break;
+		default:
+			/*64 bit ranges don't fit*/
+			break;
+	}
+
+	return 0;
+}
+#endif
+
 /*
  * output control data
  * args:
@@ -289,6 +378,7 @@ static uint8_t get_logitech_peripheral_unit_id (v4l2_dev_t *vd)
 
 /*
  * subscribe for v4l2 control events
+ *  (including the ones caused by our own control writes)
  * args:
  *  vd - pointer to video device data
  *  control_id - id of control to subscribe events for
@@ -296,18 +386,21 @@ static uint8_t get_logitech_peripheral_unit_id (v4l2_dev_t *vd)
  * asserts:
  *  vd is not null
  *
- * return: none
+ * return: ioctl result
  */
-void v4l2_subscribe_control_events(v4l2_dev_t *vd, unsigned int control_id)
+int v4l2_subscribe_control_events(v4l2_dev_t *vd, unsigned int control_id)
 {
 	vd->evsub.type = V4L2_EVENT_CTRL;
 	vd->evsub.id = control_id;
+	vd->evsub.flags = V4L2_EVENT_SUB_FL_ALLOW_FEEDBACK;
 
 	int ret = xioctl(vd->fd, VIDIOC_SUBSCRIBE_EVENT, &vd->evsub);
 
 	if(ret)
 		fprintf(stderr, "V4L2_CORE: failed to subscribe events for control 0x%08x: %s\n",
 			control_id, strerror(errno));
+
+	return ret;
 }
 
 /*
@@ -333,100 +426,95 @@ void v4l2_unsubscribe_control_events(v4l2_dev_t *vd)
 }
 
 /*
- * add control to control list
+ * query the menu items of a menu control
  * args:
  *   vd - pointer to video device data
  *   queryctrl - pointer to v4l2_queryctrl data
- *   current - pointer to pointer of current control from control list
- *   first - pointer to pointer of first control from control list
+ *   menu_entries - pointer to number of valid menu items (set on return)
  *
  * asserts:
  *   vd is not null
  *   vd->fd is valid
  *   queryctrl is not null
+ *   menu_entries is not null
  *
- * returns: pointer to newly added control
+ * returns: pointer to menu list, terminated by an entry with index
+ *   queryctrl->maximum + 1 (NULL if not a menu control)
  */
-static v4l2_ctrl_t *add_control(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl, v4l2_ctrl_t **current, v4l2_ctrl_t **first)
+static struct v4l2_querymenu *query_control_menu(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl, int *menu_entries)
 {
 	/*assertions*/
 	assert(vd != NULL);
 	assert(vd->fd > 0);
 	assert(queryctrl != NULL);
-	int menu_entries = 0;
-
-	v4l2_ctrl_t *control = NULL;
-	struct v4l2_querymenu* menu = NULL; //menu list
-	struct v4l2_querymenu* old_menu = menu; //temp menu list pointer
-	
-	if (queryctrl->flags & V4L2_CTRL_FLAG_DISABLED)
-	{
-		printf("V4L2_CORE: Control 0x%08x is disabled: remove it from control list\n", queryctrl->id);
-		return NULL;
-	}
-
-	//check menu items if needed
-    if(queryctrl->type == V4L2_CTRL_TYPE_MENU
-		|| queryctrl->type == V4L2_CTRL_TYPE_INTEGER_MENU )
-    {
-        int i = 0;
-        struct v4l2_querymenu querymenu={0};
+	assert(menu_entries != NULL);
 
-        for (querymenu.index = queryctrl->minimum;
-            querymenu.index <= queryctrl->maximum;
-            querymenu.index++)
-        {
-            querymenu.id = queryctrl->id;
-            if (xioctl (vd->fd, VIDIOC_QUERYMENU, &querymenu) < 0)
-                continue;
+	*menu_entries = 0;
 
-	        old_menu = menu;
+	if(queryctrl->type != V4L2_CTRL_TYPE_MENU &&
+		queryctrl->type != V4L2_CTRL_TYPE_INTEGER_MENU)
+		return NULL;
 
-			if(!menu)
-                menu = calloc(i+1, sizeof(struct v4l2_querymenu));
-            else
-                menu = realloc(menu, (i+1) * sizeof(struct v4l2_querymenu));
+	/*allocate the full index range (plus the last entry) at once*/
+	int64_t range = (int64_t) queryctrl->maximum - queryctrl->minimum + 1;
+	if(range < 0)
+		range = 0;
 
-            if(menu == NULL)
-			{
-				/*since we exit on failure there was no need to free any previous */
-				/* menu allocation (realloc), but silence cppcheck anyway */
-				if(old_menu)
-					free(old_menu);
+	struct v4l2_querymenu *menu = calloc(range + 1, sizeof(struct v4l2_querymenu));
+	if(menu == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (query_control_menu): %s\n", strerror(errno));
+		exit(-1);
+	}
 
-				fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control): %s\n", strerror(errno));
-				exit(-1);
-			}
+	int i = 0;
+	struct v4l2_querymenu querymenu={0};
 
-            memcpy(&(menu[i]), &querymenu, sizeof(struct v4l2_querymenu));
-            i++;
-        }
+	for (querymenu.index = queryctrl->minimum;
+		querymenu.index <= queryctrl->maximum;
+		querymenu.index++)
+	{
+		querymenu.id = queryctrl->id;
+		if (xioctl (vd->fd, VIDIOC_QUERYMENU, &querymenu) < 0)
+			continue;
 
-		old_menu = menu;
+		memcpy(&(menu[i]), &querymenu, sizeof(struct v4l2_querymenu));
+		i++;
+	}
 
-		/*last entry (NULL name)*/
-        if(!menu)
-            menu = calloc(i+1, sizeof(struct v4l2_querymenu));
-        else
-            menu = realloc(menu, (i+1) * sizeof(struct v4l2_querymenu));	
+	/*last entry (NULL name)*/
+	menu[i].id = queryctrl->id;
+	menu[i].index = queryctrl->maximum+1;
 
-		if(menu == NULL)
-		{
-			/*since we exit on failure there was no need to free any previous */
-			/* menu allocation (realloc), but silence cppcheck anyway */
-			if(old_menu)
-				free(old_menu);
+	*menu_entries = i;
+	return menu;
+}
 
-			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control): %s\n", strerror(errno));
-			exit(-1);
-		}
+/*
+ * add a control descriptor to control list
+ * args:
+ *   vd - pointer to video device data
+ *   queryctrl - pointer to v4l2_queryctrl data
+ *   menu - pointer to menu list (NULL if not a menu) - the control takes ownership
+ *   menu_entries - number of valid menu items
+ *   current - pointer to pointer of current control from control list
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *   queryctrl is not null
+ *
+ * returns: pointer to newly added control
+ */
+v4l2_ctrl_t *add_control_descriptor(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl,
+	struct v4l2_querymenu* menu, int menu_entries, v4l2_ctrl_t **current)
+{
+	/*assertions*/
+	assert(vd != NULL);
+	assert(vd->fd > 0);
+	assert(queryctrl != NULL);
 
-        menu[i].id = querymenu.id;
-        menu[i].index = queryctrl->maximum+1;
-        if(queryctrl->type == V4L2_CTRL_TYPE_MENU)
-			menu[i].name[0] = 0;
-		menu_entries = i;
-    }
+	v4l2_ctrl_t *control = NULL;
 
     /*check for focus control to enable software autofocus*/
     if(queryctrl->id == V4L2_CID_FOCUS_LOGITECH ||
@@ -444,7 +532,7 @@ static v4l2_ctrl_t *add_control(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl
     control = calloc (1, sizeof(v4l2_ctrl_t));
     if(control == NULL)
 	{
-		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control): %s\n", strerror(errno));
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control_descriptor): %s\n", strerror(errno));
 		exit(-1);
 	}
     memcpy(&(control->control), queryctrl, sizeof(struct v4l2_queryctrl));
@@ -458,7 +546,7 @@ static v4l2_ctrl_t *add_control(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl
 		control->menu_entry = calloc(menu_entries, sizeof(char *));
 		if(control->menu_entry == NULL)
 		{
-			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control): %s\n", strerror(errno));
+			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control_descriptor): %s\n", strerror(errno));
 			exit(-1);
 		}
 		for(i = 0; i< menu_entries; i++)
@@ -476,368 +564,628 @@ static v4l2_ctrl_t *add_control(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl
         control->string = (char *) calloc (control->control.maximum + 1, sizeof(char));
         if(control->string == NULL)
 		{
-			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control): %s\n", strerror(errno));
+			fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (add_control_descriptor): %s\n", strerror(errno));
 			exit(-1);
 		}
     }
     else
         control->string = NULL;
 
-    if(*first != NULL)
+    if(vd->list_device_controls != NULL)
     {
         (*current)->next = control;
         *current = control;
     }
     else
     {
-		*first = control;
-        *current = *first;
+		vd->list_device_controls = control;
+        *current = control;
     }
 
-	//subscribe control events
-	v4l2_subscribe_control_events(vd, queryctrl->id);
+	//subscribe control events (the cache can only rely on events if all controls have them)
+	if(v4l2_subscribe_control_events(vd, queryctrl->id) != 0)
+		vd->ctrl_event_cache = 0;
 
     return control;
 }
 
 /*
- * enumerate device (read/write) controls
+ * add control to control list (queries the menu items if needed)
  * args:
  *   vd - pointer to video device data
+ *   queryctrl - pointer to v4l2_queryctrl data
+ *   current - pointer to pointer of current control from control list
  *
  * asserts:
  *   vd is not null
- *   vd->fd is valid ( > 0 )
- *   vd->list_device_controls is null
+ *   vd->fd is valid
+ *   queryctrl is not null
  *
- * returns: error code
+ * returns: pointer to newly added control
  */
-int enumerate_v4l2_control(v4l2_dev_t *vd)
+static v4l2_ctrl_t *add_control(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl, v4l2_ctrl_t **current)
 {
-    /*assertions*/
-    assert(vd != NULL);
-    assert(vd->fd > 0);
-    assert(vd->list_device_controls == NULL);
-
-    int ret=0;
-    v4l2_ctrl_t *current = NULL;
-
-    int n = 0;
-    struct v4l2_queryctrl queryctrl={0};
-
-    int currentctrl = 0;
-    queryctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
-
-	/*try the next_flag method first*/
-	while ((ret=query_ioctl(vd, currentctrl, &queryctrl)) == 0)
-	{
-		if(add_control(vd, &queryctrl, &current, &(vd->list_device_controls)) != NULL)
-            n++;
-
-        currentctrl = queryctrl.id;
-
-		queryctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
-	}
-
-	if (queryctrl.id != V4L2_CTRL_FLAG_NEXT_CTRL)
-	{
-		vd->num_controls = n;
-		if(verbosity > 0)
-			print_control_list(vd);
-		return E_OK;
-	}
-
-	if(ret)
-		fprintf(stderr, "V4L2_CORE: Control 0x%08x failed to query with error %i\n", queryctrl.id, ret);
-
-	printf("buggy V4L2_CTRL_FLAG_NEXT_CTRL flag implementation (workaround enabled)\n");
+	/*assertions*/
+	assert(vd != NULL);
+	assert(vd->fd > 0);
+	assert(queryctrl != NULL);
 
-	/*
-	 * next_flag method failed, loop through the ids:
-	 *
-	 * USER CLASS Controls
-	 */
-	for (currentctrl = V4L2_CID_USER_BASE; currentctrl < V4L2_CID_LASTP1; currentctrl++)
-	{
-		queryctrl.id = currentctrl;
-		if (xioctl(vd->fd, VIDIOC_QUERYCTRL, &queryctrl) == 0)
-		{
-			if(add_control(vd, &queryctrl, &current, &(vd->list_device_controls)) != NULL)
-				n++;
-		}
-	}
-	/* CAMERA CLASS Controls */
-	for (currentctrl = V4L2_CID_CAMERA_CLASS_BASE; currentctrl < V4L2_CID_CAMERA_CLASS_BASE+32; currentctrl++)
-	{
-		queryctrl.id = currentctrl;
-		if (xioctl(vd->fd, VIDIOC_QUERYCTRL, &queryctrl) == 0)
-		{
-			if(add_control(vd, &queryctrl, &current, &(vd->list_device_controls)) != NULL)
-				n++;
-		}
-	}
-	/* PRIVATE controls (deprecated) */
-	for (queryctrl.id = V4L2_CID_PRIVATE_BASE;
-		 xioctl(vd->fd, VIDIOC_QUERYCTRL, &queryctrl) == 0; queryctrl.id++)
+	if (queryctrl->flags & V4L2_CTRL_FLAG_DISABLED)
 	{
-		if(add_control(vd, &queryctrl, &current, &(vd->list_device_controls)) != NULL)
-            n++;
+		printf("V4L2_CORE: Control 0x%08x is disabled: remove it from control list\n", queryctrl->id);
+		return NULL;
 	}
 
-    vd->num_controls = n;
-
-    if(verbosity > 0)
-		print_control_list(vd);
+	int menu_entries = 0;
+	struct v4l2_querymenu* menu = query_control_menu(vd, queryctrl, &menu_entries);
 
-	return E_OK;
+	return add_control_descriptor(vd, queryctrl, menu, menu_entries, current);
 }
 
 /*
- * update the control flags - called when setting controls
- * FIXME: use control events
- *
+ * hash a control id into the control registry index
  * args:
- *   vd - pointer to video device data
  *   id - control id
+ *   mask - index size - 1 (index size is a power of 2)
  *
  * asserts:
- *   vd is not null
+ *   none
  *
- * returns: error code
+ * returns: index slot for id
  */
-static void update_ctrl_flags(v4l2_dev_t *vd, int id)
+static int ctrl_index_hash(uint32_t id, uint32_t mask)
 {
-	/*asserts*/
-	assert(vd != NULL);
-
-    switch (id)
-    {
-        case V4L2_CID_EXPOSURE_AUTO:
-            {
-                v4l2_ctrl_t *ctrl_this = v4l2core_get_control_by_id(vd, id);
-                if(ctrl_this == NULL)
-                    break;
-
-                switch (ctrl_this->value)
-                {
-                    case V4L2_EXPOSURE_AUTO:
-                        {
-                            v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-								vd, V4L2_CID_IRIS_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_IRIS_RELATIVE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_EXPOSURE_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                        }
-                        break;
-
-                    case V4L2_EXPOSURE_APERTURE_PRIORITY:
-                        {
-                            v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_EXPOSURE_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_IRIS_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_IRIS_RELATIVE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                        }
-                        break;
-
-                    case V4L2_EXPOSURE_SHUTTER_PRIORITY:
-                        {
-                            v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_IRIS_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_IRIS_RELATIVE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_EXPOSURE_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                        }
-                        break;
-
-                    default:
-                        {
-                            v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_EXPOSURE_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_IRIS_ABSOLUTE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                            ctrl_that = v4l2core_get_control_by_id(
-                                vd, V4L2_CID_IRIS_RELATIVE );
-                            if (ctrl_that)
-                                ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                        }
-                        break;
-                }
-            }
-            break;
-
-        case V4L2_CID_FOCUS_AUTO:
-            {
-                v4l2_ctrl_t *ctrl_this = v4l2core_get_control_by_id(vd, id);
-                if(ctrl_this == NULL)
-                    break;
-                if(ctrl_this->value > 0)
-                {
-                    v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_FOCUS_ABSOLUTE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-
-                    ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_FOCUS_RELATIVE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                }
-                else
-                {
-                    v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_FOCUS_ABSOLUTE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-
-                    ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_FOCUS_RELATIVE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                }
-            }
-            break;
-
-        case V4L2_CID_HUE_AUTO:
-            {
-                v4l2_ctrl_t *ctrl_this = v4l2core_get_control_by_id(vd, id);
-                if(ctrl_this == NULL)
-                    break;
-                if(ctrl_this->value > 0)
-                {
-                    v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_HUE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                }
-                else
-                {
-                    v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_HUE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                }
-            }
-            break;
-
-        case V4L2_CID_AUTO_WHITE_BALANCE:
-            {
-                v4l2_ctrl_t *ctrl_this = v4l2core_get_control_by_id(vd, id);
-                if(ctrl_this == NULL)
-                    break;
+	id ^= id >> 16;
+	id *= 0x45d9f3b;
+	id ^= id >> 16;
 
-                if(ctrl_this->value > 0)
-                {
-                    v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_WHITE_BALANCE_TEMPERATURE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                    ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_BLUE_BALANCE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                    ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_RED_BALANCE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags |= V4L2_CTRL_FLAG_GRABBED;
-                }
-                else
-                {
-                    v4l2_ctrl_t *ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_WHITE_BALANCE_TEMPERATURE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                    ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_BLUE_BALANCE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                    ctrl_that = v4l2core_get_control_by_id(
-                        vd, V4L2_CID_RED_BALANCE);
-                    if (ctrl_that)
-                        ctrl_that->control.flags &= !(V4L2_CTRL_FLAG_GRABBED);
-                }
-            }
-            break;
-    }
+	return (int) (id & mask);
 }
 
 /*
- * update flags of entire control list
+ * get the class group index for control class
  * args:
  *   vd - pointer to video device data
+ *   cclass - control class
  *
  * asserts:
  *   vd is not null
  *
- * returns: void
+ * returns: class group index or -1 if not found
  */
-static void update_ctrl_list_flags(v4l2_dev_t *vd)
+static int get_ctrl_class_index(v4l2_dev_t *vd, int32_t cclass)
 {
-	/*asserts*/
-	assert(vd != NULL);
-
-    v4l2_ctrl_t *current = vd->list_device_controls;
+	int i = 0;
+	for(i = 0; i < vd->num_ctrl_classes; i++)
+		if(vd->ctrl_classes[i].cclass == cclass)
+			return i;
 
-    for(; current != NULL; current = current->next)
-        update_ctrl_flags(vd, current->control.id);
+	return -1;
 }
 
 /*
- * Disables special auto-controls with higher IDs than
- * their absolute/relative counterparts
- * this is needed before restoring controls state
- *
+ * build the control registry from the enumerated control list:
+ *  moves the controls into a contiguous array grouped by class
+ *  (keeping the enumeration order inside each class), relinks the
+ *  list and builds the id hash index
  * args:
  *   vd - pointer to video device data
- *   id - control id
  *
  * asserts:
  *   vd is not null
  *
  * returns: void
  */
-void disable_special_auto (v4l2_dev_t *vd, int id)
+static void build_control_registry(v4l2_dev_t *vd)
 {
 	/*asserts*/
 	assert(vd != NULL);
 
-    v4l2_ctrl_t *current = v4l2core_get_control_by_id(vd, id);
-    if(current && ((id == V4L2_CID_FOCUS_AUTO) || (id == V4L2_CID_HUE_AUTO)))
-    {
-        current->value = 0;
+	int n = vd->num_controls;
+	int i = 0;
+
+	vd->ctrl_generation = 1;
+
+	if(n <= 0 || vd->list_device_controls == NULL)
+		return;
+
+	/*class groups (in order of first appearance)*/
+	vd->ctrl_classes = calloc(n, sizeof(v4l2_ctrl_class_t));
+	if(vd->ctrl_classes == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (build_control_registry): %s\n", strerror(errno));
+		exit(-1);
+	}
+	vd->num_ctrl_classes = 0;
+
+	v4l2_ctrl_t *current = vd->list_device_controls;
+	for(; current != NULL; current = current->next)
+	{
+		int k = get_ctrl_class_index(vd, current->cclass);
+		if(k < 0)
+		{
+			k = vd->num_ctrl_classes++;
+			vd->ctrl_classes[k].cclass = current->cclass;
+		}
+		vd->ctrl_classes[k].count++;
+	}
+
+	int fill[vd->num_ctrl_classes];
+	for(i = 0; i < vd->num_ctrl_classes; i++)
+	{
+		vd->ctrl_classes[i].first = (i > 0) ?
+			vd->ctrl_classes[i-1].first + vd->ctrl_classes[i-1].count : 0;
+		fill[i] = 0;
+	}
+
+	/*move the controls into the contiguous array*/
+	v4l2_ctrl_t *array = calloc(n, sizeof(v4l2_ctrl_t));
+	if(array == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (build_control_registry): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	current = vd->list_device_controls;
+	while(current != NULL)
+	{
+		v4l2_ctrl_t *next = current->next;
+		int k = get_ctrl_class_index(vd, current->cclass);
+		int pos = vd->ctrl_classes[k].first + fill[k]++;
+
+		memcpy(&array[pos], current, sizeof(v4l2_ctrl_t));
+		free(current);
+		current = next;
+	}
+
+	for(i = 0; i < n; i++)
+	{
+		array[i].next = (i < n - 1) ? &array[i+1] : NULL;
+		array[i].generation = vd->ctrl_generation;
+	}
+
+	vd->list_device_controls = array;
+
+	/*control write queue flags*/
+	vd->ctrl_queued = calloc(n, sizeof(uint8_t));
+	if(vd->ctrl_queued == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (build_control_registry): %s\n", strerror(errno));
+		exit(-1);
+	}
+	vd->ctrl_queue_count = 0;
+
+	/*id hash index (load factor <= 0.5)*/
+	vd->ctrl_index_size = 16;
+	while(vd->ctrl_index_size < 2 * n)
+		vd->ctrl_index_size <<= 1;
+
+	vd->ctrl_index = calloc(vd->ctrl_index_size, sizeof(v4l2_ctrl_t *));
+	if(vd->ctrl_index == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (build_control_registry): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	uint32_t mask = vd->ctrl_index_size - 1;
+	for(i = 0; i < n; i++)
+	{
+		int slot = ctrl_index_hash(array[i].control.id, mask);
+		while(vd->ctrl_index[slot] != NULL)
+			slot = (slot + 1) & mask;
+		vd->ctrl_index[slot] = &array[i];
+	}
+
+	if(verbosity > 1)
+		printf("V4L2_CORE: control registry with %i controls in %i classes (%s cache)\n",
+			n, vd->num_ctrl_classes, vd->ctrl_event_cache ? "event driven" : "polled");
+}
+
+/*
+ * mark control as changed (sets a new registry generation for it)
+ * args:
+ *   vd - pointer to video device data
+ *   control - pointer to changed control
+ *
+ * asserts:
+ *   vd is not null
+ *   control is not null
+ *
+ * returns: void
+ */
+void mark_control_changed(v4l2_dev_t *vd, v4l2_ctrl_t *control)
+{
+	/*asserts*/
+	assert(vd != NULL);
+	assert(control != NULL);
+
+	/*controls are changed from both the gui and the capture threads*/
+	control->generation = __atomic_add_fetch(&vd->ctrl_generation, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * remove control from the control write queue
+ * args:
+ *   vd - pointer to video device data
+ *   control - pointer to control
+ *
+ * asserts:
+ *   vd is not null
+ *   control is not null
+ *
+ * returns: void
+ */
+static void dequeue_control(v4l2_dev_t *vd, v4l2_ctrl_t *control)
+{
+	if(vd->ctrl_queued == NULL)
+		return;
+
+	int pos = control - vd->list_device_controls;
+
+	__LOCK_MUTEX(&(vd->ctrl_queue_mutex));
+	if(vd->ctrl_queued[pos])
+	{
+		vd->ctrl_queued[pos] = 0;
+		vd->ctrl_queue_count--;
+	}
+	__UNLOCK_MUTEX(&(vd->ctrl_queue_mutex));
+}
+
+/*
+ * check if control has a pending write in the control write queue
+ * args:
+ *   vd - pointer to video device data
+ *   control - pointer to control
+ *
+ * asserts:
+ *   none
+ *
+ * returns: 1 if queued, 0 otherwise
+ */
+static int control_is_queued(v4l2_dev_t *vd, v4l2_ctrl_t *control)
+{
+	if(vd->ctrl_queued == NULL)
+		return 0;
+
+	__LOCK_MUTEX(&(vd->ctrl_queue_mutex));
+	int queued = vd->ctrl_queued[control - vd->list_device_controls];
+	__UNLOCK_MUTEX(&(vd->ctrl_queue_mutex));
+
+	return queued;
+}
+
+/*
+ * register the enumerated control list: builds the control registry
+ *  and saves the control descriptors into the cache file (if any)
+ * args:
+ *   vd - pointer to video device data
+ *   n - number of controls in list
+ *   cache_file - cache file name (NULL if none) - it's freed
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: error code
+ */
+static int register_control_list(v4l2_dev_t *vd, int n, char *cache_file)
+{
+	/*assertions*/
+	assert(vd != NULL);
+
+	vd->num_controls = n;
+	build_control_registry(vd);
+
+	if(cache_file != NULL)
+	{
+		if(n > 0)
+			save_control_cache(vd, cache_file);
+		free(cache_file);
+	}
+
+	if(verbosity > 0)
+		print_control_list(vd);
+
+	return E_OK;
+}
+
+/*
+ * enumerate device (read/write) controls
+ *  from the control descriptor cache (if enabled) or with
+ *  VIDIOC_QUERY_EXT_CTRL / VIDIOC_QUERYCTRL (V4L2_CTRL_FLAG_NEXT_CTRL)
+ *  falling back to probing the control ids
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid ( > 0 )
+ *   vd->list_device_controls is null
+ *
+ * returns: error code
+ */
+int enumerate_v4l2_control(v4l2_dev_t *vd)
+{
+    /*assertions*/
+    assert(vd != NULL);
+    assert(vd->fd > 0);
+    assert(vd->list_device_controls == NULL);
+
+    int ret=0;
+    v4l2_ctrl_t *current = NULL;
+
+    int n = 0;
+    struct v4l2_queryctrl queryctrl={0};
+
+    int currentctrl = 0;
+
+    /*cleared if any control fails to subscribe events*/
+    vd->ctrl_event_cache = 1;
+
+	/*try the control descriptor cache first (usb devices only)*/
+	char *cache_file = get_control_cache_filename(vd);
+	if(cache_file != NULL)
+	{
+		n = load_control_cache(vd, cache_file, &current);
+		if(n > 0)
+		{
+			free(cache_file);
+			return register_control_list(vd, n, NULL);
+		}
+		n = 0;
+	}
+
+#ifdef VIDIOC_QUERY_EXT_CTRL
+	/*
+	 * without libv4l2 use the extended query (libv4l2 only emulates
+	 * its own controls in VIDIOC_QUERYCTRL): it also walks the
+	 * compound controls, so we skip them explicitly
+	 */
+	if(disable_libv4l2)
+	{
+		struct v4l2_query_ext_ctrl query_ext;
+		memset(&query_ext, 0, sizeof(struct v4l2_query_ext_ctrl));
+		query_ext.id = V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+
+		while (query_ext_ioctl(vd, currentctrl, &query_ext) == 0)
+		{
+			if(query_ext_to_queryctrl(&query_ext, &queryctrl) == 0)
+			{
+				if(add_control(vd, &queryctrl, &current) != NULL)
+					n++;
+			}
+			else if(verbosity > 0)
+				printf("V4L2_CORE: skipping compound control 0x%08x (%s)\n",
+					query_ext.id, query_ext.name);
+
+			currentctrl = query_ext.id;
+
+			query_ext.id |= V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND;
+		}
+
+		if(currentctrl != 0)
+			return register_control_list(vd, n, cache_file);
+	}
+#endif
+
+    queryctrl.id = V4L2_CTRL_FLAG_NEXT_CTRL;
+
+	/*try the next_flag method*/
+	while ((ret=query_ioctl(vd, currentctrl, &queryctrl)) == 0)
+	{
+		if(add_control(vd, &queryctrl, &current) != NULL)
+            n++;
+
+        currentctrl = queryctrl.id;
+
+		queryctrl.id |= V4L2_CTRL_FLAG_NEXT_CTRL;
+	}
+
+	if (queryctrl.id != V4L2_CTRL_FLAG_NEXT_CTRL)
+		return register_control_list(vd, n, cache_file);
+
+	if(ret)
+		fprintf(stderr, "V4L2_CORE: Control 0x%08x failed to query with error %i\n", queryctrl.id, ret);
+
+	printf("buggy V4L2_CTRL_FLAG_NEXT_CTRL flag implementation (workaround enabled)\n");
+
+	/*
+	 * next_flag method failed, loop through the ids:
+	 *
+	 * USER CLASS Controls
+	 */
+	for (currentctrl = V4L2_CID_USER_BASE; currentctrl < V4L2_CID_LASTP1; currentctrl++)
+	{
+		queryctrl.id = currentctrl;
+		if (xioctl(vd->fd, VIDIOC_QUERYCTRL, &queryctrl) == 0)
+		{
+			if(add_control(vd, &queryctrl, &current) != NULL)
+				n++;
+		}
+	}
+	/* CAMERA CLASS Controls */
+	for (currentctrl = V4L2_CID_CAMERA_CLASS_BASE; currentctrl < V4L2_CID_CAMERA_CLASS_BASE+32; currentctrl++)
+	{
+		queryctrl.id = currentctrl;
+		if (xioctl(vd->fd, VIDIOC_QUERYCTRL, &queryctrl) == 0)
+		{
+			if(add_control(vd, &queryctrl, &current) != NULL)
+				n++;
+		}
+	}
+	/* PRIVATE controls (deprecated) */
+	for (queryctrl.id = V4L2_CID_PRIVATE_BASE;
+		 xioctl(vd->fd, VIDIOC_QUERYCTRL, &queryctrl) == 0; queryctrl.id++)
+	{
+		if(add_control(vd, &queryctrl, &current) != NULL)
+            n++;
+	}
+
+	return register_control_list(vd, n, cache_file);
+}
+
+/*
+ * set or clear the grabbed flag of control id
+ * args:
+ *   vd - pointer to video device data
+ *   id - control id
+ *   grabbed - if > 0 set the grabbed flag, otherwise clear it
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: void
+ */
+static void set_ctrl_grabbed(v4l2_dev_t *vd, int id, int grabbed)
+{
+	v4l2_ctrl_t *control = get_control_by_id(vd, id);
+	if(control == NULL)
+		return;
+
+	uint32_t flags = grabbed ?
+		(control->control.flags | V4L2_CTRL_FLAG_GRABBED) :
+		(control->control.flags & ~V4L2_CTRL_FLAG_GRABBED);
+
+	if(flags != control->control.flags)
+	{
+		control->control.flags = flags;
+		mark_control_changed(vd, control);
+	}
+}
+
+/*
+ * update the control flags - called when setting controls
+ * FIXME: use control events
+ *
+ * args:
+ *   vd - pointer to video device data
+ *   id - control id
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: error code
+ */
+static void update_ctrl_flags(v4l2_dev_t *vd, int id)
+{
+	/*asserts*/
+	assert(vd != NULL);
+
+	v4l2_ctrl_t *ctrl_this = NULL;
+
+	switch (id)
+	{
+		case V4L2_CID_EXPOSURE_AUTO:
+		{
+			ctrl_this = get_control_by_id(vd, id);
+			if(ctrl_this == NULL)
+				break;
+
+			int exposure_grabbed = 0;
+			int iris_grabbed = 0;
+
+			switch (ctrl_this->value)
+			{
+				case V4L2_EXPOSURE_AUTO:
+					exposure_grabbed = 1;
+					iris_grabbed = 1;
+					break;
+				case V4L2_EXPOSURE_APERTURE_PRIORITY:
+					exposure_grabbed = 1;
+					break;
+				case V4L2_EXPOSURE_SHUTTER_PRIORITY:
+					iris_grabbed = 1;
+					break;
+				default:
+					break;
+			}
+
+			set_ctrl_grabbed(vd, V4L2_CID_EXPOSURE_ABSOLUTE, exposure_grabbed);
+			set_ctrl_grabbed(vd, V4L2_CID_IRIS_ABSOLUTE, iris_grabbed);
+			set_ctrl_grabbed(vd, V4L2_CID_IRIS_RELATIVE, iris_grabbed);
+			break;
+		}
+
+		case V4L2_CID_FOCUS_AUTO:
+			ctrl_this = get_control_by_id(vd, id);
+			if(ctrl_this == NULL)
+				break;
+
+			set_ctrl_grabbed(vd, V4L2_CID_FOCUS_ABSOLUTE, ctrl_this->value > 0);
+			set_ctrl_grabbed(vd, V4L2_CID_FOCUS_RELATIVE, ctrl_this->value > 0);
+			break;
+
+		case V4L2_CID_HUE_AUTO:
+			ctrl_this = get_control_by_id(vd, id);
+			if(ctrl_this == NULL)
+				break;
+
+			set_ctrl_grabbed(vd, V4L2_CID_HUE, ctrl_this->value > 0);
+			break;
+
+		case V4L2_CID_AUTO_WHITE_BALANCE:
+			ctrl_this = get_control_by_id(vd, id);
+			if(ctrl_this == NULL)
+				break;
+
+			set_ctrl_grabbed(vd, V4L2_CID_WHITE_BALANCE_TEMPERATURE, ctrl_this->value > 0);
+			set_ctrl_grabbed(vd, V4L2_CID_BLUE_BALANCE, ctrl_this->value > 0);
+			set_ctrl_grabbed(vd, V4L2_CID_RED_BALANCE, ctrl_this->value > 0);
+			break;
+	}
+}
+
+/*
+ * update flags of entire control list
+ *  (only the auto controls grab other controls)
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: void
+ */
+static void update_ctrl_list_flags(v4l2_dev_t *vd)
+{
+	/*asserts*/
+	assert(vd != NULL);
+
+	update_ctrl_flags(vd, V4L2_CID_EXPOSURE_AUTO);
+	update_ctrl_flags(vd, V4L2_CID_FOCUS_AUTO);
+	update_ctrl_flags(vd, V4L2_CID_HUE_AUTO);
+	update_ctrl_flags(vd, V4L2_CID_AUTO_WHITE_BALANCE);
+}
+
+/*
+ * Disables special auto-controls with higher IDs than
+ * their absolute/relative counterparts
+ * this is needed before restoring controls state
+ *
+ * args:
+ *   vd - pointer to video device data
+ *   id - control id
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: void
+ */
+void disable_special_auto (v4l2_dev_t *vd, int id)
+{
+	/*asserts*/
+	assert(vd != NULL);
+
+    v4l2_ctrl_t *current = get_control_by_id(vd, id);
+    if(current && ((id == V4L2_CID_FOCUS_AUTO) || (id == V4L2_CID_HUE_AUTO)))
+    {
+        current->value = 0;
         v4l2core_set_control_value_by_id(vd, id);
     }
 }
 
 /*
  * goes trough the control list and updates/retrieves current values
+ *  (one VIDIOC_G_EXT_CTRLS per control class)
  * args:
  *   vd - pointer to video device data
  *
@@ -859,121 +1207,136 @@ void get_v4l2_control_values (v4l2_dev_t *vd)
 		return;
 	}
 
+    /*don't let the read discard queued writes*/
+    flush_control_queue(vd, 1);
+
     int ret = 0;
     struct v4l2_ext_control clist[vd->num_controls];
-    v4l2_ctrl_t *current = vd->list_device_controls;
+    v4l2_ctrl_t *clist_ctrl[vd->num_controls];
 
     int count = 0;
     int i = 0;
+    int k = 0;
 
-    for(; current != NULL; current = current->next)
+    for(k = 0; k < vd->num_ctrl_classes; k++)
     {
-        if(current->control.flags & V4L2_CTRL_FLAG_WRITE_ONLY)
-             continue;
+        v4l2_ctrl_class_t *group = &vd->ctrl_classes[k];
 
-        clist[count].id = current->control.id;
-        clist[count].size = 0;
-        if(current->control.type == V4L2_CTRL_TYPE_STRING)
+        count = 0;
+        for(i = group->first; i < group->first + group->count; i++)
         {
-            clist[count].size = current->control.maximum + 1;
-            clist[count].string = (char *) calloc(clist[count].size,  sizeof(char));
-            if(clist[count].string == NULL)
-			{
-				fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (get_v4l2_control_values): %s\n", strerror(errno));
-				exit(-1);
-			}
+            v4l2_ctrl_t *current = &vd->list_device_controls[i];
+
+            if(current->control.flags & V4L2_CTRL_FLAG_WRITE_ONLY)
+                continue;
+
+            memset(&clist[count], 0, sizeof(struct v4l2_ext_control));
+            clist[count].id = current->control.id;
+            if(current->control.type == V4L2_CTRL_TYPE_STRING)
+            {
+                clist[count].size = current->control.maximum + 1;
+                clist[count].string = (char *) calloc(clist[count].size,  sizeof(char));
+                if(clist[count].string == NULL)
+                {
+                    fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (get_v4l2_control_values): %s\n", strerror(errno));
+                    exit(-1);
+                }
+            }
+            clist_ctrl[count] = current;
+            count++;
         }
-        count++;
 
-        if((current->next == NULL) || (current->next->cclass != current->cclass))
+        if(count == 0)
+            continue;
+
+        v4l2_ctrl_t *last = clist_ctrl[count - 1];
+
+        struct v4l2_ext_controls ctrls = {0};
+        ctrls.ctrl_class = group->cclass;
+        ctrls.count = count;
+        ctrls.controls = clist;
+        ret = xioctl(vd->fd, VIDIOC_G_EXT_CTRLS, &ctrls);
+        if(ret)
         {
-            struct v4l2_ext_controls ctrls = {0};
-            ctrls.ctrl_class = current->cclass;
-            ctrls.count = count;
-            ctrls.controls = clist;
-            ret = xioctl(vd->fd, VIDIOC_G_EXT_CTRLS, &ctrls);
-            if(ret)
+            fprintf(stderr, "V4L2_CORE: (VIDIOC_G_EXT_CTRLS) failed\n");
+            struct v4l2_control ctrl;
+            /*get the controls one by one*/
+            if( group->cclass == V4L2_CTRL_CLASS_USER
+                && last->control.type != V4L2_CTRL_TYPE_STRING
+                && last->control.type != V4L2_CTRL_TYPE_INTEGER64)
             {
-                fprintf(stderr, "V4L2_CORE: (VIDIOC_G_EXT_CTRLS) failed\n");
-                struct v4l2_control ctrl;
-                /*get the controls one by one*/
-                if( current->cclass == V4L2_CTRL_CLASS_USER
-					&& current->control.type != V4L2_CTRL_TYPE_STRING
-					&& current->control.type != V4L2_CTRL_TYPE_INTEGER64)
+                fprintf(stderr, "V4L2_CORE: using VIDIOC_G_CTRL for user class controls\n");
+                for(i=0; i < count; i++)
                 {
-                    fprintf(stderr, "V4L2_CORE: using VIDIOC_G_CTRL for user class controls\n");
-                    for(i=0; i < count; i++)
-                    {
-                        ctrl.id = clist[i].id;
-                        ctrl.value = 0;
-                        ret = xioctl(vd->fd, VIDIOC_G_CTRL, &ctrl);
-                        if(ret)
-                            continue;
-                        clist[i].value = ctrl.value;
-                    }
+                    ctrl.id = clist[i].id;
+                    ctrl.value = 0;
+                    ret = xioctl(vd->fd, VIDIOC_G_CTRL, &ctrl);
+                    if(ret)
+                        continue;
+                    clist[i].value = ctrl.value;
                 }
-                else
+            }
+            else
+            {
+                fprintf(stderr, "V4L2_CORE: using VIDIOC_G_EXT_CTRLS on single controls for class: 0x%08x\n",
+                    group->cclass);
+                for(i=0;i < count; i++)
                 {
-                    fprintf(stderr, "V4L2_CORE: using VIDIOC_G_EXT_CTRLS on single controls for class: 0x%08x\n",
-                        current->cclass);
-                    for(i=0;i < count; i++)
-                    {
-                        ctrls.count = 1;
-                        ctrls.controls = &clist[i];
-                        ret = xioctl(vd->fd, VIDIOC_G_EXT_CTRLS, &ctrls);
-                        if(ret)
-                            fprintf(stderr, "V4L2_CORE: control id: 0x%08x failed to get (error %i)\n",
-                                clist[i].id, ret);
-                    }
+                    ctrls.count = 1;
+                    ctrls.controls = &clist[i];
+                    ret = xioctl(vd->fd, VIDIOC_G_EXT_CTRLS, &ctrls);
+                    if(ret)
+                        fprintf(stderr, "V4L2_CORE: control id: 0x%08x failed to get (error %i)\n",
+                            clist[i].id, ret);
                 }
             }
+        }
 
-            //fill in the values on the control list
-            for(i=0; i<count; i++)
+        //fill in the values on the control list
+        for(i=0; i<count; i++)
+        {
+            v4l2_ctrl_t *ctrl = clist_ctrl[i];
+
+            switch(ctrl->control.type)
             {
-                v4l2_ctrl_t *ctrl = v4l2core_get_control_by_id(vd, clist[i].id);
-                if(!ctrl)
-                {
-                    fprintf(stderr, "V4L2_CORE: couldn't get control for id: %i\n", clist[i].id);
-                    continue;
-                }
-                switch(ctrl->control.type)
+                case V4L2_CTRL_TYPE_STRING:
                 {
-
-                    case V4L2_CTRL_TYPE_STRING:
+                    /*
+                     * string gets set on VIDIOC_G_EXT_CTRLS
+                     * add the maximum size to value
+                     */
+                    unsigned len = strlen(clist[i].string);
+                    unsigned max_len = ctrl->control.maximum;
+
+                    if(strncmp(ctrl->string, clist[i].string, max_len + 1) != 0)
+                        mark_control_changed(vd, ctrl);
+
+                    strncpy(ctrl->string, clist[i].string, max_len + 1);
+                    if(len > max_len)
                     {
-                        /*
-                         * string gets set on VIDIOC_G_EXT_CTRLS
-                         * add the maximum size to value
-                         */
-                        unsigned len = strlen(clist[i].string);
-						unsigned max_len = ctrl->control.maximum;
-
-						strncpy(ctrl->string, clist[i].string, max_len + 1);
-						if(len > max_len)
-						{
-							ctrl->string[max_len + 1] = 0; //Null terminated
-							fprintf(stderr, "V4L2_CORE: control (0x%08x) returned string size of %d when max is %d\n",
-								ctrl->control.id, len, max_len);
-						}
-
-						/*clean up*/
-						free(clist[i].string);
-						clist[i].string = NULL;
-                        break;
+                        ctrl->string[max_len + 1] = 0; //Null terminated
+                        fprintf(stderr, "V4L2_CORE: control (0x%08x) returned string size of %d when max is %d\n",
+                            ctrl->control.id, len, max_len);
                     }
-                    case V4L2_CTRL_TYPE_INTEGER64:
-                        ctrl->value64 = clist[i].value64;
-                        break;
-                    default:
-                        ctrl->value = clist[i].value;
-                        //printf("V4L2_CORE: control %i [0x%08x] = %i\n",
-                        //    i, clist[i].id, clist[i].value);
-                        break;
+
+                    /*clean up*/
+                    free(clist[i].string);
+                    clist[i].string = NULL;
+                    break;
                 }
+                case V4L2_CTRL_TYPE_INTEGER64:
+                    if(ctrl->value64 != clist[i].value64)
+                        mark_control_changed(vd, ctrl);
+                    ctrl->value64 = clist[i].value64;
+                    break;
+                default:
+                    if(ctrl->value != clist[i].value)
+                        mark_control_changed(vd, ctrl);
+                    ctrl->value = clist[i].value;
+                    //printf("V4L2_CORE: control %i [0x%08x] = %i\n",
+                    //    i, clist[i].id, clist[i].value);
+                    break;
             }
-
-            count = 0;
         }
     }
 
@@ -982,6 +1345,7 @@ void get_v4l2_control_values (v4l2_dev_t *vd)
 
 /*
  * return the control associated to id from device list
+ *  (O(1) lookup in the control registry id index)
  * args:
  *   vd - pointer to video device data
  *   id - control id
@@ -995,47 +1359,71 @@ v4l2_ctrl_t *get_control_by_id(v4l2_dev_t *vd, int id)
 {
 	/*asserts*/
 	assert(vd != NULL);
-	
-	v4l2_ctrl_t *current = vd->list_device_controls;
-    for(; current != NULL; current = current->next)
-    {
-		if(current == NULL)
-			break;
 
-        if(current->control.id == id)
-            return (current);
-    }
+	if(vd->ctrl_index == NULL)
+		return(NULL);
+
+	uint32_t mask = vd->ctrl_index_size - 1;
+	int slot = ctrl_index_hash((uint32_t) id, mask);
+
+	while(vd->ctrl_index[slot] != NULL)
+	{
+		if(vd->ctrl_index[slot]->control.id == (uint32_t) id)
+			return (vd->ctrl_index[slot]);
+
+		slot = (slot + 1) & mask;
+	}
 
-    return(NULL);
+	return(NULL);
 }
 
 /*
- * updates the value for control id from the device
- * also updates control flags
+ * store a value reported by the device in the control cache
  * args:
  *   vd - pointer to video device data
- *   id - control id
+ *   control - pointer to control
+ *   value - control value (non 64 bit controls)
+ *   value64 - control value (64 bit controls)
  *
  * asserts:
  *   vd is not null
- *   vd->fd is valid
+ *   control is not null
  *
- * returns: ioctl result
+ * returns: void
  */
-int get_control_value_by_id (v4l2_dev_t *vd, int id)
+static void set_cached_value(v4l2_dev_t *vd, v4l2_ctrl_t *control, int32_t value, int64_t value64)
 {
-	/*asserts*/
-	assert(vd != NULL);
-	assert(vd->fd > 0);
+	if(control->control.type == V4L2_CTRL_TYPE_INTEGER64)
+	{
+		if(control->value64 != value64)
+		{
+			control->value64 = value64;
+			mark_control_changed(vd, control);
+		}
+	}
+	else if(control->value != value)
+	{
+		control->value = value;
+		mark_control_changed(vd, control);
+	}
+}
 
-    v4l2_ctrl_t *control = v4l2core_get_control_by_id(vd, id);
+/*
+ * reads the value of control from the device into the control cache
+ * args:
+ *   vd - pointer to video device data
+ *   control - pointer to control
+ *
+ * asserts:
+ *   vd is not null
+ *   control is not null
+ *
+ * returns: ioctl result
+ */
+static int read_control_value(v4l2_dev_t *vd, v4l2_ctrl_t *control)
+{
     int ret = 0;
 
-    if(!control)
-        return (-1);
-    if(control->control.flags & V4L2_CTRL_FLAG_WRITE_ONLY)
-        return (-1);
-
     if( control->cclass == V4L2_CTRL_CLASS_USER
 		&& control->control.type != V4L2_CTRL_TYPE_STRING
 		&& control->control.type != V4L2_CTRL_TYPE_INTEGER64)
@@ -1048,7 +1436,11 @@ int get_control_value_by_id (v4l2_dev_t *vd, int id)
             fprintf(stderr, "V4L2_CORE: control id: 0x%08x failed to get value (error %i)\n",
                 ctrl.id, ret);
         else
+        {
+            if(control->value != ctrl.value)
+                mark_control_changed(vd, control);
             control->value = ctrl.value;
+        }
     }
     else
     {
@@ -1079,6 +1471,8 @@ int get_control_value_by_id (v4l2_dev_t *vd, int id)
             {
                 case V4L2_CTRL_TYPE_STRING:
 				{
+					if(strncmp(control->string, ctrl.string, ctrl.size) != 0)
+						mark_control_changed(vd, control);
 					strncpy(control->string, ctrl.string, ctrl.size);
 
 					//clean up
@@ -1088,17 +1482,67 @@ int get_control_value_by_id (v4l2_dev_t *vd, int id)
 					break;
 				}
                 case V4L2_CTRL_TYPE_INTEGER64:
+                    if(control->value64 != ctrl.value64)
+                        mark_control_changed(vd, control);
                     control->value64 = ctrl.value64;
                     break;
 
-                default:
-                    control->value = ctrl.value;
-                    //printf("V4L2_CORE: control %i [0x%08x] = %i\n",
-                    //    i, clist[i].id, clist[i].value);
-                    break;
-            }
-        }
-    }
+                default:
+                    if(control->value != ctrl.value)
+                        mark_control_changed(vd, control);
+                    control->value = ctrl.value;
+                    //printf("V4L2_CORE: control %i [0x%08x] = %i\n",
+                    //    i, clist[i].id, clist[i].value);
+                    break;
+            }
+        }
+
+        if(ctrl.string && control->control.type == V4L2_CTRL_TYPE_STRING)
+            free(ctrl.string);
+    }
+
+    return (ret);
+}
+
+/*
+ * updates the value for control id from the device
+ * also updates control flags
+ * (no device read if the control cache is kept current by control events)
+ * args:
+ *   vd - pointer to video device data
+ *   id - control id
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: ioctl result
+ */
+int get_control_value_by_id (v4l2_dev_t *vd, int id)
+{
+	/*asserts*/
+	assert(vd != NULL);
+	assert(vd->fd > 0);
+
+    v4l2_ctrl_t *control = get_control_by_id(vd, id);
+    int ret = 0;
+
+    if(!control)
+        return (-1);
+    if(control->control.flags & V4L2_CTRL_FLAG_WRITE_ONLY)
+        return (-1);
+
+    /*don't let the read discard a queued write*/
+    if(control_is_queued(vd, control))
+        flush_control_queue(vd, 1);
+
+    /*
+     * the event driven cache is always current, except for
+     * volatile controls (the driver sends no value events for them)
+     */
+    if(!vd->ctrl_event_cache ||
+        (control->control.flags & V4L2_CTRL_FLAG_VOLATILE))
+        ret = read_control_value(vd, control);
 
     update_ctrl_flags(vd, id);
 
@@ -1107,8 +1551,12 @@ int get_control_value_by_id (v4l2_dev_t *vd, int id)
 
 /*
  * goes trough the control list and sets values in device
+ *  for controls changed after generation
+ *  (one VIDIOC_S_EXT_CTRLS per control class)
  * args:
  *   vd - pointer to video device data
+ *   generation - only set controls with a higher generation
+ *                (0 - set all controls)
  *
  * asserts:
  *   vd is not null
@@ -1116,12 +1564,12 @@ int get_control_value_by_id (v4l2_dev_t *vd, int id)
  *
  * returns: void
  */
-void set_v4l2_control_values (v4l2_dev_t *vd)
+void set_v4l2_changed_control_values (v4l2_dev_t *vd, uint32_t generation)
 {
 	/*asserts*/
 	assert(vd != NULL);
 	assert(vd->fd > 0);
-	
+
 	if(vd->list_device_controls == NULL)
 	{
 		printf("V4L2_CORE: (set control values) empty control list\n");
@@ -1130,130 +1578,153 @@ void set_v4l2_control_values (v4l2_dev_t *vd)
 
     int ret = 0;
     struct v4l2_ext_control clist[vd->num_controls];
-    v4l2_ctrl_t *current = vd->list_device_controls;
+    v4l2_ctrl_t *clist_ctrl[vd->num_controls];
 
     int count = 0;
     int i = 0;
+    int k = 0;
 
 	if(verbosity > 0)
 		printf("V4L2_CORE: setting control values\n");
 
-    for(; current != NULL; current = current->next)
+    for(k = 0; k < vd->num_ctrl_classes; k++)
     {
-        if(current->control.flags & V4L2_CTRL_FLAG_READ_ONLY)
-            continue;
+        v4l2_ctrl_class_t *group = &vd->ctrl_classes[k];
 
-        clist[count].id = current->control.id;
-        switch (current->control.type)
+        count = 0;
+        for(i = group->first; i < group->first + group->count; i++)
         {
-            case V4L2_CTRL_TYPE_STRING:
-            {
-				unsigned len = strlen(current->string);
-				unsigned max_len = current->control.maximum;
+            v4l2_ctrl_t *current = &vd->list_device_controls[i];
 
-				if(len > max_len)
-				{
-					clist[count].size = max_len + 1;
-					clist[count].string = (char *) calloc(max_len + 1, sizeof(char));
-					if(clist[count].string == NULL)
-					{
-						fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (set_v4l2_control_values): %s\n", strerror(errno));
-						exit(-1);
-					}
-					clist[count].string = strncpy(clist[count].string, current->string, max_len);
-					clist[count].string[max_len + 1] = 0; /*NULL terminated*/
-					fprintf(stderr, "V4L2_CORE: control (0x%08x) trying to set string size of %d when max is %d (clip)\n",
-						current->control.id, len, max_len);
-				}
-				else
-				{
-					clist[count].size = len + 1;
-					clist[count].string = (char *) strdup(current->string);
-				}
-                break;
-            }
-            case V4L2_CTRL_TYPE_INTEGER64:
-                clist[count].value64 = current->value64;
-                break;
-            default:
-				if(verbosity > 0)
-					printf("\tcontrol[%i] = %i\n", count, current->value);
-                clist[count].value = current->value;
-                break;
-        }
-        count++;
+            if(current->control.flags & V4L2_CTRL_FLAG_READ_ONLY)
+                continue;
+            if(current->generation <= generation)
+                continue;
 
-        if((current->next == NULL) || (current->next->cclass != current->cclass))
-        {
-            struct v4l2_ext_controls ctrls = {0};
-            ctrls.ctrl_class = current->cclass;
-            ctrls.count = count;
-            ctrls.controls = clist;
-            ret = xioctl(vd->fd, VIDIOC_S_EXT_CTRLS, &ctrls);
-            if(ret)
+            dequeue_control(vd, current);
+
+            memset(&clist[count], 0, sizeof(struct v4l2_ext_control));
+            clist[count].id = current->control.id;
+            switch (current->control.type)
             {
-                fprintf(stderr, "V4L2_CORE: VIDIOC_S_EXT_CTRLS for multiple controls failed (error %i)\n", ret);
-                struct v4l2_control ctrl;
-                /*set the controls one by one*/
-                if( current->cclass == V4L2_CTRL_CLASS_USER
-					&& current->control.type != V4L2_CTRL_TYPE_STRING
-					&& current->control.type != V4L2_CTRL_TYPE_INTEGER64)
+                case V4L2_CTRL_TYPE_STRING:
                 {
-                    fprintf(stderr, "V4L2_CORE: using VIDIOC_S_CTRL for user class controls\n");
-                    for(i=0;i < count; i++)
+                    unsigned len = strlen(current->string);
+                    unsigned max_len = current->control.maximum;
+
+                    if(len > max_len)
                     {
-                        ctrl.id = clist[i].id;
-                        ctrl.value = clist[i].value;
-                        ret = xioctl(vd->fd, VIDIOC_S_CTRL, &ctrl);
-                        if(ret)
+                        clist[count].size = max_len + 1;
+                        clist[count].string = (char *) calloc(max_len + 1, sizeof(char));
+                        if(clist[count].string == NULL)
                         {
-                            v4l2_ctrl_t *ctrl = v4l2core_get_control_by_id(vd, clist[i].id);
-                            if(ctrl)
-                                fprintf(stderr, "V4L2_CORE: control(0x%08x) \"%s\" failed to set (error %i)\n",
-                                    clist[i].id, ctrl->control.name, ret);
-                            else
-								fprintf(stderr, "V4L2_CORE: control(0x%08x) failed to set (error %i)\n",
-                                    clist[i].id, ret);
+                            fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (set_v4l2_control_values): %s\n", strerror(errno));
+                            exit(-1);
                         }
+                        clist[count].string = strncpy(clist[count].string, current->string, max_len);
+                        fprintf(stderr, "V4L2_CORE: control (0x%08x) trying to set string size of %d when max is %d (clip)\n",
+                            current->control.id, len, max_len);
                     }
-                }
-                else
-                {
-                    fprintf(stderr, "V4L2_CORE: using VIDIOC_S_EXT_CTRLS on single controls for class: 0x%08x\n",
-                        current->cclass);
-                    for(i=0;i < count; i++)
+                    else
                     {
-                        ctrls.count = 1;
-                        ctrls.controls = &clist[i];
-                        ret = xioctl(vd->fd, VIDIOC_S_EXT_CTRLS, &ctrls);
+                        clist[count].size = len + 1;
+                        clist[count].string = (char *) strdup(current->string);
+                    }
+                    break;
+                }
+                case V4L2_CTRL_TYPE_INTEGER64:
+                    clist[count].value64 = current->value64;
+                    break;
+                default:
+                    if(verbosity > 0)
+                        printf("\tcontrol[%i] = %i\n", count, current->value);
+                    clist[count].value = current->value;
+                    break;
+            }
+            clist_ctrl[count] = current;
+            count++;
+        }
 
-                        v4l2_ctrl_t *ctrl = v4l2core_get_control_by_id(vd, clist[i].id);
+        if(count == 0)
+            continue;
 
-                        if(ret)
-                        {
-                            if(ctrl)
-                                fprintf(stderr, "V4L2_CORE: control(0x%08x) \"%s\" failed to set (error %i)\n",
-                                    clist[i].id, ctrl->control.name, ret);
-                            else
-								fprintf(stderr, "V4L2_CORE: control(0x%08x) failed to set (error %i)\n",
-                                    clist[i].id, ret);
-                        }
-                        if(ctrl && ctrl->control.type == V4L2_CTRL_TYPE_STRING)
-                        {
-							free(clist[i].string); //free allocated string
-							clist[i].string = NULL;
-						}
-                    }
+        v4l2_ctrl_t *last = clist_ctrl[count - 1];
+
+        struct v4l2_ext_controls ctrls = {0};
+        ctrls.ctrl_class = group->cclass;
+        ctrls.count = count;
+        ctrls.controls = clist;
+        ret = xioctl(vd->fd, VIDIOC_S_EXT_CTRLS, &ctrls);
+        if(ret)
+        {
+            fprintf(stderr, "V4L2_CORE: VIDIOC_S_EXT_CTRLS for multiple controls failed (error %i)\n", ret);
+            struct v4l2_control ctrl;
+            /*set the controls one by one*/
+            if( group->cclass == V4L2_CTRL_CLASS_USER
+                && last->control.type != V4L2_CTRL_TYPE_STRING
+                && last->control.type != V4L2_CTRL_TYPE_INTEGER64)
+            {
+                fprintf(stderr, "V4L2_CORE: using VIDIOC_S_CTRL for user class controls\n");
+                for(i=0;i < count; i++)
+                {
+                    ctrl.id = clist[i].id;
+                    ctrl.value = clist[i].value;
+                    ret = xioctl(vd->fd, VIDIOC_S_CTRL, &ctrl);
+                    if(ret)
+                        fprintf(stderr, "V4L2_CORE: control(0x%08x) \"%s\" failed to set (error %i)\n",
+                            clist[i].id, clist_ctrl[i]->control.name, ret);
+                }
+            }
+            else
+            {
+                fprintf(stderr, "V4L2_CORE: using VIDIOC_S_EXT_CTRLS on single controls for class: 0x%08x\n",
+                    group->cclass);
+                for(i=0;i < count; i++)
+                {
+                    ctrls.count = 1;
+                    ctrls.controls = &clist[i];
+                    ret = xioctl(vd->fd, VIDIOC_S_EXT_CTRLS, &ctrls);
+                    if(ret)
+                        fprintf(stderr, "V4L2_CORE: control(0x%08x) \"%s\" failed to set (error %i)\n",
+                            clist[i].id, clist_ctrl[i]->control.name, ret);
                 }
             }
-            count = 0;
+        }
+
+        for(i=0; i < count; i++)
+        {
+            /*clean up string allocations*/
+            if(clist_ctrl[i]->control.type == V4L2_CTRL_TYPE_STRING)
+            {
+                free(clist[i].string);
+                clist[i].string = NULL;
+            }
+            /*the driver returns the values it actually applied*/
+            else if(!ret && vd->ctrl_event_cache)
+                set_cached_value(vd, clist_ctrl[i], clist[i].value, clist[i].value64);
         }
     }
+}
 
+/*
+ * goes trough the control list and sets values in device
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: void
+ */
+void set_v4l2_control_values (v4l2_dev_t *vd)
+{
+	set_v4l2_changed_control_values(vd, 0);
 }
 
 /*
  * goes trough the control list and sets values in device to default
+ *  (only controls not already at their default value are set)
  * args:
  *   vd - pointer to video device data
  *
@@ -1266,45 +1737,49 @@ void set_control_defaults(v4l2_dev_t *vd)
 {
 	/*asserts*/
 	assert(vd != NULL);
-	
+
 	if(vd->list_device_controls == NULL)
 	{
 		printf("V4L2_CORE: (set control defaults) empty control list\n");
 		return;
 	}
 
-    v4l2_ctrl_t *current = vd->list_device_controls;
-    v4l2_ctrl_t *next = current->next;
+	uint32_t generation = __atomic_load_n(&vd->ctrl_generation, __ATOMIC_SEQ_CST);
 
 	if(verbosity > 0)
 		printf("V4L2_CORE: loading defaults\n");
 
 	int i = 0;
-    for(; current != NULL; current = current->next, ++i)
-    {
-        if(current->control.flags & V4L2_CTRL_FLAG_READ_ONLY)
-            continue;
+	for(i = 0; i < vd->num_controls; i++)
+	{
+		v4l2_ctrl_t *current = &vd->list_device_controls[i];
 
+		if(current->control.flags & V4L2_CTRL_FLAG_READ_ONLY)
+			continue;
 
-        switch (current->control.type)
-        {
-            case V4L2_CTRL_TYPE_STRING: /* do string controls have a default value?*/
-                break;
-            case V4L2_CTRL_TYPE_INTEGER64: /* do int64 controls have a default value?*/
-                break;
-            default:
-                /*if its one of the special auto controls disable it first*/
-                disable_special_auto (vd, current->control.id);
-                if(verbosity > 1)
+		switch (current->control.type)
+		{
+			case V4L2_CTRL_TYPE_STRING: /* do string controls have a default value?*/
+				break;
+			case V4L2_CTRL_TYPE_INTEGER64: /* do int64 controls have a default value?*/
+				break;
+			default:
+				/*if its one of the special auto controls disable it first*/
+				disable_special_auto (vd, current->control.id);
+				if(verbosity > 1)
 					printf("\tdefault[%i] = %i\n", i, current->control.default_value);
-                current->value = current->control.default_value;
-                break;
-        }
-    }
+				if(current->value != current->control.default_value)
+				{
+					current->value = current->control.default_value;
+					mark_control_changed(vd, current);
+				}
+				break;
+		}
+	}
 
-    set_v4l2_control_values(vd);
+	set_v4l2_changed_control_values(vd, generation);
 
-    get_v4l2_control_values(vd);
+	sync_v4l2_control_values(vd);
 }
 
 /*
@@ -1325,7 +1800,7 @@ int set_control_value_by_id(v4l2_dev_t *vd, int id)
 	assert(vd != NULL);
 	assert(vd->fd > 0);
 
-    v4l2_ctrl_t *control = v4l2core_get_control_by_id(vd, id);
+    v4l2_ctrl_t *control = get_control_by_id(vd, id);
     int ret = 0;
 
     if(!control)
@@ -1333,6 +1808,9 @@ int set_control_value_by_id(v4l2_dev_t *vd, int id)
     if(control->control.flags & V4L2_CTRL_FLAG_READ_ONLY)
         return (-1);
 
+    /*this write supersedes any queued one*/
+    dequeue_control(vd, control);
+
     if((id == V4L2_CID_PAN_RELATIVE || id == V4L2_CID_TILT_RELATIVE) &&
 		vd->pantilt_unit_id > 0)
 	{
@@ -1357,6 +1835,9 @@ int set_control_value_by_id(v4l2_dev_t *vd, int id)
         ctrl.id = control->control.id;
         ctrl.value = control->value;
         ret = xioctl(vd->fd, VIDIOC_S_CTRL, &ctrl);
+        /*the driver returns the value it actually applied*/
+        if(!ret && vd->ctrl_event_cache)
+            set_cached_value(vd, control, ctrl.value, 0);
     }
     else
     {
@@ -1411,14 +1892,342 @@ int set_control_value_by_id(v4l2_dev_t *vd, int id)
 			free(ctrl.string); //clean up string allocation
 			ctrl.string = NULL;
 		}
+        /*the driver returns the value it actually applied*/
+        else if(!ret && vd->ctrl_event_cache)
+            set_cached_value(vd, control, ctrl.value, ctrl.value64);
     }
 
-    //update real value
-    get_control_value_by_id(vd, id);
+    if(!ret)
+        mark_control_changed(vd, control);
+
+    /*
+     * update real value: with the event driven cache, changes to
+     * other controls are delivered as events, so the device is only
+     * read back if the write failed (restores the cached value)
+     */
+    if(ret || !vd->ctrl_event_cache)
+        read_control_value(vd, control);
+    update_ctrl_flags(vd, id);
 
     return (ret);
 }
 
+/*
+ * bring the control cache up to date after writing controls
+ *  (with an event driven cache the changes made by the device are
+ *   already queued as control events - volatile controls are read -
+ *   otherwise reads all values)
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: void
+ */
+void sync_v4l2_control_values(v4l2_dev_t *vd)
+{
+	/*asserts*/
+	assert(vd != NULL);
+	assert(vd->fd > 0);
+
+	if(vd->ctrl_event_cache)
+	{
+		check_control_events(vd);
+
+		/*volatile controls send no value events*/
+		v4l2_ctrl_t *current = vd->list_device_controls;
+		for(; current != NULL; current = current->next)
+			if((current->control.flags & V4L2_CTRL_FLAG_VOLATILE) &&
+				!(current->control.flags & V4L2_CTRL_FLAG_WRITE_ONLY))
+				read_control_value(vd, current);
+
+		update_ctrl_list_flags(vd);
+	}
+	else
+		get_v4l2_control_values(vd);
+}
+
+/*
+ * check for control events and update the control cache
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: number of processed control events
+ */
+int check_control_events(v4l2_dev_t *vd)
+{
+	/*asserts*/
+	assert(vd != NULL);
+
+	int ret = 0;
+	struct v4l2_event ev;
+
+	if(vd->list_device_controls == NULL)
+		return 0;
+
+	do
+	{
+		memset(&ev, 0, sizeof(struct v4l2_event));
+		if(xioctl(vd->fd, VIDIOC_DQEVENT, &ev) != 0)
+			break;
+
+		if (ev.type != V4L2_EVENT_CTRL)
+			continue;
+
+		ret++;
+		//update control
+		v4l2_ctrl_t *control = get_control_by_id(vd, ev.id);
+		if(control == NULL)
+			continue;
+
+		if((ev.u.ctrl.changes & V4L2_EVENT_CTRL_CH_FLAGS) &&
+			control->control.flags != ev.u.ctrl.flags)
+		{
+			control->control.flags = ev.u.ctrl.flags;
+			mark_control_changed(vd, control);
+		}
+
+		if(control->control.flags & V4L2_CTRL_FLAG_DISABLED)
+			continue;
+
+		if(ev.u.ctrl.changes & V4L2_EVENT_CTRL_CH_RANGE)
+		{
+			control->control.minimum = ev.u.ctrl.minimum;
+			control->control.maximum = ev.u.ctrl.maximum;
+			control->control.step = ev.u.ctrl.step;
+			control->control.default_value = ev.u.ctrl.default_value;
+			mark_control_changed(vd, control);
+		}
+
+		if(!(ev.u.ctrl.changes & V4L2_EVENT_CTRL_CH_VALUE))
+			continue;
+
+		/*a queued write is newer than the value in the event*/
+		if(control_is_queued(vd, control))
+			continue;
+
+		switch (control->control.type)
+		{
+			case V4L2_CTRL_TYPE_STRING:
+				/*string values are not sent in events*/
+				read_control_value(vd, control);
+				break;
+			default:
+				set_cached_value(vd, control, ev.u.ctrl.value, ev.u.ctrl.value64);
+				break;
+		}
+	}
+	while (ev.pending > 0);
+
+	/*restore the grabbed flags of auto controlled controls*/
+	if(ret > 0)
+		update_ctrl_list_flags(vd);
+
+	return ret;
+}
+
+/*
+ * check if control id is a relative (or reset) control
+ *  - every write is a move, so it can't be coalesced
+ * args:
+ *   id - control id
+ *
+ * asserts:
+ *   none
+ *
+ * returns: 1 if relative control, 0 otherwise
+ */
+static int is_relative_control(int id)
+{
+	switch(id)
+	{
+		case V4L2_CID_PAN_RELATIVE:
+		case V4L2_CID_TILT_RELATIVE:
+		case V4L2_CID_PAN_RESET:
+		case V4L2_CID_TILT_RESET:
+		case V4L2_CID_FOCUS_RELATIVE:
+		case V4L2_CID_ZOOM_RELATIVE:
+		case V4L2_CID_IRIS_RELATIVE:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * queue the current value of control id for a deferred write
+ *  (repeated writes to the same control are coalesced)
+ * args:
+ *   vd - pointer to video device data
+ *   id - control id
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: error code
+ */
+int queue_control_value_by_id(v4l2_dev_t *vd, int id)
+{
+	/*asserts*/
+	assert(vd != NULL);
+	assert(vd->fd > 0);
+
+	v4l2_ctrl_t *control = get_control_by_id(vd, id);
+
+	if(!control)
+		return (-1);
+	if(control->control.flags & V4L2_CTRL_FLAG_READ_ONLY)
+		return (-1);
+
+	/*actions and strings are written right away*/
+	if(vd->ctrl_queued == NULL ||
+	   is_relative_control(id) ||
+	   (control->control.flags & V4L2_CTRL_FLAG_WRITE_ONLY) ||
+	   control->control.type == V4L2_CTRL_TYPE_BUTTON ||
+	   control->control.type == V4L2_CTRL_TYPE_STRING)
+		return set_control_value_by_id(vd, id);
+
+	/*the value is only read on flush, so the last one wins*/
+	int pos = control - vd->list_device_controls;
+
+	__LOCK_MUTEX(&(vd->ctrl_queue_mutex));
+	if(!vd->ctrl_queued[pos])
+	{
+		vd->ctrl_queued[pos] = 1;
+		vd->ctrl_queue_count++;
+	}
+	__UNLOCK_MUTEX(&(vd->ctrl_queue_mutex));
+
+	return E_OK;
+}
+
+/*
+ * flush the control write queue
+ *  (one VIDIOC_S_EXT_CTRLS per control class)
+ * args:
+ *   vd - pointer to video device data
+ *   force - if > 0 ignore the minimum flush interval
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: number of controls written to the device
+ */
+int flush_control_queue(v4l2_dev_t *vd, int force)
+{
+	/*asserts*/
+	assert(vd != NULL);
+	assert(vd->fd > 0);
+
+	if(vd->ctrl_queued == NULL)
+		return 0;
+
+	int written = 0;
+	int i = 0;
+	int k = 0;
+
+	/*
+	 * the queue flags are the reference, the count is just a hint:
+	 * rebuild it so a drifted count can't hide (or fake) pending writes
+	 */
+	__LOCK_MUTEX(&(vd->ctrl_queue_mutex));
+	int pending = 0;
+	for(i = 0; i < vd->num_controls; i++)
+		if(vd->ctrl_queued[i])
+			pending++;
+	vd->ctrl_queue_count = pending;
+
+	/*
+	 * bound the control transfer rate (don't stall streaming)
+	 * allow 10% early for timer jitter, since callers usually flush
+	 * from a timer with CTRL_QUEUE_FLUSH_INTERVAL period
+	 */
+	uint64_t now = ns_time_monotonic();
+	if(pending == 0 ||
+	   (!force &&
+	    now - vd->ctrl_queue_flush_time < (uint64_t) CTRL_QUEUE_FLUSH_INTERVAL * 900000))
+	{
+		__UNLOCK_MUTEX(&(vd->ctrl_queue_mutex));
+		return 0;
+	}
+
+	vd->ctrl_queue_flush_time = now;
+	__UNLOCK_MUTEX(&(vd->ctrl_queue_mutex));
+
+	struct v4l2_ext_control clist[vd->num_controls];
+	v4l2_ctrl_t *clist_ctrl[vd->num_controls];
+
+	for(k = 0; k < vd->num_ctrl_classes; k++)
+	{
+		v4l2_ctrl_class_t *group = &vd->ctrl_classes[k];
+		int count = 0;
+
+		/*
+		 * take the queued controls of this class under the lock,
+		 * writes queued from now on go in the next flush
+		 */
+		__LOCK_MUTEX(&(vd->ctrl_queue_mutex));
+		for(i = group->first; i < group->first + group->count; i++)
+		{
+			if(!vd->ctrl_queued[i])
+				continue;
+
+			v4l2_ctrl_t *current = &vd->list_device_controls[i];
+			vd->ctrl_queued[i] = 0;
+			vd->ctrl_queue_count--;
+
+			memset(&clist[count], 0, sizeof(struct v4l2_ext_control));
+			clist[count].id = current->control.id;
+			if(current->control.type == V4L2_CTRL_TYPE_INTEGER64)
+				clist[count].value64 = current->value64;
+			else
+				clist[count].value = current->value;
+			clist_ctrl[count] = current;
+			count++;
+		}
+		__UNLOCK_MUTEX(&(vd->ctrl_queue_mutex));
+
+		if(count == 0)
+			continue;
+
+		if(verbosity > 1)
+			printf("V4L2_CORE: flushing %i queued controls for class 0x%08x\n",
+				count, group->cclass);
+
+		struct v4l2_ext_controls ctrls = {0};
+		ctrls.ctrl_class = group->cclass;
+		ctrls.count = count;
+		ctrls.controls = clist;
+		int ret = xioctl(vd->fd, VIDIOC_S_EXT_CTRLS, &ctrls);
+		if(ret)
+		{
+			fprintf(stderr, "V4L2_CORE: VIDIOC_S_EXT_CTRLS for queued controls failed (error %i): setting them one by one\n", ret);
+			for(i = 0; i < count; i++)
+				set_control_value_by_id(vd, clist_ctrl[i]->control.id);
+		}
+		else
+		{
+			/*the driver returns the values it actually applied*/
+			for(i = 0; i < count; i++)
+			{
+				set_cached_value(vd, clist_ctrl[i], clist[i].value, clist[i].value64);
+				update_ctrl_flags(vd, clist_ctrl[i]->control.id);
+			}
+		}
+
+		written += count;
+	}
+
+	return written;
+}
+
 /*
  * free control list
  * args:
@@ -1439,25 +2248,44 @@ void free_v4l2_control_list(v4l2_dev_t *vd)
 		return;
 	}
 
-	v4l2_ctrl_t *first = vd->list_device_controls;
+	/*send any pending writes*/
+	if(vd->fd > 0)
+		flush_control_queue(vd, 1);
 
-    while (first != NULL)
-    {
-		v4l2_ctrl_t *next = first->next;
+	int i = 0;
+	for(i = 0; i < vd->num_controls; i++)
+	{
+		v4l2_ctrl_t *current = &vd->list_device_controls[i];
 
-        if(first->string) free(first->string);
-        if(first->menu) free(first->menu);
-        if(first->menu_entry)
-        {
-			int i = 0;
-			for(i = 0; i < first->menu_entries; i++)
-				free(first->menu_entry[i]);
-			free(first->menu_entry);
+		if(current->string) free(current->string);
+		if(current->menu) free(current->menu);
+		if(current->menu_entry)
+		{
+			int j = 0;
+			for(j = 0; j < current->menu_entries; j++)
+				free(current->menu_entry[j]);
+			free(current->menu_entry);
 		}
-        free(first);
-        first = next;
-    }
-    vd->list_device_controls = NULL;
+	}
+	/*the registry holds all controls in a single allocation*/
+	free(vd->list_device_controls);
+	vd->list_device_controls = NULL;
+	vd->num_controls = 0;
+
+	if(vd->ctrl_index)
+		free(vd->ctrl_index);
+	vd->ctrl_index = NULL;
+	vd->ctrl_index_size = 0;
+
+	if(vd->ctrl_classes)
+		free(vd->ctrl_classes);
+	vd->ctrl_classes = NULL;
+	vd->num_ctrl_classes = 0;
+
+	if(vd->ctrl_queued)
+		free(vd->ctrl_queued);
+	vd->ctrl_queued = NULL;
+	vd->ctrl_queue_count = 0;
 
 	//unsubscibe control events
 	v4l2_unsubscribe_control_events(vd);
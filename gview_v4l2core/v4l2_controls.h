@@ -27,6 +27,7 @@
 /*
  * enumerate device (read/write) controls
  * and creates list in vd->list_device_controls
+ * (a contiguous control registry grouped by class and indexed by id)
  * args:
  *   vd - pointer to video device data
  *
@@ -39,8 +40,28 @@
  */
 int enumerate_v4l2_control(v4l2_dev_t *vd);
 
+/*
+ * add a control descriptor to control list
+ * args:
+ *   vd - pointer to video device data
+ *   queryctrl - pointer to v4l2_queryctrl data
+ *   menu - pointer to menu list (NULL if not a menu) - the control takes ownership
+ *   menu_entries - number of valid menu items
+ *   current - pointer to pointer of current control from control list
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *   queryctrl is not null
+ *
+ * returns: pointer to newly added control
+ */
+v4l2_ctrl_t *add_control_descriptor(v4l2_dev_t *vd, struct v4l2_queryctrl* queryctrl,
+	struct v4l2_querymenu* menu, int menu_entries, v4l2_ctrl_t **current);
+
 /*
  * subscribe for v4l2 control events
+ *  (including the ones caused by our own control writes)
  * args:
  *  vd - pointer to video device data
  *  control_id - id of control to subscribe events for
@@ -48,9 +69,21 @@ int enumerate_v4l2_control(v4l2_dev_t *vd);
  * asserts:
  *  vd is not null
  *
- * return: none
+ * return: ioctl result
  */
-void v4l2_subscribe_control_events(v4l2_dev_t *vd, unsigned int control_id);
+int v4l2_subscribe_control_events(v4l2_dev_t *vd, unsigned int control_id);
+
+/*
+ * check for control events and update the control cache
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: number of processed control events
+ */
+int check_control_events(v4l2_dev_t *vd);
 
 /*
  * unsubscribev4l2 control events
@@ -77,9 +110,24 @@ void v4l2_unsubscribe_control_events(v4l2_dev_t *vd);
  */
 v4l2_ctrl_t *get_control_by_id(v4l2_dev_t *vd, int id);
 
+/*
+ * mark control as changed (sets a new registry generation for it)
+ * args:
+ *   vd - pointer to video device data
+ *   control - pointer to changed control
+ *
+ * asserts:
+ *   vd is not null
+ *   control is not null
+ *
+ * returns: void
+ */
+void mark_control_changed(v4l2_dev_t *vd, v4l2_ctrl_t *control);
+
 /*
  * updates the value for control id from the device
  * also updates control flags
+ * (no device read if the control cache is kept current by control events)
  * args:
  *   vd - pointer to video device data
  *   id - control id
@@ -106,6 +154,36 @@ int get_control_value_by_id (v4l2_dev_t *vd, int id);
  */
 int set_control_value_by_id(v4l2_dev_t *vd, int id);
 
+/*
+ * queue the current value of control id for a deferred write
+ *  (repeated writes to the same control are coalesced)
+ * args:
+ *   vd - pointer to video device data
+ *   id - control id
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: error code
+ */
+int queue_control_value_by_id(v4l2_dev_t *vd, int id);
+
+/*
+ * flush the control write queue
+ *  (one VIDIOC_S_EXT_CTRLS per control class)
+ * args:
+ *   vd - pointer to video device data
+ *   force - if > 0 ignore the minimum flush interval
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: number of controls written to the device
+ */
+int flush_control_queue(v4l2_dev_t *vd, int force);
+
 /*
  * goes trough the control list and updates/retrieves current values
  * args:
@@ -118,6 +196,21 @@ int set_control_value_by_id(v4l2_dev_t *vd, int id);
  */
 void get_v4l2_control_values (v4l2_dev_t *vd);
 
+/*
+ * goes trough the control list and sets values in device
+ *  for controls changed after generation
+ * args:
+ *   vd - pointer to video device data
+ *   generation - only set controls with a higher generation
+ *                (0 - set all controls)
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: void
+ */
+void set_v4l2_changed_control_values (v4l2_dev_t *vd, uint32_t generation);
+
 /*
  * goes trough the control list and sets values in device
  * args:
@@ -130,6 +223,21 @@ void get_v4l2_control_values (v4l2_dev_t *vd);
  */
 void set_v4l2_control_values (v4l2_dev_t *vd);
 
+/*
+ * bring the control cache up to date after writing controls
+ *  (with an event driven cache the changes made by the device are
+ *   already queued as control events, otherwise reads all values)
+ * args:
+ *   vd - pointer to video device data
+ *
+ * asserts:
+ *   vd is not null
+ *   vd->fd is valid
+ *
+ * returns: void
+ */
+void sync_v4l2_control_values(v4l2_dev_t *vd);
+
 /*
  * goes trough the control list and sets values in device to default
  * args:
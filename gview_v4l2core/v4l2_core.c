@@ -51,6 +51,7 @@
 #include "uvc_h264.h"
 #include "frame_decoder.h"
 #include "control_profile.h"
+#include "control_cache.h"
 #include "v4l2_formats.h"
 #include "v4l2_controls.h"
 #include "v4l2_devices.h"
@@ -75,7 +76,8 @@ static uint32_t fps_frame_count = 0;
 
 static uint8_t flag_fps_change = 0; /*set to 1 to request a fps change*/
 
-static uint8_t disable_libv4l2 = 0; /*set to 1 to disable libv4l2 calls*/
+/*set to 1 to disable libv4l2 calls (global scope)*/
+uint8_t disable_libv4l2 = 0;
 
 static int frame_queue_size = 1; /*just one frame in queue (enough for a single thread)*/
 
@@ -147,6 +149,8 @@ void __attribute__ ((destructor)) v4l2core_fini()
 	if(verbosity > 2)
 		printf("V4L2_CORE: closing device list\n");
 	v4l2core_close_v4l2_device_list();
+	//free the control cache directory
+	set_control_cache_dir(NULL);
 }
 
 /*
@@ -214,7 +218,10 @@ static int check_v4l2_dev(v4l2_dev_t *vd)
 
 	/*enumerate device controls*/
 	enumerate_v4l2_control(vd);
-	/*gets the current control values and sets their flags*/
+	/*
+	 * gets the current control values and sets their flags
+	 * (full resync: control events keep the values current from now on)
+	 */
 	get_v4l2_control_values(vd);
 
 	/*if we have a focus control initiate the software autofocus*/
@@ -675,6 +682,21 @@ void v4l2core_enable_libv4l2()
 	disable_libv4l2 = 0;
 }
 
+/*
+ * set the control descriptor cache directory (set before opening the device)
+ * args:
+ *   dir - cache directory (NULL disables the cache - default)
+ *
+ * asserts:
+ *   none
+ *
+ * returns void
+ */
+void v4l2core_set_control_cache_dir(const char *dir)
+{
+	set_control_cache_dir(dir);
+}
+
 /*
  * set v4l2 capture method to use
  * args:
@@ -1548,6 +1570,24 @@ int v4l2core_get_frame_height(v4l2_dev_t *vd)
 	return vd->format.fmt.pix.height;
 }
 
+/*
+ * get the maximum raw frame size for the current format
+ * args:
+ *   vd - pointer to v4l2 device handler
+ *
+ * asserts:
+ *   vd is not null
+ *
+ * returns: negotiated frame size (sizeimage) in bytes
+ */
+size_t v4l2core_get_frame_max_size(v4l2_dev_t *vd)
+{
+	/*assertions*/
+	assert(vd != NULL);
+
+	return vd->format.fmt.pix.sizeimage;
+}
+
 /*
  * get requested frame format
  * args:
@@ -1727,6 +1767,8 @@ static void clean_v4l2_dev(v4l2_dev_t *vd)
 
 	vd->fd = 0;
 
+	__CLOSE_MUTEX(&(vd->ctrl_queue_mutex));
+
 	free(vd);
 }
 
@@ -1763,6 +1805,8 @@ v4l2_dev_t* v4l2core_init_dev(const char *device)
 	
 	/*init the device mutex*/
 	__INIT_MUTEX(__PMUTEX);
+	/*init the control write queue mutex*/
+	__INIT_MUTEX(&(vd->ctrl_queue_mutex));
 
 	/*MMAP by default*/
 	vd->cap_meth = IO_MMAP;
@@ -1837,6 +1881,118 @@ v4l2_dev_t* v4l2core_init_dev(const char *device)
 	return (vd);
 }
 
+/*
+ * Initiate a video device handler without a device (offline decoding)
+ *   raw frames are fed with v4l2core_decode_raw_frame
+ * args:
+ *   pixelformat - raw frame v4l2 pixel format
+ *   width - frame width
+ *   height - frame height
+ *
+ * asserts:
+ *   none
+ *
+ * returns: pointer to v4l2 device handler (or NULL on error)
+ */
+v4l2_dev_t* v4l2core_init_offline_dev(uint32_t pixelformat, int width, int height)
+{
+	if(width <= 0 || height <= 0)
+	{
+		fprintf(stderr, "V4L2_CORE: (offline) bad frame size %ix%i\n", width, height);
+		return (NULL);
+	}
+
+	/*alloc the device data*/
+	v4l2_dev_t* vd = calloc(1, sizeof(v4l2_dev_t));
+
+	assert(vd != NULL);
+
+	/*init the device mutex*/
+	__INIT_MUTEX(__PMUTEX);
+	/*init the control write queue mutex*/
+	__INIT_MUTEX(&(vd->ctrl_queue_mutex));
+
+	/*no driver buffers: IO_READ with no allocated mem is a no-op on clean*/
+	vd->cap_meth = IO_READ;
+	vd->fd = -1;
+
+	vd->frame_queue_size = 1;
+	vd->frame_queue = calloc(vd->frame_queue_size, sizeof(v4l2_frame_buff_t));
+	if(vd->frame_queue == NULL)
+	{
+		fprintf(stderr, "V4L2_CORE: FATAL memory allocation failure (v4l2core_init_offline_dev): %s\n", strerror(errno));
+		exit(-1);
+	}
+
+	vd->fps_num = 1;
+	vd->fps_denom = 25;
+
+	vd->format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	vd->format.fmt.pix.width = width;
+	vd->format.fmt.pix.height = height;
+	vd->format.fmt.pix.pixelformat = pixelformat;
+	vd->requested_fmt = pixelformat;
+
+	/*offline h264 input is always a plain elementary stream*/
+	if(pixelformat == V4L2_PIX_FMT_H264)
+		h264_set_support(H264_FRAME);
+
+	if(alloc_v4l2_frames(vd) != E_OK)
+	{
+		fprintf(stderr, "V4L2_CORE: (offline) couldn't alloc frames for format %c%c%c%c\n",
+			pixelformat & 0xFF, (pixelformat >> 8) & 0xFF,
+			(pixelformat >> 16) & 0xFF, (pixelformat >> 24) & 0xFF);
+		v4l2core_close_dev(vd);
+		return (NULL);
+	}
+
+	return (vd);
+}
+
+/*
+ * decode a raw frame on an offline device handler
+ * args:
+ *   vd - pointer to v4l2 device handler (from v4l2core_init_offline_dev)
+ *   raw_frame - pointer to raw frame data (in the device pixel format)
+ *   raw_size - raw frame size in bytes
+ *   timestamp - frame timestamp (ns)
+ *
+ * asserts:
+ *   vd is not null
+ *   raw_frame is not null
+ *
+ * returns: pointer to decoded frame buffer (or NULL on error)
+ */
+v4l2_frame_buff_t *v4l2core_decode_raw_frame(v4l2_dev_t *vd,
+	uint8_t *raw_frame, size_t raw_size, uint64_t timestamp)
+{
+	/*assertions*/
+	assert(vd != NULL);
+	assert(raw_frame != NULL);
+
+	v4l2_frame_buff_t *frame = &vd->frame_queue[0];
+
+	frame->index = 0;
+	frame->width = vd->format.fmt.pix.width;
+	frame->height = vd->format.fmt.pix.height;
+	frame->raw_frame = raw_frame;
+	frame->raw_frame_size = raw_size;
+	frame->raw_frame_max_size = raw_size;
+	frame->timestamp = timestamp;
+	frame->status = FRAME_DECODING;
+
+	if(decode_v4l2_frame(vd, frame) != E_OK)
+	{
+		frame->status = FRAME_READY;
+		return NULL;
+	}
+
+	frame->status = FRAME_DONE;
+	vd->frame_index++;
+
+	return frame;
+}
+
 /*
  * get stream frame format list for device
  * args:
@@ -1873,6 +2029,24 @@ v4l2_ctrl_t *v4l2core_get_control_list(v4l2_dev_t *vd)
 	return vd->list_device_controls;
 }
 
+/*
+ * get device control registry generation
+ * args:
+ *    vd - pointer to v4l2 device handler
+ *
+ * asserts:
+ *    vd is not null
+ *
+ * return: current control generation
+ */
+uint32_t v4l2core_get_control_generation(v4l2_dev_t *vd)
+{
+	/*assertions*/
+	assert(vd != NULL);
+
+	return __atomic_load_n(&vd->ctrl_generation, __ATOMIC_SEQ_CST);
+}
+
 /*
  * check for control events
  * args:
@@ -1887,47 +2061,8 @@ int v4l2core_check_control_events(v4l2_dev_t *vd)
 {
 	/*assertions*/
 	assert(vd != NULL);
-	
-	int ret = 0;
-	struct v4l2_event ev;
 
-	while (xioctl(vd->fd, VIDIOC_DQEVENT, &ev) == 0)
-	{
-		if (ev.type != V4L2_EVENT_CTRL)
-			continue;
-
-		ret++;
-		//update control
-		v4l2_ctrl_t *control = v4l2core_get_control_by_id(vd, ev.id);
-		if(control != NULL)
-		{
-			control->control.flags = ev.u.ctrl.flags;
-			if(control->control.flags & V4L2_CTRL_FLAG_DISABLED)
-				continue;
-
-			control->control.minimum = ev.u.ctrl.minimum;
-			control->control.maximum = ev.u.ctrl.maximum;
-			control->control.step = ev.u.ctrl.step;
-			control->control.default_value = ev.u.ctrl.default_value;
-
-			switch (control->control.type)
-			{
-#ifdef V4L2_CTRL_TYPE_INTEGER64
-				case V4L2_CTRL_TYPE_INTEGER64:
-					control->value64 = ev.u.ctrl.value64;
-					break;
-#endif
-#ifdef V4L2_CTRL_TYPE_STRING
-				case V4L2_CTRL_TYPE_STRING:
-					break;
-#endif
-				default:
-					control->value = ev.u.ctrl.value;
-			}
-		}
-	}
-
-	return ret;
+	return check_control_events(vd);
 }
 
 /*
@@ -2213,6 +2348,37 @@ int v4l2core_get_control_value_by_id (v4l2_dev_t *vd, int id)
 	return get_control_value_by_id (vd, id);
 }
 
+/*
+ * queue the current value of control id for a deferred write
+ * args:
+ *   vd - pointer to v4l2 device handler
+ *   id - control id
+ *
+ * asserts:
+ *   none
+ *
+ * returns: error code
+ */
+int v4l2core_queue_control_value_by_id(v4l2_dev_t *vd, int id)
+{
+	return queue_control_value_by_id(vd, id);
+}
+
+/*
+ * flush the control write queue (rate limited)
+ * args:
+ *   vd - pointer to v4l2 device handler
+ *
+ * asserts:
+ *   none
+ *
+ * returns: number of controls written to the device
+ */
+int v4l2core_flush_control_queue(v4l2_dev_t *vd)
+{
+	return flush_control_queue(vd, 0);
+}
+
 /*
  * goes trough the control list and sets values in device to default
  * args:
@@ -2250,7 +2416,7 @@ int v4l2core_set_control_value_by_id(v4l2_dev_t *vd, int id)
  *    frame - pointer to frame buffer
  *    filename - output file name
  *    format - image type
- *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP)
+ *           (IMG_FMT_RAW, IMG_FMT_JPG, IMG_FMT_PNG, IMG_FMT_BMP, IMG_FMT_JPG_RAW)
  *
  * asserts:
  *    vd is not null
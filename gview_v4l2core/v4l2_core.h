@@ -25,6 +25,16 @@
 #include "gviewv4l2core.h"
 #include "gview.h"
 
+/*
+ * control class group (range of same class controls in the control registry)
+ */
+typedef struct _v4l2_ctrl_class_t
+{
+	int32_t cclass;                     //control class
+	int first;                          //index of the first class control in list_device_controls
+	int count;                          //number of controls in the class
+} v4l2_ctrl_class_t;
+
 /*
  * video device data
  */
@@ -76,8 +86,18 @@ struct _v4l2_dev_t
 
     int this_device;                    // index of this device in device list
 
-    v4l2_ctrl_t* list_device_controls;    //null terminated linked list of available device controls
+    v4l2_ctrl_t* list_device_controls;    //null terminated linked list of available device controls (contiguous array grouped by class)
     int num_controls;                   //number of controls in list
+    v4l2_ctrl_t** ctrl_index;           //control id hash index (open addressing, NULL for empty slots)
+    int ctrl_index_size;                //hash index size (power of 2)
+    v4l2_ctrl_class_t *ctrl_classes;    //control class groups
+    int num_ctrl_classes;               //number of control class groups
+    uint32_t ctrl_generation;           //control registry generation (atomically incremented on every control change)
+    uint8_t *ctrl_queued;               //control write queue flags (indexed by registry position)
+    int ctrl_queue_count;               //number of queued control writes
+    uint64_t ctrl_queue_flush_time;     //time of the last control write queue flush (ns)
+    __MUTEX_TYPE ctrl_queue_mutex;      //control write queue mutex (gui and capture threads)
+    uint8_t ctrl_event_cache;           //flag control values are kept current by control events (no value reads)
 
     uint8_t isbayer;                    //flag if we are streaming bayer data in yuyv frame (logitech only)
     uint8_t bayer_pix_order;            //bayer pixel order
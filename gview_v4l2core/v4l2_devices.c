@@ -24,6 +24,8 @@
 #include <linux/videodev2.h>
 #include <libv4l2.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
 #include <string.h>
 #include <errno.h>
 #include <assert.h>
@@ -180,22 +182,24 @@ int enum_v4l2_devices()
             printf("V4L2_CORE: Device Node Path: %s\n", v4l2_device);
 
 		int fd = 0;
-        /* open the device and query the capabilities */
-        if ((fd = v4l2_open(v4l2_device, O_RDWR | O_NONBLOCK, 0)) < 0)
+        /*
+         * open the device and query the capabilities
+         * (plain open: libv4l2 would probe every format of every device)
+         */
+        if ((fd = open(v4l2_device, O_RDWR | O_NONBLOCK, 0)) < 0)
         {
             fprintf(stderr, "V4L2_CORE: ERROR opening V4L2 interface for %s\n", v4l2_device);
-            v4l2_close(fd);
             continue; /*next dir entry*/
         }
 
-        if (xioctl(fd, VIDIOC_QUERYCAP, &v4l2_cap) < 0)
+        if (ioctl(fd, VIDIOC_QUERYCAP, &v4l2_cap) < 0)
         {
             fprintf(stderr, "V4L2_CORE: VIDIOC_QUERYCAP error: %s\n", strerror(errno));
             fprintf(stderr, "V4L2_CORE: couldn't query device %s\n", v4l2_device);
-            v4l2_close(fd);
+            close(fd);
             continue; /*next dir entry*/
         }
-        v4l2_close(fd);
+        close(fd);
 
         num_dev++;
         /* Update the device list*/
@@ -211,6 +215,12 @@ int enum_v4l2_devices()
         my_device_list.list_devices[num_dev-1].location = strdup((char *) v4l2_cap.bus_info);
         my_device_list.list_devices[num_dev-1].valid = 1;
         my_device_list.list_devices[num_dev-1].current = 0;
+        /*usb data (not available for non usb devices)*/
+        my_device_list.list_devices[num_dev-1].vendor = 0;
+        my_device_list.list_devices[num_dev-1].product = 0;
+        my_device_list.list_devices[num_dev-1].firmware = 0;
+        my_device_list.list_devices[num_dev-1].busnum = 0;
+        my_device_list.list_devices[num_dev-1].devnum = 0;
 				
         /* The device pointed to by dev contains information about
             the v4l2 device. In order to get information about the
@@ -255,6 +265,10 @@ int enum_v4l2_devices()
         my_device_list.list_devices[num_dev-1].product = strtoull(udev_device_get_sysattr_value(dev, "idProduct"), NULL, 16);
         my_device_list.list_devices[num_dev-1].busnum = strtoull(udev_device_get_sysattr_value(dev, "busnum"), NULL, 10);
 		my_device_list.list_devices[num_dev-1].devnum = strtoull(udev_device_get_sysattr_value(dev, "devnum"), NULL, 10);
+        /*bcdDevice (device release number) identifies the firmware*/
+        const char *bcd_device = udev_device_get_sysattr_value(dev, "bcdDevice");
+        if(bcd_device)
+            my_device_list.list_devices[num_dev-1].firmware = strtoul(bcd_device, NULL, 16);
 
         udev_device_unref(dev);
     }
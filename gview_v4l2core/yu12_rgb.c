@@ -0,0 +1,442 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+/*******************************************************************************#
+#                                                                               #
+#  V4L2 core library - yu12 to packed rgb conversion                            #
+#                                                                               #
+#  fixed point math (coefficients scaled by 2^13, results in 1/16 units) so     #
+#  the sse2 and the scalar paths produce exactly the same output                #
+#                                                                               #
+********************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "gviewv4l2core.h"
+#include "yu12_rgb.h"
+#include "gview.h"
+#include "../config.h"
+
+extern int verbosity;
+
+typedef struct _yuv_coef_t
+{
+	int y_off;  /*luma offset (0 or 16)*/
+	int y_mul;  /*luma gain*/
+	int r_v;    /*v contribution to r*/
+	int g_u;    /*u contribution to g*/
+	int g_v;    /*v contribution to g*/
+	int b_u;    /*u contribution to b*/
+} yuv_coef_t;
+
+/*current colorspace for the rgb conversions (defaults to jpeg - bt601 full)*/
+static int yuv_matrix = YUV_MATRIX_BT601;
+static int yuv_range = YUV_RANGE_FULL;
+
+/*
+ * fill the fixed point coefficients for matrix and range
+ * args:
+ *    coef - pointer to coefficients struct
+ *    matrix - yuv matrix coefficients
+ *    range - yuv quantization range
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void yuv_coef_init(yuv_coef_t *coef, int matrix, int range)
+{
+	double kr = 0.299;
+	double kb = 0.114;
+
+	if(matrix == YUV_MATRIX_BT709)
+	{
+		kr = 0.2126;
+		kb = 0.0722;
+	}
+
+	double kg = 1.0 - kr - kb;
+	double ys = 1.0;
+	double cs = 1.0;
+
+	coef->y_off = 0;
+
+	if(range == YUV_RANGE_LIMITED)
+	{
+		coef->y_off = 16;
+		ys = 255.0 / 219.0;
+		cs = 255.0 / 224.0;
+	}
+
+	coef->y_mul = (int) (ys * 8192.0 + 0.5);
+	coef->r_v = (int) (2.0 * (1.0 - kr) * cs * 8192.0 + 0.5);
+	coef->g_u = - (int) (2.0 * kb * (1.0 - kb) / kg * cs * 8192.0 + 0.5);
+	coef->g_v = - (int) (2.0 * kr * (1.0 - kr) / kg * cs * 8192.0 + 0.5);
+	coef->b_u = (int) (2.0 * (1.0 - kb) * cs * 8192.0 + 0.5);
+}
+
+/*
+ * high half of the 16 bit product (same as _mm_mulhi_epi16)
+ * args:
+ *    a - first factor
+ *    b - second factor
+ *
+ * asserts:
+ *    none
+ *
+ * returns: (a * b) >> 16
+ */
+static inline int mulhi(int a, int b)
+{
+	return (a * b) >> 16;
+}
+
+/*
+ * store one rgb pixel in the requested layout
+ * args:
+ *    out - pointer to output pixel
+ *    r - red value
+ *    g - green value
+ *    b - blue value
+ *    rgb_fmt - output pixel layout
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static inline void store_pixel(uint8_t *out, uint8_t r, uint8_t g, uint8_t b, int rgb_fmt)
+{
+	switch(rgb_fmt)
+	{
+		case RGB_FMT_BGR24:
+			out[0] = b;
+			out[1] = g;
+			out[2] = r;
+			break;
+		case RGB_FMT_RGBA:
+			out[0] = r;
+			out[1] = g;
+			out[2] = b;
+			out[3] = 255;
+			break;
+		case RGB_FMT_BGRA:
+			out[0] = b;
+			out[1] = g;
+			out[2] = r;
+			out[3] = 255;
+			break;
+		default:
+			out[0] = r;
+			out[1] = g;
+			out[2] = b;
+			break;
+	}
+}
+
+/*
+ * convert a yu12 line pair section (scalar)
+ * args:
+ *    out - pointer to output line
+ *    py - pointer to luma line
+ *    pu - pointer to u line
+ *    pv - pointer to v line
+ *    x - first pixel to convert
+ *    width - line width
+ *    bpp - output bytes per pixel
+ *    rgb_fmt - output pixel layout
+ *    coef - pointer to fixed point coefficients
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+static void yu12_line_to_rgb_c(uint8_t *out, uint8_t *py, uint8_t *pu, uint8_t *pv,
+	int x, int width, int bpp, int rgb_fmt, yuv_coef_t *coef)
+{
+	for(; x < width; x++)
+	{
+		int u = (pu[x>>1] - 128) * 128;
+		int v = (pv[x>>1] - 128) * 128;
+		int y = mulhi((py[x] - coef->y_off) * 128, coef->y_mul);
+
+		int r = (y + mulhi(v, coef->r_v) + 8) >> 4;
+		int g = (y + mulhi(u, coef->g_u) + mulhi(v, coef->g_v) + 8) >> 4;
+		int b = (y + mulhi(u, coef->b_u) + 8) >> 4;
+
+		store_pixel(out + x * bpp, CLIP(r), CLIP(g), CLIP(b), rgb_fmt);
+	}
+}
+
+#if defined(__SSE2__)
+/*
+ * convert a yu12 line (sse2 - 16 pixels per iteration)
+ * args:
+ *    out - pointer to output line
+ *    py - pointer to luma line
+ *    pu - pointer to u line
+ *    pv - pointer to v line
+ *    width - line width
+ *    bpp - output bytes per pixel
+ *    rgb_fmt - output pixel layout
+ *    coef - pointer to fixed point coefficients
+ *
+ * asserts:
+ *    none
+ *
+ * returns: number of converted pixels
+ */
+static int yu12_line_to_rgb_sse2(uint8_t *out, uint8_t *py, uint8_t *pu, uint8_t *pv,
+	int width, int bpp, int rgb_fmt, yuv_coef_t *coef)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i round = _mm_set1_epi16(8);
+	const __m128i alpha = _mm_set1_epi8((char) 0xff);
+	const __m128i y_off = _mm_set1_epi16(coef->y_off);
+	const __m128i y_mul = _mm_set1_epi16(coef->y_mul);
+	const __m128i r_v = _mm_set1_epi16(coef->r_v);
+	const __m128i g_u = _mm_set1_epi16(coef->g_u);
+	const __m128i g_v = _mm_set1_epi16(coef->g_v);
+	const __m128i b_u = _mm_set1_epi16(coef->b_u);
+
+	uint8_t tmp[3][16] __attribute__((aligned(16)));
+
+	int x = 0;
+	for(; x + 16 <= width; x += 16)
+	{
+		__m128i y8 = _mm_loadu_si128((__m128i *) (py + x));
+		__m128i u = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (pu + (x>>1))), zero);
+		__m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((__m128i *) (pv + (x>>1))), zero);
+
+		u = _mm_slli_epi16(_mm_sub_epi16(u, c128), 7);
+		v = _mm_slli_epi16(_mm_sub_epi16(v, c128), 7);
+
+		/*chroma contributions for 8 chroma samples*/
+		__m128i rc = _mm_mulhi_epi16(v, r_v);
+		__m128i gc = _mm_add_epi16(_mm_mulhi_epi16(u, g_u), _mm_mulhi_epi16(v, g_v));
+		__m128i bc = _mm_mulhi_epi16(u, b_u);
+
+		__m128i ylo = _mm_unpacklo_epi8(y8, zero);
+		__m128i yhi = _mm_unpackhi_epi8(y8, zero);
+		ylo = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(ylo, y_off), 7), y_mul);
+		yhi = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(yhi, y_off), 7), y_mul);
+		ylo = _mm_add_epi16(ylo, round);
+		yhi = _mm_add_epi16(yhi, round);
+
+		/*each chroma sample is shared by two horizontal pixels*/
+		__m128i r = _mm_packus_epi16(
+			_mm_srai_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(rc, rc)), 4),
+			_mm_srai_epi16(_mm_add_epi16(yhi, _mm_unpackhi_epi16(rc, rc)), 4));
+		__m128i g = _mm_packus_epi16(
+			_mm_srai_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(gc, gc)), 4),
+			_mm_srai_epi16(_mm_add_epi16(yhi, _mm_unpackhi_epi16(gc, gc)), 4));
+		__m128i b = _mm_packus_epi16(
+			_mm_srai_epi16(_mm_add_epi16(ylo, _mm_unpacklo_epi16(bc, bc)), 4),
+			_mm_srai_epi16(_mm_add_epi16(yhi, _mm_unpackhi_epi16(bc, bc)), 4));
+
+		if(bpp == 4)
+		{
+			if(rgb_fmt == RGB_FMT_BGRA)
+			{
+				__m128i t = r;
+				r = b;
+				b = t;
+			}
+
+			__m128i rg_lo = _mm_unpacklo_epi8(r, g);
+			__m128i rg_hi = _mm_unpackhi_epi8(r, g);
+			__m128i ba_lo = _mm_unpacklo_epi8(b, alpha);
+			__m128i ba_hi = _mm_unpackhi_epi8(b, alpha);
+
+			__m128i *pout = (__m128i *) (out + x * bpp);
+			_mm_storeu_si128(pout++, _mm_unpacklo_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128(pout++, _mm_unpackhi_epi16(rg_lo, ba_lo));
+			_mm_storeu_si128(pout++, _mm_unpacklo_epi16(rg_hi, ba_hi));
+			_mm_storeu_si128(pout, _mm_unpackhi_epi16(rg_hi, ba_hi));
+		}
+		else
+		{
+			/*no byte shuffles in sse2: interleave the 3 planes from cache*/
+			_mm_store_si128((__m128i *) tmp[0], r);
+			_mm_store_si128((__m128i *) tmp[1], g);
+			_mm_store_si128((__m128i *) tmp[2], b);
+
+			uint8_t *pout = out + x * bpp;
+			int i = 0;
+			if(rgb_fmt == RGB_FMT_BGR24)
+			{
+				for(i = 0; i < 16; i++)
+				{
+					*pout++ = tmp[2][i];
+					*pout++ = tmp[1][i];
+					*pout++ = tmp[0][i];
+				}
+			}
+			else
+			{
+				for(i = 0; i < 16; i++)
+				{
+					*pout++ = tmp[0][i];
+					*pout++ = tmp[1][i];
+					*pout++ = tmp[2][i];
+				}
+			}
+		}
+	}
+
+	return x;
+}
+#endif
+
+/*
+ * convert a yu12 frame to packed rgb (rgb24, bgr24, rgba or bgra)
+ * args:
+ *    out - pointer to first line of the output buffer
+ *    out_stride - output line stride in bytes
+ *                 (negative values write lines bottom-up)
+ *    in - pointer to input yu12 data buffer
+ *    width - frame width (in pixels)
+ *    height - frame height (in pixels)
+ *    rgb_fmt - output pixel layout (RGB_FMT_XXX)
+ *    matrix - yuv matrix coefficients (YUV_MATRIX_BT601 or YUV_MATRIX_BT709)
+ *    range - yuv quantization range (YUV_RANGE_FULL or YUV_RANGE_LIMITED)
+ *
+ * asserts:
+ *    out is not null
+ *    in is not null
+ *
+ * returns: none
+ */
+void yu12_to_rgb(uint8_t *out, int out_stride, uint8_t *in,
+	int width, int height, int rgb_fmt, int matrix, int range)
+{
+	/*assertions*/
+	assert(out);
+	assert(in);
+
+	yuv_coef_t coef;
+	yuv_coef_init(&coef, matrix, range);
+
+	int bpp = (rgb_fmt == RGB_FMT_RGBA || rgb_fmt == RGB_FMT_BGRA) ? 4 : 3;
+
+	uint8_t *pu = in + (width * height);
+	uint8_t *pv = pu + ((width * height) / 4);
+
+	int h = 0;
+	for(h = 0; h < height; h++)
+	{
+		uint8_t *py = in + (h * width);
+		uint8_t *pul = pu + ((h>>1) * (width>>1));
+		uint8_t *pvl = pv + ((h>>1) * (width>>1));
+		uint8_t *pout = out + (h * out_stride);
+
+		int x = 0;
+#if defined(__SSE2__)
+		x = yu12_line_to_rgb_sse2(pout, py, pul, pvl, width, bpp, rgb_fmt, &coef);
+#endif
+		yu12_line_to_rgb_c(pout, py, pul, pvl, x, width, bpp, rgb_fmt, &coef);
+	}
+}
+
+/*
+ * get the yuv matrix coefficients used for rgb conversions
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: current yuv matrix (YUV_MATRIX_BT601 or YUV_MATRIX_BT709)
+ */
+int yu12_rgb_get_matrix()
+{
+	return yuv_matrix;
+}
+
+/*
+ * get the yuv quantization range used for rgb conversions
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: current yuv range (YUV_RANGE_FULL or YUV_RANGE_LIMITED)
+ */
+int yu12_rgb_get_range()
+{
+	return yuv_range;
+}
+
+/*
+ * set the yuv colorspace used for rgb conversions (snapshots and cpu render)
+ * args:
+ *    matrix - yuv matrix coefficients (YUV_MATRIX_BT601 or YUV_MATRIX_BT709)
+ *    range - yuv quantization range (YUV_RANGE_FULL or YUV_RANGE_LIMITED)
+ *
+ * asserts:
+ *    none
+ *
+ * returns: none
+ */
+void v4l2core_set_yuv_colorspace(int matrix, int range)
+{
+	yuv_matrix = (matrix == YUV_MATRIX_BT709) ? YUV_MATRIX_BT709 : YUV_MATRIX_BT601;
+	yuv_range = (range == YUV_RANGE_LIMITED) ? YUV_RANGE_LIMITED : YUV_RANGE_FULL;
+
+	if(verbosity > 1)
+		printf("V4L2_CORE: rgb conversion set to %s %s range\n",
+			yuv_matrix == YUV_MATRIX_BT709 ? "BT.709" : "BT.601",
+			yuv_range == YUV_RANGE_LIMITED ? "limited" : "full");
+}
+
+/*
+ * convert a yu12 frame to packed rgb using the current yuv colorspace
+ * args:
+ *    out - pointer to first line of the output buffer
+ *    out_stride - output line stride in bytes
+ *                 (negative values write lines bottom-up)
+ *    in - pointer to input yu12 data buffer
+ *    width - frame width (in pixels)
+ *    height - frame height (in pixels)
+ *    rgb_fmt - output pixel layout (RGB_FMT_XXX)
+ *
+ * asserts:
+ *    out is not null
+ *    in is not null
+ *
+ * returns: none
+ */
+void v4l2core_yu12_to_rgb(uint8_t *out, int out_stride, uint8_t *in,
+	int width, int height, int rgb_fmt)
+{
+	yu12_to_rgb(out, out_stride, in, width, height, rgb_fmt, yuv_matrix, yuv_range);
+}
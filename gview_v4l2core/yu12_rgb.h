@@ -0,0 +1,74 @@
+/*******************************************************************************#
+#           guvcview              http://guvcview.sourceforge.net               #
+#                                                                               #
+#           Paulo Assis <pj.assis@gmail.com>                                    #
+#                                                                               #
+# This program is free software; you can redistribute it and/or modify          #
+# it under the terms of the GNU General Public License as published by          #
+# the Free Software Foundation; either version 2 of the License, or             #
+# (at your option) any later version.                                           #
+#                                                                               #
+# This program is distributed in the hope that it will be useful,               #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of                #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the                 #
+# GNU General Public License for more details.                                  #
+#                                                                               #
+# You should have received a copy of the GNU General Public License             #
+# along with this program; if not, write to the Free Software                   #
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA     #
+#                                                                               #
+********************************************************************************/
+
+#ifndef YU12_RGB_H
+#define YU12_RGB_H
+
+#include "gview.h"
+#include "../config.h"
+
+/*
+ * convert a yu12 frame to packed rgb (rgb24, bgr24, rgba or bgra)
+ * args:
+ *    out - pointer to first line of the output buffer
+ *    out_stride - output line stride in bytes
+ *                 (negative values write lines bottom-up)
+ *    in - pointer to input yu12 data buffer
+ *    width - frame width (in pixels)
+ *    height - frame height (in pixels)
+ *    rgb_fmt - output pixel layout (RGB_FMT_XXX)
+ *    matrix - yuv matrix coefficients (YUV_MATRIX_BT601 or YUV_MATRIX_BT709)
+ *    range - yuv quantization range (YUV_RANGE_FULL or YUV_RANGE_LIMITED)
+ *
+ * asserts:
+ *    out is not null
+ *    in is not null
+ *
+ * returns: none
+ */
+void yu12_to_rgb(uint8_t *out, int out_stride, uint8_t *in,
+	int width, int height, int rgb_fmt, int matrix, int range);
+
+/*
+ * get the yuv matrix coefficients used for rgb conversions
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: current yuv matrix (YUV_MATRIX_BT601 or YUV_MATRIX_BT709)
+ */
+int yu12_rgb_get_matrix();
+
+/*
+ * get the yuv quantization range used for rgb conversions
+ * args:
+ *    none
+ *
+ * asserts:
+ *    none
+ *
+ * returns: current yuv range (YUV_RANGE_FULL or YUV_RANGE_LIMITED)
+ */
+int yu12_rgb_get_range();
+
+#endif
@@ -90,6 +90,7 @@
 #define __CLOSE_COND(c) ( pthread_cond_destroy(c) )
 #define __COND_BCAST(c) ( pthread_cond_broadcast(c) )
 #define __COND_SIGNAL(c) ( pthread_cond_signal(c) )
+#define __COND_WAIT(c,m) ( pthread_cond_wait(c,m) )
 #define __COND_TIMED_WAIT(c,m,t) ( pthread_cond_timedwait(c,m,t) )
 
 /*next index of ring buffer with size elements*/
@@ -131,4 +132,79 @@ static const int stdSampleRates[] =
 /*array lenght*/
 #define ARRAY_LENGTH(a) (sizeof (a)/ sizeof (a)[0])
 
+/*
+ * single writer sequence lock (lock free snapshots)
+ *   the writer never waits; readers retry while a write is in progress
+ *   data is copied in 32 bit words with relaxed atomics,
+ *   so snapshot sizes must be a multiple of 4 bytes
+ */
+typedef struct _gv_seqlock_t
+{
+	uint32_t seq; /*odd while a write is in progress*/
+} gv_seqlock_t;
+
+/*
+ * publish a snapshot (single writer)
+ * args:
+ *   lock - pointer to sequence lock
+ *   dst - pointer to shared snapshot
+ *   src - pointer to new snapshot data
+ *   size - snapshot size in bytes (multiple of 4)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: none
+ */
+static inline void gv_seqlock_write(gv_seqlock_t *lock, void *dst, const void *src, size_t size)
+{
+	uint32_t *d = (uint32_t *) dst;
+	const uint32_t *s = (const uint32_t *) src;
+	uint32_t seq = __atomic_load_n(&lock->seq, __ATOMIC_RELAXED);
+	size_t i = 0;
+
+	__atomic_store_n(&lock->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	for(i = 0; i < size / 4; i++)
+		__atomic_store_n(&d[i], s[i], __ATOMIC_RELAXED);
+
+	__atomic_store_n(&lock->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * read a consistent snapshot (any thread, never blocks the writer)
+ * args:
+ *   lock - pointer to sequence lock
+ *   dst - pointer to snapshot copy
+ *   src - pointer to shared snapshot
+ *   size - snapshot size in bytes (multiple of 4)
+ *
+ * asserts:
+ *   none
+ *
+ * returns: snapshot sequence (0 if nothing was published yet)
+ */
+static inline uint32_t gv_seqlock_read(gv_seqlock_t *lock, void *dst, const void *src, size_t size)
+{
+	uint32_t *d = (uint32_t *) dst;
+	const uint32_t *s = (const uint32_t *) src;
+
+	for(;;)
+	{
+		uint32_t seq = __atomic_load_n(&lock->seq, __ATOMIC_ACQUIRE);
+		size_t i = 0;
+
+		if(seq & 1)
+			continue; /*write in progress*/
+
+		for(i = 0; i < size / 4; i++)
+			d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&lock->seq, __ATOMIC_RELAXED) == seq)
+			return seq / 2;
+	}
+}
+
 #endif